@@ -0,0 +1,1448 @@
+/*
+ * ctkAnsi.c (CTk) --
+ *
+ *	CTk display driver that writes ANSI (VT100/xterm) escape
+ *	sequences straight to the terminal, without curses.
+ *
+ * Copyright (c) 1994-1995 Cleveland Clinic Foundation
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * @(#) $Id: ctk.shar,v 1.50 1996/01/15 14:47:16 andrewm Exp andrewm $
+ */
+
+#include "tkPort.h"
+#include "tkInt.h"
+#ifdef HAVE_ERRNO_H
+#   include <errno.h>
+#endif
+#ifdef HAVE_TERMIOS_H
+#   include <termios.h>
+#endif
+#ifdef HAVE_SYS_IOCTL_H
+#   include <sys/ioctl.h>
+#endif
+
+/*
+ * Size of the terminal if it can't be found out.
+ */
+#define DEFAULT_WIDTH	80
+#define DEFAULT_HEIGHT	24
+
+/*
+ * Longest key sequence the terminal sends.
+ */
+#define MAX_KEY_SEQ	8
+
+/*
+ * Milliseconds to wait for the rest of a key sequence (after an ESC
+ * byte, say) before taking the bytes held so far as keys by themselves.
+ * The ESCDELAY environment variable overrides this, as for curses.
+ */
+#define ESC_DELAY	50
+
+/*
+ * Fewest blanks at the end of a run worth erasing with EL rather than
+ * writing (EL is "\033[K").
+ */
+#define MIN_ERASE	4
+
+/*
+ * Key sym that DecodeKey returns for the sequence that starts a
+ * bracketed paste (VoidSymbol, which no key sends), and the sequence
+ * that ends one.
+ */
+#define PASTE_START	0xFFFFFF
+#define PASTE_END	"\033[201~"
+#define PASTE_END_LEN	6
+
+/*
+ * Most bytes of a bracketed paste that are kept waiting for the end of
+ * the paste;  when this many have arrived they are delivered as a paste
+ * and the rest of the input is taken as keys.  Must be a power of two
+ * times 256, the size the buffer starts at.
+ */
+#define MAX_PASTE	(1 << 20)
+
+/*
+ * Ways of moving the cursor (see MoveCursor).
+ */
+#define MOVE_ABSOLUTE	0
+#define MOVE_RELATIVE	1
+#define MOVE_RETURN	2
+
+/*
+ * One of the following structures is kept (as `dispPtr->display')
+ * for each display using this driver.
+ */
+
+typedef struct {
+    int outFd;			/* File descriptor to write to. */
+    Tcl_Channel outChan;	/* Channel for `outFd', watched while output
+				 * is queued.  NULL if there is none (output
+				 * is then written with blocking writes). */
+    int isTerminal;		/* Non-zero means the device is a tty
+				 * (rather than, say, a socket). */
+#ifdef HAVE_TERMIOS_H
+    struct termios savedModes;	/* Terminal modes to restore on exit. */
+#endif
+    char *out;			/* Output not yet written.  Malloc-ed. */
+    int outUsed;		/* Bytes used in `out'. */
+    int outSize;		/* Bytes allocated for `out'. */
+    int style;			/* Style the terminal is drawing in. */
+    int lineDrawing;		/* Non-zero means the terminal has the line
+				 * drawing character set selected. */
+    int x, y;			/* Terminal's cursor position, or -1
+				 * if not known. */
+    int cursorVisible;		/* Non-zero means the terminal is showing
+				 * the cursor. */
+    unsigned char in[MAX_KEY_SEQ];
+				/* Start of key sequence not yet completed
+				 * by input read so far. */
+    int inUsed;			/* Bytes used in `in'. */
+    int escDelay;		/* Milliseconds to wait for the rest of the
+				 * sequence in `in' (see ESC_DELAY). */
+    Tcl_TimerToken inTimer;	/* Timer that takes the bytes in `in' as
+				 * keys if nothing follows them in time, or
+				 * NULL. */
+    int inTimedOut;		/* Non-zero means the bytes in `in' are to
+				 * be taken as keys without reading more. */
+    char *paste;		/* Text of a bracketed paste still being
+				 * received, or NULL.  Malloc-ed. */
+    int pasteUsed;		/* Bytes used in `paste'. */
+    int pasteSize;		/* Bytes allocated for `paste'. */
+} AnsiInfo;
+
+/*
+ * SGR attributes that select each CTk style, and whether a blank in
+ * the style looks the same as an erased cell (indexed by Ctk_Style).
+ * This definition must be modified in concert with the Ctk_Style
+ * definition in tk.h
+ */
+
+typedef struct {
+    char *attribute;		/* SGR parameter selecting style, or ""
+				 * for none. */
+    int blankIsClear;		/* Non-zero means a blank in this style
+				 * can be drawn by erasing it. */
+} StyleInfo;
+
+static StyleInfo styleInfo[] = {
+    {"", 1},			/* CTK_INVISIBLE_STYLE */
+    {"", 1},			/* CTK_PLAIN_STYLE */
+    {"4", 0},			/* CTK_UNDERLINE_STYLE */
+    {"7", 0},			/* CTK_REVERSE_STYLE */
+    {"2", 1},			/* CTK_DIM_STYLE */
+    {"1", 1},			/* CTK_BOLD_STYLE */
+    {"2", 1},			/* CTK_DISABLED_STYLE */
+    {"1", 1},			/* CTK_BUTTON_STYLE */
+    {"7", 0},			/* CTK_CURSOR_STYLE */
+    {"7", 0}			/* CTK_SELECTED_STYLE */
+};
+
+#define IsClear(cellPtr) \
+	((cellPtr)->ch == ' ' && styleInfo[(cellPtr)->style].blankIsClear)
+
+/*
+ * Characters that select line drawing characters in the VT100 special
+ * graphics set (indexed by CTK_ACS_* code - CTK_ACS_ULCORNER).
+ */
+
+static char lineDrawingChars[] = "lmkjqxn";
+
+/*
+ * Keys that send control characters (codes below 0x100 in
+ * keyCodes.h; the rest are curses key codes, which aren't
+ * defined here).
+ */
+
+typedef struct {
+    int code;			/* Character sent by key. */
+    KeySym sym;			/* Key sym. */
+    int modMask;		/* Modifiers. */
+} KeyCodeInfo;
+
+static KeyCodeInfo keyCodeArray[] = {
+#include "keyCodes.h"
+    {0, 0, 0}
+};
+
+/*
+ * Escape sequences sent by function keys.
+ */
+
+typedef struct {
+    char *seq;			/* Sequence sent by key. */
+    KeySym sym;			/* Key sym. */
+    int modMask;		/* Modifiers. */
+} KeySeqInfo;
+
+static KeySeqInfo keySeqArray[] = {
+    {"\033[A", 0xFF52, 0},	{"\033OA", 0xFF52, 0},	/* Up */
+    {"\033[B", 0xFF54, 0},	{"\033OB", 0xFF54, 0},	/* Down */
+    {"\033[C", 0xFF53, 0},	{"\033OC", 0xFF53, 0},	/* Right */
+    {"\033[D", 0xFF51, 0},	{"\033OD", 0xFF51, 0},	/* Left */
+    {"\033[H", 0xFF50, 0},	{"\033OH", 0xFF50, 0},	/* Home */
+    {"\033[1~", 0xFF50, 0},
+    {"\033[F", 0xFF57, 0},	{"\033OF", 0xFF57, 0},	/* End */
+    {"\033[4~", 0xFF57, 0},
+    {"\033[2~", 0xFF63, 0},				/* Insert */
+    {"\033[3~", 0xFFFF, 0},				/* Delete */
+    {"\033[5~", 0xFF55, 0},				/* Prior */
+    {"\033[6~", 0xFF56, 0},				/* Next */
+    {"\033[Z", 0xFF09, ShiftMask},			/* Back tab */
+    {"\033OP", 0xFFBE, 0},	{"\033[11~", 0xFFBE, 0},/* F1 */
+    {"\033OQ", 0xFFBF, 0},	{"\033[12~", 0xFFBF, 0},/* F2 */
+    {"\033OR", 0xFFC0, 0},	{"\033[13~", 0xFFC0, 0},/* F3 */
+    {"\033OS", 0xFFC1, 0},	{"\033[14~", 0xFFC1, 0},/* F4 */
+    {"\033[15~", 0xFFC2, 0},				/* F5 */
+    {"\033[17~", 0xFFC3, 0},				/* F6 */
+    {"\033[18~", 0xFFC4, 0},				/* F7 */
+    {"\033[19~", 0xFFC5, 0},				/* F8 */
+    {"\033[20~", 0xFFC6, 0},				/* F9 */
+    {"\033[21~", 0xFFC7, 0},				/* F10 */
+    {"\033[200~", PASTE_START, 0},			/* Paste */
+    {NULL, 0, 0}
+};
+
+/*
+ * Forward declarations of static functions.
+ */
+
+static int		AnsiInit _ANSI_ARGS_((Tcl_Interp *interp,
+			    TkDisplay *dispPtr));
+static void		AnsiEnd _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		AnsiPutSpan _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, CtkCell *cellPtr, int count));
+static void		AnsiFill _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, CtkCell *cellPtr, int count));
+static void		AnsiScroll _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int top, int bottom, int dy));
+static void		AnsiSetCursor _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, int visible));
+static void		AnsiFlush _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		AnsiBell _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		AnsiRedraw _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		AnsiPaste _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int on));
+static int		PasteBytes _ANSI_ARGS_((AnsiInfo *infoPtr,
+			    unsigned char *bytes, int length,
+			    Ctk_Event *eventPtr));
+static int		AnsiRead _ANSI_ARGS_((TkDisplay *dispPtr,
+			    Ctk_Event *eventPtr, int maxEvents));
+static void		AnsiInTimerProc _ANSI_ARGS_((ClientData clientData));
+static void		OutputBytes _ANSI_ARGS_((AnsiInfo *infoPtr,
+			    char *bytes, int length));
+static void		OutputString _ANSI_ARGS_((AnsiInfo *infoPtr,
+			    char *string));
+static void		OutputCell _ANSI_ARGS_((AnsiInfo *infoPtr,
+			    CtkCell *cellPtr));
+static void		PutCells _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, CtkCell *cellPtr, int count,
+			    int fill));
+static void		MoveCursor _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y));
+static int		MoveVertical _ANSI_ARGS_((AnsiInfo *infoPtr,
+			    int from, int to, int emit));
+static int		MoveHorizontal _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int from, int to, int y, int emit));
+static void		SetStyle _ANSI_ARGS_((AnsiInfo *infoPtr, int style));
+static void		WriteOutput _ANSI_ARGS_((TkDisplay *dispPtr, int wait));
+static void		AnsiWritable _ANSI_ARGS_((ClientData clientData,
+			    int mask));
+static void		StopQueue _ANSI_ARGS_((TkDisplay *dispPtr));
+static int		DecodeKey _ANSI_ARGS_((unsigned char *bytes,
+			    int length, int final, Ctk_Event *eventPtr));
+
+/*
+ * The ANSI display driver.
+ */
+
+CtkDisplayDriver ctkAnsiDriver = {
+    "ansi",
+    CTK_DEVICE_ANY,
+    AnsiInit,
+    AnsiEnd,
+    AnsiPutSpan,
+    AnsiFill,
+    AnsiScroll,
+    AnsiSetCursor,
+    AnsiFlush,
+    AnsiBell,
+    AnsiRedraw,
+    AnsiRead,
+    AnsiPaste
+};
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiInit --
+ *
+ *	Puts a display's terminal (already opened in `dispPtr->fd')
+ *	into raw mode and clears it.  A device that isn't a tty
+ *	is taken to be a connection to a remote terminal that is
+ *	already in raw mode.
+ *
+ * Results:
+ *	Standard TCL result.
+ *
+ * Side effects:
+ *	The terminal's modes are changed, and the screen is
+ *	cleared.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+AnsiInit(interp, dispPtr)
+    Tcl_Interp *interp;
+    TkDisplay *dispPtr;
+{
+#ifdef HAVE_TERMIOS_H
+    AnsiInfo *infoPtr;
+    struct termios modes;
+#ifdef TIOCGWINSZ
+    struct winsize size;
+#endif
+    char *value;
+
+    infoPtr = (AnsiInfo *) ckalloc(sizeof(AnsiInfo));
+    if (dispPtr->fd == 0) {
+	infoPtr->outFd = 1;
+	infoPtr->outChan = Tcl_GetStdChannel(TCL_STDOUT);
+    } else {
+	infoPtr->outFd = dispPtr->fd;
+	infoPtr->outChan = dispPtr->chan;
+    }
+    infoPtr->isTerminal = isatty(dispPtr->fd);
+    dispPtr->width = dispPtr->height = 0;
+    if (infoPtr->isTerminal) {
+	if (tcgetattr(dispPtr->fd, &infoPtr->savedModes) != 0) {
+	    Tcl_AppendResult(interp, "couldn't get modes of device \"",
+		    dispPtr->name, "\": ", Tcl_PosixError(interp),
+		    (char *) NULL);
+	    ckfree((char *) infoPtr);
+	    return TCL_ERROR;
+	}
+	modes = infoPtr->savedModes;
+	modes.c_iflag &= ~(IGNBRK|BRKINT|PARMRK|ISTRIP|INLCR|IGNCR|ICRNL|IXON);
+	modes.c_oflag &= ~OPOST;
+	modes.c_lflag &= ~(ECHO|ECHONL|ICANON|ISIG|IEXTEN);
+	modes.c_cflag &= ~(CSIZE|PARENB);
+	modes.c_cflag |= CS8;
+	modes.c_cc[VMIN] = 1;
+	modes.c_cc[VTIME] = 0;
+	tcsetattr(dispPtr->fd, TCSADRAIN, &modes);
+
+#ifdef TIOCGWINSZ
+	if (ioctl(infoPtr->outFd, TIOCGWINSZ, (char *) &size) == 0) {
+	    dispPtr->width = size.ws_col;
+	    dispPtr->height = size.ws_row;
+	}
+#endif
+    } else {
+	/*
+	 * The device is a socket or the like, whose far end is
+	 * expected to be a terminal already in raw mode.  Its size
+	 * can only come from the display name's type ("WxH").
+	 */
+
+	if (sscanf(dispPtr->type, "%dx%d", &dispPtr->width,
+		&dispPtr->height) != 2) {
+	    dispPtr->width = DEFAULT_WIDTH;
+	    dispPtr->height = DEFAULT_HEIGHT;
+	} else if (CtkDisplayCheckSize(interp, dispPtr, dispPtr->width,
+		dispPtr->height) != TCL_OK) {
+	    ckfree((char *) infoPtr);
+	    return TCL_ERROR;
+	}
+    }
+    if (dispPtr->width > CTK_MAX_SIZE) {
+	dispPtr->width = 0;
+    }
+    if (dispPtr->height > CTK_MAX_SIZE) {
+	dispPtr->height = 0;
+    }
+    if (dispPtr->width <= 0) {
+	value = getenv("COLUMNS");
+	dispPtr->width = (value != NULL) ? atoi(value) : 0;
+	if (dispPtr->width <= 0 || dispPtr->width > CTK_MAX_SIZE) {
+	    dispPtr->width = DEFAULT_WIDTH;
+	}
+    }
+    if (dispPtr->height <= 0) {
+	value = getenv("LINES");
+	dispPtr->height = (value != NULL) ? atoi(value) : 0;
+	if (dispPtr->height <= 0 || dispPtr->height > CTK_MAX_SIZE) {
+	    dispPtr->height = DEFAULT_HEIGHT;
+	}
+    }
+
+    infoPtr->outSize = 4096;
+    infoPtr->out = ckalloc((unsigned) infoPtr->outSize);
+    infoPtr->outUsed = 0;
+    infoPtr->inUsed = 0;
+    value = getenv("ESCDELAY");
+    infoPtr->escDelay = (value != NULL) ? atoi(value) : ESC_DELAY;
+    if (infoPtr->escDelay < 0) {
+	infoPtr->escDelay = ESC_DELAY;
+    }
+    infoPtr->inTimer = NULL;
+    infoPtr->inTimedOut = 0;
+    infoPtr->paste = NULL;
+    dispPtr->display = (ClientData) infoPtr;
+
+    /*
+     * Anything written to stdout so far must reach the terminal
+     * before the screen is cleared.
+     */
+
+    fflush(stdout);
+    OutputString(infoPtr, "\033[?1049h\033[r\033(B\033[0m\033[H\033[2J");
+    infoPtr->style = CTK_PLAIN_STYLE;
+    infoPtr->lineDrawing = 0;
+    infoPtr->x = infoPtr->y = 0;
+    infoPtr->cursorVisible = 1;
+    return TCL_OK;
+#else
+    Tcl_AppendResult(interp, "the ansi display driver isn't supported ",
+	    "on this system", (char *) NULL);
+    return TCL_ERROR;
+#endif /* HAVE_TERMIOS_H */
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiEnd --
+ *
+ *	Restores a display's terminal.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The terminal is restored to line mode, and the
+ *	driver's information about the display is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+AnsiEnd(dispPtr)
+    TkDisplay *dispPtr;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+
+    if (dispPtr->reportPastes) {
+	OutputString(infoPtr, "\033[?2004l");
+    }
+    OutputString(infoPtr, "\033[r\033(B\033[0m\033[?25h\033[?1049l");
+
+    /*
+     * A local terminal is waited for, so that it is left usable.  A
+     * remote one that isn't keeping up just gets what it will take.
+     */
+
+    StopQueue(dispPtr);
+    WriteOutput(dispPtr, infoPtr->isTerminal);
+    StopQueue(dispPtr);
+#ifdef HAVE_TERMIOS_H
+    if (infoPtr->isTerminal) {
+	tcsetattr(dispPtr->fd, TCSADRAIN, &infoPtr->savedModes);
+    }
+#endif
+    if (infoPtr->inTimer != NULL) {
+	Tcl_DeleteTimerHandler(infoPtr->inTimer);
+    }
+    if (infoPtr->paste != NULL) {
+	ckfree(infoPtr->paste);
+    }
+    ckfree(infoPtr->out);
+    ckfree((char *) infoPtr);
+    dispPtr->display = NULL;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiPutSpan --
+ * AnsiFill --
+ *
+ *	Output a run of cells (or `count' copies of one cell).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is added to the display's buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+AnsiPutSpan(dispPtr, x, y, cellPtr, count)
+    TkDisplay *dispPtr;
+    int x, y;
+    CtkCell *cellPtr;
+    int count;
+{
+    PutCells(dispPtr, x, y, cellPtr, count, 0);
+}
+
+static void
+AnsiFill(dispPtr, x, y, cellPtr, count)
+    TkDisplay *dispPtr;
+    int x, y;
+    CtkCell *cellPtr;
+    int count;
+{
+    PutCells(dispPtr, x, y, cellPtr, count, 1);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * PutCells --
+ *
+ *	Outputs a run of cells.  If the run ends in blanks that
+ *	carry on to the end of the row, they are erased with EL
+ *	instead of being written, and other long stretches of
+ *	blanks are erased with ECH.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is added to the display's buffer.  If the row is
+ *	erased past the end of the run, the erased cells are
+ *	recorded in the display's `shown' cells.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+PutCells(dispPtr, x, y, cellPtr, count, fill)
+    TkDisplay *dispPtr;
+    int x, y;			/* Where run starts. */
+    CtkCell *cellPtr;		/* First cell of run. */
+    int count;			/* Number of cells in run. */
+    int fill;			/* Non-zero means every cell of the run
+				 * is a copy of *cellPtr. */
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+    int width = dispPtr->width;
+    int end = x + count;
+    int stop = end;		/* Cells from here on are erased. */
+    CtkCell *rowPtr = dispPtr->cells + y*width;
+    char erase[40], skip[40];
+    int i, n;
+
+    while (stop > x && IsClear(fill ? cellPtr : cellPtr + (stop-1-x))) {
+	stop--;
+    }
+    if (end - stop >= MIN_ERASE) {
+	for (i = end; i < width; i++) {
+	    if (!IsClear(rowPtr + i)) {
+		stop = end;
+		break;
+	    }
+	}
+    } else {
+	stop = end;
+    }
+
+    MoveCursor(dispPtr, x, y);
+    for (i = x; i < stop; ) {
+	for (n = 0; i+n < stop && IsClear(fill ? cellPtr : cellPtr+(i+n-x));
+		n++) {
+	    /* Empty loop body. */
+	}
+	if (n >= MIN_ERASE) {
+	    /*
+	     * Erase the blanks with ECH (which leaves the cursor
+	     * where it is) if that, and moving past them, is cheaper
+	     * than writing them.
+	     */
+
+	    sprintf(erase, "\033[%dX", n);
+	    skip[0] = '\0';
+	    if (i+n < stop) {
+		sprintf(skip, "\033[%dC", n);
+	    }
+	    if ((int) (strlen(erase) + strlen(skip)) < n) {
+		if (!styleInfo[infoPtr->style].blankIsClear) {
+		    SetStyle(infoPtr, CTK_PLAIN_STYLE);
+		}
+		OutputString(infoPtr, erase);
+		OutputString(infoPtr, skip);
+		i += n;
+		if (i == stop) {
+		    i -= n;
+		    break;
+		}
+		continue;
+	    }
+	}
+	if (n == 0) {
+	    n = 1;
+	}
+	for ( ; n > 0; n--, i++) {
+	    OutputCell(infoPtr, fill ? cellPtr : cellPtr + (i-x));
+	}
+    }
+    infoPtr->x = (i < width) ? i : -1;
+    if (stop < end) {
+	if (!styleInfo[infoPtr->style].blankIsClear) {
+	    SetStyle(infoPtr, CTK_PLAIN_STYLE);
+	}
+	OutputString(infoPtr, "\033[K");
+	memcpy((VOID *) (dispPtr->shown + y*width + end),
+		(VOID *) (rowPtr + end), (width - end) * sizeof(CtkCell));
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiScroll --
+ *
+ *	Scrolls rows `top' to `bottom'-1 of the terminal by `dy'
+ *	rows, using a scrolling region.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is added to the display's buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+AnsiScroll(dispPtr, top, bottom, dy)
+    TkDisplay *dispPtr;
+    int top, bottom;
+    int dy;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+    char buffer[40];
+
+    /*
+     * Blank lines take the current background, so make it plain.
+     */
+
+    SetStyle(infoPtr, CTK_PLAIN_STYLE);
+    sprintf(buffer, "\033[%d;%dr", top+1, bottom);
+    OutputString(infoPtr, buffer);
+    infoPtr->x = infoPtr->y = -1;
+    if (dy > 0) {
+	MoveCursor(dispPtr, 0, top);
+	for ( ; dy > 0; dy--) {
+	    OutputString(infoPtr, "\033M");
+	}
+    } else {
+	MoveCursor(dispPtr, 0, bottom-1);
+	for ( ; dy < 0; dy++) {
+	    OutputString(infoPtr, "\n");
+	}
+    }
+    OutputString(infoPtr, "\033[r");
+    infoPtr->x = infoPtr->y = -1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiSetCursor --
+ *
+ *	Positions (or hides) the cursor.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is added to the display's buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+AnsiSetCursor(dispPtr, x, y, visible)
+    TkDisplay *dispPtr;
+    int x, y;
+    int visible;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+
+    if (visible) {
+	MoveCursor(dispPtr, x, y);
+    }
+    if (visible != infoPtr->cursorVisible) {
+	OutputString(infoPtr, visible ? "\033[?25h" : "\033[?25l");
+	infoPtr->cursorVisible = visible;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiFlush --
+ * AnsiBell --
+ * AnsiPaste --
+ * AnsiRedraw --
+ *
+ *	Write the buffered output to the terminal, ring its bell,
+ *	turn its bracketed paste mode on or off, or clear it so
+ *	that the next flush redraws all of it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output to the terminal.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+AnsiFlush(dispPtr)
+    TkDisplay *dispPtr;
+{
+    WriteOutput(dispPtr, 0);
+}
+
+static void
+AnsiBell(dispPtr)
+    TkDisplay *dispPtr;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+
+    OutputString(infoPtr, "\007");
+    WriteOutput(dispPtr, 0);
+}
+
+static void
+AnsiPaste(dispPtr, on)
+    TkDisplay *dispPtr;
+    int on;
+{
+    OutputString((AnsiInfo *) dispPtr->display,
+	    on ? "\033[?2004h" : "\033[?2004l");
+}
+
+static void
+AnsiRedraw(dispPtr)
+    TkDisplay *dispPtr;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+
+    OutputString(infoPtr, "\033(B\033[0m\033[H\033[2J");
+    infoPtr->style = CTK_PLAIN_STYLE;
+    infoPtr->lineDrawing = 0;
+    infoPtr->x = infoPtr->y = 0;
+    CtkDisplayForget(dispPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiRead --
+ *
+ *	Reads the keystrokes waiting on the terminal and
+ *	translates them to key events.
+ *
+ * Results:
+ *	Returns the number of events stored at `eventPtr',
+ *	or -1 at end of file or if the connection has failed.
+ *
+ * Side effects:
+ *	Input is consumed.  The start of a key sequence that
+ *	hasn't all arrived (even just an ESC) is kept for the
+ *	next call, as is the text of a paste that hasn't ended;
+ *	if the rest of the sequence doesn't come within the
+ *	display's escape delay, a timer has the bytes kept
+ *	taken as keys by themselves.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+AnsiRead(dispPtr, eventPtr, maxEvents)
+    TkDisplay *dispPtr;
+    Ctk_Event *eventPtr;
+    int maxEvents;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+    unsigned char bytes[MAX_KEY_SEQ + 256];
+    int length, pos, used, numEvents, final;
+
+    /*
+     * Every key is at least one byte, so reading no more than
+     * `maxEvents' bytes (counting those kept from last time)
+     * ensures that all the complete keys read can be returned.
+     */
+
+    if (maxEvents > (int) sizeof(bytes)) {
+	maxEvents = sizeof(bytes);
+    }
+    memcpy((VOID *) bytes, (VOID *) infoPtr->in, (size_t) infoPtr->inUsed);
+    final = infoPtr->inTimedOut;
+    infoPtr->inTimedOut = 0;
+    if (final) {
+	length = 0;
+    } else {
+	length = read(dispPtr->fd, (char *) bytes + infoPtr->inUsed,
+		(size_t) (maxEvents - infoPtr->inUsed));
+	if (length == 0
+		|| (length < 0 && errno != EINTR && errno != EAGAIN)) {
+	    return -1;
+	} else if (length < 0) {
+	    return 0;
+	}
+    }
+    length += infoPtr->inUsed;
+    numEvents = 0;
+    for (pos = 0; pos < length; pos += used) {
+	if (infoPtr->paste != NULL) {
+	    used = PasteBytes(infoPtr, bytes + pos, length - pos,
+		    eventPtr + numEvents);
+	    if (infoPtr->paste == NULL) {
+		numEvents++;
+	    }
+	    continue;
+	}
+	used = DecodeKey(bytes + pos, length - pos, final,
+		eventPtr + numEvents);
+	if (used == 0) {
+	    break;
+	}
+	if (eventPtr[numEvents].u.key.sym == PASTE_START) {
+	    infoPtr->pasteSize = 256;
+	    infoPtr->paste = ckalloc((unsigned) infoPtr->pasteSize);
+	    infoPtr->pasteUsed = 0;
+	    continue;
+	}
+	numEvents++;
+    }
+    infoPtr->inUsed = length - pos;
+    memcpy((VOID *) infoPtr->in, (VOID *) (bytes + pos),
+	    (size_t) infoPtr->inUsed);
+    if (infoPtr->inTimer != NULL) {
+	Tcl_DeleteTimerHandler(infoPtr->inTimer);
+	infoPtr->inTimer = NULL;
+    }
+    if (infoPtr->inUsed > 0) {
+	infoPtr->inTimer = Tcl_CreateTimerHandler(infoPtr->escDelay,
+		AnsiInTimerProc, (ClientData) dispPtr);
+    }
+    return numEvents;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiInTimerProc --
+ *
+ *	Invoked when the rest of a key sequence hasn't arrived
+ *	within the display's escape delay.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The bytes held are decoded as keys by themselves (a lone
+ *	ESC becomes the Escape key) and the events are handled.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+AnsiInTimerProc(clientData)
+    ClientData clientData;
+{
+    TkDisplay *dispPtr = (TkDisplay *) clientData;
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+
+    infoPtr->inTimer = NULL;
+    infoPtr->inTimedOut = 1;
+    CtkDisplayReadKeys(dispPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * PasteBytes --
+ *
+ *	Adds input to the text of a bracketed paste, up to the
+ *	sequence that ends the paste.
+ *
+ * Results:
+ *	Returns the number of bytes used.  If the paste ended,
+ *	or grew to MAX_PASTE bytes, `infoPtr->paste' is set to NULL.
+ *
+ * Side effects:
+ *	When the paste ends, *eventPtr is filled in with a paste
+ *	event, which takes over the text.  Carriage returns
+ *	(which terminals send for newlines) become newlines.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+PasteBytes(infoPtr, bytes, length, eventPtr)
+    AnsiInfo *infoPtr;
+    unsigned char *bytes;
+    int length;
+    Ctk_Event *eventPtr;
+{
+    char *src, *dst, *end;
+    int pos, ended;
+
+    for (pos = 0; pos < length; pos++) {
+	if (infoPtr->pasteUsed + 1 >= infoPtr->pasteSize) {
+	    infoPtr->pasteSize *= 2;
+	    infoPtr->paste = ckrealloc(infoPtr->paste,
+		    (unsigned) infoPtr->pasteSize);
+	}
+	infoPtr->paste[infoPtr->pasteUsed++] = bytes[pos];
+	ended = (bytes[pos] == '~') && (infoPtr->pasteUsed >= PASTE_END_LEN)
+		&& (strncmp(infoPtr->paste + infoPtr->pasteUsed
+		- PASTE_END_LEN, PASTE_END, PASTE_END_LEN) == 0);
+	if (ended || (infoPtr->pasteUsed + 1 >= MAX_PASTE)) {
+	    end = infoPtr->paste + infoPtr->pasteUsed;
+	    if (ended) {
+		end -= PASTE_END_LEN;
+	    }
+	    for (src = dst = infoPtr->paste; src < end; src++) {
+		if (*src != '\r') {
+		    *dst++ = *src;
+		} else if ((src + 1 == end) || (src[1] != '\n')) {
+		    *dst++ = '\n';
+		}
+	    }
+	    *dst = '\0';
+	    eventPtr->type = CTK_PASTE_EVENT;
+	    eventPtr->u.paste.string = infoPtr->paste;
+	    eventPtr->u.paste.length = dst - infoPtr->paste;
+	    infoPtr->paste = NULL;
+	    return pos + 1;
+	}
+    }
+    return length;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DecodeKey --
+ *
+ *	Translates the key sequence at the start of `bytes'
+ *	to a key event.
+ *
+ * Results:
+ *	Returns the number of bytes used, or 0 if `bytes' is
+ *	only the start of a sequence (or a lone ESC, which may
+ *	be the start of one) and `final' is zero.  If `final'
+ *	is non-zero no more bytes are coming, so the start of
+ *	a sequence is taken as separate keys.
+ *
+ * Side effects:
+ *	Fills in *eventPtr.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+DecodeKey(bytes, length, final, eventPtr)
+    unsigned char *bytes;
+    int length;
+    int final;
+    Ctk_Event *eventPtr;
+{
+    KeyCodeInfo *codePtr;
+    KeySeqInfo *seqPtr;
+    int seqLength, partial = 0;
+
+    eventPtr->type = CTK_KEY_EVENT;
+    if (bytes[0] == '\033' && length == 1 && !final) {
+	return 0;
+    }
+    if (bytes[0] == '\033' && length > 1) {
+	for (seqPtr = keySeqArray; seqPtr->seq != NULL; seqPtr++) {
+	    seqLength = strlen(seqPtr->seq);
+	    if (strncmp(seqPtr->seq, (char *) bytes,
+		    (size_t) ((length < seqLength) ? length : seqLength))
+		    != 0) {
+		continue;
+	    }
+	    if (length < seqLength) {
+		partial = 1;
+		continue;
+	    }
+	    eventPtr->u.key.sym = seqPtr->sym;
+	    eventPtr->u.key.state = seqPtr->modMask;
+	    return seqLength;
+	}
+	if (partial && length < MAX_KEY_SEQ && !final) {
+	    return 0;
+	}
+    }
+    for (codePtr = keyCodeArray; codePtr->code != 0; codePtr++) {
+	if (codePtr->code == bytes[0]) {
+	    eventPtr->u.key.sym = codePtr->sym;
+	    eventPtr->u.key.state = codePtr->modMask;
+	    return 1;
+	}
+    }
+    eventPtr->u.key.sym = bytes[0];
+    eventPtr->u.key.state = 0;
+    return 1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * OutputBytes --
+ * OutputString --
+ *
+ *	Add bytes to a display's output buffer.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The buffer may be grown.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+OutputBytes(infoPtr, bytes, length)
+    AnsiInfo *infoPtr;
+    char *bytes;
+    int length;
+{
+    char *newOut;
+
+    if (infoPtr->outUsed + length > infoPtr->outSize) {
+	infoPtr->outSize = 2*(infoPtr->outUsed + length);
+	newOut = ckalloc((unsigned) infoPtr->outSize);
+	memcpy((VOID *) newOut, (VOID *) infoPtr->out,
+		(size_t) infoPtr->outUsed);
+	ckfree(infoPtr->out);
+	infoPtr->out = newOut;
+    }
+    memcpy((VOID *) (infoPtr->out + infoPtr->outUsed), (VOID *) bytes,
+	    (size_t) length);
+    infoPtr->outUsed += length;
+}
+
+static void
+OutputString(infoPtr, string)
+    AnsiInfo *infoPtr;
+    char *string;
+{
+    OutputBytes(infoPtr, string, strlen(string));
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * OutputCell --
+ *
+ *	Outputs the character in a cell, in the cell's style.
+ *	The caller keeps track of the cursor position.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is added to the display's buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+OutputCell(infoPtr, cellPtr)
+    AnsiInfo *infoPtr;
+    CtkCell *cellPtr;
+{
+    int ch = cellPtr->ch;
+    char c;
+
+    SetStyle(infoPtr, cellPtr->style);
+    if (ch >= CTK_ACS_ULCORNER && ch <= CTK_ACS_PLUS) {
+	if (!infoPtr->lineDrawing) {
+	    OutputString(infoPtr, "\033(0");
+	    infoPtr->lineDrawing = 1;
+	}
+	c = lineDrawingChars[ch - CTK_ACS_ULCORNER];
+    } else {
+	if (infoPtr->lineDrawing) {
+	    OutputString(infoPtr, "\033(B");
+	    infoPtr->lineDrawing = 0;
+	}
+	c = (ch < ' ' || ch == 0177 || ch > UCHAR_MAX) ? '?' : (char) ch;
+    }
+    OutputBytes(infoPtr, &c, 1);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * MoveCursor --
+ *
+ *	Moves the terminal's cursor, unless it is already in
+ *	place.  The cheapest of an absolute move (CUP), a move
+ *	relative to where the cursor is, and a carriage return
+ *	followed by a relative move, is used.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is added to the display's buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+MoveCursor(dispPtr, x, y)
+    TkDisplay *dispPtr;
+    int x, y;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+    char buffer[40];
+    int method, best, cost, verticalCost;
+
+    if (x == infoPtr->x && y == infoPtr->y) {
+	return;
+    }
+    sprintf(buffer, "\033[%d;%dH", y+1, x+1);
+    method = MOVE_ABSOLUTE;
+    best = strlen(buffer);
+    if (infoPtr->y >= 0) {
+	verticalCost = MoveVertical(infoPtr, infoPtr->y, y, 0);
+	if (infoPtr->x >= 0) {
+	    cost = verticalCost
+		    + MoveHorizontal(dispPtr, infoPtr->x, x, y, 0);
+	    if (cost < best) {
+		method = MOVE_RELATIVE;
+		best = cost;
+	    }
+	}
+	cost = verticalCost + 1 + MoveHorizontal(dispPtr, 0, x, y, 0);
+	if (cost < best) {
+	    method = MOVE_RETURN;
+	    best = cost;
+	}
+    }
+
+    switch (method) {
+	case MOVE_ABSOLUTE:
+	    OutputString(infoPtr, buffer);
+	    break;
+	case MOVE_RELATIVE:
+	    MoveVertical(infoPtr, infoPtr->y, y, 1);
+	    MoveHorizontal(dispPtr, infoPtr->x, x, y, 1);
+	    break;
+	case MOVE_RETURN:
+	    MoveVertical(infoPtr, infoPtr->y, y, 1);
+	    OutputString(infoPtr, "\r");
+	    MoveHorizontal(dispPtr, 0, x, y, 1);
+	    break;
+    }
+    infoPtr->x = x;
+    infoPtr->y = y;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * MoveVertical --
+ * MoveHorizontal --
+ *
+ *	Work out the cheapest way of moving the cursor from one
+ *	row to another (with line feeds, or CUD or CUU), or from
+ *	one column to another in row `y' (with backspaces, CUB,
+ *	CUF, or by writing over the cells in between again), and
+ *	optionally output it.
+ *
+ * Results:
+ *	Returns the number of bytes needed for the move.
+ *
+ * Side effects:
+ *	If `emit' is non-zero, output is added to the display's
+ *	buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+MoveVertical(infoPtr, from, to, emit)
+    AnsiInfo *infoPtr;
+    int from, to;		/* Rows to move from and to. */
+    int emit;			/* Non-zero means output the move. */
+{
+    char buffer[40];
+    int i;
+
+    if (to == from) {
+	return 0;
+    }
+    sprintf(buffer, "\033[%d%c", (to > from) ? to - from : from - to,
+	    (to > from) ? 'B' : 'A');
+    if (to > from && to - from <= (int) strlen(buffer)) {
+	if (emit) {
+	    for (i = from; i < to; i++) {
+		OutputString(infoPtr, "\n");
+	    }
+	}
+	return to - from;
+    }
+    if (emit) {
+	OutputString(infoPtr, buffer);
+    }
+    return strlen(buffer);
+}
+
+static int
+MoveHorizontal(dispPtr, from, to, y, emit)
+    TkDisplay *dispPtr;
+    int from, to;		/* Columns to move from and to. */
+    int y;			/* Row to move along. */
+    int emit;			/* Non-zero means output the move. */
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+    CtkCell *cellPtr;
+    char buffer[40];
+    int i, ch;
+
+    if (to == from) {
+	return 0;
+    }
+    sprintf(buffer, "\033[%d%c", (to > from) ? to - from : from - to,
+	    (to > from) ? 'C' : 'D');
+    if (to < from) {
+	if (from - to <= (int) strlen(buffer)) {
+	    if (emit) {
+		for (i = to; i < from; i++) {
+		    OutputString(infoPtr, "\b");
+		}
+	    }
+	    return from - to;
+	}
+    } else if (to - from < (int) strlen(buffer) && !infoPtr->lineDrawing) {
+	/*
+	 * Writing the cells between again is cheaper, as long as
+	 * they're ordinary characters in the current style.
+	 */
+
+	cellPtr = dispPtr->shown + y*dispPtr->width + from;
+	for (i = from; i < to; i++, cellPtr++) {
+	    ch = cellPtr->ch;
+	    if (ch < ' ' || ch == 0177 || ch > UCHAR_MAX
+		    || cellPtr->style != infoPtr->style) {
+		break;
+	    }
+	}
+	if (i == to) {
+	    if (emit) {
+		cellPtr = dispPtr->shown + y*dispPtr->width + from;
+		for (i = from; i < to; i++, cellPtr++) {
+		    OutputCell(infoPtr, cellPtr);
+		}
+	    }
+	    return to - from;
+	}
+    }
+    if (emit) {
+	OutputString(infoPtr, buffer);
+    }
+    return strlen(buffer);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * SetStyle --
+ *
+ *	Has the terminal draw in a style.  Nothing is output if
+ *	the terminal's attributes are already right, and attributes
+ *	are only reset (SGR 0) when some are set.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is added to the display's buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+SetStyle(infoPtr, style)
+    AnsiInfo *infoPtr;
+    int style;
+{
+    char *attribute = styleInfo[style].attribute;
+    char *oldAttribute = styleInfo[infoPtr->style].attribute;
+    char buffer[40];
+
+    if (strcmp(attribute, oldAttribute) != 0) {
+	if (*attribute == '\0') {
+	    OutputString(infoPtr, "\033[m");
+	} else {
+	    sprintf(buffer, (*oldAttribute == '\0') ? "\033[%sm"
+		    : "\033[0;%sm", attribute);
+	    OutputString(infoPtr, buffer);
+	}
+    }
+    infoPtr->style = style;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * WriteOutput --
+ *
+ *	Writes as much of a display's buffered output to its
+ *	terminal as it will take without blocking (or all of
+ *	it, if `wait' is set).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output is removed from the buffer.  If some is left,
+ *	the display's output is blocked until it has been
+ *	written.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+WriteOutput(dispPtr, wait)
+    TkDisplay *dispPtr;
+    int wait;			/* Non-zero means write everything, even
+				 * if that means waiting for the terminal. */
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+    char *p = infoPtr->out;
+    int left = infoPtr->outUsed;
+    int n, flags = 0;
+
+    /*
+     * Unless told to wait (or there is no channel to watch for the
+     * terminal becoming writable), the descriptor is made
+     * non-blocking just while writing, since it may be shared with
+     * channels that expect it to block.
+     */
+
+    if (infoPtr->outChan == NULL) {
+	wait = 1;
+    }
+    if (!wait) {
+	flags = fcntl(infoPtr->outFd, F_GETFL);
+	fcntl(infoPtr->outFd, F_SETFL, flags | O_NONBLOCK);
+    }
+    while (left > 0) {
+	n = write(infoPtr->outFd, p, (size_t) left);
+	if (n < 0) {
+	    if (errno == EINTR) {
+		continue;
+	    }
+	    if (errno != EAGAIN && errno != EWOULDBLOCK) {
+		/*
+		 * The terminal has gone away:  the output is dropped,
+		 * and end of file will be seen on its input.
+		 */
+
+		left = 0;
+	    }
+	    break;
+	}
+	p += n;
+	left -= n;
+    }
+    if (!wait) {
+	fcntl(infoPtr->outFd, F_SETFL, flags);
+    }
+
+    /*
+     * Whatever the terminal didn't take stays queued, and a handler
+     * sends it when the terminal can take more.  Meanwhile the display
+     * is marked blocked so that no new frames are added to the queue.
+     */
+
+    memmove((VOID *) infoPtr->out, (VOID *) p, (size_t) left);
+    infoPtr->outUsed = left;
+    if (left > 0 && !dispPtr->outputBlocked) {
+	dispPtr->outputBlocked = 1;
+	Tcl_CreateChannelHandler(infoPtr->outChan, TCL_WRITABLE,
+		AnsiWritable, (ClientData) dispPtr);
+    } else if (left == 0 && dispPtr->outputBlocked) {
+	StopQueue(dispPtr);
+	CtkDisplayDrained(dispPtr);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * StopQueue --
+ *
+ *	Stops waiting to write a display's queued output.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The writable handler is deleted and the display's
+ *	output is no longer blocked.  The queued output stays
+ *	in the buffer.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+StopQueue(dispPtr)
+    TkDisplay *dispPtr;
+{
+    AnsiInfo *infoPtr = (AnsiInfo *) dispPtr->display;
+
+    if (dispPtr->outputBlocked) {
+	Tcl_DeleteChannelHandler(infoPtr->outChan, AnsiWritable,
+		(ClientData) dispPtr);
+	dispPtr->outputBlocked = 0;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * AnsiWritable --
+ *
+ *	Channel handler called when a display's terminal can
+ *	take more of the output queued for it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Queued output is written.  Once the queue is empty,
+ *	the display is brought up to date.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+AnsiWritable(clientData, mask)
+    ClientData clientData;
+    int mask;
+{
+    WriteOutput((TkDisplay *) clientData, 0);
+}
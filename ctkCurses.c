@@ -0,0 +1,547 @@
+/*
+ * ctkCurses.c (CTk) --
+ *
+ *	CTk display driver for curses (hides all curses functions).
+ *
+ * Copyright (c) 1994-1995 Cleveland Clinic Foundation
+ *
+ * See the file "license.terms" for information on usage and redistribution
+ * of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+ *
+ * @(#) $Id: ctk.shar,v 1.50 1996/01/15 14:47:16 andrewm Exp andrewm $
+ */
+
+#include "tkPort.h"
+#include "tkInt.h"
+#ifdef HAVE_CURSES_H
+#  include <curses.h>
+#elif defined(HAVE_CURSES_CURSES_H)
+#  include <curses/curses.h>
+#elif defined(HAVE_CURSES_NCURSES_H)
+#  include <curses/ncurses.h>
+#elif defined(HAVE_NCURSES_NCURSES_H)
+#  include <ncurses/ncurses.h>
+#endif
+
+/*
+ * Definitions for weak curses implementations.
+ */
+
+#ifndef ACS_ULCORNER
+/*
+ * This curses does not define the alternate character set constants.
+ * Define them locally.
+ */
+#   define ACS_ULCORNER    '+'
+#   define ACS_LLCORNER    '+'
+#   define ACS_URCORNER    '+'
+#   define ACS_LRCORNER    '+'
+#   define ACS_HLINE       '-'
+#   define ACS_VLINE       '|'
+#   define ACS_PLUS        '+'
+#endif /* ACS_ULCORNER */
+
+#ifndef HAVE_CURS_SET
+/*
+ * Don't have curs_set() function - ignore it.
+ *
+ * The cursor gets pretty annoying, but haven't found any other
+ * way to turn it off.
+ */
+#   define curs_set(mode)	((void) 0)
+#endif
+
+#ifndef A_STANDOUT
+    typedef int chtype;
+#   define attrset(attr)	((attr) ? standout() : standend())
+#   define A_STANDOUT	1
+#   define A_INVIS	0
+#   define A_NORMAL	0
+#   define A_UNDERLINE	0
+#   define A_REVERSE	0
+#   define A_DIM	0
+#   define A_BOLD	0
+#   define A_DIM	0
+#   define A_BOLD	0
+#   define A_REVERSE	0
+#endif
+
+#ifdef HAVE_SET_TERM
+#   define SetTerm(dispPtr) \
+	if (cursesDispPtr != (dispPtr)) \
+	set_term((SCREEN *) (cursesDispPtr = (dispPtr))->display)
+#else
+#   define SetTerm(dispPtr)		(cursesDispPtr = (dispPtr))
+#   define newterm(type, outPtr, inPtr)	initscr()
+#endif
+
+#ifndef HAVE_KEYPAD
+#   define keypad(win, flag)		((void) 0)
+#endif
+
+#ifndef HAVE_BEEP
+#   define beep()			((void) 0)
+#endif
+
+#ifndef HAVE_NODELAY
+#   define nodelay(win, flag)		((void) 0)
+#endif
+
+/*
+ * Curses attributes that correspond to CTk styles.
+ * This definition must be modified in concert with
+ * the Ctk_Style definition in tk.h
+ */
+chtype styleAttributes[] = {
+    A_NORMAL, A_NORMAL, A_UNDERLINE, A_REVERSE, A_DIM, A_BOLD,
+    A_DIM, A_BOLD, A_STANDOUT, A_REVERSE
+};
+
+/*
+ * Display whose terminal curses is currently using.  Changed by
+ * SetTerm().
+ */
+
+static TkDisplay *cursesDispPtr = NULL;
+
+/*
+ * Buffer used to pass runs of cells to curses.  Grown as needed.
+ */
+
+static chtype *runBuffer = NULL;
+static int runBufferSize = 0;
+
+/*
+ * The data structure and hash table below are used to map from
+ * raw keycodes (curses) to keysyms and modifier masks.
+ */
+
+typedef struct {
+    int code;			/* Curses key code. */
+    KeySym sym;			/* Key sym. */
+    int modMask;		/* Modifiers. */
+} KeyCodeInfo;
+
+static KeyCodeInfo keyCodeArray[] = {
+#include "keyCodes.h"
+    {0, 0, 0}
+};
+static Tcl_HashTable keyCodeTable;	/* Hashed form of above structure. */
+
+/*
+ * Forward declarations of static functions.
+ */
+
+static int		CursesInit _ANSI_ARGS_((Tcl_Interp *interp,
+			    TkDisplay *dispPtr));
+static void		CursesEnd _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		CursesPutSpan _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, CtkCell *cellPtr, int count));
+static void		CursesFill _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, CtkCell *cellPtr, int count));
+static void		CursesScroll _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int top, int bottom, int dy));
+static void		CursesSetCursor _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, int visible));
+static void		CursesFlush _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		CursesBell _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		CursesRedraw _ANSI_ARGS_((TkDisplay *dispPtr));
+static int		CursesRead _ANSI_ARGS_((TkDisplay *dispPtr,
+			    Ctk_Event *eventPtr, int maxEvents));
+static chtype		CellChar _ANSI_ARGS_((CtkCell *cellPtr));
+static void		GrowRunBuffer _ANSI_ARGS_((int count));
+
+/*
+ * The curses display driver.
+ */
+
+CtkDisplayDriver ctkCursesDriver = {
+    "curses",
+    CTK_DEVICE_TTY,
+    CursesInit,
+    CursesEnd,
+    CursesPutSpan,
+    CursesFill,
+    CursesScroll,
+    CursesSetCursor,
+    CursesFlush,
+    CursesBell,
+    CursesRedraw,
+    CursesRead,
+    NULL
+};
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CursesInit --
+ *
+ *	Starts curses on a display's terminal (already opened
+ *	in `dispPtr->fd').
+ *
+ * Results:
+ *	Standard TCL result.
+ *
+ * Side effects:
+ *	The screen is cleared, and all sorts of I/O options
+ *	are set appropriately for a full-screen application.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+CursesInit(interp, dispPtr)
+    Tcl_Interp *interp;
+    TkDisplay *dispPtr;
+{
+    FILE *outPtr;
+    static int initialized = 0;
+
+    if (!initialized) {
+	register KeyCodeInfo *codePtr;
+	register Tcl_HashEntry *hPtr;
+	int dummy;
+
+	initialized = 1;
+	Tcl_InitHashTable(&keyCodeTable, TCL_ONE_WORD_KEYS);
+	for (codePtr = keyCodeArray; codePtr->code != 0; codePtr++) {
+	    hPtr = Tcl_CreateHashEntry(&keyCodeTable,
+	    	    (char *) codePtr->code, &dummy);
+	    Tcl_SetHashValue(hPtr, (ClientData) codePtr);
+	}
+    }
+
+    if (dispPtr->fd == 0) {
+	dispPtr->inPtr = stdin;
+	outPtr = stdout;
+    } else {
+	dispPtr->inPtr = fdopen(dispPtr->fd, "r+");
+	outPtr = dispPtr->inPtr;
+    }
+
+    dispPtr->display =
+	    (ClientData) newterm(dispPtr->type, outPtr, dispPtr->inPtr);
+    if (dispPtr->display == NULL) {
+	Tcl_AppendResult(interp, "couldn't start curses on device \"",
+		dispPtr->name, "\" (terminal type \"", dispPtr->type,
+		"\")", (char *) NULL);
+	return TCL_ERROR;
+    }
+    SetTerm(dispPtr);
+    raw();
+    nonl();
+    noecho();
+    keypad(stdscr, TRUE);
+    nodelay(stdscr, TRUE);
+    idlok(stdscr, TRUE);
+    dispPtr->width = COLS;
+    dispPtr->height = LINES;
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CursesEnd --
+ *
+ *	Ends curses' use of a display's terminal.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The terminal is restored to line mode.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+CursesEnd(dispPtr)
+    TkDisplay *dispPtr;
+{
+    SetTerm(dispPtr);
+    curs_set(1);
+    endwin();
+    cursesDispPtr = NULL;
+
+    if (dispPtr->inPtr != stdin) {
+    	fclose(dispPtr->inPtr);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CursesPutSpan --
+ * CursesFill --
+ *
+ *	Hands a run of cells (or `count' copies of one cell) to
+ *	curses with a single call.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Curses' screen is updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+CursesPutSpan(dispPtr, x, y, cellPtr, count)
+    TkDisplay *dispPtr;
+    int x, y;
+    CtkCell *cellPtr;
+    int count;
+{
+    int i;
+
+    SetTerm(dispPtr);
+    GrowRunBuffer(count);
+    for (i = 0; i < count; i++) {
+	runBuffer[i] = CellChar(cellPtr + i);
+    }
+    mvaddchnstr(y, x, runBuffer, count);
+}
+
+static void
+CursesFill(dispPtr, x, y, cellPtr, count)
+    TkDisplay *dispPtr;
+    int x, y;
+    CtkCell *cellPtr;
+    int count;
+{
+    chtype ch = CellChar(cellPtr);
+    int i;
+
+    SetTerm(dispPtr);
+    GrowRunBuffer(count);
+    for (i = 0; i < count; i++) {
+	runBuffer[i] = ch;
+    }
+    mvaddchnstr(y, x, runBuffer, count);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * GrowRunBuffer --
+ *
+ *	Makes sure runBuffer can hold `count' characters.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory may be (re)allocated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+GrowRunBuffer(count)
+    int count;
+{
+    if (runBufferSize < count) {
+	if (runBuffer != NULL) {
+	    ckfree((char *) runBuffer);
+	}
+	runBufferSize = count;
+	runBuffer = (chtype *) ckalloc((unsigned) (runBufferSize
+		* sizeof(chtype)));
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CursesScroll --
+ *
+ *	Has curses scroll part of the terminal.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Curses' screen is updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+CursesScroll(dispPtr, top, bottom, dy)
+    TkDisplay *dispPtr;
+    int top, bottom;
+    int dy;
+{
+    SetTerm(dispPtr);
+    wsetscrreg(stdscr, top, bottom-1);
+    scrollok(stdscr, TRUE);
+    wscrl(stdscr, -dy);
+    scrollok(stdscr, FALSE);
+    wsetscrreg(stdscr, 0, dispPtr->height-1);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CursesSetCursor --
+ *
+ *	Positions (or hides) the cursor.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Curses' cursor is moved.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+CursesSetCursor(dispPtr, x, y, visible)
+    TkDisplay *dispPtr;
+    int x, y;
+    int visible;
+{
+    SetTerm(dispPtr);
+    if (visible) {
+	move(y, x);
+    }
+    curs_set(visible);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CursesFlush --
+ * CursesBell --
+ * CursesRedraw --
+ *
+ *	Update the terminal, ring its bell, or arrange for the
+ *	next update to redraw it completely.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output to the terminal.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+CursesFlush(dispPtr)
+    TkDisplay *dispPtr;
+{
+    SetTerm(dispPtr);
+    refresh();
+}
+
+static void
+CursesBell(dispPtr)
+    TkDisplay *dispPtr;
+{
+    SetTerm(dispPtr);
+    beep();
+}
+
+static void
+CursesRedraw(dispPtr)
+    TkDisplay *dispPtr;
+{
+    SetTerm(dispPtr);
+    clearok(stdscr, 1);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CursesRead --
+ *
+ *	Reads the keys waiting on the terminal and translates
+ *	them to key events.
+ *
+ * Results:
+ *	Returns the number of events stored at `eventPtr'.
+ *
+ * Side effects:
+ *	Input is consumed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+CursesRead(dispPtr, eventPtr, maxEvents)
+    TkDisplay *dispPtr;
+    Ctk_Event *eventPtr;
+    int maxEvents;
+{
+    Tcl_HashEntry *hPtr;
+    KeyCodeInfo *codePtr;
+    int key, numEvents;
+
+    SetTerm(dispPtr);
+    for (numEvents = 0; numEvents < maxEvents; numEvents++, eventPtr++) {
+	/*
+	 * The terminal is in no-delay mode, so once the keys
+	 * waiting have all been read getch returns ERR.  Without
+	 * no-delay mode only the first key can be read safely.
+	 */
+
+	key = getch();
+	if (key == ERR) {
+	    break;
+	}
+	hPtr = Tcl_FindHashEntry(&keyCodeTable, (char *) key);
+	if (hPtr) {
+	    codePtr = (KeyCodeInfo *) Tcl_GetHashValue(hPtr);
+	    eventPtr->u.key.sym = codePtr->sym;
+	    eventPtr->u.key.state = codePtr->modMask;
+	} else {
+	    eventPtr->u.key.sym = key;
+	    eventPtr->u.key.state = 0;
+	}
+	eventPtr->type = CTK_KEY_EVENT;
+#ifndef HAVE_NODELAY
+	numEvents++;
+	break;
+#endif
+    }
+    return numEvents;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CellChar --
+ *
+ *	Translates a cell to a curses character.
+ *
+ * Results:
+ *	Curses character (with attributes) to display for cell.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static chtype
+CellChar(cellPtr)
+    CtkCell *cellPtr;
+{
+    chtype ch;
+
+    switch (cellPtr->ch) {
+	case CTK_ACS_ULCORNER:	ch = ACS_ULCORNER;	break;
+	case CTK_ACS_LLCORNER:	ch = ACS_LLCORNER;	break;
+	case CTK_ACS_URCORNER:	ch = ACS_URCORNER;	break;
+	case CTK_ACS_LRCORNER:	ch = ACS_LRCORNER;	break;
+	case CTK_ACS_HLINE:	ch = ACS_HLINE;		break;
+	case CTK_ACS_VLINE:	ch = ACS_VLINE;		break;
+	case CTK_ACS_PLUS:	ch = ACS_PLUS;		break;
+	default:		ch = cellPtr->ch;	break;
+    }
+    return ch | styleAttributes[cellPtr->style];
+}
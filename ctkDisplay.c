@@ -1,7 +1,10 @@
 /* 
  * ctkDisplay.c (CTk) --
  *
- *	CTK display functions (hides all curses functions).
+ *	CTK display functions.  Drawing goes into a shadow screen
+ *	kept for each display, and the differences are handed to
+ *	the display's driver (see ctkCurses.c and ctkAnsi.c) when
+ *	the display is flushed.
  *
  * Copyright (c) 1994-1995 Cleveland Clinic Foundation
  *
@@ -14,15 +17,6 @@
 #include "tkPort.h"
 #include "tkInt.h"
 #include <sys/times.h>
-#ifdef HAVE_CURSES_H
-#  include <curses.h>
-#elif defined(HAVE_CURSES_CURSES_H)
-#  include <curses/curses.h>
-#elif defined(HAVE_CURSES_NCURSES_H)
-#  include <curses/ncurses.h>
-#elif defined(HAVE_NCURSES_NCURSES_H)
-#  include <ncurses/ncurses.h>
-#endif
 #ifdef CLK_TCK
 #   define MS_PER_CLOCK	(1000.0/CLK_TCK)
 #elif defined HZ
@@ -35,74 +29,49 @@
 #   define MS_PER_CLOCK	(1000.0/60)
 #endif
 
+#define SetDisplay(dispPtr)	(curDispPtr = (dispPtr))
+
 /*
- * Definitions for weak curses implementations.
+ * Macros for the most often used drawing operations.  Drawing
+ * goes into the shadow screen of the current display, and only
+ * reaches the display's driver when the display is flushed.
  */
+#define Move(x,y)	(curDispPtr->drawX = (x), curDispPtr->drawY = (y))
+#define PutChar(ch)	PutCell(curDispPtr, (ch))
+#define SetStyle(style)	(curDispPtr->drawStyle = (style))
 
-#ifndef ACS_ULCORNER
 /*
- * This curses does not define the alternate character set constants.
- * Define them locally.
+ * Macros to access the shadow screen of a display.
  */
-#   define ACS_ULCORNER    '+'
-#   define ACS_LLCORNER    '+'
-#   define ACS_URCORNER    '+'
-#   define ACS_LRCORNER    '+'
-#   define ACS_HLINE       '-'
-#   define ACS_VLINE       '|'
-#   define ACS_PLUS        '+'
-#endif /* ACS_ULCORNER */
+#define CellPtr(dispPtr,x,y)	((dispPtr)->cells + (y)*(dispPtr)->width + (x))
+#define CellsEqual(c1Ptr,c2Ptr) \
+	((c1Ptr)->ch == (c2Ptr)->ch && (c1Ptr)->style == (c2Ptr)->style)
 
-#ifndef HAVE_CURS_SET
 /*
- * Don't have curs_set() function - ignore it.
- *
- * The cursor gets pretty annoying, but haven't found any other
- * way to turn it off.
+ * When flushing, runs of changed cells separated by no more than
+ * RUN_GAP unchanged cells are sent to the driver as one run.
  */
-#   define curs_set(mode)	((void) 0)
-#endif
+#define RUN_GAP		4
 
-#ifndef A_STANDOUT
-    typedef int chtype;
-#   define attrset(attr)	((attr) ? standout() : standend())
-#   define A_STANDOUT	1
-#   define A_INVIS	0
-#   define A_NORMAL	0
-#   define A_UNDERLINE	0
-#   define A_REVERSE	0
-#   define A_DIM	0
-#   define A_BOLD	0
-#   define A_DIM	0
-#   define A_BOLD	0
-#   define A_REVERSE	0
-#endif
-
-#ifdef HAVE_SET_TERM
-#   define SetDisplay(dispPtr) \
-	if (curDispPtr != (dispPtr)) \
-	set_term((SCREEN *) (curDispPtr = (dispPtr))->display)
-#else
-#   define SetDisplay(dispPtr)		((void) 0)
-#   define newterm(type, outPtr, inPtr)	initscr()
-#endif
-
-#ifndef HAVE_KEYPAD
-#   define keypad(win, flag)		((void) 0)
-#endif
+/*
+ * Estimated cost, in cells, of the escape sequences needed to scroll
+ * part of the terminal (used by ScrollCells() to decide whether the
+ * terminal should scroll or have the cells redrawn).
+ */
+#define SCROLL_COST	16
 
-#ifndef HAVE_BEEP
-#   define beep()			((void) 0)
-#endif
+/*
+ * Size of an in-memory display if its type doesn't give one.
+ */
+#define MEM_WIDTH	80
+#define MEM_HEIGHT	24
 
 /*
- * Macros for the most often used curses operations.  This
- * will hopefully help if someone wants to convert to a different
- * terminal I/O library (like DOS BIOS?).
+ * Most key events a driver is asked to decode each time
+ * its terminal becomes readable.  All of them are handled
+ * before the display is next refreshed.
  */
-#define Move(x,y)		move(y,x)
-#define PutChar(ch)		addch(ch)
-#define SetStyle(style)		attrset(styleAttributes[style])
+#define MAX_READ_EVENTS	256
 
 
 /*
@@ -115,52 +84,81 @@ typedef struct {
 } TextInfo;
 
 /*
- * Curses attributes that correspond to CTk styles.
- * This definition must be modified in concert with
- * the Ctk_Style definition in tk.h
- */
-chtype styleAttributes[] = {
-    A_NORMAL, A_NORMAL, A_UNDERLINE, A_REVERSE, A_DIM, A_BOLD,
-    A_DIM, A_BOLD, A_STANDOUT, A_REVERSE
-};
-
-/*
- * Current display for input/output.  Changed by SetDisplay().
+ * Current display for drawing.  Changed by SetDisplay().
  */
 
 TkDisplay *curDispPtr = NULL;
 
-/*
- * The data structure and hash table below are used to map from
- * raw keycodes (curses) to keysyms and modifier masks.
- */
-
-typedef struct {
-    int code;			/* Curses key code. */
-    KeySym sym;			/* Key sym. */
-    int modMask;		/* Modifiers. */
-} KeyCodeInfo;
-
-static KeyCodeInfo keyCodeArray[] = {
-#include "keyCodes.h"
-    {0, 0, 0}
-};
-static Tcl_HashTable keyCodeTable;	/* Hashed form of above structure. */
-
 /*
  * Forward declarations of static functions.
  */
 
 static void		TermFileProc _ANSI_ARGS_((ClientData clientData,
 			    int mask));
+static CtkDisplayDriver *FindDriver _ANSI_ARGS_((char *name, int length));
+static int		DisplayExists _ANSI_ARGS_((TkDisplay *dispPtr));
 static void		RefreshDisplay _ANSI_ARGS_((TkDisplay *dispPtr));
+static int		MemInit _ANSI_ARGS_((Tcl_Interp *interp,
+			    TkDisplay *dispPtr));
+static void		MemNoOp _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		MemPutSpan _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, CtkCell *cellPtr, int count));
+static void		MemScroll _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int top, int bottom, int dy));
+static void		MemSetCursor _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int x, int y, int visible));
+static int		MemRead _ANSI_ARGS_((TkDisplay *dispPtr,
+			    Ctk_Event *eventPtr, int maxEvents));
+static void		InitCells _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int width, int height));
+static void		FreeCells _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		DamageCells _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int left, int right, int y));
+static void		PutCell _ANSI_ARGS_((TkDisplay *dispPtr, int ch));
+static void		PutSpan _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int left, int right, int y, char *str));
+static void		FillCells _ANSI_ARGS_((TkDisplay *dispPtr,
+			    int left, int right, int y, int ch));
+static void		FlushCells _ANSI_ARGS_((TkDisplay *dispPtr));
+static void		ScrollCells _ANSI_ARGS_((TkDisplay *dispPtr,
+			    Ctk_Rect *rectPtr, int dy));
 static void		DrawTextSpan _ANSI_ARGS_((int left, int right, int y,
 			    ClientData data));
 static void		FillSpan _ANSI_ARGS_((int left, int right, int y,
 			    ClientData data));
 
+/*
+ * The in-memory display driver: a screen with no terminal, whose
+ * contents exist only as the display's cells (for tests and
+ * benchmarks).
+ */
+
+static CtkDisplayDriver memDriver = {
+    "mem",
+    CTK_DEVICE_NONE,
+    MemInit,
+    MemNoOp,
+    MemPutSpan,
+    MemPutSpan,
+    MemScroll,
+    MemSetCursor,
+    MemNoOp,
+    MemNoOp,
+    MemNoOp,
+    MemRead,
+    NULL
+};
+
+/*
+ * All display drivers, for selecting one by name.
+ */
+
+static CtkDisplayDriver *driverTable[] = {
+    &ctkCursesDriver, &ctkAnsiDriver, &memDriver, NULL
+};
+
+
 
-
 /*
  *--------------------------------------------------------------
  *
@@ -168,7 +166,13 @@ static void		FillSpan _ANSI_ARGS_((int left, int right, int y,
  *
  *	Opens a connection to terminal with specified name,
  *	and stores terminal information in the display
- *	structure pointed to by `dispPtr'.
+ *	structure pointed to by `dispPtr'.  The name has the
+ *	form ?driver@?device?:type?.  If no driver is given,
+ *	a "mem" device uses the in-memory driver and other
+ *	devices use the driver named by the CTK_DRIVER
+ *	environment variable (curses by default).  The ansi
+ *	driver also accepts the name of a channel open in
+ *	`interp' (such as a socket) as the device.
  *
  * Results:
  *	Standard TCL result.
@@ -186,38 +190,55 @@ CtkDisplayInit(interp, dispPtr, termName)
     TkDisplay *dispPtr;
     char *termName;
 {
-    char *type;
-    int length;
-    FILE *outPtr;
-
-    int fd;			/* For the return value of Tcl_GetChannelHandle */
-    /* The Tcl_File is no longer needed, since Channels now subsume their work */
-
-    static int initialized = 0;
-
-    if (!initialized) {
-	register KeyCodeInfo *codePtr;
-	register Tcl_HashEntry *hPtr;
-	int dummy;
-
-	initialized = 1;
-	Tcl_InitHashTable(&keyCodeTable, TCL_ONE_WORD_KEYS);
-	for (codePtr = keyCodeArray; codePtr->code != 0; codePtr++) {
-	    hPtr = Tcl_CreateHashEntry(&keyCodeTable,
-	    	    (char *) codePtr->code, &dummy);
-	    Tcl_SetHashValue(hPtr, (ClientData) codePtr);
+    CtkDisplayDriver *driverPtr = NULL;
+    char *type, *device;
+    int length, isMem, isChannel;
+    ClientData handle;
+
+    device = strchr(termName, '@');
+    if (device != NULL) {
+	driverPtr = FindDriver(termName, device - termName);
+	if (driverPtr == NULL) {
+	    Tcl_AppendResult(interp, "bad driver in display name \"",
+		    termName, "\": must be curses, ansi, or mem",
+		    (char *) NULL);
+	    return TCL_ERROR;
 	}
+	termName = device + 1;
     }
 
     type = strchr(termName, ':');
     if (type == NULL) {
     	length = strlen(termName);
-    	type = getenv("CTK_TERM");
-	if (!type) type = getenv("TERM");
     } else {
 	length = type - termName;
 	type++;
     }
+    isMem = (strncmp(termName, "mem", 3) == 0)
+	    && (strspn(termName+3, "0123456789") == length-3);
+    if (type == NULL) {
+	if (isMem) {
+	    type = "";
+	} else {
+	    type = getenv("CTK_TERM");
+	    if (!type) type = getenv("TERM");
+	    if (!type) type = "";
+	}
+    }
+    if (driverPtr == NULL) {
+	if (isMem) {
+	    driverPtr = &memDriver;
+	} else if ((device = getenv("CTK_DRIVER")) != NULL) {
+	    driverPtr = FindDriver(device, strlen(device));
+	    if (driverPtr == NULL) {
+		Tcl_AppendResult(interp, "bad CTK_DRIVER \"", device,
+			"\": must be curses, ansi, or mem", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	} else {
+	    driverPtr = &ctkCursesDriver;
+	}
+    }
     dispPtr->type = (char *) ckalloc((unsigned) strlen(type) + 1);
     strcpy(dispPtr->type, type);
 
@@ -225,51 +246,60 @@ CtkDisplayInit(interp, dispPtr, termName)
     strncpy(dispPtr->name, termName, length);
     dispPtr->name[length] = '\0';
 
-    if (strcmp(dispPtr->name, "tty") == 0) {
-	dispPtr->chan = Tcl_GetStdChannel(TCL_STDIN);
-    } else {
-#ifdef HAVE_SET_TERM
-	dispPtr->chan = HAVE_SET_TERM ? Tcl_OpenFileChannel(interp, dispPtr->name, 
-							    "r+", 0) : NULL;
-#else
-	dispPtr->chan = NULL;
-#endif
-        if (dispPtr->chan == NULL) {
-	    Tcl_AppendResult(interp, "couldn't connect to device \"",
+    dispPtr->driverPtr = driverPtr;
+    dispPtr->display = NULL;
+    dispPtr->chan = NULL;
+    dispPtr->fd = -1;
+    dispPtr->inPtr = NULL;
+    dispPtr->outputBlocked = 0;
+    dispPtr->reportPastes = 0;
+    if (driverPtr->deviceKind != CTK_DEVICE_NONE) {
+	isChannel = 0;
+	if (strcmp(dispPtr->name, "tty") == 0) {
+	    dispPtr->chan = Tcl_GetStdChannel(TCL_STDIN);
+	} else if ((driverPtr->deviceKind == CTK_DEVICE_ANY)
+		&& ((dispPtr->chan = Tcl_GetChannel(interp, dispPtr->name,
+		(int *) NULL)) != NULL)) {
+	    /*
+	     * The device is a channel that is already open in the
+	     * application's interpreter, such as a socket accepted by
+	     * a server (see ctk_serve).
+	     */
+
+	    isChannel = 1;
+	} else {
+	    Tcl_ResetResult(interp);
+	    dispPtr->chan = Tcl_OpenFileChannel(interp, dispPtr->name,
+		    "r+", 0);
+	    if (dispPtr->chan == NULL) {
+		Tcl_ResetResult(interp);
+		Tcl_AppendResult(interp, "couldn't connect to device \"",
+			dispPtr->name, "\"", (char *) NULL);
+		goto error;
+	    }
+	}
+	if (Tcl_GetChannelHandle(dispPtr->chan, TCL_READABLE, &handle)
+		!= TCL_OK) {
+	    Tcl_AppendResult(interp, "couldn't get device handle for device \"",
 		    dispPtr->name, "\"", (char *) NULL);
 	    goto error;
 	}
+	dispPtr->fd = (int) (long) handle;
+	if (!isChannel && !isatty(dispPtr->fd)) {
+	    Tcl_AppendResult(interp, "display device \"", dispPtr->name,
+		    "\" is not a tty", (char *) NULL);
+	    goto error;
+	}
     }
-    if ( Tcl_GetChannelHandle(dispPtr->chan, TCL_READABLE, &(dispPtr->fd) ) != TCL_OK )
-    {
-    	Tcl_AppendResult(interp, "couldn't get device handle for device \"",
-    		dispPtr->name, "\"", (char *) NULL);
-        goto error;
-    }
-    
-    if (!isatty(dispPtr->fd)) {
-	Tcl_AppendResult(interp, "display device \"", dispPtr->name,
-		"\" is not a tty", (char *) NULL);
+    if ((*driverPtr->initProc)(interp, dispPtr) != TCL_OK) {
 	goto error;
     }
-    if (dispPtr->fd == 0) {
-	dispPtr->inPtr = stdin;
-	outPtr = stdout;
-    } else {
-	dispPtr->inPtr = fdopen(dispPtr->fd, "r+");
-	outPtr = dispPtr->inPtr;
-    }
-
-    dispPtr->display =
-	    (ClientData) newterm(dispPtr->type, outPtr, dispPtr->inPtr);
-    SetDisplay(dispPtr);
-    raw();
-    nonl();
-    noecho();
-    keypad(stdscr, TRUE);
+    InitCells(dispPtr, dispPtr->width, dispPtr->height);
 
-    Tcl_CreateChannelHandler(dispPtr->chan, TCL_READABLE,
-    	    TermFileProc, (ClientData) dispPtr);
+    if (dispPtr->chan != NULL) {
+	Tcl_CreateChannelHandler(dispPtr->chan, TCL_READABLE,
+		TermFileProc, (ClientData) dispPtr);
+    }
     return TCL_OK;
 
 error:
@@ -279,222 +309,923 @@ error:
     dispPtr->type = NULL;
     return TCL_ERROR;
 }
-
+
+/*
+ *--------------------------------------------------------------
+ *
+ * FindDriver --
+ *
+ *	Looks up a display driver by name.
+ *
+ * Results:
+ *	The driver whose name is the `length' characters at
+ *	`name', or NULL if there is none.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static CtkDisplayDriver *
+FindDriver(name, length)
+    char *name;
+    int length;
+{
+    CtkDisplayDriver **driverPtrPtr;
+
+    for (driverPtrPtr = driverTable; *driverPtrPtr != NULL;
+	    driverPtrPtr++) {
+	if ((strncmp((*driverPtrPtr)->name, name, length) == 0)
+		&& ((*driverPtrPtr)->name[length] == '\0')) {
+	    return *driverPtrPtr;
+	}
+    }
+    return NULL;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CtkDisplayEnd --
+ *
+ *	Ends CTk's use of terminal.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The terminal is restored to line mode.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CtkDisplayEnd(dispPtr)
+    TkDisplay *dispPtr;
+{
+    if (dispPtr->chan != NULL) {
+	Tcl_DeleteChannelHandler(dispPtr->chan,
+		TermFileProc, (ClientData) dispPtr);
+    }
+    (*dispPtr->driverPtr->endProc)(dispPtr);
+    FreeCells(dispPtr);
+    ckfree(dispPtr->name);
+    ckfree(dispPtr->type);
+    if (curDispPtr == dispPtr) {
+	curDispPtr = NULL;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Ctk_DisplayFlush --
+ *
+ *	Flushes all output to the specified display.  If dispPtr
+ *	is NULL then output to all connected displays is flushed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The terminal display is updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+Ctk_DisplayFlush(dispPtr)
+    TkDisplay *dispPtr;
+{
+    if (dispPtr) {
+	RefreshDisplay(dispPtr);
+    } else {
+    	for (dispPtr = tkDisplayList;
+    		dispPtr != (TkDisplay*) NULL;
+    		dispPtr = dispPtr->nextPtr) {
+	    RefreshDisplay(dispPtr);
+	}
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Ctk_DisplayRedraw --
+ *
+ *	Force a complete redraw of the specified display.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The entire terminal display is redrawn.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+Ctk_DisplayRedraw(dispPtr)
+    TkDisplay *dispPtr;
+{
+    (*dispPtr->driverPtr->redrawProc)(dispPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Ctk_SetCursor --
+ *
+ *	Postions display cursor in window at specified (local)
+ *	coordinates.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Modifies window's display structure.
+ *--------------------------------------------------------------
+ */
+
+void
+Ctk_SetCursor(winPtr, x, y)
+    TkWindow *winPtr;
+    int x, y;
+{
+    TkDisplay *dispPtr = Tk_Display(winPtr);
+    dispPtr->cursorPtr = winPtr;
+    dispPtr->cursorX = x;
+    dispPtr->cursorY = y;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * RefreshDisplay --
+ *
+ *	Sends the damaged parts of a display's shadow screen to
+ *	its driver, positions the cursor and updates the terminal.
+ *	While the driver's output is blocked this is put off (the
+ *	damage stays, so nothing is lost).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The terminal display is updated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+RefreshDisplay(dispPtr)
+    TkDisplay *dispPtr;
+{
+    TkWindow *winPtr = dispPtr->cursorPtr;
+    int x = 0, y = 0;
+    int visible = 0;
+
+    if (dispPtr->outputBlocked) {
+	if (CtkDisplayIsDamaged(dispPtr)) {
+	    dispPtr->numDeferred++;
+	}
+	return;
+    }
+    FlushCells(dispPtr);
+    if (CtkIsDisplayed(winPtr)) {
+	/*
+	 * Convert to absolute screen coordinates
+	 */
+	x = dispPtr->cursorX + winPtr->absLeft;
+	y = dispPtr->cursorY + winPtr->absTop;
+	if (y >= winPtr->maskRect.top
+		&& y < winPtr->maskRect.bottom
+		&& x >= winPtr->maskRect.left
+		&& x < winPtr->maskRect.right
+		&& CtkPointInRegion(x, y, winPtr->clipRgn) ) {
+	    visible = 1;
+	}
+    }
+    (*dispPtr->driverPtr->setCursorProc)(dispPtr, x, y, visible);
+    (*dispPtr->driverPtr->flushProc)(dispPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CtkDisplayBell --
+ *
+ *	Rings the terminal's bell.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Output to the terminal.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CtkDisplayBell(dispPtr)
+    TkDisplay *dispPtr;
+{
+    (*dispPtr->driverPtr->bellProc)(dispPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * MemInit --
+ *
+ *	Sets up an in-memory display.  The display's type gives
+ *	its size as "WIDTHxHEIGHT", each at most CTK_MAX_SIZE.
+ *
+ * Results:
+ *	Standard TCL result.
+ *
+ * Side effects:
+ *	The display's size is set.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+MemInit(interp, dispPtr)
+    Tcl_Interp *interp;
+    TkDisplay *dispPtr;
+{
+    int width = MEM_WIDTH;
+    int height = MEM_HEIGHT;
+    char extra;
+
+    if (dispPtr->type[0] != '\0'
+	    && (sscanf(dispPtr->type, "%dx%d%c", &width, &height, &extra) != 2
+	    || width <= 0 || height <= 0)) {
+	Tcl_AppendResult(interp, "bad size \"", dispPtr->type,
+		"\" for display \"", dispPtr->name,
+		"\": should be WIDTHxHEIGHT", (char *) NULL);
+	return TCL_ERROR;
+    }
+    if (CtkDisplayCheckSize(interp, dispPtr, width, height) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    dispPtr->width = width;
+    dispPtr->height = height;
+    return TCL_OK;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * MemNoOp --
+ * MemPutSpan --
+ * MemScroll --
+ * MemSetCursor --
+ * MemRead --
+ *
+ *	The remaining procedures of the in-memory driver.  There
+ *	is no terminal, so there is nothing for them to do: the
+ *	display's `shown' cells are its screen.
+ *
+ * Results:
+ *	MemRead returns 0 (there is never any input).
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+	/* ARGSUSED */
+static void
+MemNoOp(dispPtr)
+    TkDisplay *dispPtr;
+{
+}
+
+	/* ARGSUSED */
+static void
+MemPutSpan(dispPtr, x, y, cellPtr, count)
+    TkDisplay *dispPtr;
+    int x, y;
+    CtkCell *cellPtr;
+    int count;
+{
+}
+
+	/* ARGSUSED */
+static void
+MemScroll(dispPtr, top, bottom, dy)
+    TkDisplay *dispPtr;
+    int top, bottom;
+    int dy;
+{
+}
+
+	/* ARGSUSED */
+static void
+MemSetCursor(dispPtr, x, y, visible)
+    TkDisplay *dispPtr;
+    int x, y;
+    int visible;
+{
+}
+
+	/* ARGSUSED */
+static int
+MemRead(dispPtr, eventPtr, maxEvents)
+    TkDisplay *dispPtr;
+    Ctk_Event *eventPtr;
+    int maxEvents;
+{
+    return 0;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * Ctk_DisplayWidth --
+ * Ctk_DisplayHeight --
+ *
+ *	Get geometry of terminal.
+ *
+ * Results:
+ *	Size (width/height respectively) of terminal.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+Ctk_DisplayWidth(dispPtr)
+    TkDisplay *dispPtr;
+{
+    return dispPtr->width;
+}
+
+int
+Ctk_DisplayHeight(dispPtr)
+    TkDisplay *dispPtr;
+{
+    return dispPtr->height;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CtkDisplayDump --
+ *
+ *	Describes what is currently shown on a display (as of its
+ *	last flush), for tests and benchmarks.
+ *
+ * Results:
+ *	Sets the interpreter's result to a list with one element per
+ *	row of the display.  If `styles' is zero each element holds
+ *	the row's characters (line drawing characters are shown as
+ *	"+", "-" and "|"), otherwise it holds the style number of
+ *	each cell, one digit per cell.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+CtkDisplayDump(interp, dispPtr, styles)
+    Tcl_Interp *interp;
+    TkDisplay *dispPtr;
+    int styles;			/* Non-zero means dump cell styles
+				 * rather than characters. */
+{
+    char *row = (char *) ckalloc((unsigned) (dispPtr->width + 1));
+    CtkCell *cellPtr = dispPtr->shown;
+    int x, y, ch;
+
+    for (y = 0; y < dispPtr->height; y++) {
+	for (x = 0; x < dispPtr->width; x++, cellPtr++) {
+	    if (styles) {
+		ch = '0' + cellPtr->style;
+	    } else {
+		switch (cellPtr->ch) {
+		    case CTK_ACS_HLINE:	ch = '-';		break;
+		    case CTK_ACS_VLINE:	ch = '|';		break;
+		    default:
+			ch = (cellPtr->ch > UCHAR_MAX) ? '+' : cellPtr->ch;
+			break;
+		}
+	    }
+	    row[x] = (char) ch;
+	}
+	row[x] = '\0';
+	Tcl_AppendElement(interp, row);
+    }
+    ckfree(row);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * InitCells --
+ *
+ *	Allocates the shadow screen of a display and sets it to
+ *	match the (freshly cleared) terminal.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is allocated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+InitCells(dispPtr, width, height)
+    TkDisplay *dispPtr;
+    int width, height;		/* Size of display. */
+{
+    int numCells, i;
+
+    dispPtr->width = width;
+    dispPtr->height = height;
+    numCells = dispPtr->width * dispPtr->height;
+    dispPtr->cells = (CtkCell *) ckalloc((unsigned) (numCells
+	    * sizeof(CtkCell)));
+    dispPtr->shown = (CtkCell *) ckalloc((unsigned) (numCells
+	    * sizeof(CtkCell)));
+    memset((VOID *) dispPtr->cells, 0, numCells * sizeof(CtkCell));
+    for (i = 0; i < numCells; i++) {
+	dispPtr->cells[i].ch = ' ';
+	dispPtr->cells[i].style = CTK_PLAIN_STYLE;
+    }
+    memcpy((VOID *) dispPtr->shown, (VOID *) dispPtr->cells,
+	    numCells * sizeof(CtkCell));
+    dispPtr->damageLeft = (int *) ckalloc((unsigned) (dispPtr->height
+	    * sizeof(int)));
+    dispPtr->damageRight = (int *) ckalloc((unsigned) (dispPtr->height
+	    * sizeof(int)));
+    for (i = 0; i < dispPtr->height; i++) {
+	dispPtr->damageLeft[i] = dispPtr->width;
+	dispPtr->damageRight[i] = 0;
+    }
+    dispPtr->damageTop = dispPtr->height;
+    dispPtr->damageBottom = 0;
+    dispPtr->drawX = 0;
+    dispPtr->drawY = 0;
+    dispPtr->drawStyle = CTK_PLAIN_STYLE;
+    dispPtr->numFlushes = 0;
+    dispPtr->numCellsSent = 0;
+    dispPtr->lastCellsSent = 0;
+    dispPtr->numScrolls = 0;
+    dispPtr->numDeferred = 0;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * FreeCells --
+ *
+ *	Releases the shadow screen of a display.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+FreeCells(dispPtr)
+    TkDisplay *dispPtr;
+{
+    ckfree((char *) dispPtr->cells);
+    ckfree((char *) dispPtr->shown);
+    ckfree((char *) dispPtr->damageLeft);
+    ckfree((char *) dispPtr->damageRight);
+    dispPtr->cells = dispPtr->shown = NULL;
+    dispPtr->damageLeft = dispPtr->damageRight = NULL;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DamageCells --
+ *
+ *	Records that the cells from `left' to `right'-1 of row `y'
+ *	may no longer match what is shown on the terminal.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Damage area of display is expanded.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+DamageCells(dispPtr, left, right, y)
+    TkDisplay *dispPtr;
+    int left;
+    int right;
+    int y;
+{
+    if (left < dispPtr->damageLeft[y]) {
+	dispPtr->damageLeft[y] = left;
+    }
+    if (right > dispPtr->damageRight[y]) {
+	dispPtr->damageRight[y] = right;
+    }
+    if (y < dispPtr->damageTop) {
+	dispPtr->damageTop = y;
+    }
+    if (y >= dispPtr->damageBottom) {
+	dispPtr->damageBottom = y+1;
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * PutCell --
+ *
+ *	Stores a character, in the current drawing style, into
+ *	the shadow screen at the current drawing position, and
+ *	advances the drawing position.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The cell is damaged if its contents change.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+PutCell(dispPtr, ch)
+    TkDisplay *dispPtr;
+    int ch;
+{
+    int x = dispPtr->drawX++;
+    int y = dispPtr->drawY;
+    CtkCell *cellPtr;
+
+    if (x < 0 || x >= dispPtr->width || y < 0 || y >= dispPtr->height) {
+	return;
+    }
+    cellPtr = CellPtr(dispPtr, x, y);
+    if (cellPtr->ch != ch || cellPtr->style != dispPtr->drawStyle) {
+	cellPtr->ch = ch;
+	cellPtr->style = dispPtr->drawStyle;
+	DamageCells(dispPtr, x, x+1, y);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * PutSpan --
+ *
+ *	Stores the characters of a string, in the current drawing
+ *	style, into cells `left' to `right'-1 of row `y' of the
+ *	shadow screen.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The part of the span whose contents change is damaged.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+PutSpan(dispPtr, left, right, y, str)
+    TkDisplay *dispPtr;
+    int left;			/* First cell to store into. */
+    int right;			/* Cell after last one to store into. */
+    int y;			/* Row of cells. */
+    char *str;			/* Character for cell `left'. */
+{
+    unsigned char style = (unsigned char) dispPtr->drawStyle;
+    CtkCell *cellPtr;
+    int x, ch;
+    int first = -1, last = -1;
+
+    if (y < 0 || y >= dispPtr->height) {
+	return;
+    }
+    if (left < 0) {
+	str -= left;
+	left = 0;
+    }
+    if (right > dispPtr->width) {
+	right = dispPtr->width;
+    }
+    cellPtr = CellPtr(dispPtr, left, y);
+    for (x = left; x < right; x++, cellPtr++) {
+	ch = UCHAR(*str++);
+	if (cellPtr->ch != ch || cellPtr->style != style) {
+	    cellPtr->ch = ch;
+	    cellPtr->style = style;
+	    if (first < 0) {
+		first = x;
+	    }
+	    last = x;
+	}
+    }
+    if (first >= 0) {
+	DamageCells(dispPtr, first, last+1, y);
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
- * CtkDisplayEnd --
+ * FillCells --
  *
- *	Ends CTk's use of terminal.
+ *	Stores a character, in the current drawing style, into
+ *	cells `left' to `right'-1 of row `y' of the shadow screen.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	The terminal is restored to line mode.
+ *	The part of the span whose contents change is damaged.
  *
  *--------------------------------------------------------------
  */
 
-void
-CtkDisplayEnd(dispPtr)
+static void
+FillCells(dispPtr, left, right, y, ch)
     TkDisplay *dispPtr;
+    int left;			/* First cell to fill. */
+    int right;			/* Cell after last one to fill. */
+    int y;			/* Row of cells. */
+    int ch;			/* Character to fill with. */
 {
-    SetDisplay(dispPtr);
-    curs_set(1);
-    endwin();
+    unsigned char style = (unsigned char) dispPtr->drawStyle;
+    CtkCell *cellPtr;
+    int x;
+    int first = -1, last = -1;
 
-    Tcl_DeleteChannelHandler(dispPtr->chan,
-		TermFileProc, (ClientData) dispPtr);
-    if (dispPtr->inPtr != stdin) {
-    	fclose(dispPtr->inPtr);
+    if (y < 0 || y >= dispPtr->height) {
+	return;
+    }
+    if (left < 0) {
+	left = 0;
+    }
+    if (right > dispPtr->width) {
+	right = dispPtr->width;
+    }
+    cellPtr = CellPtr(dispPtr, left, y);
+    for (x = left; x < right; x++, cellPtr++) {
+	if (cellPtr->ch != ch || cellPtr->style != style) {
+	    cellPtr->ch = ch;
+	    cellPtr->style = style;
+	    if (first < 0) {
+		first = x;
+	    }
+	    last = x;
+	}
+    }
+    if (first >= 0) {
+	DamageCells(dispPtr, first, last+1, y);
     }
-    ckfree(dispPtr->name);
-    ckfree(dispPtr->type);
 }
-
+
 /*
  *--------------------------------------------------------------
  *
- * Ctk_DisplayFlush --
+ * FlushCells --
  *
- *	Flushes all output to the specified display.  If dispPtr
- *	is NULL then output to all connected displays is flushed.
+ *	Sends the cells in the damaged area of a display that
+ *	differ from what is on the terminal to the display's
+ *	driver.  Changed cells are gathered into runs, and each
+ *	run is handed to the driver with a single call (as a fill
+ *	if all its cells are the same).
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	The terminal display is updated.
+ *	The driver's screen is updated, and the display's damage
+ *	area is cleared.
  *
  *--------------------------------------------------------------
  */
 
-void
-Ctk_DisplayFlush(dispPtr)
+static void
+FlushCells(dispPtr)
     TkDisplay *dispPtr;
 {
-    if (dispPtr) {
-	RefreshDisplay(dispPtr);
-    } else {
-    	for (dispPtr = tkDisplayList;
-    		dispPtr != (TkDisplay*) NULL;
-    		dispPtr = dispPtr->nextPtr) {
-	    RefreshDisplay(dispPtr);
+    CtkDisplayDriver *driverPtr = dispPtr->driverPtr;
+    CtkCell *rowPtr, *shownRowPtr;
+    int x, y, right, runLeft, runRight, i;
+    int numSent = 0;
+
+    for (y = dispPtr->damageTop; y < dispPtr->damageBottom; y++) {
+	rowPtr = CellPtr(dispPtr, 0, y);
+	shownRowPtr = dispPtr->shown + (rowPtr - dispPtr->cells);
+	right = dispPtr->damageRight[y];
+	x = dispPtr->damageLeft[y];
+	while (x < right) {
+	    /*
+	     * Find the next changed cell, then extend the run over
+	     * following cells until RUN_GAP unchanged cells are seen.
+	     */
+
+	    for ( ; x < right; x++) {
+		if (!CellsEqual(rowPtr + x, shownRowPtr + x)) {
+		    break;
+		}
+	    }
+	    if (x >= right) {
+		break;
+	    }
+	    runLeft = x;
+	    runRight = x+1;
+	    for (x++; x < right && x - runRight < RUN_GAP; x++) {
+		if (!CellsEqual(rowPtr + x, shownRowPtr + x)) {
+		    runRight = x+1;
+		}
+	    }
+	    for (i = runLeft+1; i < runRight; i++) {
+		if (!CellsEqual(rowPtr + i, rowPtr + runLeft)) {
+		    break;
+		}
+	    }
+	    if (i == runRight && runRight - runLeft > 1) {
+		(*driverPtr->fillProc)(dispPtr, runLeft, y, rowPtr + runLeft,
+			runRight - runLeft);
+	    } else {
+		(*driverPtr->putSpanProc)(dispPtr, runLeft, y,
+			rowPtr + runLeft, runRight - runLeft);
+	    }
+	    numSent += runRight - runLeft;
+	    memcpy((VOID *) (shownRowPtr + runLeft),
+		    (VOID *) (rowPtr + runLeft),
+		    (runRight - runLeft) * sizeof(CtkCell));
+	    x = runRight;
 	}
+	dispPtr->damageLeft[y] = dispPtr->width;
+	dispPtr->damageRight[y] = 0;
+    }
+    dispPtr->damageTop = dispPtr->height;
+    dispPtr->damageBottom = 0;
+    if (numSent > 0) {
+	dispPtr->numFlushes++;
+	dispPtr->numCellsSent += numSent;
+	dispPtr->lastCellsSent = numSent;
     }
 }
-
+
 /*
  *--------------------------------------------------------------
  *
- * Ctk_DisplayRedraw --
+ * CtkDisplayForget --
  *
- *	Force a complete redraw of the specified display.
+ *	Called by a driver that is about to clear its terminal,
+ *	so that the next flush sends every cell that isn't blank.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	The entire terminal display is redrawn.
+ *	The display's `shown' cells are set to blanks, and the
+ *	whole display is damaged.
  *
  *--------------------------------------------------------------
  */
 
 void
-Ctk_DisplayRedraw(dispPtr)
+CtkDisplayForget(dispPtr)
     TkDisplay *dispPtr;
 {
-    SetDisplay(dispPtr);
-    clearok(stdscr, 1);
+    int numCells = dispPtr->width * dispPtr->height;
+    int i;
+
+    for (i = 0; i < numCells; i++) {
+	dispPtr->shown[i].ch = ' ';
+	dispPtr->shown[i].style = CTK_PLAIN_STYLE;
+    }
+    for (i = 0; i < dispPtr->height; i++) {
+	DamageCells(dispPtr, 0, dispPtr->width, i);
+    }
 }
-
+
 /*
  *--------------------------------------------------------------
  *
- * Ctk_SetCursor --
+ * CtkDisplayCheckSize --
  *
- *	Postions display cursor in window at specified (local)
- *	coordinates.
+ *	Called by a driver to check a size given in a display's
+ *	type (rather than reported by a terminal).
  *
  * Results:
- *	None.
+ *	Standard TCL result:  an error if either dimension is
+ *	more than CTK_MAX_SIZE.
  *
  * Side effects:
- *	Modifies window's display structure.
+ *	None.
+ *
  *--------------------------------------------------------------
  */
 
-void
-Ctk_SetCursor(winPtr, x, y)
-    TkWindow *winPtr;
-    int x, y;
-{
-    TkDisplay *dispPtr = Tk_Display(winPtr);
-    dispPtr->cursorPtr = winPtr;
-    dispPtr->cursorX = x;
-    dispPtr->cursorY = y;
-}
-
-static void
-RefreshDisplay(dispPtr)
+int
+CtkDisplayCheckSize(interp, dispPtr, width, height)
+    Tcl_Interp *interp;
     TkDisplay *dispPtr;
+    int width, height;
 {
-    TkWindow *winPtr = dispPtr->cursorPtr;
-    int x, y;
-    int visible = 0;
-
-    SetDisplay(dispPtr);
-    if (CtkIsDisplayed(winPtr)) {
-	/*
-	 * Convert to absolute screen coordinates
-	 */
-	x = dispPtr->cursorX + winPtr->absLeft;
-	y = dispPtr->cursorY + winPtr->absTop;
-	if (y >= winPtr->maskRect.top
-		&& y < winPtr->maskRect.bottom
-		&& x >= winPtr->maskRect.left
-		&& x < winPtr->maskRect.right
-		&& CtkPointInRegion(x, y, winPtr->clipRgn) ) {
-	    Move(x, y);
-	    visible = 1;
-	}
+    char buffer[30];
+
+    if (width > CTK_MAX_SIZE || height > CTK_MAX_SIZE) {
+	sprintf(buffer, "%d", CTK_MAX_SIZE);
+	Tcl_AppendResult(interp, "size \"", dispPtr->type,
+		"\" for display \"", dispPtr->name,
+		"\" is too big: width and height must be at most ",
+		buffer, (char *) NULL);
+	return TCL_ERROR;
     }
-    curs_set(visible);
-    refresh();
+    return TCL_OK;
 }
-
+
 /*
  *--------------------------------------------------------------
  *
- * CtkDisplayBell --
+ * CtkDisplayDrained --
  *
- *	Flushes all output to the terminal (otherwise drawing
- *	may be buffered).
+ *	Called by a driver when the terminal has accepted all
+ *	of its queued output, after having set `outputBlocked'.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	The terminal display is updated.
+ *	`outputBlocked' is cleared, and the display is brought
+ *	up to date with everything drawn since it was set.
  *
  *--------------------------------------------------------------
  */
 
 void
-CtkDisplayBell(dispPtr)
+CtkDisplayDrained(dispPtr)
     TkDisplay *dispPtr;
 {
-    SetDisplay(dispPtr);
-    beep();
+    dispPtr->outputBlocked = 0;
+    RefreshDisplay(dispPtr);
 }
-
+
 /*
  *--------------------------------------------------------------
  *
- * Ctk_DisplayWidth --
- * Ctk_DisplayHeight --
+ * CtkDisplayReadKeys --
  *
- *	Get geometry of terminal.
+ *	Called by a driver that has keys to report other than
+ *	when the terminal is readable (for instance, an ESC it
+ *	held on to in case more of a key sequence followed).
  *
  * Results:
- *	Size (width/height respectively) of terminal.
+ *	None.
  *
  * Side effects:
- *	None.
+ *	The driver's readProc is called, and the events it
+ *	returns are handled, just as when input arrives.
  *
  *--------------------------------------------------------------
  */
 
-int
-Ctk_DisplayWidth(dispPtr)
+void
+CtkDisplayReadKeys(dispPtr)
     TkDisplay *dispPtr;
 {
-    SetDisplay(dispPtr);
-    return COLS;
+    TermFileProc((ClientData) dispPtr, TCL_READABLE);
 }
 
-int
-Ctk_DisplayHeight(dispPtr)
-    TkDisplay *dispPtr;
-{
-    SetDisplay(dispPtr);
-    return LINES;
-}
-
 /*
  *--------------------------------------------------------------
  *
  * TermFileProc --
  *
- *	File handler for a terminal.
+ *	File handler for a terminal.  Has the display's driver
+ *	decode the waiting keystrokes, and dispatches them back
+ *	to back (the display is refreshed once, after the lot).
  *
  * Results:
- *	Returns TK_FILE_HANDLED if any events were processed.
- *	Otherwise returns TCL_READABLE.
+ *	None.
  *
  * Side effects:
- *	Dispatches events (invoking event handlers).
+ *	Dispatches events (invoking event handlers).  At end of
+ *	file, the applications on the display are destroyed.
  *
  *--------------------------------------------------------------
  */
@@ -505,32 +1236,95 @@ TermFileProc(clientData, mask)
     int mask;
 {
     TkDisplay *dispPtr = (TkDisplay *) clientData;
-    Ctk_Event event;
+    Ctk_Event events[MAX_READ_EVENTS];
     struct tms timesBuf;
-    Tcl_HashEntry *hPtr;
-    KeyCodeInfo *codePtr;
-    int key;
-
-    if ((mask & TCL_READABLE) == TCL_READABLE) {
-	SetDisplay(dispPtr);
-
-	key = getch();
-	hPtr = Tcl_FindHashEntry(&keyCodeTable, (char *) key);
-	if (hPtr) {
-	    codePtr = (KeyCodeInfo *) Tcl_GetHashValue(hPtr);
-	    event.u.key.sym = codePtr->sym;
-	    event.u.key.state = codePtr->modMask;
-	} else {
-	    event.u.key.sym = key;
-	    event.u.key.state = 0;
+    unsigned long time;
+    int numEvents, i;
+    TkMainInfo *mainPtr;
+
+    if ((mask & TCL_READABLE) != TCL_READABLE) {
+	return;
+    }
+    numEvents = (*dispPtr->driverPtr->readProc)(dispPtr, events,
+	    MAX_READ_EVENTS);
+    if (numEvents < 0) {
+	/*
+	 * End of file on the device (for instance, a remote terminal
+	 * has hung up): stop listening to it, and destroy each
+	 * application on the display, just as Tk does when it loses
+	 * its connection to an X server.  The display itself goes
+	 * away along with its last application.
+	 */
+
+	Tcl_DeleteChannelHandler(dispPtr->chan,
+		TermFileProc, (ClientData) dispPtr);
+	while (DisplayExists(dispPtr)) {
+	    for (mainPtr = tkMainWindowList; mainPtr != NULL;
+		    mainPtr = mainPtr->nextPtr) {
+		if (mainPtr->winPtr->dispPtr == dispPtr) {
+		    break;
+		}
+	    }
+	    if (mainPtr == NULL) {
+		break;
+	    }
+	    Tk_DestroyWindow(mainPtr->winPtr);
+	}
+	return;
+    }
+    time = (unsigned long) (times(&timesBuf)*MS_PER_CLOCK);
+    for (i = 0; i < numEvents; i++) {
+	/*
+	 * An event handler may have destroyed the display.
+	 */
+
+	if (DisplayExists(dispPtr)) {
+	    events[i].window = dispPtr->focusPtr;
+	    if (events[i].type == CTK_PASTE_EVENT) {
+		events[i].u.paste.time = time;
+	    } else {
+		events[i].u.key.time = time;
+	    }
+	    Tk_HandleEvent(&events[i]);
+	}
+	if (events[i].type == CTK_PASTE_EVENT) {
+	    ckfree(events[i].u.paste.string);
 	}
-	event.type = CTK_KEY_EVENT;
-	event.window = dispPtr->focusPtr;
-	event.u.key.time = (unsigned long) (times(&timesBuf)*MS_PER_CLOCK);
-	Tk_HandleEvent(&event);
     }
 }
-
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DisplayExists --
+ *
+ *	Checks whether a display is still open.
+ *
+ * Results:
+ *	Returns 1 if `dispPtr' is in the list of displays,
+ *	0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+DisplayExists(dispPtr)
+    TkDisplay *dispPtr;
+{
+    TkDisplay *listPtr;
+
+    for (listPtr = tkDisplayList; listPtr != NULL;
+	    listPtr = listPtr->nextPtr) {
+	if (listPtr == dispPtr) {
+	    return 1;
+	}
+    }
+    return 0;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -665,12 +1459,8 @@ DrawTextSpan(left, right, y, data)
     ClientData data;		/* Points at TextInfo structure. */
 {
     char *charPtr = ((TextInfo*) data)->str + left - ((TextInfo*) data)->left;
-    int x;
 
-    Move(left, y);
-    for (x=left; x < right; x++) {
-	PutChar(UCHAR(*charPtr++));
-    }
+    PutSpan(curDispPtr, left, right, y, charPtr);
 }
 
 /*
@@ -792,6 +1582,190 @@ Ctk_FillRect(winPtr, x1, y1, x2, y2, fillStyle, fillChar)
     }
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * Ctk_ScrollRect --
+ *
+ *	Shift the contents of the rectangle (x1,y1) to (x2-1,y2-1)
+ *	in `winPtr' (relative coordinates) down by `dy' lines (up if
+ *	`dy' is negative).  Lines shifted out of the rectangle are
+ *	lost, and the lines shifted away from are left as they were
+ *	(the caller must redraw them).
+ *
+ *	The rectangle must be fully visible, since otherwise it
+ *	could contain parts of other windows.
+ *
+ * Results:
+ *	Returns 1 if the contents were shifted, 0 if the caller
+ *	must redraw the whole rectangle instead.
+ *
+ * Side effects:
+ *	The terminal may be scrolled at the next flush.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+Ctk_ScrollRect(winPtr, x1, y1, x2, y2, dy)
+    TkWindow *winPtr;
+    int x1;
+    int y1;
+    int x2;
+    int y2;
+    int dy;
+{
+    Ctk_Rect rect;
+
+    if (!CtkIsDisplayed(winPtr)) {
+	return 0;
+    }
+    CtkSetRect(&rect, x1, y1, x2, y2);
+    CtkMoveRect(&rect, winPtr->absLeft, winPtr->absTop);
+    if (CtkSpanIsEmpty(rect.left, rect.right)
+	    || CtkSpanIsEmpty(rect.top, rect.bottom)) {
+	return 1;
+    }
+    if (rect.left < winPtr->clipRect.left
+	    || rect.right > winPtr->clipRect.right
+	    || rect.top < winPtr->clipRect.top
+	    || rect.bottom > winPtr->clipRect.bottom
+	    || !CtkRegionContainsRect(winPtr->clipRgn, &rect)) {
+	return 0;
+    }
+    if (dy >= rect.bottom - rect.top || -dy >= rect.bottom - rect.top) {
+	/*
+	 * Nothing left to shift.
+	 */
+
+	return 1;
+    }
+    if (dy != 0) {
+	SetDisplay(winPtr->dispPtr);
+	ScrollCells(winPtr->dispPtr, &rect, dy);
+    }
+    return 1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * ScrollCells --
+ *
+ *	Shift the cells of a rectangle of the shadow screen down by
+ *	`dy' lines (up if negative).  If it looks cheaper than
+ *	redrawing the shifted cells, the terminal is scrolled too;
+ *	since terminals scroll whole lines, that also shifts the
+ *	cells to the left and right of the rectangle, which are
+ *	then repaired when the display is flushed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The shadow screen and (possibly) curses' screen are changed,
+ *	and the rectangle's lines are damaged.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+ScrollCells(dispPtr, rectPtr, dy)
+    TkDisplay *dispPtr;
+    Ctk_Rect *rectPtr;		/* Area to scroll, in absolute
+				 * coordinates.  Must be on screen. */
+    int dy;			/* Distance to shift, non-zero and
+				 * less than the height of the area. */
+{
+    int top = rectPtr->top;
+    int bottom = rectPtr->bottom;
+    int left = rectPtr->left;
+    int right = rectPtr->right;
+    int width = dispPtr->width;
+    int redrawCost = 0;		/* Cells to send if terminal doesn't
+				 * scroll. */
+    int scrollCost = SCROLL_COST;
+				/* Cells to send if terminal scrolls. */
+    CtkCell *newPtr, *shownPtr, *oldShownPtr;
+    int x, y, first, last, step;
+
+    /*
+     * Compare what each shifted line would have to show against
+     * what the terminal shows there now, and against what the
+     * terminal would show there after scrolling.
+     */
+
+    for (y = top; y < bottom; y++) {
+	if (y - dy < top || y - dy >= bottom) {
+	    continue;
+	}
+	shownPtr = dispPtr->shown + y*width;
+	oldShownPtr = dispPtr->shown + (y-dy)*width;
+	for (x = 0; x < width; x++) {
+	    if (x >= left && x < right) {
+		newPtr = CellPtr(dispPtr, x, y-dy);
+		if (!CellsEqual(newPtr, shownPtr + x)) {
+		    redrawCost++;
+		}
+	    } else {
+		newPtr = CellPtr(dispPtr, x, y);
+	    }
+	    if (!CellsEqual(newPtr, oldShownPtr + x)) {
+		scrollCost++;
+	    }
+	}
+    }
+
+    /*
+     * Shift the cells, working away from the lines being shifted
+     * into so that no line is overwritten before it is copied.
+     */
+
+    if (dy > 0) {
+	first = bottom - 1;
+	last = top + dy - 1;
+	step = -1;
+    } else {
+	first = top;
+	last = bottom + dy;
+	step = 1;
+    }
+    for (y = first; y != last; y += step) {
+	memcpy((VOID *) CellPtr(dispPtr, left, y),
+		(VOID *) CellPtr(dispPtr, left, y-dy),
+		(right - left) * sizeof(CtkCell));
+    }
+
+    if (dispPtr->driverPtr->scrollProc != NULL && scrollCost < redrawCost
+	    && !dispPtr->outputBlocked) {
+	(*dispPtr->driverPtr->scrollProc)(dispPtr, top, bottom, dy);
+	dispPtr->numScrolls++;
+
+	for (y = first; y != last; y += step) {
+	    memcpy((VOID *) (dispPtr->shown + y*width),
+		    (VOID *) (dispPtr->shown + (y-dy)*width),
+		    width * sizeof(CtkCell));
+	}
+
+	/*
+	 * The terminal blanks the lines scrolled away from.
+	 */
+
+	for ( ; y >= top && y < bottom; y += step) {
+	    shownPtr = dispPtr->shown + y*width;
+	    for (x = 0; x < width; x++) {
+		shownPtr[x].ch = ' ';
+		shownPtr[x].style = CTK_PLAIN_STYLE;
+	    }
+	}
+	left = 0;
+	right = width;
+    }
+    for (y = top; y < bottom; y++) {
+	DamageCells(dispPtr, left, right, y);
+    }
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -817,12 +1791,7 @@ FillSpan(left, right, y, data)
     int y;			/* Y coordinate to draw at. */
     ClientData data;		/* Character to draw. */
 {
-    int x;
-
-    Move(left, y);
-    for (x=left; x < right; x++) {
-	PutChar((int) data);
-    }
+    FillCells(curDispPtr, left, right, y, (int) data);
 }
 
 /*
@@ -865,10 +1834,10 @@ Ctk_DrawRect(winPtr, x1, y1, x2, y2, lineStyle)
     SetDisplay(winPtr->dispPtr);
     SetStyle(lineStyle);
 
-    Ctk_DrawCharacter(winPtr, x1, y1, lineStyle, ACS_ULCORNER);
-    Ctk_DrawCharacter(winPtr, x2, y1, lineStyle, ACS_URCORNER);
-    Ctk_DrawCharacter(winPtr, x1, y2, lineStyle, ACS_LLCORNER);
-    Ctk_DrawCharacter(winPtr, x2, y2, lineStyle, ACS_LRCORNER);
+    Ctk_DrawCharacter(winPtr, x1, y1, lineStyle, CTK_ACS_ULCORNER);
+    Ctk_DrawCharacter(winPtr, x2, y1, lineStyle, CTK_ACS_URCORNER);
+    Ctk_DrawCharacter(winPtr, x1, y2, lineStyle, CTK_ACS_LLCORNER);
+    Ctk_DrawCharacter(winPtr, x2, y2, lineStyle, CTK_ACS_LRCORNER);
 
     /* Convert to screen coordinates */
     x1 += winPtr->absLeft;
@@ -885,13 +1854,13 @@ Ctk_DrawRect(winPtr, x1, y1, x2, y2, lineStyle)
     if (!CtkSpanIsEmpty(left, right)) {
 	if ((clipRectPtr->top <= y1) && (clipRectPtr->bottom > y1)) {
 	    CtkForEachIntersectingSpan(
-		FillSpan, (ClientData) ACS_HLINE,
+		FillSpan, (ClientData) CTK_ACS_HLINE,
 		left, right, y1,
 		winPtr->clipRgn);
 	}
 	if ((clipRectPtr->top <= y2) && (clipRectPtr->bottom > y2)) {
 	    CtkForEachIntersectingSpan(
-		FillSpan, (ClientData) ACS_HLINE,
+		FillSpan, (ClientData) CTK_ACS_HLINE,
 		left, right, y2,
 		winPtr->clipRgn);
 	}
@@ -907,7 +1876,7 @@ Ctk_DrawRect(winPtr, x1, y1, x2, y2, lineStyle)
 	for (y=top; y < bottom; y++) {
 	    if (CtkPointInRegion(x1, y, winPtr->clipRgn)) {
 		Move(x1, y);
-		PutChar(ACS_VLINE);
+		PutChar(CTK_ACS_VLINE);
 	    }
 	}
     }
@@ -915,7 +1884,7 @@ Ctk_DrawRect(winPtr, x1, y1, x2, y2, lineStyle)
 	for (y=top; y < bottom; y++) {
 	    if (CtkPointInRegion(x2, y, winPtr->clipRgn)) {
 		Move(x2, y);
-		PutChar(ACS_VLINE);
+		PutChar(CTK_ACS_VLINE);
 	    }
 	}
     }
@@ -568,6 +568,53 @@ CtkPointInRegion(x, y, rgnPtr)
     return 0;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * CtkRegionContainsRect -- check if rectangle is contained in region
+ *
+ *	Check if every point of `rectPtr' is in the region `rgnPtr'.
+ *	Assumes that touching spans of the region have been merged
+ *	(so each scan line of the rectangle must lie within a single
+ *	span).
+ *
+ * Results:
+ *	Returns 1 if rectangle is in region, otherwise returns 0.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+CtkRegionContainsRect(rgnPtr, rectPtr)
+    CtkRegion *rgnPtr;
+    Ctk_Rect *rectPtr;
+{
+    RegionSpan *spans = rgnPtr->spans;
+    int y;
+    int idx;
+
+    if (rectPtr->top < rgnPtr->top || rectPtr->bottom > rgnPtr->bottom) {
+	return 0;
+    }
+    for (y = rectPtr->top; y < rectPtr->bottom; y++) {
+	for (idx = y - rgnPtr->top; idx != NO_SPAN; idx = spans[idx].next) {
+	    if (spans[idx].left > rectPtr->left) {
+		return 0;
+	    }
+	    if (spans[idx].right >= rectPtr->right) {
+		break;
+	    }
+	}
+	if (idx == NO_SPAN) {
+	    return 0;
+	}
+    }
+    return 1;
+}
+
 /*
  *----------------------------------------------------------------------
  *
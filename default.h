@@ -137,16 +137,22 @@
  * Defaults for texts:
  */
 
+#define DEF_TEXT_AUTO_SEPARATORS	"1"
 #define DEF_TEXT_BORDER_WIDTH		"1"
+#define DEF_TEXT_FILE			""
 #define DEF_TEXT_HEIGHT			"10"
+#define DEF_TEXT_MAX_UNDO_BYTES		"1000000"
 #define DEF_TEXT_PADX			"0"
 #define DEF_TEXT_PADY			"0"
+#define DEF_TEXT_READONLY		"0"
 #define DEF_TEXT_SPACING1		"0"
 #define DEF_TEXT_SPACING2		"0"
 #define DEF_TEXT_SPACING3		"0"
 #define DEF_TEXT_STATE			"normal"
+#define DEF_TEXT_SYNC_COMMAND		""
 #define DEF_TEXT_TABS			""
 #define DEF_TEXT_TAKE_FOCUS		(char *) NULL
+#define DEF_TEXT_UNDO			"0"
 #define DEF_TEXT_WIDTH			"40"
 #define DEF_TEXT_WRAP			"char"
 #define DEF_TEXT_XSCROLL_COMMAND	""
@@ -55,6 +55,12 @@ bind Entry <KeyPress> {
     if [tkEntryInsert %W %A] break
 }
 
+# Pasted text arrives all at once if "ctk paste" is on.
+
+bind Entry <Paste> {
+    tkEntryInsert %W %A
+}
+
 # Ignore all Alt, Meta, and Control keypresses unless explicitly bound.
 # Otherwise, if a widget binding for one of these is defined, the
 # <KeyPress> class binding will also fire and insert the character,
@@ -0,0 +1,142 @@
+# serve.tcl --
+#
+# This file defines procedures that let one process run many CTk
+# applications, each on a remote terminal connected by a socket.
+#
+# @(#) $Id: ctk.shar,v 1.50 1996/01/15 14:47:16 andrewm Exp andrewm $
+#
+# See the file "license.terms" for information on usage and redistribution
+# of this file, and for a DISCLAIMER OF ALL WARRANTIES.
+#
+
+# ctk_serve --
+# Listens for terminals connecting to a TCP port.  Each connection
+# becomes the display (driven by the ansi driver) of a new application,
+# which runs in a slave interpreter of its own that loads Tk and then
+# evaluates a script.  The application ends, and its interpreter is
+# deleted, when the terminal hangs up or when "." is destroyed (the
+# application's "exit" does this rather than ending the process).
+# Only terminals on the local host can connect unless -myaddr says
+# otherwise, and once -maxclients applications are running (0 means
+# no limit) further terminals are told so and disconnected.
+# Returns the server socket, which can be closed to stop accepting
+# terminals.
+#
+# Arguments:
+# args -	?-myaddr addr? ?-maxclients n? ?-size widthxheight? port script
+
+proc ctk_serve args {
+    global ctkServe
+    set myaddr 127.0.0.1
+    set max 0
+    set size 80x24
+    while {[llength $args] > 2} {
+	set option [lindex $args 0]
+	set value [lindex $args 1]
+	set args [lrange $args 2 end]
+	switch -- $option {
+	    -myaddr {set myaddr $value}
+	    -maxclients {
+		if {[catch {incr value 0}] || ($value < 0)} {
+		    error "bad -maxclients \"$value\": must be a\
+			    non-negative integer"
+		}
+		set max $value
+	    }
+	    -size {set size $value}
+	    default {
+		error "bad option \"$option\": must be -myaddr,\
+			-maxclients or -size"
+	    }
+	}
+    }
+    if {[llength $args] != 2} {
+	error "wrong # args: should be \"ctk_serve ?-myaddr addr?\
+		?-maxclients n? ?-size widthxheight? port script\""
+    }
+    if ![info exists ctkServe(servers)] {
+	set ctkServe(servers) 0
+    }
+    set id [incr ctkServe(servers)]
+    set ctkServe(clients,$id) 0
+    set command [list ctkServeAccept $id $max $size [lindex $args 1]]
+    return [socket -server $command -myaddr $myaddr [lindex $args 0]]
+}
+
+# ctkServeAccept --
+# This procedure is invoked when a terminal connects to a server
+# started by ctk_serve.  It creates the terminal's application.
+#
+# Arguments:
+# id -		Identifies the server, for counting its applications.
+# max -		Most applications the server may run at once, or 0.
+# size -	Size of the remote terminal (e.g. 80x24).
+# script -	Script to evaluate in the new application.
+# chan -	Socket connected to the terminal.
+# addr, port -	Address and port of the terminal.
+
+proc ctkServeAccept {id max size script chan addr port} {
+    global ctkServe env tk_library
+
+    fconfigure $chan -translation binary -buffering none
+    if {($max > 0) && ($ctkServe(clients,$id) >= $max)} {
+	catch {puts $chan "Too many terminals are connected.\r"}
+	close $chan
+	return
+    }
+    set slave [interp create]
+    interp transfer {} $chan $slave
+    $slave eval [list set tk_library $tk_library]
+    $slave eval [list set argv0 ctk_serve]
+    $slave eval {set argv {}; set argc 0}
+
+    # Tk takes its display from CTK_DISPLAY, which is shared by all
+    # the interpreters in the process; put it back once Tk has the
+    # terminal.
+
+    set saved [array get env CTK_DISPLAY]
+    set env(CTK_DISPLAY) ansi@$chan:$size
+    set code [catch {load {} Tk $slave} msg]
+    unset env(CTK_DISPLAY)
+    array set env $saved
+    if $code {
+	catch {puts $chan "$msg\r"}
+	interp delete $slave
+	return
+    }
+    incr ctkServe(clients,$id)
+    interp alias $slave exit {} ctkServeExit $slave
+    interp alias $slave ctkServeDone {} ctkServeDone $id $slave
+    $slave eval {bind . <Destroy> {+if {"%W" == "."} ctkServeDone}}
+    if [catch {$slave eval $script} msg] {
+	catch {$slave eval [list tkerror $msg]}
+    }
+}
+
+# ctkServeExit --
+# Replaces "exit" in an application started by ctk_serve: ends the
+# application without ending the process.
+#
+# Arguments:
+# slave -	The application's interpreter.
+# args -	Exit status (ignored).
+
+proc ctkServeExit {slave args} {
+    $slave eval {destroy .}
+}
+
+# ctkServeDone --
+# This procedure is invoked when the main window of an application
+# started by ctk_serve is destroyed.  It deletes the interpreter once
+# the destruction is over.
+#
+# Arguments:
+# id -		Identifies the server that started the application.
+# slave -	The application's interpreter.
+
+proc ctkServeDone {id slave} {
+    global ctkServe
+
+    incr ctkServe(clients,$id) -1
+    after idle [list catch [list interp delete $slave]]
+}
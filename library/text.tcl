@@ -103,6 +103,12 @@ bind Text <KeyPress> {
     if [tkTextInsert %W %A] break
 }
 
+# Pasted text arrives all at once if "ctk paste" is on.
+
+bind Text <Paste> {
+    tkTextInsert %W %A
+}
+
 # Ignore all Alt, Meta, and Control keypresses unless explicitly bound.
 # Otherwise, if a widget binding for one of these is defined, the
 # <KeyPress> class binding will also fire and insert the character,
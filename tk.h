@@ -74,7 +74,7 @@ typedef enum {
 typedef enum {
     CTK_MAP_EVENT, CTK_UNMAP_EVENT, CTK_EXPOSE_EVENT,
     CTK_FOCUS_EVENT, CTK_UNFOCUS_EVENT, CTK_KEY_EVENT,
-    CTK_DESTROY_EVENT, CTK_UNSUPPORTED_EVENT
+    CTK_DESTROY_EVENT, CTK_PASTE_EVENT, CTK_UNSUPPORTED_EVENT
 } Ctk_EventType;
 
 /*
@@ -87,6 +87,7 @@ typedef enum {
 #define CTK_KEY_EVENT_MASK		(1<<3)
 #define CTK_DESTROY_EVENT_MASK		(1<<4)
 #define CTK_UNSUPPORTED_EVENT_MASK	(1<<5)
+#define CTK_PASTE_EVENT_MASK		(1<<6)
 
 /*
  * Various X11 definitions to ease porting of Tk code.
@@ -144,6 +145,14 @@ typedef struct Ctk_Event {
 	    unsigned int state;		/* Modifier key mask. */
 	    Time time;			/* When key was pressed. */
 	} key;
+	struct {
+	    char *string;		/* Text pasted (null-terminated).
+					 * Malloc-ed by the display driver;
+					 * freed after the event is
+					 * handled. */
+	    int length;			/* Bytes in `string'. */
+	    Time time;			/* When paste arrived. */
+	} paste;
 	Ctk_Rect expose;		/* Rectangle to redraw. */
     } u;
 } Ctk_Event, XEvent;
@@ -201,6 +210,8 @@ EXTERN void         Ctk_FillRect _ANSI_ARGS_((Tk_Window tkwin,
 			int x1, int y1, int x2, int y2,
 			Ctk_Style style, int ch));
 EXTERN void         Ctk_ClearWindow _ANSI_ARGS_((Tk_Window tkwin));
+EXTERN int          Ctk_ScrollRect _ANSI_ARGS_((Tk_Window tkwin,
+			int x1, int y1, int x2, int y2, int dy));
 EXTERN void	    Ctk_DrawBorder _ANSI_ARGS_((Tk_Window, Ctk_Style,
 			char *title));
 EXTERN void	    Ctk_SetCursor _ANSI_ARGS_((Tk_Window, int x, int y));
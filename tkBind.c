@@ -304,6 +304,7 @@ static EventInfo eventArray[] = {
     {"Destroy",		CTK_DESTROY_EVENT,	CTK_DESTROY_EVENT_MASK},
     {"Gravity",		CTK_UNSUPPORTED_EVENT,	CTK_UNSUPPORTED_EVENT_MASK},
     {"Map",		CTK_MAP_EVENT,		CTK_MAP_EVENT_MASK},
+    {"Paste",		CTK_PASTE_EVENT,	CTK_PASTE_EVENT_MASK},
     {"Reparent",	CTK_UNSUPPORTED_EVENT,	CTK_UNSUPPORTED_EVENT_MASK},
     {"Unmap",		CTK_UNMAP_EVENT,	CTK_MAP_EVENT_MASK},
     {"Visibility",	CTK_UNSUPPORTED_EVENT,	CTK_UNSUPPORTED_EVENT_MASK},
@@ -1658,6 +1659,8 @@ ExpandPercents(winPtr, before, eventPtr, keySym, dsPtr)
 	    case 't':
 		if (eventPtr->type == CTK_KEY_EVENT) {
 		    number = (int) eventPtr->u.key.time;
+		} else if (eventPtr->type == CTK_PASTE_EVENT) {
+		    number = (int) eventPtr->u.paste.time;
 		}
 		goto doNumber;
 	    case 'w':
@@ -1690,6 +1693,9 @@ ExpandPercents(winPtr, before, eventPtr, keySym, dsPtr)
 		    } else {
 			numStorage[0] = '\0';
 		    }
+		} else if (eventPtr->type == CTK_PASTE_EVENT) {
+		    string = eventPtr->u.paste.string;
+		    goto doString;
 		}
 		string = numStorage;
 		goto doString;
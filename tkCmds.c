@@ -30,7 +30,16 @@ static void		WaitWindowProc _ANSI_ARGS_((ClientData clientData,
 
 static int		GetFocusOk _ANSI_ARGS_((Tcl_Interp *interp,
 			    TkWindow *winPtr, int *flagPtr));
+static int		RefreshCmd _ANSI_ARGS_((Tcl_Interp *interp,
+			    int argc, char **argv));
 static char error_buffer[200];
+
+/*
+ * The frame rate last given to "ctk refresh -maxrate", reported back
+ * as it was given rather than derived from ctkRefreshInterval.
+ */
+
+static int refreshRate = 0;
 
 /*
  *----------------------------------------------------------------------
@@ -1444,7 +1453,54 @@ Ctk_CtkCmd(clientData, interp, argc, argv)
     }
     c = argv[1][0];
     length = strlen(argv[1]);
-    if ((c == 'r') && (strncmp(argv[1], "redraw", length) == 0)) {
+    if ((c == 'd') && (strncmp(argv[1], "dump", length) == 0)) {
+	Tk_Window tkwin;
+	int styles = 0;
+
+	if ((argc == 4) && (strcmp(argv[3], "-styles") == 0)) {
+	    styles = 1;
+	} else if (argc != 3) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " dump window ?-styles?\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	tkwin = Tk_NameToWindow(interp, argv[2], mainWin);
+	if (tkwin == NULL) {
+	    return TCL_ERROR;
+	}
+	CtkDisplayDump(interp, Tk_Display(tkwin), styles);
+    } else if ((c == 'p') && (strncmp(argv[1], "paste", length) == 0)) {
+	Tk_Window tkwin;
+	TkDisplay *dispPtr;
+	int on;
+
+	if ((argc != 3) && (argc != 4)) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " paste window ?boolean?\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	tkwin = Tk_NameToWindow(interp, argv[2], mainWin);
+	if (tkwin == NULL) {
+	    return TCL_ERROR;
+	}
+	dispPtr = Tk_Display(tkwin);
+	if (argc == 4) {
+	    if (Tcl_GetBoolean(interp, argv[3], &on) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if (dispPtr->driverPtr->pasteProc == NULL) {
+		Tcl_AppendResult(interp, "the ", dispPtr->driverPtr->name,
+			" driver can't report pastes", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	    if (on != dispPtr->reportPastes) {
+		(*dispPtr->driverPtr->pasteProc)(dispPtr, on);
+		dispPtr->reportPastes = on;
+	    }
+	}
+	Tcl_SetResult(interp, dispPtr->reportPastes ? "1" : "0", TCL_STATIC);
+    } else if ((c == 'r') && (strncmp(argv[1], "redraw", length) == 0)
+	    && (length >= 3)) {
 	Tk_Window tkwin;
 	if (argc != 3) {
 	    Tcl_AppendResult(interp, "wrong # args: should be \"",
@@ -1456,11 +1512,119 @@ Ctk_CtkCmd(clientData, interp, argc, argv)
 	    return TCL_ERROR;
 	}
         Ctk_DisplayRedraw(Tk_Display(tkwin));
+    } else if ((c == 'r') && (strncmp(argv[1], "refresh", length) == 0)
+	    && (length >= 3)) {
+	return RefreshCmd(interp, argc, argv);
+    } else if ((c == 's') && (strncmp(argv[1], "stats", length) == 0)) {
+	Tk_Window tkwin;
+	TkDisplay *dispPtr;
+	char buffer[200];
+
+	if ((argc != 3) && ((argc != 4) || (strcmp(argv[3], "-reset") != 0))) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " stats window ?-reset?\"", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	tkwin = Tk_NameToWindow(interp, argv[2], mainWin);
+	if (tkwin == NULL) {
+	    return TCL_ERROR;
+	}
+	dispPtr = Tk_Display(tkwin);
+	sprintf(buffer,
+		"-flushes %d -cells %ld -lastcells %d -scrolls %d -deferred %d",
+		dispPtr->numFlushes, dispPtr->numCellsSent,
+		dispPtr->lastCellsSent, dispPtr->numScrolls,
+		dispPtr->numDeferred);
+	Tcl_SetResult(interp, buffer, TCL_VOLATILE);
+	if (argc == 4) {
+	    dispPtr->numFlushes = 0;
+	    dispPtr->numCellsSent = 0;
+	    dispPtr->lastCellsSent = 0;
+	    dispPtr->numScrolls = 0;
+	    dispPtr->numDeferred = 0;
+	}
     } else {
 	Tcl_AppendResult(interp, "bad option \"", argv[1],
-		"\": must be redraw", (char *) NULL);
+		"\": must be dump, paste, redraw, refresh, or stats",
+		(char *) NULL);
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RefreshCmd --
+ *
+ *	This procedure is invoked to process the "ctk refresh" command,
+ *	which queries or sets how often displays are brought up to date
+ *	(see Tk_DoOneEvent).
+ *
+ * Results:
+ *	A standard Tcl result.  With no options, the result is a list
+ *	of the current settings.
+ *
+ * Side effects:
+ *	Refresh scheduling may be changed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RefreshCmd(interp, argc, argv)
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings. */
+{
+    int i, rate;
+    size_t length;
+    char buffer[100];
+
+    if (argc == 2) {
+	sprintf(buffer, "-maxrate %d -policy %s",
+		refreshRate,
+		(ctkRefreshPolicy == CTK_REFRESH_EVENT) ? "event" : "drained");
+	Tcl_SetResult(interp, buffer, TCL_VOLATILE);
+	return TCL_OK;
+    }
+    if (argc % 2) {
+	Tcl_AppendResult(interp, "wrong # args: should be \"",
+		argv[0], " refresh ?-maxrate framesPerSecond? ",
+		"?-policy drained|event?\"", (char *) NULL);
 	return TCL_ERROR;
     }
+    for (i = 2; i < argc; i += 2) {
+	length = strlen(argv[i]);
+	if ((length >= 2) && (strncmp(argv[i], "-maxrate", length) == 0)) {
+	    if (Tcl_GetInt(interp, argv[i+1], &rate) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if (rate < 0) {
+		Tcl_AppendResult(interp, "bad rate \"", argv[i+1],
+			"\": must be a non-negative integer", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	    refreshRate = rate;
+	    ctkRefreshInterval = (rate > 0) ? (1000 + rate - 1)/rate : 0;
+	} else if ((length >= 2)
+		&& (strncmp(argv[i], "-policy", length) == 0)) {
+	    length = strlen(argv[i+1]);
+	    if (strncmp(argv[i+1], "drained", length) == 0) {
+		ctkRefreshPolicy = CTK_REFRESH_DRAINED;
+	    } else if (strncmp(argv[i+1], "event", length) == 0) {
+		ctkRefreshPolicy = CTK_REFRESH_EVENT;
+	    } else {
+		Tcl_AppendResult(interp, "bad policy \"", argv[i+1],
+			"\": must be drained or event", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	} else {
+	    Tcl_AppendResult(interp, "bad option \"", argv[i],
+		    "\": must be -maxrate or -policy", (char *) NULL);
+	    return TCL_ERROR;
+	}
+    }
     return TCL_OK;
 }
 
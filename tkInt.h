@@ -22,6 +22,112 @@
 #endif
 #include <tcl.h>
 
+/*
+ * Each display keeps a shadow copy of the screen made up of the
+ * following structures, one per character cell (see ctkDisplay.c).
+ */
+
+typedef struct CtkCell {
+    unsigned short ch;		/* Character in cell (line drawing
+				 * characters use private codes). */
+    unsigned char style;	/* Ctk_Style to display character in. */
+} CtkCell;
+
+/*
+ * Line drawing characters are kept in cells as the following codes
+ * (outside the range of 8-bit characters), and are translated to
+ * the terminal's characters by the display driver.
+ */
+
+#define CTK_ACS_ULCORNER	0x100
+#define CTK_ACS_LLCORNER	0x101
+#define CTK_ACS_URCORNER	0x102
+#define CTK_ACS_LRCORNER	0x103
+#define CTK_ACS_HLINE		0x104
+#define CTK_ACS_VLINE		0x105
+#define CTK_ACS_PLUS		0x106
+
+/*
+ * The procedures below make up a display driver: the code that puts
+ * a display's cells on a particular kind of terminal and reads its
+ * keystrokes.  ctkDisplay.c calls them when displays are opened,
+ * flushed and closed.  Cell arguments point into the display's
+ * `cells'.
+ */
+
+typedef int (CtkDriverInitProc) _ANSI_ARGS_((Tcl_Interp *interp,
+	TkDisplay *dispPtr));
+typedef void (CtkDriverProc) _ANSI_ARGS_((TkDisplay *dispPtr));
+typedef void (CtkDriverSpanProc) _ANSI_ARGS_((TkDisplay *dispPtr,
+	int x, int y, CtkCell *cellPtr, int count));
+typedef void (CtkDriverScrollProc) _ANSI_ARGS_((TkDisplay *dispPtr,
+	int top, int bottom, int dy));
+typedef void (CtkDriverCursorProc) _ANSI_ARGS_((TkDisplay *dispPtr,
+	int x, int y, int visible));
+typedef int (CtkDriverReadProc) _ANSI_ARGS_((TkDisplay *dispPtr,
+	Ctk_Event *eventPtr, int maxEvents));
+typedef void (CtkDriverPasteProc) _ANSI_ARGS_((TkDisplay *dispPtr,
+	int on));
+
+typedef struct CtkDisplayDriver {
+    char *name;			/* Name used to select driver in a display
+				 * name ("driver@device:type"). */
+    int deviceKind;		/* What the display's device, opened before
+				 * `initProc' is called, must be: see
+				 * below. */
+    CtkDriverInitProc *initProc;
+				/* Sets up the terminal and stores the
+				 * display's size in `width' and `height'. */
+    CtkDriverProc *endProc;	/* Restores the terminal. */
+    CtkDriverSpanProc *putSpanProc;
+				/* Puts `count' cells at (x,y). */
+    CtkDriverSpanProc *fillProc;
+				/* Puts `count' copies of one cell at
+				 * (x,y). */
+    CtkDriverScrollProc *scrollProc;
+				/* Shifts rows `top' to `bottom'-1 of the
+				 * terminal down by `dy' (up if negative),
+				 * blanking the rows left behind.  NULL
+				 * if the terminal can't scroll. */
+    CtkDriverCursorProc *setCursorProc;
+				/* Places (or hides) the cursor. */
+    CtkDriverProc *flushProc;	/* Sends everything put since the last
+				 * flush to the terminal. */
+    CtkDriverProc *bellProc;	/* Rings the terminal's bell. */
+    CtkDriverProc *redrawProc;	/* Arranges for the next flush to redraw
+				 * the whole terminal. */
+    CtkDriverReadProc *readProc;/* Called when the device is readable.
+				 * Decodes up to `maxEvents' key (and
+				 * paste) events into `eventPtr' and
+				 * returns how many. */
+    CtkDriverPasteProc *pasteProc;
+				/* Turns reporting of pastes as paste
+				 * events on or off.  NULL if the terminal
+				 * can't report them. */
+} CtkDisplayDriver;
+
+/*
+ * Values for the `deviceKind' field of CtkDisplayDriver:
+ *
+ * CTK_DEVICE_NONE -		The driver doesn't use a device.
+ * CTK_DEVICE_TTY -		The device must be a terminal.
+ * CTK_DEVICE_ANY -		The device may be any channel, such as
+ *				a socket attached to a remote terminal.
+ */
+
+#define CTK_DEVICE_NONE		0
+#define CTK_DEVICE_TTY		1
+#define CTK_DEVICE_ANY		2
+
+/*
+ * Largest width or height of a display, in cells.  A size given in a
+ * display's type is checked against it, so that the cell arrays (width
+ * times height cells) can't overflow;  a terminal reporting more is
+ * given the default size.
+ */
+
+#define CTK_MAX_SIZE		4096
+
 /*
  * One of the following structures is maintained for each display
  * containing a window managed by Tk:
@@ -33,13 +139,43 @@ struct TkDisplay {
      */
     char *name;			/* Name of display device. Malloc-ed. */
     char *type;			/* Device type. Malloc-ed. */
-    ClientData display;		/* Curses's info about display. */
+    CtkDisplayDriver *driverPtr;/* Driver for the display's terminal. */
+    ClientData display;		/* Driver's info about display. */
     Tcl_Channel chan;		/* Input channel for the device */
     int fd;			/* Input file descriptor for device. */
     FILE *inPtr;		/* Input file pointer for device. */
     TkWindow *cursorPtr;	/* Window to display cursor in. */
     int cursorX, cursorY;	/* Position in `cursWinPtr' to display
 				 * cursor. */
+    int width, height;		/* Size of display in character cells. */
+    CtkCell *cells;		/* Screen contents as drawn by CTk (`width'
+				 * by `height' cells, row by row).
+				 * Malloc-ed. */
+    CtkCell *shown;		/* Screen contents as last sent to the
+				 * terminal.  Malloc-ed. */
+    int *damageLeft;		/* For each row, the span of columns that */
+    int *damageRight;		/* may differ between `cells' and `shown'.
+				 * Empty if left >= right.  Malloc-ed. */
+    int damageTop, damageBottom;/* Rows that may have damage (bottom is
+				 * exclusive). */
+    int drawX, drawY;		/* Cell to draw next character into. */
+    Ctk_Style drawStyle;	/* Style to draw characters in. */
+    int numFlushes;		/* Flushes that sent cells to the display. */
+    long numCellsSent;		/* Total cells sent to the display. */
+    int lastCellsSent;		/* Cells sent by the most recent flush
+				 * that sent any. */
+    int numScrolls;		/* Times the display was scrolled rather
+				 * than redrawn. */
+    int reportPastes;		/* Non-zero means the driver has been asked
+				 * to report pastes as paste events. */
+    int numDeferred;		/* Refreshes put off because of
+				 * `outputBlocked'. */
+    int outputBlocked;		/* Set by the driver while the terminal
+				 * has yet to accept earlier output.
+				 * Refreshes are put off until the driver
+				 * calls CtkDisplayDrained, so that the
+				 * frames drawn meanwhile are sent as
+				 * one. */
 
     /*
      * Maintained by tkWindow.c
@@ -158,6 +294,20 @@ extern void			(*tkDelayedEventProc) _ANSI_ARGS_((void));
 extern Tk_Uid			tkDisabledUid;
 extern TkMainInfo		*tkMainWindowList;
 extern Tk_Uid			tkNormalUid;
+extern int			ctkRefreshPolicy;
+extern int			ctkRefreshInterval;
+
+/*
+ * Values for ctkRefreshPolicy:
+ *
+ * CTK_REFRESH_DRAINED		Refresh displays when no more events
+ *				are ready to be handled.
+ * CTK_REFRESH_EVENT		Refresh displays before and after
+ *				every event.
+ */
+
+#define CTK_REFRESH_DRAINED	0
+#define CTK_REFRESH_EVENT	1
 
 /*
  * Internal procedures shared among Tk modules but not exported
@@ -207,6 +357,8 @@ extern void		TkQueueEvent _ANSI_ARGS_((TkDisplay *dispPtr,
 extern void		TkDeleteMain _ANSI_ARGS_((TkMainInfo *mainPtr));
 
 #define CtkIsDisplayed(tkwin)	(((tkwin)->flags)& CTK_DISPLAYED)
+#define CtkDisplayIsDamaged(dispPtr) \
+	((dispPtr)->damageTop < (dispPtr)->damageBottom)
 
 typedef void (CtkSpanProc) _ANSI_ARGS_((int left, int right, int y,
 	ClientData data));
@@ -225,6 +377,16 @@ EXTERN int		CtkDisplayInit _ANSI_ARGS_((Tcl_Interp *interp,
 			    TkDisplay *dispPtr, char *displayName));
 EXTERN void		CtkDisplayEnd _ANSI_ARGS_((TkDisplay *dispPtr));
 EXTERN void		CtkDisplayBell _ANSI_ARGS_((TkDisplay *dispPtr));
+EXTERN int		CtkDisplayCheckSize _ANSI_ARGS_((Tcl_Interp *interp,
+			    TkDisplay *dispPtr, int width, int height));
+EXTERN void		CtkDisplayDump _ANSI_ARGS_((Tcl_Interp *interp,
+			    TkDisplay *dispPtr, int styles));
+EXTERN void		CtkDisplayForget _ANSI_ARGS_((TkDisplay *dispPtr));
+EXTERN void		CtkDisplayDrained _ANSI_ARGS_((TkDisplay *dispPtr));
+EXTERN void		CtkDisplayReadKeys _ANSI_ARGS_((TkDisplay *dispPtr));
+
+EXTERN CtkDisplayDriver	ctkCursesDriver;
+EXTERN CtkDisplayDriver	ctkAnsiDriver;
 
 EXTERN void         CtkSetFocus _ANSI_ARGS_((TkWindow *winPtr));
 EXTERN void	    Ctk_Forget _ANSI_ARGS_((Tk_Window tkwin));
@@ -252,5 +414,7 @@ EXTERN void	    CtkRegionGetRect _ANSI_ARGS_((CtkRegion *rgn,
 			Ctk_Rect *rect_ptr));
 EXTERN int	    CtkPointInRegion _ANSI_ARGS_((int x, int y,
 			CtkRegion *rgn));
+EXTERN int	    CtkRegionContainsRect _ANSI_ARGS_((CtkRegion *rgn,
+			Ctk_Rect *rect_ptr));
 
 #endif  /* _TKINT */
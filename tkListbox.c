@@ -69,6 +69,10 @@ typedef struct {
 				 * window. */
     int numLines;		/* Actual number of lines (elements) that 
 				 * currently fit in window. */
+    int drawnTopIndex;		/* Value of topIndex when window was last
+				 * drawn, or -1 if the window's contents
+				 * must be redrawn from scratch.  Used to
+				 * scroll rather than redraw lines. */
 
     /*
      * Information to support horizontal scrolling:
@@ -267,6 +271,7 @@ Tk_ListboxCmd(clientData, interp, argc, argv)
     listPtr->height = 0;
     listPtr->topIndex = 0;
     listPtr->numLines = 1;
+    listPtr->drawnTopIndex = -1;
     listPtr->maxWidth = 0;
     listPtr->xOffset = 0;
     listPtr->selectMode = NULL;
@@ -846,7 +851,7 @@ DisplayListbox(clientData)
     int height = Tk_Height(tkwin);
     int yCurs = listPtr->borderWidth;		/* Vertical position for
 						 * cursor. */
-    int i, x, y, limit;
+    int i, x, y, limit, offset;
 
     listPtr->flags &= ~REDRAW_PENDING;
     if (listPtr->flags & UPDATE_V_SCROLLBAR) {
@@ -860,6 +865,22 @@ DisplayListbox(clientData)
 	return;
     }
 
+    /*
+     * If the view has been scrolled since the listbox was last drawn,
+     * shift the lines that are still visible to their new position
+     * (redrawing them below then leaves them unchanged, so the terminal
+     * can scroll rather than redraw them).
+     */
+
+    offset = listPtr->drawnTopIndex - listPtr->topIndex;
+    if ((listPtr->drawnTopIndex >= 0) && (offset != 0)
+	    && (offset < listPtr->numLines) && (-offset < listPtr->numLines)) {
+	Ctk_ScrollRect(tkwin, listPtr->borderWidth, listPtr->borderWidth,
+		width - listPtr->borderWidth,
+		listPtr->borderWidth + listPtr->numLines, offset);
+    }
+    listPtr->drawnTopIndex = listPtr->topIndex;
+
     /*
      * Draw background.
      */
@@ -1218,6 +1239,7 @@ ListboxEventProc(clientData, eventPtr)
     Listbox *listPtr = (Listbox *) clientData;
 
     if (eventPtr->type == CTK_EXPOSE_EVENT) {
+	listPtr->drawnTopIndex = -1;
 	ListboxRedrawRange(listPtr,
 		NearestListboxElement(listPtr, eventPtr->u.expose.top),
 		NearestListboxElement(listPtr, eventPtr->u.expose.bottom));
@@ -1233,6 +1255,7 @@ ListboxEventProc(clientData, eventPtr)
 	}
 	Tk_EventuallyFree((ClientData) listPtr, DestroyListbox);
     } else if (eventPtr->type == CTK_MAP_EVENT) {
+	listPtr->drawnTopIndex = -1;
 	listPtr->numLines = Tk_Height(listPtr->tkwin) - 2*listPtr->borderWidth;
 	listPtr->flags |= UPDATE_V_SCROLLBAR|UPDATE_H_SCROLLBAR;
 	ChangeListboxView(listPtr, listPtr->topIndex);
@@ -50,6 +50,9 @@
 #include <string.h>
 #include <sys/types.h>
 #include <sys/file.h>
+#ifdef HAVE_SYS_MMAN_H
+#   include <sys/mman.h>
+#endif
 #ifdef HAVE_SYS_SELECT_H
 #   include <sys/select.h>
 #endif
@@ -151,9 +154,9 @@ extern int errno;
 #ifdef OLDTCL
 #define open(a,b,c) TclOpen(a,b,c)
 #define read(a,b,c) TclRead(a,b,c)
+#define write(a,b,c) TclWrite(a,b,c)
 #endif
 #define waitpid(a,b,c) TclWaitpid(a,b,c)
-#define write(a,b,c) TclWrite(a,b,c)
 EXTERN int	TclOpen _ANSI_ARGS_((char *path, int oflag, mode_t mode));
 EXTERN int	TclRead _ANSI_ARGS_((int fd, VOID *buf,
 		    unsigned int numBytes));
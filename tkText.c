@@ -28,16 +28,25 @@
  */
 
 static Tk_ConfigSpec configSpecs[] = {
+    {TK_CONFIG_BOOLEAN, "-autoseparators", "autoSeparators",
+	"AutoSeparators", DEF_TEXT_AUTO_SEPARATORS,
+	Tk_Offset(TkText, autoSeparators), 0},
     {TK_CONFIG_SYNONYM, "-bd", "borderWidth", (char *) NULL,
 	(char *) NULL, 0, 0},
     {TK_CONFIG_PIXELS, "-borderwidth", "borderWidth", "BorderWidth",
 	DEF_TEXT_BORDER_WIDTH, Tk_Offset(TkText, borderWidth), 0},
+    {TK_CONFIG_STRING, "-file", "file", "File",
+	DEF_TEXT_FILE, Tk_Offset(TkText, fileName), TK_CONFIG_NULL_OK},
     {TK_CONFIG_PIXELS, "-height", "height", "Height",
 	DEF_TEXT_HEIGHT, Tk_Offset(TkText, height), 0},
+    {TK_CONFIG_INT, "-maxundobytes", "maxUndoBytes", "MaxUndoBytes",
+	DEF_TEXT_MAX_UNDO_BYTES, Tk_Offset(TkText, maxUndoBytes), 0},
     {TK_CONFIG_PIXELS, "-padx", "padX", "Pad",
 	DEF_TEXT_PADX, Tk_Offset(TkText, padX), 0},
     {TK_CONFIG_PIXELS, "-pady", "padY", "Pad",
 	DEF_TEXT_PADY, Tk_Offset(TkText, padY), 0},
+    {TK_CONFIG_BOOLEAN, "-readonly", "readOnly", "ReadOnly",
+	DEF_TEXT_READONLY, Tk_Offset(TkText, readOnly), 0},
     {TK_CONFIG_PIXELS, "-spacing1", "spacing1", "Spacing",
 	DEF_TEXT_SPACING1, Tk_Offset(TkText, spacing1),
 	TK_CONFIG_DONT_SET_DEFAULT},
@@ -49,11 +58,16 @@ static Tk_ConfigSpec configSpecs[] = {
 	TK_CONFIG_DONT_SET_DEFAULT},
     {TK_CONFIG_UID, "-state", "state", "State",
 	DEF_TEXT_STATE, Tk_Offset(TkText, state), 0},
+    {TK_CONFIG_STRING, "-synccommand", "syncCommand", "SyncCommand",
+	DEF_TEXT_SYNC_COMMAND, Tk_Offset(TkText, syncCmd),
+	TK_CONFIG_NULL_OK},
     {TK_CONFIG_STRING, "-tabs", "tabs", "Tabs",
 	DEF_TEXT_TABS, Tk_Offset(TkText, tabOptionString), TK_CONFIG_NULL_OK},
     {TK_CONFIG_STRING, "-takefocus", "takeFocus", "TakeFocus",
 	DEF_TEXT_TAKE_FOCUS, Tk_Offset(TkText, takeFocus),
 	TK_CONFIG_NULL_OK},
+    {TK_CONFIG_BOOLEAN, "-undo", "undo", "Undo",
+	DEF_TEXT_UNDO, Tk_Offset(TkText, undo), 0},
     {TK_CONFIG_INT, "-width", "width", "Width",
 	DEF_TEXT_WIDTH, Tk_Offset(TkText, width), 0},
     {TK_CONFIG_UID, "-wrap", "wrap", "Wrap",
@@ -68,6 +82,119 @@ static Tk_ConfigSpec configSpecs[] = {
 	(char *) NULL, 0, 0}
 };
 
+/*
+ * The structure below holds an exact search pattern compiled by
+ * CompileExact.  Lines whose matches aren't all needed remember up
+ * to STATIC_MATCHES matches without allocating.
+ */
+
+typedef struct ExactPattern {
+    unsigned char *string;	/* The pattern, folded to lower case if case
+				 * is to be ignored.  Null-terminated. */
+    int length;			/* Number of characters in pattern. */
+    unsigned char fold[256];	/* Maps each character to the one it is
+				 * compared as (its lower-case form if case
+				 * is to be ignored, else itself). */
+    int shift[256];		/* How far to move the pattern along the
+				 * text for each character (see
+				 * CompileExact). */
+    unsigned char staticString[64];
+				/* Space for short patterns. */
+} ExactPattern;
+
+#define STATIC_MATCHES 16
+
+/*
+ * When -undo is on, each insertion and deletion is recorded in a
+ * structure of the following type.  The changes that can be undone are
+ * kept in a list from oldest to newest;  changes that have been undone
+ * move to a stack of changes that can be redone.  An insertion that
+ * continues the one before it (as when typing) and a deletion next to
+ * the one before it (as when backspacing) are merged into the record
+ * for the earlier change, so there's one record per run of typing
+ * rather than one per keystroke.
+ */
+
+typedef struct TkTextUndo {
+    int type;			/* UNDO_INSERT or UNDO_DELETE. */
+    int group;			/* Non-zero means this is the first change
+				 * in a group of changes that are undone
+				 * and redone together. */
+    int line, charIndex;	/* Where the change starts:  index of the
+				 * line (0 for the first line) and of the
+				 * character within it. */
+    int endLine, endChar;	/* For an insertion, the position just
+				 * after the inserted characters.  Not used
+				 * for deletions. */
+    int length;			/* Number of characters inserted or
+				 * deleted. */
+    int space;			/* Number of bytes allocated at chars. */
+    char *chars;		/* The characters inserted or deleted,
+				 * null-terminated (malloc'ed). */
+    struct TkTextUndo *prevPtr;	/* Next older change that can be undone,
+				 * or NULL.  Not used in the redo stack. */
+    struct TkTextUndo *nextPtr;	/* Next newer change that can be undone,
+				 * or NULL;  in the redo stack, the change
+				 * to be redone after this one. */
+} TkTextUndo;
+
+#define UNDO_INSERT	1
+#define UNDO_DELETE	2
+
+/*
+ * The "dump" widget command keeps its state in a structure of the
+ * following type while it walks through the text.
+ */
+
+typedef struct DumpInfo {
+    Tcl_Interp *interp;		/* Interpreter for results and callbacks. */
+    TkText *textPtr;		/* Text being dumped. */
+    int what;			/* OR-ed combination of DUMP_TEXT, DUMP_MARK,
+				 * and DUMP_TAG:  what is to be dumped. */
+    char *command;		/* Value of -command switch, or NULL. */
+    Tcl_Channel chan;		/* Channel given with -channel, or NULL. */
+    int chunk;			/* Value of -chunk switch:  most characters
+				 * in a "text" item, or 0 to end them at
+				 * line ends instead. */
+    Tcl_DString text;		/* Characters gathered for the next "text"
+				 * item. */
+    int textLine, textChar;	/* Position of the first character in
+				 * text. */
+} DumpInfo;
+
+#define DUMP_TEXT	1
+#define DUMP_MARK	2
+#define DUMP_TAG	4
+
+/*
+ * While a text is being loaded from a channel by the "load" widget
+ * command, information about the load is kept in a structure of the
+ * following type.  The channel is read LOAD_BLOCK_SIZE characters at a
+ * time;  with -async, blocks are read for at most LOAD_SLICE_USECS
+ * microseconds before the text is redisplayed and other events are
+ * handled.
+ */
+
+#define LOAD_BLOCK_SIZE		65536
+#define LOAD_SLICE_USECS	20000
+
+typedef struct TkTextLoad {
+    Tcl_Channel chan;		/* Channel being read. */
+    int async;			/* Non-zero means -async was given. */
+    int first;			/* Non-zero means nothing has been added to
+				 * the text yet. */
+    char *command;		/* Value of -command switch (malloc'ed), or
+				 * NULL. */
+    char *error;		/* Message for a read error (malloc'ed), or
+				 * NULL. */
+    int numChars;		/* Number of characters in buffer that
+				 * haven't been added to the text yet:  the
+				 * start of a line whose end hasn't been
+				 * read. */
+    char buffer[LOAD_BLOCK_SIZE + 1];
+				/* Characters read from chan. */
+} TkTextLoad;
+
 /*
  * Tk_Uid's used to represent text states:
  */
@@ -89,21 +216,80 @@ int tkTextDebug = 0;
  * Forward declarations for procedures defined later in this file:
  */
 
+static void		AddUndoChars _ANSI_ARGS_((TkText *textPtr,
+			    TkTextUndo *undoPtr, char *string,
+			    int length, int atStart));
+static void		AdjustForSegments _ANSI_ARGS_((TkTextLine *linePtr,
+			    int *charPtr, int *lengthPtr));
+static void		AppendChars _ANSI_ARGS_((TkText *textPtr,
+			    char *string, int maxLines));
+static void		ApplyUndo _ANSI_ARGS_((TkText *textPtr,
+			    TkTextUndo *undoPtr, int redo));
+static void		CompileExact _ANSI_ARGS_((ExactPattern *patPtr,
+			    char *pattern, int noCase));
 static int		ConfigureText _ANSI_ARGS_((Tcl_Interp *interp,
 			    TkText *textPtr, int argc, char **argv, int flags));
 static int		DeleteChars _ANSI_ARGS_((TkText *textPtr,
 			    char *index1String, char *index2String));
 static void		DestroyText _ANSI_ARGS_((ClientData clientData));
+static int		DumpFlush _ANSI_ARGS_((DumpInfo *dumpPtr,
+			    int *calledPtr));
+static int		DumpItem _ANSI_ARGS_((DumpInfo *dumpPtr, char *key,
+			    char *value, int lineNum, int charIndex));
+static int		DumpLine _ANSI_ARGS_((DumpInfo *dumpPtr,
+			    TkTextLine **linePtrPtr, int lineNum, int first,
+			    int last, int *calledPtr));
+static int		DumpText _ANSI_ARGS_((DumpInfo *dumpPtr, int lineNum,
+			    int charIndex, char *chars, int length,
+			    int *countPtr, int *calledPtr));
+static void		EndLoad _ANSI_ARGS_((TkText *textPtr, int closing,
+			    int notify));
+static void		FreeExact _ANSI_ARGS_((ExactPattern *patPtr));
+static void		FreeUndo _ANSI_ARGS_((TkText *textPtr,
+			    TkTextUndo *undoPtr));
+static void		GetChars _ANSI_ARGS_((TkTextIndex *index1Ptr,
+			    TkTextIndex *index2Ptr, Tcl_DString *dsPtr));
 static void		InsertChars _ANSI_ARGS_((TkText *textPtr,
 			    TkTextIndex *indexPtr, char *string));
+static int		LoadBlock _ANSI_ARGS_((TkText *textPtr));
+static void		LoadChannelProc _ANSI_ARGS_((ClientData clientData,
+			    int mask));
+static void		LoadChars _ANSI_ARGS_((TkText *textPtr,
+			    TkTextLoad *loadPtr, int numChars));
+static void		LoadCloseProc _ANSI_ARGS_((ClientData clientData));
+static int		LoadFile _ANSI_ARGS_((Tcl_Interp *interp,
+			    TkText *textPtr));
+static void		LoadIdleProc _ANSI_ARGS_((ClientData clientData));
+static int		MatchExact _ANSI_ARGS_((ExactPattern *patPtr,
+			    char *string, int first, int length));
+static void		MovePastChars _ANSI_ARGS_((char *string, int length,
+			    int *linePtr, int *charPtr));
+static TkTextUndo *	NewUndo _ANSI_ARGS_((TkText *textPtr,
+			    int type, int line, int charIndex));
+static void		RecordDelete _ANSI_ARGS_((TkText *textPtr,
+			    TkTextIndex *index1Ptr, TkTextIndex *index2Ptr));
+static void		RecordInsert _ANSI_ARGS_((TkText *textPtr,
+			    TkTextIndex *indexPtr, char *string));
+static void		ReleaseMap _ANSI_ARGS_((TkText *textPtr));
+static void		ReplaceText _ANSI_ARGS_((TkText *textPtr, char *chars,
+			    size_t size, int fd));
+static void		ResetRedo _ANSI_ARGS_((TkText *textPtr));
+static void		ResetUndo _ANSI_ARGS_((TkText *textPtr));
 static void		TextCmdDeletedProc _ANSI_ARGS_((
 			    ClientData clientData));
+static int		TextDumpCmd _ANSI_ARGS_((TkText *textPtr,
+			    Tcl_Interp *interp, int argc, char **argv));
+static int		TextEditCmd _ANSI_ARGS_((TkText *textPtr,
+			    Tcl_Interp *interp, int argc, char **argv));
 static void		TextEventProc _ANSI_ARGS_((ClientData clientData,
 			    XEvent *eventPtr));
+static int		TextLoadCmd _ANSI_ARGS_((TkText *textPtr,
+			    Tcl_Interp *interp, int argc, char **argv));
 static int		TextSearchCmd _ANSI_ARGS_((TkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
 static int		TextWidgetCmd _ANSI_ARGS_((ClientData clientData,
 			    Tcl_Interp *interp, int argc, char **argv));
+static void		TrimUndo _ANSI_ARGS_((TkText *textPtr));
 
 /*
  *--------------------------------------------------------------
@@ -174,6 +360,20 @@ Tk_TextCmd(clientData, interp, argc, argv)
     Tcl_InitHashTable(&textPtr->markTable, TCL_STRING_KEYS);
     Tcl_InitHashTable(&textPtr->windowTable, TCL_STRING_KEYS);
     textPtr->state = tkTextNormalUid;
+    textPtr->readOnly = 0;
+    textPtr->fileName = NULL;
+    textPtr->mapChars = NULL;
+    textPtr->mapSize = 0;
+    textPtr->mapped = 0;
+    textPtr->mapFd = -1;
+    textPtr->loadPtr = NULL;
+    textPtr->undo = 0;
+    textPtr->autoSeparators = 1;
+    textPtr->maxUndoBytes = 0;
+    textPtr->undoFirstPtr = NULL;
+    textPtr->undoLastPtr = NULL;
+    textPtr->redoPtr = NULL;
+    textPtr->undoBytes = 0;
     textPtr->borderWidth = 0;
     textPtr->padX = 0;
     textPtr->padY = 0;
@@ -195,6 +395,7 @@ Tk_TextCmd(clientData, interp, argc, argv)
     textPtr->takeFocus = NULL;
     textPtr->xScrollCmd = NULL;
     textPtr->yScrollCmd = NULL;
+    textPtr->syncCmd = NULL;
     textPtr->flags = 0;
 
     /*
@@ -261,7 +462,40 @@ TextWidgetCmd(clientData, interp, argc, argv)
     Tk_Preserve((ClientData) textPtr);
     c = argv[1][0];
     length = strlen(argv[1]);
-    if ((c == 'b') && (strncmp(argv[1], "bbox", length) == 0)) {
+    if ((c == 'a') && (strncmp(argv[1], "append", length) == 0)) {
+	int maxLines = 0;
+
+	if ((argc != 3) && (argc != 5)) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " append ?-maxlines count? chars\"",
+		    (char *) NULL);
+	    result = TCL_ERROR;
+	    goto done;
+	}
+	if (argc == 5) {
+	    length = strlen(argv[2]);
+	    if ((length < 2)
+		    || (strncmp(argv[2], "-maxlines", length) != 0)) {
+		Tcl_AppendResult(interp, "bad switch \"", argv[2],
+			"\": must be -maxlines", (char *) NULL);
+		result = TCL_ERROR;
+		goto done;
+	    }
+	    if (Tcl_GetInt(interp, argv[3], &maxLines) != TCL_OK) {
+		result = TCL_ERROR;
+		goto done;
+	    }
+	    if (maxLines <= 0) {
+		Tcl_AppendResult(interp, "bad line count \"", argv[3],
+			"\": must be greater than zero", (char *) NULL);
+		result = TCL_ERROR;
+		goto done;
+	    }
+	}
+	if ((textPtr->state == tkTextNormalUid) && !textPtr->readOnly) {
+	    AppendChars(textPtr, argv[argc-1], maxLines);
+	}
+    } else if ((c == 'b') && (strncmp(argv[1], "bbox", length) == 0)) {
 	int x, y, width, height;
 
 	if (argc != 3) {
@@ -350,6 +584,42 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	}
     } else if ((c == 'd') && (strncmp(argv[1], "debug", length) == 0)
 	    && (length >= 3)) {
+	if ((argc >= 3) && (strcmp(argv[2], "stats") == 0)) {
+	    char buffer[100];
+
+	    /*
+	     * Report the B-tree's counts of character segment storage
+	     * activity (shared by all text widgets), then maybe reset
+	     * them.
+	     */
+
+	    if ((argc != 3)
+		    && ((argc != 4) || (strcmp(argv[3], "-reset") != 0))) {
+		Tcl_AppendResult(interp, "wrong # args: should be \"",
+			argv[0], " debug stats ?-reset?\"", (char *) NULL);
+		result = TCL_ERROR;
+		goto done;
+	    }
+	    sprintf(buffer, "-allocs %d -frees %d -copied %d",
+		    tkBTreeCharAllocs, tkBTreeCharFrees, tkBTreeCharsCopied);
+	    Tcl_SetResult(interp, buffer, TCL_VOLATILE);
+	    if (argc == 4) {
+		tkBTreeCharAllocs = 0;
+		tkBTreeCharFrees = 0;
+		tkBTreeCharsCopied = 0;
+	    }
+	    goto done;
+	}
+	if ((argc >= 3) && (strcmp(argv[2], "memory") == 0)) {
+	    if (argc != 3) {
+		Tcl_AppendResult(interp, "wrong # args: should be \"",
+			argv[0], " debug memory\"", (char *) NULL);
+		result = TCL_ERROR;
+		goto done;
+	    }
+	    TkBTreeMemory(textPtr->tree, interp);
+	    goto done;
+	}
 	if (argc > 3) {
 	    Tcl_AppendResult(interp, "wrong # args: should be \"",
 		    argv[0], " debug boolean\"", (char *) NULL);
@@ -373,7 +643,7 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	    result = TCL_ERROR;
 	    goto done;
 	}
-	if (textPtr->state == tkTextNormalUid) {
+	if ((textPtr->state == tkTextNormalUid) && !textPtr->readOnly) {
 	    result = DeleteChars(textPtr, argv[2],
 		    (argc == 4) ? argv[3] : (char *) NULL);
 	}
@@ -398,6 +668,11 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	    	    x, y, width, height, base);
 	    Tcl_SetResult(interp,buffer,TCL_VOLATILE);
 	}
+    } else if ((c == 'd') && (strncmp(argv[1], "dump", length) == 0)
+	    && (length >= 2)) {
+	result = TextDumpCmd(textPtr, interp, argc, argv);
+    } else if ((c == 'e') && (strncmp(argv[1], "edit", length) == 0)) {
+	result = TextEditCmd(textPtr, interp, argc, argv);
     } else if ((c == 'g') && (strncmp(argv[1], "get", length) == 0)) {
 	if ((argc != 3) && (argc != 4)) {
 	    Tcl_AppendResult(interp, "wrong # args: should be \"",
@@ -420,31 +695,12 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	if (TkTextIndexCmp(&index1, &index2) >= 0) {
 	    goto done;
 	}
-	while (1) {
-	    int offset, last, savedChar;
-	    TkTextSegment *segPtr;
-
-	    segPtr = TkTextIndexToSeg(&index1, &offset);
-	    last = segPtr->size;
-	    if (index1.linePtr == index2.linePtr) {
-		int last2;
+	{
+	    Tcl_DString chars;
 
-		if (index2.charIndex == index1.charIndex) {
-		    break;
-		}
-		last2 = index2.charIndex - index1.charIndex + offset;
-		if (last2 < last) {
-		    last = last2;
-		}
-	    }
-	    if (segPtr->typePtr == &tkTextCharType) {
-		savedChar = segPtr->body.chars[last];
-		segPtr->body.chars[last] = 0;
-		Tcl_AppendResult(interp, segPtr->body.chars + offset,
-			(char *) NULL);
-		segPtr->body.chars[last] = savedChar;
-	    }
-	    TkTextIndexForwChars(&index1, last-offset, &index1);
+	    Tcl_DStringInit(&chars);
+	    GetChars(&index1, &index2, &chars);
+	    Tcl_DStringResult(interp, &chars);
 	}
     } else if ((c == 'i') && (strncmp(argv[1], "index", length) == 0)
 	    && (length >= 3)) {
@@ -478,7 +734,7 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	    result = TCL_ERROR;
 	    goto done;
 	}
-	if (textPtr->state == tkTextNormalUid) {
+	if ((textPtr->state == tkTextNormalUid) && !textPtr->readOnly) {
 	    for (j = 3;  j < argc; j += 2) {
 		InsertChars(textPtr, &index1, argv[j]);
 		if (argc > (j+1)) {
@@ -505,8 +761,19 @@ TextWidgetCmd(clientData, interp, argc, argv)
 		}
 	    }
 	}
+    } else if ((c == 'l') && (strncmp(argv[1], "load", length) == 0)) {
+	result = TextLoadCmd(textPtr, interp, argc, argv);
     } else if ((c == 'm') && (strncmp(argv[1], "mark", length) == 0)) {
 	result = TkTextMarkCmd(textPtr, interp, argc, argv);
+    } else if ((c == 'p') && (strncmp(argv[1], "pendingsync", length) == 0)) {
+	if (argc != 2) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " pendingsync\"", (char *) NULL);
+	    result = TCL_ERROR;
+	    goto done;
+	}
+	Tcl_SetResult(interp, TkTextPendingSync(textPtr) ? "1" : "0",
+		TCL_STATIC);
     } else if ((c == 's') && (strcmp(argv[1], "scan") == 0) && (length >= 2)) {
 	result = Ctk_Unsupported(interp, "scan");
     } else if ((c == 's') && (strcmp(argv[1], "search") == 0)
@@ -514,6 +781,15 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	result = TextSearchCmd(textPtr, interp, argc, argv);
     } else if ((c == 's') && (strcmp(argv[1], "see") == 0) && (length >= 3)) {
 	result = TkTextSeeCmd(textPtr, interp, argc, argv);
+    } else if ((c == 's') && (strncmp(argv[1], "sync", length) == 0)
+	    && (length >= 2)) {
+	if (argc != 2) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " sync\"", (char *) NULL);
+	    result = TCL_ERROR;
+	    goto done;
+	}
+	TkTextSync(textPtr);
     } else if ((c == 't') && (strcmp(argv[1], "tag") == 0)) {
 	result = TkTextTagCmd(textPtr, interp, argc, argv);
     } else if ((c == 'w') && (strncmp(argv[1], "window", length) == 0)) {
@@ -526,9 +802,10 @@ TextWidgetCmd(clientData, interp, argc, argv)
 	result = TkTextYviewCmd(textPtr, interp, argc, argv);
     } else {
 	Tcl_AppendResult(interp, "bad option \"", argv[1],
-		"\":  must be bbox, cget, compare, configure, debug, delete, ",
-		"dlineinfo, get, index, insert, mark, scan, search, see, ",
-		"tag, window, xview, or yview",
+		"\":  must be append, bbox, cget, compare, configure, debug, ",
+		"delete, dlineinfo, dump, edit, get, index, insert, load, ",
+		"mark, pendingsync, scan, search, see, sync, tag, window, ",
+		"xview, or yview",
 		(char *) NULL);
 	result = TCL_ERROR;
     }
@@ -575,6 +852,8 @@ DestroyText(clientData)
 
     TkTextFreeDInfo(textPtr);
     TkBTreeDestroy(textPtr->tree);
+    ReleaseMap(textPtr);
+    ResetUndo(textPtr);
     for (hPtr = Tcl_FirstHashEntry(&textPtr->tagTable, &search);
 	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
 	tagPtr = (TkTextTag *) Tcl_GetHashValue(hPtr);
@@ -624,6 +903,8 @@ ConfigureText(interp, textPtr, argc, argv, flags)
     char **argv;		/* Arguments. */
     int flags;			/* Flags to pass to Tk_ConfigureWidget. */
 {
+    Tk_ConfigSpec *specPtr;
+
     if (Tk_ConfigureWidget(interp, textPtr->tkwin, configSpecs,
 	    argc, argv, (char *) textPtr, flags) != TCL_OK) {
 	return TCL_ERROR;
@@ -642,6 +923,38 @@ ConfigureText(interp, textPtr, argc, argv, flags)
 	return TCL_ERROR;
     }
 
+    /*
+     * Load the text from a file if -file has just been given (or came
+     * from the option database when the widget was created).  Once a
+     * file's text can be changed, it no longer needs to stay mapped.
+     */
+
+    for (specPtr = configSpecs; specPtr->type != TK_CONFIG_END; specPtr++) {
+	if (strcmp(specPtr->argvName, "-file") == 0) {
+	    break;
+	}
+    }
+    if ((textPtr->fileName != NULL) && (!(flags & TK_CONFIG_ARGV_ONLY)
+	    || (specPtr->specFlags & TK_CONFIG_OPTION_SPECIFIED))) {
+	if (LoadFile(interp, textPtr) != TCL_OK) {
+	    return TCL_ERROR;
+	}
+    } else if (!textPtr->readOnly && (textPtr->mapChars != NULL)) {
+	TkBTreeUnmapChars(textPtr->tree);
+	ReleaseMap(textPtr);
+    }
+
+    /*
+     * Forget the changes recorded for undo if -undo has been turned off,
+     * and make the rest fit in -maxundobytes.
+     */
+
+    if (!textPtr->undo) {
+	ResetUndo(textPtr);
+    } else {
+	TrimUndo(textPtr);
+    }
+
     if ((textPtr->wrapMode != tkTextCharUid)
 	    && (textPtr->wrapMode != tkTextNoneUid)
 	    && (textPtr->wrapMode != tkTextWordUid)) {
@@ -727,201 +1040,924 @@ ConfigureText(interp, textPtr, argc, argv, flags)
 }
 
 /*
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  *
- * TextEventProc --
+ * LoadFile --
  *
- *	This procedure is invoked by the Tk dispatcher on
- *	structure changes to a text.  For texts with 3D
- *	borders, this procedure is also invoked for exposures.
+ *	This procedure replaces the text of a widget with the contents
+ *	of the file named by its -file option.  The file is mapped into
+ *	memory (or read, if it can't be mapped) and handed to the B-tree
+ *	with TkBTreeMapChars, which only creates lines as they're needed,
+ *	so even a huge file comes up at once.  If the text is -readonly
+ *	the file stays mapped (and open, so that the B-tree can check
+ *	that it hasn't shrunk);  otherwise every line is created right
+ *	away and the file is let go.
  *
  * Results:
- *	None.
+ *	The return value is a standard Tcl result.  If TCL_ERROR is
+ *	returned, then interp->result contains an error message and
+ *	the widget's -file option is reset.
  *
  * Side effects:
- *	When the window gets deleted, internal structures get
- *	cleaned up.  When it gets exposed, it is redisplayed.
+ *	All of the old text and its tags are discarded, and all of the
+ *	marks are moved to the start of the new text.  The view is
+ *	reset to the top of the text.
  *
- *--------------------------------------------------------------
+ *----------------------------------------------------------------------
  */
 
-static void
-TextEventProc(clientData, eventPtr)
-    ClientData clientData;	/* Information about window. */
-    register XEvent *eventPtr;	/* Information about event. */
+static int
+LoadFile(interp, textPtr)
+    Tcl_Interp *interp;		/* Used for error reporting. */
+    register TkText *textPtr;	/* Text whose -file is to be loaded. */
 {
-    register TkText *textPtr = (TkText *) clientData;
-    TkTextIndex index, index2;
-
-    if (eventPtr->type == CTK_EXPOSE_EVENT) {
-	TkTextRedrawRegion(textPtr,
-		eventPtr->u.expose.left, eventPtr->u.expose.top,
-		eventPtr->u.expose.right - eventPtr->u.expose.left,
-		eventPtr->u.expose.bottom - eventPtr->u.expose.top);
-    } else if (eventPtr->type == CTK_MAP_EVENT) {
-	if ((textPtr->prevWidth != Tk_Width(textPtr->tkwin))
-		|| (textPtr->prevHeight != Tk_Height(textPtr->tkwin))) {
-	    TkTextRelayoutWindow(textPtr);
-	    textPtr->prevWidth = Tk_Width(textPtr->tkwin);
-	    textPtr->prevHeight = Tk_Height(textPtr->tkwin);
+    Tcl_DString buffer;
+    char *realName, *chars;
+    struct stat statBuf;
+    size_t size, numRead;
+    int fd, mapped, count;
+
+    Tcl_DStringInit(&buffer);
+    realName = Tcl_TranslateFileName(interp, textPtr->fileName, &buffer);
+    if (realName == NULL) {
+	goto error;
+    }
+    fd = open(realName, O_RDONLY, 0);
+    Tcl_DStringFree(&buffer);
+    if ((fd < 0) || (fstat(fd, &statBuf) != 0)) {
+	Tcl_AppendResult(interp, "couldn't read file \"", textPtr->fileName,
+		"\": ", Tcl_PosixError(interp), (char *) NULL);
+	if (fd >= 0) {
+	    close(fd);
 	}
-    } else if (eventPtr->type == CTK_DESTROY_EVENT) {
-	if (textPtr->tkwin != NULL) {
-	    textPtr->tkwin = NULL;
-	    Tcl_DeleteCommand(textPtr->interp,
-		    Tcl_GetCommandName(textPtr->interp,
-		    textPtr->widgetCmd));
+	goto error;
+    }
+    size = (size_t) statBuf.st_size;
+    chars = NULL;
+    mapped = 0;
+#ifdef HAVE_SYS_MMAN_H
+    if (size > 0) {
+	chars = (char *) mmap((VOID *) NULL, size, PROT_READ, MAP_PRIVATE,
+		fd, (off_t) 0);
+	if (chars == (char *) MAP_FAILED) {
+	    chars = NULL;
+	} else {
+	    mapped = 1;
 	}
-	Tk_EventuallyFree((ClientData) textPtr, DestroyText);
-    } else if (eventPtr->type == CTK_FOCUS_EVENT) {
-	textPtr->flags |= GOT_FOCUS;
-	TkTextMarkSegToIndex(textPtr, textPtr->insertMarkPtr, &index);
-	TkTextIndexForwChars(&index, 1, &index2);
-	TkTextChanged(textPtr, &index, &index2);
-    } else if (eventPtr->type == CTK_UNFOCUS_EVENT) {
-	textPtr->flags &= ~GOT_FOCUS;
     }
+#endif
+    if (chars == NULL) {
+	chars = (char *) ckalloc((unsigned) (size + 1));
+	for (numRead = 0; numRead < size; numRead += count) {
+	    count = read(fd, chars + numRead, size - numRead);
+	    if (count < 0) {
+		Tcl_AppendResult(interp, "couldn't read file \"",
+			textPtr->fileName, "\": ", Tcl_PosixError(interp),
+			(char *) NULL);
+		close(fd);
+		ckfree(chars);
+		goto error;
+	    }
+	    if (count == 0) {
+		break;
+	    }
+	}
+	size = numRead;
+    }
+    if (!mapped) {
+	close(fd);
+	fd = -1;
+    }
+
+    EndLoad(textPtr, 0, 0);
+    ReplaceText(textPtr, chars, size, fd);
+    if (!textPtr->readOnly) {
+	TkBTreeUnmapChars(textPtr->tree);
+	ReleaseMap(textPtr);
+    }
+    return TCL_OK;
+
+    error:
+    ckfree(textPtr->fileName);
+    textPtr->fileName = NULL;
+    return TCL_ERROR;
 }
+
 
 /*
  *----------------------------------------------------------------------
  *
- * TextCmdDeletedProc --
+ * ReleaseMap --
  *
- *	This procedure is invoked when a widget command is deleted.  If
- *	the widget isn't already in the process of being destroyed,
- *	this command destroys it.
+ *	This procedure lets go of the file contents that a widget's
+ *	B-tree was given with TkBTreeMapChars, once the B-tree no longer
+ *	needs them.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	The widget is destroyed.
+ *	The file is unmapped and closed, or its copy freed.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-TextCmdDeletedProc(clientData)
-    ClientData clientData;	/* Pointer to widget record for widget. */
+ReleaseMap(textPtr)
+    register TkText *textPtr;	/* Text whose file is to be let go. */
 {
-    TkText *textPtr = (TkText *) clientData;
-    Tk_Window tkwin = textPtr->tkwin;
-
-    /*
-     * This procedure could be invoked either because the window was
-     * destroyed and the command was then deleted (in which case tkwin
-     * is NULL) or because the command was deleted, and then this procedure
-     * destroys the widget.
-     */
-
-    if (tkwin != NULL) {
-	textPtr->tkwin = NULL;
-	Tk_DestroyWindow(tkwin);
+    if (textPtr->mapChars == NULL) {
+	return;
+    }
+#ifdef HAVE_SYS_MMAN_H
+    if (textPtr->mapped) {
+	munmap((VOID *) textPtr->mapChars, textPtr->mapSize);
+    } else
+#endif
+    {
+	ckfree(textPtr->mapChars);
     }
+    if (textPtr->mapFd >= 0) {
+	close(textPtr->mapFd);
+    }
+    textPtr->mapChars = NULL;
+    textPtr->mapSize = 0;
+    textPtr->mapped = 0;
+    textPtr->mapFd = -1;
 }
+
 
 /*
  *----------------------------------------------------------------------
  *
- * InsertChars --
+ * ReplaceText --
  *
- *	This procedure implements most of the functionality of the
- *	"insert" widget command.
+ *	This procedure replaces all of the text in a widget with new
+ *	characters, by handing them to TkBTreeMapChars.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	The characters in "string" get added to the text just before
- *	the character indicated by "indexPtr".
+ *	The old text, its tags, and the recorded undo information are
+ *	thrown away, and all the marks are moved to 1.0.  The characters
+ *	belong to the widget until it's done with them:  the caller
+ *	either lets the lines be built as they're needed or builds them
+ *	all with TkBTreeUnmapChars and then calls ReleaseMap.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-InsertChars(textPtr, indexPtr, string)
-    TkText *textPtr;		/* Overall information about text widget. */
-    TkTextIndex *indexPtr;	/* Where to insert new characters.  May be
-				 * modified and/or invalidated. */
-    char *string;		/* Null-terminated string containing new
-				 * information to add to text. */
+ReplaceText(textPtr, chars, size, fd)
+    register TkText *textPtr;	/* Text whose contents are to be
+				 * replaced. */
+    char *chars;		/* New characters (mapped if fd isn't -1,
+				 * otherwise malloc'ed), or NULL to leave
+				 * the text empty. */
+    size_t size;		/* Number of characters at chars. */
+    int fd;			/* Open file that chars is mapped from,
+				 * which now belongs to the widget, or -1. */
 {
-    int lineIndex;
+    TkTextIndex index1, index2;
+    Tcl_HashSearch search;
+    Tcl_HashEntry *hPtr;
+    TkTextSegment *markPtr;
 
     /*
-     * Don't allow insertions on the last (dummy) line of the text.
+     * Let go of all the display information for the old text, take
+     * the marks out of it, and swap in the new text.
      */
 
-    lineIndex = TkBTreeLineIndex(indexPtr->linePtr);
-    if (lineIndex == TkBTreeNumLines(textPtr->tree)) {
-	lineIndex--;
-	TkTextMakeIndex(textPtr->tree, lineIndex, 1000000, indexPtr);
+    TkTextMakeIndex(textPtr->tree, 0, 0, &index1);
+    TkTextMakeIndex(textPtr->tree, TkBTreeNumLines(textPtr->tree), 0,
+	    &index2);
+    TkTextChanged(textPtr, &index1, &index2);
+    for (hPtr = Tcl_FirstHashEntry(&textPtr->markTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	markPtr = (TkTextSegment *) Tcl_GetHashValue(hPtr);
+	TkBTreeUnlinkSegment(textPtr->tree, markPtr,
+		markPtr->body.mark.linePtr);
     }
-
-    /*
-     * Notify the display module that lines are about to change, then do
-     * the insertion.
-     */
-
-    TkTextChanged(textPtr, indexPtr, indexPtr);
-    TkBTreeInsertChars(indexPtr, string);
+    TkBTreeMapChars(textPtr->tree, (chars == NULL) ? "" : chars, size, fd);
+    ReleaseMap(textPtr);
+    textPtr->mapChars = chars;
+    textPtr->mapSize = size;
+    textPtr->mapped = (fd >= 0);
+    textPtr->mapFd = fd;
+    ResetUndo(textPtr);
+    TkTextMakeIndex(textPtr->tree, 0, 0, &index1);
+    for (hPtr = Tcl_FirstHashEntry(&textPtr->markTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	markPtr = (TkTextSegment *) Tcl_GetHashValue(hPtr);
+	TkBTreeLinkSegment(markPtr, &index1);
+	markPtr->body.mark.linePtr = index1.linePtr;
+    }
+    TkTextSetYView(textPtr, &index1, 0);
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * DeleteChars --
+ * TextLoadCmd --
  *
- *	This procedure implements most of the functionality of the
- *	"delete" widget command.
+ *	This procedure is invoked to process the "load" widget command
+ *	for text widgets, which replaces the text with what's read from
+ *	a channel.  See the user documentation for details on what it
+ *	does.
  *
  * Results:
- *	Returns a standard Tcl result, and leaves an error message
- *	in textPtr->interp if there is an error.
+ *	A standard Tcl result.
  *
  * Side effects:
- *	Characters get deleted from the text.
+ *	See the user documentation.
  *
  *----------------------------------------------------------------------
  */
 
 static int
-DeleteChars(textPtr, index1String, index2String)
-    TkText *textPtr;		/* Overall information about text widget. */
-    char *index1String;		/* String describing location of first
-				 * character to delete. */
-    char *index2String;		/* String describing location of last
-				 * character to delete.  NULL means just
-				 * delete the one character given by
-				 * index1String. */
+TextLoadCmd(textPtr, interp, argc, argv)
+    TkText *textPtr;		/* Information about text widget. */
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings.  Someone else has already
+				 * parsed this command enough to know that
+				 * argv[1] is "load". */
 {
-    int line1, line2, line, charIndex, resetView;
-    TkTextIndex index1, index2;
-
-    /*
-     * Parse the starting and stopping indices.
-     */
+    TkTextLoad *loadPtr;
+    Tcl_Channel chan;
+    char *command, *error;
+    size_t length;
+    int i, c, mode, async, done;
 
-    if (TkTextGetIndex(textPtr->interp, textPtr, index1String, &index1)
-	    != TCL_OK) {
-	return TCL_ERROR;
+    if (argc < 3) {
+	goto wrongArgs;
     }
-    if (index2String != NULL) {
-	if (TkTextGetIndex(textPtr->interp, textPtr, index2String, &index2)
-		!= TCL_OK) {
+    async = 0;
+    command = NULL;
+    for (i = 3; i < argc; i++) {
+	length = strlen(argv[i]);
+	c = (length >= 2) ? argv[i][1] : 0;
+	if ((c == 'a') && (strncmp(argv[i], "-async", length) == 0)) {
+	    async = 1;
+	} else if ((c == 'c') && (strncmp(argv[i], "-command", length) == 0)
+		&& (length >= 2)) {
+	    i++;
+	    if (i >= argc) {
+		goto wrongArgs;
+	    }
+	    command = argv[i];
+	} else {
+	    Tcl_AppendResult(interp, "bad switch \"", argv[i],
+		    "\": must be -async or -command", (char *) NULL);
 	    return TCL_ERROR;
 	}
-    } else {
-	index2 = index1;
-	TkTextIndexForwChars(&index2, 1, &index2);
+    }
+    chan = Tcl_GetChannel(interp, argv[2], &mode);
+    if (chan == NULL) {
+	return TCL_ERROR;
+    }
+    if (!(mode & TCL_READABLE)) {
+	Tcl_AppendResult(interp, "channel \"", argv[2],
+		"\" wasn't opened for reading", (char *) NULL);
+	return TCL_ERROR;
     }
 
     /*
-     * Make sure there's really something to delete.
+     * Like "insert" and "delete", quietly do nothing if the text can't
+     * be changed.
      */
 
-    if (TkTextIndexCmp(&index1, &index2) >= 0) {
+    if ((textPtr->state != tkTextNormalUid) || textPtr->readOnly) {
+	return TCL_OK;
+    }
+    if (async && (Tcl_SetChannelOption(interp, chan, "-blocking", "0")
+	    != TCL_OK)) {
+	return TCL_ERROR;
+    }
+
+    /*
+     * Stop any earlier load and empty the text, then read the channel
+     * into it a block at a time.
+     */
+
+    EndLoad(textPtr, 0, 0);
+    ReplaceText(textPtr, (char *) NULL, 0, -1);
+    TkBTreeUnmapChars(textPtr->tree);
+    loadPtr = (TkTextLoad *) ckalloc(sizeof(TkTextLoad));
+    loadPtr->chan = chan;
+    loadPtr->async = async;
+    loadPtr->first = 1;
+    if (command != NULL) {
+	loadPtr->command = (char *) ckalloc((unsigned) (strlen(command) + 1));
+	strcpy(loadPtr->command, command);
+    } else {
+	loadPtr->command = NULL;
+    }
+    loadPtr->numChars = 0;
+    loadPtr->error = NULL;
+    textPtr->loadPtr = loadPtr;
+    Tcl_CreateCloseHandler(chan, LoadCloseProc, (ClientData) textPtr);
+    if (async) {
+	Tcl_CreateChannelHandler(chan, TCL_READABLE, LoadChannelProc,
+		(ClientData) textPtr);
+	return TCL_OK;
+    }
+    do {
+	done = LoadBlock(textPtr);
+    } while (!done);
+    error = loadPtr->error;
+    loadPtr->error = NULL;
+    EndLoad(textPtr, 0, 1);
+    if (error != NULL) {
+	Tcl_ResetResult(interp);
+	Tcl_AppendResult(interp, error, (char *) NULL);
+	ckfree(error);
+	return TCL_ERROR;
+    }
+    return TCL_OK;
+
+    wrongArgs:
+    Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
+	    " load channelId ?-async? ?-command script?\"", (char *) NULL);
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadBlock --
+ *
+ *	This procedure reads the next block of characters from the
+ *	channel that a text is being loaded from, and adds the lines in
+ *	it to the end of the text.
+ *
+ * Results:
+ *	The return value is 1 if the load is over, because the end of
+ *	the channel has been reached or there was an error, and 0 if
+ *	there may be more to read.  If there was an error, a message is
+ *	left in textPtr->loadPtr->error.
+ *
+ * Side effects:
+ *	Whole lines are added to the text's B-tree in bulk;  a partial
+ *	line at the end of the block is kept until the rest of it is
+ *	read, unless it fills the whole block.  Null characters become
+ *	spaces, as for -file.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+LoadBlock(textPtr)
+    TkText *textPtr;		/* Text being loaded. */
+{
+    TkTextLoad *loadPtr = textPtr->loadPtr;
+    char *p, *end, *lastNewline;
+    int count, done;
+
+    count = Tcl_Read(loadPtr->chan, loadPtr->buffer + loadPtr->numChars,
+	    LOAD_BLOCK_SIZE - loadPtr->numChars);
+    done = 0;
+    if (count < 0) {
+	if (Tcl_InputBlocked(loadPtr->chan)) {
+	    return 0;
+	}
+	if (loadPtr->error == NULL) {
+	    Tcl_DString message;
+
+	    Tcl_DStringInit(&message);
+	    Tcl_DStringAppend(&message, "error reading \"", -1);
+	    Tcl_DStringAppend(&message, Tcl_GetChannelName(loadPtr->chan), -1);
+	    Tcl_DStringAppend(&message, "\": ", -1);
+	    Tcl_DStringAppend(&message, Tcl_PosixError(textPtr->interp), -1);
+	    loadPtr->error = (char *) ckalloc((unsigned)
+		    (Tcl_DStringLength(&message) + 1));
+	    strcpy(loadPtr->error, Tcl_DStringValue(&message));
+	    Tcl_DStringFree(&message);
+	}
+	count = 0;
+	done = 1;
+    } else if ((count == 0) && Tcl_Eof(loadPtr->chan)) {
+	done = 1;
+    }
+    end = loadPtr->buffer + loadPtr->numChars + count;
+    lastNewline = NULL;
+    for (p = loadPtr->buffer + loadPtr->numChars; p < end; p++) {
+	if (*p == '\n') {
+	    lastNewline = p;
+	} else if (*p == 0) {
+	    *p = ' ';
+	}
+    }
+    loadPtr->numChars += count;
+
+    /*
+     * Add everything up to the last newline (or everything, at the end
+     * or if there's no newline in a whole block) just before the final
+     * newline of the text, as "insert end" would.
+     */
+
+    if (done || (loadPtr->numChars == LOAD_BLOCK_SIZE)) {
+	p = end;
+    } else if (lastNewline != NULL) {
+	p = lastNewline + 1;
+    } else {
+	return 0;
+    }
+    LoadChars(textPtr, loadPtr, p - loadPtr->buffer);
+    loadPtr->numChars = end - p;
+    memmove((VOID *) loadPtr->buffer, (VOID *) p,
+	    (size_t) loadPtr->numChars);
+    return done;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadChars --
+ *
+ *	This procedure adds characters read by a load from a channel to
+ *	the end of the text.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The first characters of a load replace the (empty) text with
+ *	ReplaceText, so that its marks stay at 1.0, rather than being
+ *	inserted after them;  the rest are added in bulk just before the
+ *	final newline of the text, where "insert end" would put them.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LoadChars(textPtr, loadPtr, numChars)
+    TkText *textPtr;		/* Text being loaded. */
+    TkTextLoad *loadPtr;	/* Information about the load. */
+    int numChars;		/* Number of characters at the start of
+				 * loadPtr->buffer to add. */
+{
+    TkTextIndex index;
+    char *chars, saved;
+
+    if (numChars == 0) {
+	return;
+    }
+    if (loadPtr->first) {
+	chars = (char *) ckalloc((unsigned) numChars);
+	memcpy((VOID *) chars, (VOID *) loadPtr->buffer, (size_t) numChars);
+	ReplaceText(textPtr, chars, (size_t) numChars, -1);
+	TkBTreeUnmapChars(textPtr->tree);
+	ReleaseMap(textPtr);
+	loadPtr->first = 0;
+	return;
+    }
+    saved = loadPtr->buffer[numChars];
+    loadPtr->buffer[numChars] = 0;
+    TkTextMakeIndex(textPtr->tree, TkBTreeNumLines(textPtr->tree) - 1,
+	    1000000, &index);
+    TkTextChanged(textPtr, &index, &index);
+    TkBTreeAppendChars(&index, loadPtr->buffer);
+    loadPtr->buffer[numChars] = saved;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadChannelProc --
+ *
+ *	This procedure is invoked by the Tcl event loop when the channel
+ *	that a text is loading from with -async becomes readable.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Blocks are read into the text for up to LOAD_SLICE_USECS
+ *	microseconds.  Then, so that the text can be redisplayed and
+ *	other events handled, the channel handler is removed until the
+ *	Tcl event loop is next idle;  the idle handler for redisplay runs
+ *	before the one that puts the channel handler back.  When the
+ *	load is over, it's ended with EndLoad.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LoadChannelProc(clientData, mask)
+    ClientData clientData;	/* Information about text widget. */
+    int mask;			/* Not used. */
+{
+    TkText *textPtr = (TkText *) clientData;
+    TkTextLoad *loadPtr = textPtr->loadPtr;
+    Tcl_Time start, now;
+    int done;
+
+    Tcl_GetTime(&start);
+    now = start;
+    do {
+	done = LoadBlock(textPtr);
+	if (done || Tcl_InputBlocked(loadPtr->chan)) {
+	    break;
+	}
+	Tcl_GetTime(&now);
+    } while ((now.sec - start.sec)*1000000 + (now.usec - start.usec)
+	    < LOAD_SLICE_USECS);
+    if (done) {
+	EndLoad(textPtr, 0, 1);
+	return;
+    }
+    Tcl_DeleteChannelHandler(loadPtr->chan, LoadChannelProc,
+	    (ClientData) textPtr);
+    Tcl_DoWhenIdle(LoadIdleProc, (ClientData) textPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadIdleProc --
+ *
+ *	This procedure is invoked as an idle handler to go on with an
+ *	-async load once the text has been redisplayed.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The channel handler for the load is put back.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LoadIdleProc(clientData)
+    ClientData clientData;	/* Information about text widget. */
+{
+    TkText *textPtr = (TkText *) clientData;
+
+    Tcl_CreateChannelHandler(textPtr->loadPtr->chan, TCL_READABLE,
+	    LoadChannelProc, (ClientData) textPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadCloseProc --
+ *
+ *	This procedure is invoked when the channel that a text is being
+ *	loaded from is closed before the load is over.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The load is ended with whatever has been read.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LoadCloseProc(clientData)
+    ClientData clientData;	/* Information about text widget. */
+{
+    EndLoad((TkText *) clientData, 1, 1);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * EndLoad --
+ *
+ *	This procedure ends a text's load from a channel, if there is
+ *	one.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Any partial line that has been read is added to the text, the
+ *	handlers for the load are removed, and its storage is freed.  If
+ *	notify is non-zero, a read error in an -async load is reported
+ *	with Tcl_BackgroundError and the -command script is evaluated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+EndLoad(textPtr, closing, notify)
+    TkText *textPtr;		/* Text whose load is to be ended. */
+    int closing;		/* Non-zero means the channel is being
+				 * closed, so its close handler is already
+				 * gone. */
+    int notify;			/* Non-zero means tell the application
+				 * that the load is over. */
+{
+    TkTextLoad *loadPtr = textPtr->loadPtr;
+    Tcl_Interp *interp = textPtr->interp;
+
+    if (loadPtr == NULL) {
+	return;
+    }
+    textPtr->loadPtr = NULL;
+    if (textPtr->tkwin != NULL) {
+	LoadChars(textPtr, loadPtr, loadPtr->numChars);
+    }
+    Tcl_DeleteChannelHandler(loadPtr->chan, LoadChannelProc,
+	    (ClientData) textPtr);
+    Tcl_CancelIdleCall(LoadIdleProc, (ClientData) textPtr);
+    if (!closing) {
+	Tcl_DeleteCloseHandler(loadPtr->chan, LoadCloseProc,
+		(ClientData) textPtr);
+    }
+    if (notify && (textPtr->tkwin != NULL)) {
+	if ((loadPtr->error != NULL) && loadPtr->async) {
+	    Tcl_SetResult(interp, loadPtr->error, TCL_VOLATILE);
+	    Tcl_AddErrorInfo(interp, "\n    (loading text from channel)");
+	    Tcl_BackgroundError(interp);
+	}
+	if ((loadPtr->command != NULL)
+		&& (Tcl_GlobalEval(interp, loadPtr->command) != TCL_OK)) {
+	    Tcl_AddErrorInfo(interp, "\n    (text load command)");
+	    Tcl_BackgroundError(interp);
+	}
+    }
+    if (loadPtr->command != NULL) {
+	ckfree(loadPtr->command);
+    }
+    if (loadPtr->error != NULL) {
+	ckfree(loadPtr->error);
+    }
+    ckfree((char *) loadPtr);
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * TextEventProc --
+ *
+ *	This procedure is invoked by the Tk dispatcher on
+ *	structure changes to a text.  For texts with 3D
+ *	borders, this procedure is also invoked for exposures.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	When the window gets deleted, internal structures get
+ *	cleaned up.  When it gets exposed, it is redisplayed.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+TextEventProc(clientData, eventPtr)
+    ClientData clientData;	/* Information about window. */
+    register XEvent *eventPtr;	/* Information about event. */
+{
+    register TkText *textPtr = (TkText *) clientData;
+    TkTextIndex index, index2;
+
+    if (eventPtr->type == CTK_EXPOSE_EVENT) {
+	TkTextRedrawRegion(textPtr,
+		eventPtr->u.expose.left, eventPtr->u.expose.top,
+		eventPtr->u.expose.right - eventPtr->u.expose.left,
+		eventPtr->u.expose.bottom - eventPtr->u.expose.top);
+    } else if (eventPtr->type == CTK_MAP_EVENT) {
+	if ((textPtr->prevWidth != Tk_Width(textPtr->tkwin))
+		|| (textPtr->prevHeight != Tk_Height(textPtr->tkwin))) {
+	    TkTextRelayoutWindow(textPtr);
+	    textPtr->prevWidth = Tk_Width(textPtr->tkwin);
+	    textPtr->prevHeight = Tk_Height(textPtr->tkwin);
+	}
+    } else if (eventPtr->type == CTK_DESTROY_EVENT) {
+	if (textPtr->tkwin != NULL) {
+	    EndLoad(textPtr, 0, 0);
+	    textPtr->tkwin = NULL;
+	    Tcl_DeleteCommand(textPtr->interp,
+		    Tcl_GetCommandName(textPtr->interp,
+		    textPtr->widgetCmd));
+	}
+	Tk_EventuallyFree((ClientData) textPtr, DestroyText);
+    } else if (eventPtr->type == CTK_FOCUS_EVENT) {
+	textPtr->flags |= GOT_FOCUS;
+	TkTextMarkSegToIndex(textPtr, textPtr->insertMarkPtr, &index);
+	TkTextIndexForwChars(&index, 1, &index2);
+	TkTextChanged(textPtr, &index, &index2);
+    } else if (eventPtr->type == CTK_UNFOCUS_EVENT) {
+	textPtr->flags &= ~GOT_FOCUS;
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextCmdDeletedProc --
+ *
+ *	This procedure is invoked when a widget command is deleted.  If
+ *	the widget isn't already in the process of being destroyed,
+ *	this command destroys it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The widget is destroyed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TextCmdDeletedProc(clientData)
+    ClientData clientData;	/* Pointer to widget record for widget. */
+{
+    TkText *textPtr = (TkText *) clientData;
+    Tk_Window tkwin = textPtr->tkwin;
+
+    /*
+     * This procedure could be invoked either because the window was
+     * destroyed and the command was then deleted (in which case tkwin
+     * is NULL) or because the command was deleted, and then this procedure
+     * destroys the widget.
+     */
+
+    if (tkwin != NULL) {
+	textPtr->tkwin = NULL;
+	Tk_DestroyWindow(tkwin);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InsertChars --
+ *
+ *	This procedure implements most of the functionality of the
+ *	"insert" widget command.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The characters in "string" get added to the text just before
+ *	the character indicated by "indexPtr".
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InsertChars(textPtr, indexPtr, string)
+    TkText *textPtr;		/* Overall information about text widget. */
+    TkTextIndex *indexPtr;	/* Where to insert new characters.  May be
+				 * modified and/or invalidated. */
+    char *string;		/* Null-terminated string containing new
+				 * information to add to text. */
+{
+    int lineIndex;
+
+    /*
+     * Don't allow insertions on the last (dummy) line of the text.
+     */
+
+    lineIndex = TkBTreeLineIndex(indexPtr->linePtr);
+    if (lineIndex == TkBTreeNumLines(textPtr->tree)) {
+	lineIndex--;
+	TkTextMakeIndex(textPtr->tree, lineIndex, 1000000, indexPtr);
+    }
+
+    /*
+     * Notify the display module that lines are about to change, then do
+     * the insertion.
+     */
+
+    RecordInsert(textPtr, indexPtr, string);
+    TkTextChanged(textPtr, indexPtr, indexPtr);
+    TkBTreeInsertChars(indexPtr, string);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AppendChars --
+ *
+ *	This procedure implements the "append" widget command, which
+ *	is meant for texts that are continually added to at the end,
+ *	such as logs.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The characters in "string" get added at the end of the text,
+ *	just as for "insert end".  If maxLines is greater than zero,
+ *	lines are then deleted from the beginning of the text until
+ *	it holds no more than maxLines newlines.  If the end of the
+ *	text was visible beforehand, the view scrolls to keep it so.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AppendChars(textPtr, string, maxLines)
+    TkText *textPtr;		/* Overall information about text widget. */
+    char *string;		/* Null-terminated string containing new
+				 * information to add to text. */
+    int maxLines;		/* Maximum number of lines to keep, or 0
+				 * for no limit. */
+{
+    TkTextIndex index;
+    int follow, numLines;
+    char buffer[30];
+
+    if (*string == 0) {
+	return;
+    }
+    follow = TkTextEndVisible(textPtr);
+
+    /*
+     * Add the characters just before the final newline of the text,
+     * where "insert end" would put them.
+     */
+
+    TkTextMakeIndex(textPtr->tree, TkBTreeNumLines(textPtr->tree) - 1,
+	    1000000, &index);
+    RecordInsert(textPtr, &index, string);
+    TkTextChanged(textPtr, &index, &index);
+    TkBTreeAppendChars(&index, string);
+
+    /*
+     * Throw away the oldest lines, all in one deletion.  Any characters
+     * after the last newline don't count as a line.
+     */
+
+    if (maxLines > 0) {
+	numLines = TkBTreeNumLines(textPtr->tree) - 1;
+	if (numLines > maxLines) {
+	    sprintf(buffer, "%d.0", numLines - maxLines + 1);
+	    DeleteChars(textPtr, "1.0", buffer);
+	}
+    }
+
+    if (follow) {
+	TkTextSeeEnd(textPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DeleteChars --
+ *
+ *	This procedure implements most of the functionality of the
+ *	"delete" widget command.
+ *
+ * Results:
+ *	Returns a standard Tcl result, and leaves an error message
+ *	in textPtr->interp if there is an error.
+ *
+ * Side effects:
+ *	Characters get deleted from the text.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DeleteChars(textPtr, index1String, index2String)
+    TkText *textPtr;		/* Overall information about text widget. */
+    char *index1String;		/* String describing location of first
+				 * character to delete. */
+    char *index2String;		/* String describing location of last
+				 * character to delete.  NULL means just
+				 * delete the one character given by
+				 * index1String. */
+{
+    int line1, line2, line, charIndex, resetView;
+    TkTextIndex index1, index2;
+
+    /*
+     * Parse the starting and stopping indices.
+     */
+
+    if (TkTextGetIndex(textPtr->interp, textPtr, index1String, &index1)
+	    != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (index2String != NULL) {
+	if (TkTextGetIndex(textPtr->interp, textPtr, index2String, &index2)
+		!= TCL_OK) {
+	    return TCL_ERROR;
+	}
+    } else {
+	index2 = index1;
+	TkTextIndexForwChars(&index2, 1, &index2);
+    }
+
+    /*
+     * Make sure there's really something to delete.
+     */
+
+    if (TkTextIndexCmp(&index1, &index2) >= 0) {
 	return TCL_OK;
     }
 
@@ -937,83 +1973,1189 @@ DeleteChars(textPtr, index1String, index2String)
      * deleting the newline and then adding a "clean" one back again).
      */
 
-    line1 = TkBTreeLineIndex(index1.linePtr);
-    line2 = TkBTreeLineIndex(index2.linePtr);
-    if (line2 == TkBTreeNumLines(textPtr->tree)) {
-	TkTextTag **arrayPtr;
-	int arraySize, i;
-	TkTextIndex oldIndex2;
+    line1 = TkBTreeLineIndex(index1.linePtr);
+    line2 = TkBTreeLineIndex(index2.linePtr);
+    if (line2 == TkBTreeNumLines(textPtr->tree)) {
+	TkTextTag **arrayPtr;
+	int arraySize, i;
+	TkTextIndex oldIndex2;
+
+	oldIndex2 = index2;
+	TkTextIndexBackChars(&oldIndex2, 1, &index2);
+	line2--;
+	if ((index1.charIndex == 0) && (line1 != 0)) {
+	    TkTextIndexBackChars(&index1, 1, &index1);
+	    line1--;
+	}
+	arrayPtr = TkBTreeGetTags(&index2, &arraySize);
+	if (arrayPtr != NULL) {
+	    for (i = 0; i < arraySize; i++) {
+		TkBTreeTag(&index2, &oldIndex2, arrayPtr[i], 0);
+	    }
+	    ckfree((char *) arrayPtr);
+	}
+    }
+
+    /*
+     * Tell the display what's about to happen so it can discard
+     * obsolete display information, then do the deletion.  Also,
+     * if the deletion involves the top line on the screen, then
+     * we have to reset the view (the deletion will invalidate
+     * textPtr->topIndex).  Compute what the new first character
+     * will be, then do the deletion, then reset the view.
+     */
+
+    RecordDelete(textPtr, &index1, &index2);
+    TkTextChanged(textPtr, &index1, &index2);
+    resetView = line = charIndex = 0;
+    if (TkTextIndexCmp(&index2, &textPtr->topIndex) >= 0) {
+	if (TkTextIndexCmp(&index1, &textPtr->topIndex) <= 0) {
+	    /*
+	     * Deletion range straddles topIndex: use the beginning
+	     * of the range as the new topIndex.
+	     */
+
+	    resetView = 1;
+	    line = line1;
+	    charIndex = index1.charIndex;
+	} else if (index1.linePtr == textPtr->topIndex.linePtr) {
+	    /*
+	     * Deletion range starts on top line but after topIndex.
+	     * Use the current topIndex as the new one.
+	     */
+
+	    resetView = 1;
+	    line = line1;
+	    charIndex = textPtr->topIndex.charIndex;
+	}
+    } else if (index2.linePtr == textPtr->topIndex.linePtr) {
+	/*
+	 * Deletion range ends on top line but before topIndex.
+	 * Figure out what will be the new character index for
+	 * the character currently pointed to by topIndex.
+	 */
+
+	resetView = 1;
+	line = line2;
+	charIndex = textPtr->topIndex.charIndex;
+	if (index1.linePtr != index2.linePtr) {
+	    charIndex -= index2.charIndex;
+	} else {
+	    charIndex -= (index2.charIndex - index1.charIndex);
+	}
+    }
+    TkBTreeDeleteChars(&index1, &index2);
+    if (resetView) {
+	TkTextMakeIndex(textPtr->tree, line, charIndex, &index1);
+	TkTextSetYView(textPtr, &index1, 0);
+    }
+
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextDumpCmd --
+ *
+ *	This procedure is invoked to process the "dump" widget command
+ *	for text widgets, which reports the characters, marks, and tag
+ *	toggles in a range of the text.  See the user documentation for
+ *	details on what it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextDumpCmd(textPtr, interp, argc, argv)
+    TkText *textPtr;		/* Information about text widget. */
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings.  Someone else has already
+				 * parsed this command enough to know that
+				 * argv[1] is "dump". */
+{
+    DumpInfo dump;
+    TkTextIndex index1, index2;
+    TkTextLine *linePtr;
+    char *chanName;
+    size_t length;
+    int i, c, mode, lineNum, line2, last2, first, last, result, called;
+
+    dump.interp = interp;
+    dump.textPtr = textPtr;
+    dump.what = 0;
+    dump.command = NULL;
+    dump.chan = NULL;
+    dump.chunk = 0;
+    chanName = NULL;
+    for (i = 2; i < argc; i++) {
+	length = strlen(argv[i]);
+	if ((length < 2) || (argv[i][0] != '-')) {
+	    break;
+	}
+	c = argv[i][1];
+	if ((c == 'a') && (strncmp(argv[i], "-all", length) == 0)) {
+	    dump.what |= DUMP_TEXT|DUMP_MARK|DUMP_TAG;
+	} else if ((c == 'c') && (strncmp(argv[i], "-channel", length) == 0)
+		&& (length >= 4)) {
+	    i++;
+	    if (i >= argc) {
+		goto wrongArgs;
+	    }
+	    chanName = argv[i];
+	} else if ((c == 'c') && (strncmp(argv[i], "-chunk", length) == 0)
+		&& (length >= 4)) {
+	    i++;
+	    if (i >= argc) {
+		goto wrongArgs;
+	    }
+	    if (Tcl_GetInt(interp, argv[i], &dump.chunk) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if (dump.chunk <= 0) {
+		Tcl_AppendResult(interp, "bad chunk size \"", argv[i],
+			"\": must be greater than zero", (char *) NULL);
+		return TCL_ERROR;
+	    }
+	} else if ((c == 'c') && (strncmp(argv[i], "-command", length) == 0)
+		&& (length >= 3)) {
+	    i++;
+	    if (i >= argc) {
+		goto wrongArgs;
+	    }
+	    dump.command = argv[i];
+	} else if ((c == 'm') && (strncmp(argv[i], "-mark", length) == 0)) {
+	    dump.what |= DUMP_MARK;
+	} else if ((c == 't') && (strncmp(argv[i], "-tag", length) == 0)
+		&& (length >= 3)) {
+	    dump.what |= DUMP_TAG;
+	} else if ((c == 't') && (strncmp(argv[i], "-text", length) == 0)
+		&& (length >= 3)) {
+	    dump.what |= DUMP_TEXT;
+	} else {
+	    Tcl_AppendResult(interp, "bad switch \"", argv[i],
+		    "\": must be -all, -channel, -chunk, -command, -mark, ",
+		    "-tag, or -text", (char *) NULL);
+	    return TCL_ERROR;
+	}
+    }
+    if ((i != argc-1) && (i != argc-2)) {
+	goto wrongArgs;
+    }
+
+    /*
+     * With -channel only the characters are dumped, straight into the
+     * channel, so none of the switches for what else to dump make sense.
+     */
+
+    if (chanName != NULL) {
+	if ((dump.command != NULL) || (dump.what & ~DUMP_TEXT)) {
+	    Tcl_AppendResult(interp, "can't use -channel with -all, ",
+		    "-command, -mark, or -tag", (char *) NULL);
+	    return TCL_ERROR;
+	}
+	dump.chan = Tcl_GetChannel(interp, chanName, &mode);
+	if (dump.chan == NULL) {
+	    return TCL_ERROR;
+	}
+	if (!(mode & TCL_WRITABLE)) {
+	    Tcl_AppendResult(interp, "channel \"", chanName,
+		    "\" wasn't opened for writing", (char *) NULL);
+	    return TCL_ERROR;
+	}
+    }
+    if (dump.what == 0) {
+	dump.what = DUMP_TEXT|DUMP_MARK|DUMP_TAG;
+    }
+
+    if (TkTextGetIndex(interp, textPtr, argv[i], &index1) != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (i == argc-1) {
+	TkTextIndexForwChars(&index1, 1, &index2);
+    } else if (TkTextGetIndex(interp, textPtr, argv[i+1], &index2)
+	    != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (TkTextIndexCmp(&index1, &index2) >= 0) {
+	return TCL_OK;
+    }
+
+    /*
+     * Walk through the lines of the range, leaf by leaf.  The callbacks
+     * for -command may change the text;  in that case DumpLine finds
+     * its place again by line number, and the range is cut back to the
+     * end of the text if the text has become shorter than the range.
+     */
+
+    Tcl_DStringInit(&dump.text);
+    result = TCL_OK;
+    lineNum = TkBTreeLineIndex(index1.linePtr);
+    line2 = TkBTreeLineIndex(index2.linePtr);
+    last2 = index2.charIndex;
+    linePtr = index1.linePtr;
+    first = index1.charIndex;
+    for ( ; (linePtr != NULL) && (lineNum <= line2); lineNum++) {
+	last = (lineNum == line2) ? last2 : -1;
+	if (last == 0) {
+	    break;
+	}
+	called = 0;
+	result = DumpLine(&dump, &linePtr, lineNum, first, last, &called);
+	if (result != TCL_OK) {
+	    break;
+	}
+	if (called && (textPtr->tkwin != NULL)
+		&& (line2 > TkBTreeNumLines(textPtr->tree))) {
+	    line2 = TkBTreeNumLines(textPtr->tree);
+	    last2 = 0;
+	}
+	if (linePtr != NULL) {
+	    linePtr = TkBTreeNextLine(linePtr);
+	}
+	first = 0;
+    }
+    if (result == TCL_OK) {
+	result = DumpFlush(&dump, &called);
+    }
+    Tcl_DStringFree(&dump.text);
+    if ((result == TCL_OK) && (dump.command != NULL)) {
+	Tcl_ResetResult(interp);
+    }
+    return result;
+
+    wrongArgs:
+    Tcl_AppendResult(interp, "wrong # args: should be \"", argv[0],
+	    " dump ?switches? index1 ?index2?\"", (char *) NULL);
+    return TCL_ERROR;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DumpLine --
+ *
+ *	This procedure dumps the segments of one line of a text that
+ *	lie in a given range of characters.
+ *
+ * Results:
+ *	A standard Tcl result;  there may be an error in a -command
+ *	callback or in writing to a -channel.  *linePtrPtr is updated if
+ *	the text was changed by a callback, and becomes NULL if the line
+ *	no longer exists.  *calledPtr is set to 1 if a callback was
+ *	invoked.
+ *
+ * Side effects:
+ *	Characters, marks, and tag toggles are dumped as described for
+ *	DumpText and DumpItem.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DumpLine(dumpPtr, linePtrPtr, lineNum, first, last, calledPtr)
+    DumpInfo *dumpPtr;		/* Information about the dump. */
+    TkTextLine **linePtrPtr;	/* Line to dump;  may be modified. */
+    int lineNum;		/* Index of the line (0 means first line). */
+    int first;			/* Index of first character to dump. */
+    int last;			/* Index of character just after the last
+				 * one to dump, or -1 for the whole rest of
+				 * the line. */
+    int *calledPtr;		/* Set to 1 if a callback is invoked. */
+{
+    TkTextSegment *segPtr;
+    TkText *textPtr = dumpPtr->textPtr;
+    int pos, skip, offset, passed, start, end, count, called;
+    char *key, *value = NULL;
+
+    /*
+     * The place reached in the line is kept as the index of the next
+     * character to dump, pos, and the number of marks and toggles just
+     * before it that have been passed, skip, so that it can be found
+     * again after a callback.
+     */
+
+    pos = first;
+    skip = 0;
+
+    seek:
+    segPtr = (*linePtrPtr)->segPtr;
+    offset = 0;
+    passed = 0;
+    while (segPtr != NULL) {
+	if (segPtr->size == 0) {
+	    if ((offset == pos) && (passed < skip)) {
+		passed++;
+	    } else if (offset >= pos) {
+		break;
+	    }
+	} else if (offset + segPtr->size > pos) {
+	    break;
+	}
+	offset += segPtr->size;
+	segPtr = segPtr->nextPtr;
+    }
+
+    for ( ; segPtr != NULL; offset += segPtr->size,
+	    segPtr = segPtr->nextPtr) {
+	if ((last >= 0) && (offset >= last)) {
+	    break;
+	}
+	called = 0;
+	if (segPtr->typePtr == &tkTextCharType) {
+	    start = (pos > offset) ? pos - offset : 0;
+	    end = segPtr->size;
+	    if ((last >= 0) && (last - offset < end)) {
+		end = last - offset;
+	    }
+	    if (DumpText(dumpPtr, lineNum, offset + start,
+		    segPtr->body.chars + start, end - start, &count, &called)
+		    != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    pos = offset + start + count;
+	    skip = 0;
+	} else {
+	    key = NULL;
+	    if ((segPtr->typePtr == &tkTextToggleOnType)
+		    && (dumpPtr->what & DUMP_TAG)) {
+		key = "tagon";
+		value = segPtr->body.toggle.tagPtr->name;
+	    } else if ((segPtr->typePtr == &tkTextToggleOffType)
+		    && (dumpPtr->what & DUMP_TAG)) {
+		key = "tagoff";
+		value = segPtr->body.toggle.tagPtr->name;
+	    } else if (((segPtr->typePtr == &tkTextRightMarkType)
+		    || (segPtr->typePtr == &tkTextLeftMarkType))
+		    && (dumpPtr->what & DUMP_MARK)) {
+		key = "mark";
+		value = Tcl_GetHashKey(&textPtr->markTable,
+			segPtr->body.mark.hPtr);
+	    }
+	    if ((key != NULL) && (DumpFlush(dumpPtr, &called) != TCL_OK)) {
+		return TCL_ERROR;
+	    }
+
+	    /*
+	     * If the flush invoked a callback the segment may be gone, so
+	     * it's found again before it's dumped.
+	     */
+
+	    if (!called) {
+		if (key != NULL) {
+		    if (DumpItem(dumpPtr, key, value, lineNum, offset)
+			    != TCL_OK) {
+			return TCL_ERROR;
+		    }
+		    called = (dumpPtr->command != NULL);
+		}
+		if (segPtr->size == 0) {
+		    skip++;
+		} else {
+		    pos = offset + segPtr->size;
+		    skip = 0;
+		}
+	    }
+	}
+
+	/*
+	 * A callback may have changed the text, or even destroyed the
+	 * widget, so find the line again and the place in it.  If the
+	 * text was changed this is only roughly where the dump got to,
+	 * but it's a safe place to carry on from.
+	 */
+
+	if (called) {
+	    *calledPtr = 1;
+	    if ((textPtr->tkwin == NULL)
+		    || (lineNum >= TkBTreeNumLines(textPtr->tree))) {
+		*linePtrPtr = NULL;
+		return TCL_OK;
+	    }
+	    *linePtrPtr = TkBTreeFindLine(textPtr->tree, lineNum);
+	    goto seek;
+	}
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DumpText --
+ *
+ *	This procedure adds characters to the text being gathered for a
+ *	dump.
+ *
+ * Results:
+ *	A standard Tcl result.  *countPtr is set to the number of
+ *	characters used up, which is less than length if a -command
+ *	callback was invoked;  the characters may no longer exist after
+ *	a callback, so the caller has to find the rest again.  *calledPtr
+ *	is set to 1 if a callback was invoked.
+ *
+ * Side effects:
+ *	With -channel the characters are written to the channel at once.
+ *	Otherwise they are gathered into "text" items, which are dumped
+ *	when they hold -chunk characters or, without -chunk, when they
+ *	reach the end of a line.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DumpText(dumpPtr, lineNum, charIndex, chars, length, countPtr, calledPtr)
+    DumpInfo *dumpPtr;		/* Information about the dump. */
+    int lineNum, charIndex;	/* Position of the first character. */
+    char *chars;		/* Characters to add;  not null-terminated. */
+    int length;			/* Number of characters at chars. */
+    int *countPtr;		/* Number of characters used is stored
+				 * here. */
+    int *calledPtr;		/* Set to 1 if a callback is invoked. */
+{
+    int count, total;
+
+    *countPtr = length;
+    if (!(dumpPtr->what & DUMP_TEXT)) {
+	return TCL_OK;
+    }
+    if (dumpPtr->chan != NULL) {
+	if (Tcl_Write(dumpPtr->chan, chars, length) < 0) {
+	    Tcl_AppendResult(dumpPtr->interp, "error writing \"",
+		    Tcl_GetChannelName(dumpPtr->chan), "\": ",
+		    Tcl_PosixError(dumpPtr->interp), (char *) NULL);
+	    return TCL_ERROR;
+	}
+	return TCL_OK;
+    }
+    for (total = 0; total < length; ) {
+	if (Tcl_DStringLength(&dumpPtr->text) == 0) {
+	    dumpPtr->textLine = lineNum;
+	    dumpPtr->textChar = charIndex + total;
+	}
+	count = length - total;
+	if ((dumpPtr->chunk > 0) && (count > dumpPtr->chunk
+		- Tcl_DStringLength(&dumpPtr->text))) {
+	    count = dumpPtr->chunk - Tcl_DStringLength(&dumpPtr->text);
+	}
+	Tcl_DStringAppend(&dumpPtr->text, chars + total, count);
+	total += count;
+	if ((dumpPtr->chunk > 0)
+		? (Tcl_DStringLength(&dumpPtr->text) == dumpPtr->chunk)
+		: (chars[total-1] == '\n')) {
+	    if (DumpFlush(dumpPtr, calledPtr) != TCL_OK) {
+		return TCL_ERROR;
+	    }
+	    if (*calledPtr) {
+		*countPtr = total;
+		return TCL_OK;
+	    }
+	}
+    }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DumpFlush --
+ *
+ *	This procedure dumps any characters gathered by DumpText as a
+ *	"text" item.
+ *
+ * Results:
+ *	A standard Tcl result.  *calledPtr is set to 1 if a -command
+ *	callback was invoked.
+ *
+ * Side effects:
+ *	See DumpItem.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DumpFlush(dumpPtr, calledPtr)
+    DumpInfo *dumpPtr;		/* Information about the dump. */
+    int *calledPtr;		/* Set to 1 if a callback is invoked. */
+{
+    int result;
+
+    if (Tcl_DStringLength(&dumpPtr->text) == 0) {
+	return TCL_OK;
+    }
+    result = DumpItem(dumpPtr, "text", Tcl_DStringValue(&dumpPtr->text),
+	    dumpPtr->textLine, dumpPtr->textChar);
+    Tcl_DStringSetLength(&dumpPtr->text, 0);
+    if (dumpPtr->command != NULL) {
+	*calledPtr = 1;
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * DumpItem --
+ *
+ *	This procedure dumps one item:  a run of characters, a mark, or
+ *	a tag toggle.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	With -command, the command is invoked with the item's key, value
+ *	and index appended to it.  Otherwise they're appended to the
+ *	interpreter's result as three list elements.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+DumpItem(dumpPtr, key, value, lineNum, charIndex)
+    DumpInfo *dumpPtr;		/* Information about the dump. */
+    char *key;			/* "text", "mark", "tagon", or "tagoff". */
+    char *value;		/* Characters, mark name, or tag name. */
+    int lineNum, charIndex;	/* Position of the item. */
+{
+    Tcl_DString command;
+    char index[40];
+    int result;
+
+    sprintf(index, "%d.%d", lineNum + 1, charIndex);
+    if (dumpPtr->command == NULL) {
+	Tcl_AppendElement(dumpPtr->interp, key);
+	Tcl_AppendElement(dumpPtr->interp, value);
+	Tcl_AppendElement(dumpPtr->interp, index);
+	return TCL_OK;
+    }
+    Tcl_DStringInit(&command);
+    Tcl_DStringAppend(&command, dumpPtr->command, -1);
+    Tcl_DStringAppendElement(&command, key);
+    Tcl_DStringAppendElement(&command, value);
+    Tcl_DStringAppendElement(&command, index);
+    result = Tcl_Eval(dumpPtr->interp, Tcl_DStringValue(&command));
+    Tcl_DStringFree(&command);
+    if (result != TCL_OK) {
+	Tcl_AddErrorInfo(dumpPtr->interp,
+		"\n    (segment dump command executed by text)");
+    }
+    return result;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TextEditCmd --
+ *
+ *	This procedure is invoked to process the "edit" widget command
+ *	for text widgets, which undoes and redoes changes to the text.
+ *	See the user documentation for details on what it does.
+ *
+ * Results:
+ *	A standard Tcl result.
+ *
+ * Side effects:
+ *	See the user documentation.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TextEditCmd(textPtr, interp, argc, argv)
+    TkText *textPtr;		/* Information about text widget. */
+    Tcl_Interp *interp;		/* Current interpreter. */
+    int argc;			/* Number of arguments. */
+    char **argv;		/* Argument strings.  Someone else has already
+				 * parsed this command enough to know that
+				 * argv[1] is "edit". */
+{
+    TkTextUndo *undoPtr;
+    size_t length;
+    int c;
 
-	oldIndex2 = index2;
-	TkTextIndexBackChars(&oldIndex2, 1, &index2);
-	line2--;
-	if ((index1.charIndex == 0) && (line1 != 0)) {
-	    TkTextIndexBackChars(&index1, 1, &index1);
-	    line1--;
+    if (argc != 3) {
+	Tcl_AppendResult(interp, "wrong # args: should be \"",
+		argv[0], " edit option\"", (char *) NULL);
+	return TCL_ERROR;
+    }
+    c = argv[2][0];
+    length = strlen(argv[2]);
+    if ((c == 'r') && (strncmp(argv[2], "redo", length) == 0)
+	    && (length >= 3)) {
+	if (textPtr->redoPtr == NULL) {
+	    Tcl_SetResult(interp, "nothing to redo", TCL_STATIC);
+	    return TCL_ERROR;
 	}
-	arrayPtr = TkBTreeGetTags(&index2, &arraySize);
-	if (arrayPtr != NULL) {
-	    for (i = 0; i < arraySize; i++) {
-		TkBTreeTag(&index2, &oldIndex2, arrayPtr[i], 0);
+	if ((textPtr->state != tkTextNormalUid) || textPtr->readOnly) {
+	    return TCL_OK;
+	}
+
+	/*
+	 * Redo the next group of changes, oldest first, moving them back
+	 * to the end of the list of changes that can be undone.
+	 */
+
+	do {
+	    undoPtr = textPtr->redoPtr;
+	    textPtr->redoPtr = undoPtr->nextPtr;
+	    ApplyUndo(textPtr, undoPtr, 1);
+	    undoPtr->prevPtr = textPtr->undoLastPtr;
+	    undoPtr->nextPtr = NULL;
+	    if (textPtr->undoLastPtr == NULL) {
+		textPtr->undoFirstPtr = undoPtr;
+	    } else {
+		textPtr->undoLastPtr->nextPtr = undoPtr;
 	    }
-	    ckfree((char *) arrayPtr);
+	    textPtr->undoLastPtr = undoPtr;
+	} while ((textPtr->redoPtr != NULL) && !textPtr->redoPtr->group);
+	textPtr->flags |= UNDO_SEPARATOR;
+    } else if ((c == 'r') && (strncmp(argv[2], "reset", length) == 0)
+	    && (length >= 3)) {
+	ResetUndo(textPtr);
+    } else if ((c == 's') && (strncmp(argv[2], "separator", length) == 0)) {
+	textPtr->flags |= UNDO_SEPARATOR;
+    } else if ((c == 'u') && (strncmp(argv[2], "undo", length) == 0)) {
+	if (textPtr->undoLastPtr == NULL) {
+	    Tcl_SetResult(interp, "nothing to undo", TCL_STATIC);
+	    return TCL_ERROR;
+	}
+	if ((textPtr->state != tkTextNormalUid) || textPtr->readOnly) {
+	    return TCL_OK;
 	}
+
+	/*
+	 * Undo the newest group of changes, newest first, pushing them
+	 * on the redo stack so that the group's first change comes out
+	 * first.
+	 */
+
+	do {
+	    undoPtr = textPtr->undoLastPtr;
+	    textPtr->undoLastPtr = undoPtr->prevPtr;
+	    if (textPtr->undoLastPtr == NULL) {
+		textPtr->undoFirstPtr = NULL;
+	    } else {
+		textPtr->undoLastPtr->nextPtr = NULL;
+	    }
+	    ApplyUndo(textPtr, undoPtr, 0);
+	    undoPtr->prevPtr = NULL;
+	    undoPtr->nextPtr = textPtr->redoPtr;
+	    textPtr->redoPtr = undoPtr;
+	} while (!undoPtr->group && (textPtr->undoLastPtr != NULL));
+	textPtr->flags |= UNDO_SEPARATOR;
+    } else {
+	Tcl_AppendResult(interp, "bad edit option \"", argv[2],
+		"\": must be redo, reset, separator, or undo",
+		(char *) NULL);
+	return TCL_ERROR;
     }
+    return TCL_OK;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RecordInsert --
+ *
+ *	This procedure is called just before characters are inserted
+ *	into a text, to record the insertion so that it can be undone.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If the text's -undo option is on, the insertion is added to the
+ *	text's list of changes, either as a new record or by extending
+ *	the newest record if the insertion continues it.  Anything that
+ *	could be redone is forgotten.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RecordInsert(textPtr, indexPtr, string)
+    TkText *textPtr;		/* Overall information about text widget. */
+    TkTextIndex *indexPtr;	/* Where the characters will be inserted. */
+    char *string;		/* Characters to be inserted. */
+{
+    TkTextUndo *undoPtr;
+    int line, length;
+
+    if (!textPtr->undo || (textPtr->flags & UNDO_IN_PROGRESS)) {
+	return;
+    }
+    length = strlen(string);
+    if (length == 0) {
+	return;
+    }
+    ResetRedo(textPtr);
+    line = TkBTreeLineIndex(indexPtr->linePtr);
+    undoPtr = textPtr->undoLastPtr;
+    if ((undoPtr == NULL) || (textPtr->flags & UNDO_SEPARATOR)
+	    || (undoPtr->type != UNDO_INSERT) || (undoPtr->endLine != line)
+	    || (undoPtr->endChar != indexPtr->charIndex)) {
+	undoPtr = NewUndo(textPtr, UNDO_INSERT, line, indexPtr->charIndex);
+	undoPtr->endLine = line;
+	undoPtr->endChar = indexPtr->charIndex;
+    }
+    AddUndoChars(textPtr, undoPtr, string, length, 0);
+    MovePastChars(string, length, &undoPtr->endLine, &undoPtr->endChar);
+    TrimUndo(textPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RecordDelete --
+ *
+ *	This procedure is called just before a range of characters is
+ *	deleted from a text, to record the deletion so that it can be
+ *	undone.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If the text's -undo option is on, the deleted characters are
+ *	added to the text's list of changes, either as a new record or
+ *	by extending the newest record if the deletion is next to it.
+ *	Anything that could be redone is forgotten, and if the deletion
+ *	is too big for -maxundobytes everything recorded is forgotten.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+RecordDelete(textPtr, index1Ptr, index2Ptr)
+    TkText *textPtr;		/* Overall information about text widget. */
+    TkTextIndex *index1Ptr;	/* First character to be deleted. */
+    TkTextIndex *index2Ptr;	/* Character just after the last one to be
+				 * deleted. */
+{
+    TkTextUndo *undoPtr;
+    TkTextLine *linePtr;
+    Tcl_DString chars;
+    int line1, line2, count;
+
+    if (!textPtr->undo || (textPtr->flags & UNDO_IN_PROGRESS)
+	    || (TkTextIndexCmp(index1Ptr, index2Ptr) >= 0)) {
+	return;
+    }
+    ResetRedo(textPtr);
 
     /*
-     * Tell the display what's about to happen so it can discard
-     * obsolete display information, then do the deletion.  Also,
-     * if the deletion involves the top line on the screen, then
-     * we have to reset the view (the deletion will invalidate
-     * textPtr->topIndex).  Compute what the new first character
-     * will be, then do the deletion, then reset the view.
+     * If the record for the deletion couldn't fit in -maxundobytes,
+     * TrimUndo would throw away everything anyway, so don't copy the
+     * characters at all.  Counting stops as soon as the limit is
+     * passed, so deleting most of a huge text stays cheap.
      */
 
-    TkTextChanged(textPtr, &index1, &index2);
-    resetView = line = charIndex = 0;
-    if (TkTextIndexCmp(&index2, &textPtr->topIndex) >= 0) {
-	if (TkTextIndexCmp(&index1, &textPtr->topIndex) <= 0) {
-	    /*
-	     * Deletion range straddles topIndex: use the beginning
-	     * of the range as the new topIndex.
-	     */
+    if (textPtr->maxUndoBytes > 0) {
+	count = index2Ptr->charIndex - index1Ptr->charIndex;
+	for (linePtr = index1Ptr->linePtr; (linePtr != index2Ptr->linePtr)
+		&& (count <= textPtr->maxUndoBytes);
+		linePtr = TkBTreeNextLine(linePtr)) {
+	    count += TkBTreeCharsInLine(linePtr);
+	}
+	if (count + 1 > (textPtr->maxUndoBytes
+		- (int) sizeof(TkTextUndo)) / 2) {
+	    ResetUndo(textPtr);
+	    return;
+	}
+    }
+    Tcl_DStringInit(&chars);
+    GetChars(index1Ptr, index2Ptr, &chars);
+    line1 = TkBTreeLineIndex(index1Ptr->linePtr);
+    line2 = TkBTreeLineIndex(index2Ptr->linePtr);
+    undoPtr = textPtr->undoLastPtr;
+    if ((undoPtr != NULL) && !(textPtr->flags & UNDO_SEPARATOR)
+	    && (undoPtr->type == UNDO_DELETE)
+	    && (undoPtr->line == line2)
+	    && (undoPtr->charIndex == index2Ptr->charIndex)) {
+	/*
+	 * The characters are just before the last ones deleted, as when
+	 * backspacing.
+	 */
+
+	AddUndoChars(textPtr, undoPtr, Tcl_DStringValue(&chars),
+		Tcl_DStringLength(&chars), 1);
+	undoPtr->line = line1;
+	undoPtr->charIndex = index1Ptr->charIndex;
+    } else {
+	if ((undoPtr == NULL) || (textPtr->flags & UNDO_SEPARATOR)
+		|| (undoPtr->type != UNDO_DELETE) || (undoPtr->line != line1)
+		|| (undoPtr->charIndex != index1Ptr->charIndex)) {
+	    undoPtr = NewUndo(textPtr, UNDO_DELETE, line1,
+		    index1Ptr->charIndex);
+	}
+	AddUndoChars(textPtr, undoPtr, Tcl_DStringValue(&chars),
+		Tcl_DStringLength(&chars), 0);
+    }
+    Tcl_DStringFree(&chars);
+    TrimUndo(textPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * NewUndo --
+ *
+ *	This procedure adds a new, empty record to the end of a text's
+ *	list of changes that can be undone.
+ *
+ * Results:
+ *	The return value is a pointer to the new record.
+ *
+ * Side effects:
+ *	Memory is allocated.  The record starts a new group of changes
+ *	if the text has -autoseparators or a separator was asked for.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static TkTextUndo *
+NewUndo(textPtr, type, line, charIndex)
+    TkText *textPtr;		/* Overall information about text widget. */
+    int type;			/* UNDO_INSERT or UNDO_DELETE. */
+    int line, charIndex;	/* Where the change starts. */
+{
+    TkTextUndo *undoPtr;
+
+    undoPtr = (TkTextUndo *) ckalloc(sizeof(TkTextUndo));
+    undoPtr->type = type;
+    undoPtr->group = textPtr->autoSeparators
+	    || (textPtr->flags & UNDO_SEPARATOR)
+	    || (textPtr->undoLastPtr == NULL);
+    undoPtr->line = line;
+    undoPtr->charIndex = charIndex;
+    undoPtr->endLine = line;
+    undoPtr->endChar = charIndex;
+    undoPtr->length = 0;
+    undoPtr->space = 0;
+    undoPtr->chars = NULL;
+    undoPtr->prevPtr = textPtr->undoLastPtr;
+    undoPtr->nextPtr = NULL;
+    if (textPtr->undoLastPtr == NULL) {
+	textPtr->undoFirstPtr = undoPtr;
+    } else {
+	textPtr->undoLastPtr->nextPtr = undoPtr;
+    }
+    textPtr->undoLastPtr = undoPtr;
+    textPtr->undoBytes += sizeof(TkTextUndo);
+    textPtr->flags &= ~UNDO_SEPARATOR;
+    return undoPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddUndoChars --
+ *
+ *	This procedure adds characters to the start or end of those
+ *	recorded for a change.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The record's storage may be reallocated;  it's doubled each time
+ *	it fills up, so that typing a long run of characters one at a
+ *	time doesn't take quadratic time.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AddUndoChars(textPtr, undoPtr, string, length, atStart)
+    TkText *textPtr;		/* Overall information about text widget. */
+    TkTextUndo *undoPtr;	/* Record to add to. */
+    char *string;		/* Characters to add. */
+    int length;			/* Number of characters at string. */
+    int atStart;		/* Non-zero means put the characters before
+				 * those already recorded;  zero means put
+				 * them after. */
+{
+    int space;
+
+    if (undoPtr->length + length + 1 > undoPtr->space) {
+	space = 2 * (undoPtr->length + length + 1);
+	if (space < 16) {
+	    space = 16;
+	}
+	if (undoPtr->chars == NULL) {
+	    undoPtr->chars = (char *) ckalloc((unsigned) space);
+	} else {
+	    undoPtr->chars = (char *) ckrealloc(undoPtr->chars,
+		    (unsigned) space);
+	}
+	textPtr->undoBytes += space - undoPtr->space;
+	undoPtr->space = space;
+    }
+    if (atStart) {
+	memmove((VOID *) (undoPtr->chars + length), (VOID *) undoPtr->chars,
+		(size_t) undoPtr->length);
+	memcpy((VOID *) undoPtr->chars, (VOID *) string, (size_t) length);
+    } else {
+	memcpy((VOID *) (undoPtr->chars + undoPtr->length), (VOID *) string,
+		(size_t) length);
+    }
+    undoPtr->length += length;
+    undoPtr->chars[undoPtr->length] = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MovePastChars --
+ *
+ *	Given a position in a text, as a line index and character index,
+ *	compute where characters inserted there would end.
+ *
+ * Results:
+ *	*linePtr and *charPtr are advanced past the characters.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+MovePastChars(string, length, linePtr, charPtr)
+    char *string;		/* Characters. */
+    int length;			/* Number of characters at string. */
+    int *linePtr;		/* Line index;  modified. */
+    int *charPtr;		/* Character index within line;  modified. */
+{
+    char *p, *end;
+
+    for (p = string, end = string + length; p < end; p++) {
+	if (*p == '\n') {
+	    (*linePtr)++;
+	    *charPtr = 0;
+	} else {
+	    (*charPtr)++;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ApplyUndo --
+ *
+ *	This procedure undoes or redoes one recorded change.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The characters of the change are deleted from the text or put
+ *	back, and the insertion cursor is moved to where they were.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ApplyUndo(textPtr, undoPtr, redo)
+    TkText *textPtr;		/* Overall information about text widget. */
+    TkTextUndo *undoPtr;	/* Change to undo or redo. */
+    int redo;			/* Non-zero means redo the change, zero
+				 * means undo it. */
+{
+    TkTextIndex index;
+    char string1[40], string2[40];
+    int line, charIndex;
+
+    line = undoPtr->line;
+    charIndex = undoPtr->charIndex;
+    MovePastChars(undoPtr->chars, undoPtr->length, &line, &charIndex);
+    textPtr->flags |= UNDO_IN_PROGRESS;
+    if ((undoPtr->type == UNDO_INSERT) == !redo) {
+	sprintf(string1, "%d.%d", undoPtr->line + 1, undoPtr->charIndex);
+	sprintf(string2, "%d.%d", line + 1, charIndex);
+	DeleteChars(textPtr, string1, string2);
+	line = undoPtr->line;
+	charIndex = undoPtr->charIndex;
+    } else {
+	TkTextMakeIndex(textPtr->tree, undoPtr->line, undoPtr->charIndex,
+		&index);
+	InsertChars(textPtr, &index, undoPtr->chars);
+    }
+    textPtr->flags &= ~UNDO_IN_PROGRESS;
+    TkTextMakeIndex(textPtr->tree, line, charIndex, &index);
+    TkTextSetMark(textPtr, "insert", &index);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TrimUndo --
+ *
+ *	This procedure makes sure that the changes recorded for a text
+ *	fit in its -maxundobytes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The oldest groups of changes are forgotten until the rest fit.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+TrimUndo(textPtr)
+    TkText *textPtr;		/* Overall information about text widget. */
+{
+    TkTextUndo *undoPtr;
+
+    if (textPtr->maxUndoBytes <= 0) {
+	return;
+    }
+    while ((textPtr->undoBytes > textPtr->maxUndoBytes)
+	    && (textPtr->undoFirstPtr != NULL)) {
+	do {
+	    undoPtr = textPtr->undoFirstPtr;
+	    textPtr->undoFirstPtr = undoPtr->nextPtr;
+	    FreeUndo(textPtr, undoPtr);
+	} while ((textPtr->undoFirstPtr != NULL)
+		&& !textPtr->undoFirstPtr->group);
+	if (textPtr->undoFirstPtr == NULL) {
+	    textPtr->undoLastPtr = NULL;
+	} else {
+	    textPtr->undoFirstPtr->prevPtr = NULL;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ResetUndo, ResetRedo --
+ *
+ *	These procedures forget all the changes recorded for a text
+ *	(ResetUndo) or just those that could be redone (ResetRedo).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ResetUndo(textPtr)
+    TkText *textPtr;		/* Overall information about text widget. */
+{
+    TkTextUndo *undoPtr;
 
-	    resetView = 1;
-	    line = line1;
-	    charIndex = index1.charIndex;
-	} else if (index1.linePtr == textPtr->topIndex.linePtr) {
-	    /*
-	     * Deletion range starts on top line but after topIndex.
-	     * Use the current topIndex as the new one.
-	     */
+    ResetRedo(textPtr);
+    while (textPtr->undoFirstPtr != NULL) {
+	undoPtr = textPtr->undoFirstPtr;
+	textPtr->undoFirstPtr = undoPtr->nextPtr;
+	FreeUndo(textPtr, undoPtr);
+    }
+    textPtr->undoLastPtr = NULL;
+    textPtr->flags &= ~UNDO_SEPARATOR;
+}
 
-	    resetView = 1;
-	    line = line1;
-	    charIndex = textPtr->topIndex.charIndex;
-	}
-    } else if (index2.linePtr == textPtr->topIndex.linePtr) {
-	/*
-	 * Deletion range ends on top line but before topIndex.
-	 * Figure out what will be the new character index for
-	 * the character currently pointed to by topIndex.
-	 */
+static void
+ResetRedo(textPtr)
+    TkText *textPtr;		/* Overall information about text widget. */
+{
+    TkTextUndo *undoPtr;
 
-	resetView = 1;
-	line = line2;
-	charIndex = textPtr->topIndex.charIndex;
-	if (index1.linePtr != index2.linePtr) {
-	    charIndex -= index2.charIndex;
-	} else {
-	    charIndex -= (index2.charIndex - index1.charIndex);
-	}
+    while (textPtr->redoPtr != NULL) {
+	undoPtr = textPtr->redoPtr;
+	textPtr->redoPtr = undoPtr->nextPtr;
+	FreeUndo(textPtr, undoPtr);
     }
-    TkBTreeDeleteChars(&index1, &index2);
-    if (resetView) {
-	TkTextMakeIndex(textPtr->tree, line, charIndex, &index1);
-	TkTextSetYView(textPtr, &index1, 0);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeUndo --
+ *
+ *	This procedure frees the storage for a recorded change.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed and the text's count of undo memory is reduced.
+ *	The caller must already have unlinked the record.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeUndo(textPtr, undoPtr)
+    TkText *textPtr;		/* Overall information about text widget. */
+    TkTextUndo *undoPtr;	/* Record to free. */
+{
+    textPtr->undoBytes -= sizeof(TkTextUndo) + undoPtr->space;
+    if (undoPtr->chars != NULL) {
+	ckfree(undoPtr->chars);
     }
+    ckfree((char *) undoPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetChars --
+ *
+ *	This procedure collects the characters in a range of a text.
+ *
+ * Results:
+ *	The characters from index1Ptr up to but not including index2Ptr
+ *	are appended to *dsPtr.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
 
-    return TCL_OK;
+static void
+GetChars(index1Ptr, index2Ptr, dsPtr)
+    TkTextIndex *index1Ptr;	/* First character to get. */
+    TkTextIndex *index2Ptr;	/* Character just after the last one to
+				 * get. */
+    Tcl_DString *dsPtr;		/* Where to put the characters. */
+{
+    TkTextIndex index;
+    TkTextSegment *segPtr;
+    int offset, last, last2;
+
+    index = *index1Ptr;
+    while (TkTextIndexCmp(&index, index2Ptr) < 0) {
+	segPtr = TkTextIndexToSeg(&index, &offset);
+	last = segPtr->size;
+	if (index.linePtr == index2Ptr->linePtr) {
+	    last2 = index2Ptr->charIndex - index.charIndex + offset;
+	    if (last2 < last) {
+		last = last2;
+	    }
+	}
+	if (segPtr->typePtr == &tkTextCharType) {
+	    Tcl_DStringAppend(dsPtr, segPtr->body.chars + offset,
+		    last - offset);
+	}
+	TkTextIndexForwChars(&index, last - offset, &index);
+    }
 }
 
 /*
@@ -1041,17 +3183,21 @@ TextSearchCmd(textPtr, interp, argc, argv)
     int argc;			/* Number of arguments. */
     char **argv;		/* Argument strings. */
 {
-    int backwards, exact, c, i, argsLeft, noCase, leftToScan;
+    int backwards, exact, c, i, argsLeft, noCase, all;
     size_t length;
     int numLines, startingLine, startingChar, lineNum, firstChar, lastChar;
-    int code, matchLength, matchChar, passes, stopLine, searchWholeText;
-    int patLength;
+    int code, matchChar, matchLength, passes, stopLine, searchWholeText;
+    int lineLength, numCharSegs, prevLineNum, numMatches, maxMatches, m;
     char *arg, *pattern, *varName, *p, *startOfLine;
-    char buffer[20];
-    TkTextIndex index, stopIndex;
-    Tcl_DString line, patDString;
-    TkTextSegment *segPtr;
+    char buffer[TK_POS_CHARS];
+    TkTextIndex index, endIndex, stopIndex;
+    Tcl_DString line, patDString, resultString, countString;
+    TkTextSegment *segPtr, *charSegPtr;
     TkTextLine *linePtr;
+    ExactPattern exactPat;
+    int staticMatches[2*STATIC_MATCHES];
+    int *matches;			/* Start and length of each match in
+					 * the current line. */
     Tcl_RegExp regexp = NULL;		/* Initialization needed only to
 					 * prevent compiler warning. */
 
@@ -1062,6 +3208,7 @@ TextSearchCmd(textPtr, interp, argc, argv)
     exact = 1;
     backwards = 0;
     noCase = 0;
+    all = 0;
     varName = NULL;
     for (i = 2; i < argc; i++) {
 	arg = argv[i];
@@ -1073,11 +3220,13 @@ TextSearchCmd(textPtr, interp, argc, argv)
 	    badSwitch:
 	    Tcl_AppendResult(interp, "bad switch \"", arg,
 		    "\": must be -forward, -backward, -exact, -regexp, ",
-		    "-nocase, -count, or --", (char *) NULL);
+		    "-nocase, -all, -count, or --", (char *) NULL);
 	    return TCL_ERROR;
 	}
 	c = arg[1];
-	if ((c == 'b') && (strncmp(argv[i], "-backwards", length) == 0)) {
+	if ((c == 'a') && (strncmp(argv[i], "-all", length) == 0)) {
+	    all = 1;
+	} else if ((c == 'b') && (strncmp(argv[i], "-backwards", length) == 0)) {
 	    backwards = 1;
 	} else if ((c == 'c') && (strncmp(argv[i], "-count", length) == 0)) {
 	    if (i >= (argc-1)) {
@@ -1110,21 +3259,6 @@ TextSearchCmd(textPtr, interp, argc, argv)
     }
     pattern = argv[i];
 
-    /*
-     * Convert the pattern to lower-case if we're supposed to ignore case.
-     */
-
-    if (noCase) {
-	Tcl_DStringInit(&patDString);
-	Tcl_DStringAppend(&patDString, pattern, -1);
-	pattern = Tcl_DStringValue(&patDString);
-	for (p = pattern; *p != 0; p++) {
-	    if (isupper(UCHAR(*p))) {
-		*p = tolower(UCHAR(*p));
-	    }
-	}
-    }
-
     if (TkTextGetIndex(interp, textPtr, argv[i+1], &index) != TCL_OK) {
 	return TCL_ERROR;
     }
@@ -1156,23 +3290,52 @@ TextSearchCmd(textPtr, interp, argc, argv)
     }
 
     /*
-     * Scan through all of the lines of the text circularly, starting
-     * at the given index.
+     * Set up the matcher.  Exact patterns are compiled once into a
+     * Boyer-Moore-Horspool table that folds case as it compares, so
+     * lines never need to be copied or converted for them.  For
+     * regular expressions, convert the pattern to lower-case if we're
+     * supposed to ignore case (the lines are converted as they're
+     * searched).
      */
 
-    matchLength = patLength = 0;	/* Only needed to prevent compiler
-					 * warnings. */
     if (exact) {
-	patLength = strlen(pattern);
+	CompileExact(&exactPat, pattern, noCase);
     } else {
+	if (noCase) {
+	    Tcl_DStringInit(&patDString);
+	    Tcl_DStringAppend(&patDString, pattern, -1);
+	    pattern = Tcl_DStringValue(&patDString);
+	    for (p = pattern; *p != 0; p++) {
+		if (isupper(UCHAR(*p))) {
+		    *p = tolower(UCHAR(*p));
+		}
+	    }
+	}
 	regexp = Tcl_RegExpCompile(interp, pattern);
+	if (noCase) {
+	    Tcl_DStringFree(&patDString);
+	}
 	if (regexp == NULL) {
 	    return TCL_ERROR;
 	}
     }
+
+    /*
+     * Scan through all of the lines of the text circularly, starting
+     * at the given index.  Lines are fetched one after another with
+     * TkBTreeNextLine when going forward, rather than being looked up
+     * from the top of the B-tree each time.
+     */
+
+    matches = staticMatches;
+    maxMatches = STATIC_MATCHES;
     lineNum = startingLine;
+    prevLineNum = -1;
+    linePtr = NULL;
     code = TCL_OK;
     Tcl_DStringInit(&line);
+    Tcl_DStringInit(&resultString);
+    Tcl_DStringInit(&countString);
     for (passes = 0; passes < 2; ) {
 	if (lineNum >= numLines) {
 	    /*
@@ -1181,49 +3344,60 @@ TextSearchCmd(textPtr, interp, argc, argv)
 
 	    goto nextLine;
 	}
+	if ((linePtr != NULL) && (lineNum == prevLineNum+1)) {
+	    linePtr = TkBTreeNextLine(linePtr);
+	} else {
+	    linePtr = TkBTreeFindLine(textPtr->tree, lineNum);
+	}
+	prevLineNum = lineNum;
 
 	/*
-	 * Extract the text from the line.  If we're doing regular
-	 * expression matching, drop the newline from the line, so
-	 * that "$" can be used to match the end of the line.
+	 * Get the text of the line.  Exact matching can use it where it
+	 * is if it's all in one segment, as it usually is.  Otherwise
+	 * extract it into a buffer (reused from line to line).  If we're
+	 * doing regular expression matching, drop the newline from the
+	 * line, so that "$" can be used to match the end of the line, and
+	 * convert the line to lower case if we're ignoring case.
 	 */
 
-	linePtr = TkBTreeFindLine(textPtr->tree, lineNum);
+	charSegPtr = NULL;
+	numCharSegs = 0;
 	for (segPtr = linePtr->segPtr; segPtr != NULL;
 		segPtr = segPtr->nextPtr) {
-	    if (segPtr->typePtr != &tkTextCharType) {
-		continue;
+	    if (segPtr->typePtr == &tkTextCharType) {
+		charSegPtr = segPtr;
+		numCharSegs++;
 	    }
-	    Tcl_DStringAppend(&line, segPtr->body.chars, segPtr->size);
 	}
-	if (!exact) {
-	    Tcl_DStringSetLength(&line, Tcl_DStringLength(&line)-1);
-	}
-	startOfLine = Tcl_DStringValue(&line);
-
-	/*
-	 * If we're ignoring case, convert the line to lower case.
-	 */
-
-	if (noCase) {
-	    for (p = Tcl_DStringValue(&line); *p != 0; p++) {
-		if (isupper(UCHAR(*p))) {
-		    *p = tolower(UCHAR(*p));
+	if (exact && (numCharSegs == 1)) {
+	    startOfLine = charSegPtr->body.chars;
+	    lineLength = charSegPtr->size;
+	} else {
+	    Tcl_DStringSetLength(&line, 0);
+	    for (segPtr = linePtr->segPtr; segPtr != NULL;
+		    segPtr = segPtr->nextPtr) {
+		if (segPtr->typePtr == &tkTextCharType) {
+		    Tcl_DStringAppend(&line, segPtr->body.chars, segPtr->size);
 		}
 	    }
+	    if (!exact) {
+		Tcl_DStringSetLength(&line, Tcl_DStringLength(&line)-1);
+		if (noCase) {
+		    for (p = Tcl_DStringValue(&line); *p != 0; p++) {
+			if (isupper(UCHAR(*p))) {
+			    *p = tolower(UCHAR(*p));
+			}
+		    }
+		}
+	    }
+	    startOfLine = Tcl_DStringValue(&line);
+	    lineLength = Tcl_DStringLength(&line);
 	}
 
-	/*
-	 * Check for matches within the current line.  If so, and if we're
-	 * searching backwards, repeat the search to find the last match
-	 * in the line.
-	 */
-
-	matchChar = -1;
 	firstChar = 0;
 	lastChar = INT_MAX;
 	if (lineNum == startingLine) {
-	    int indexInDString;
+	    int indexInLine, leftToScan;
 
 	    /*
 	     * The starting line is tricky: the first time we see it
@@ -1235,11 +3409,11 @@ TextSearchCmd(textPtr, interp, argc, argv)
 	     * character.
 	     */
 
-	    indexInDString = startingChar;
+	    indexInLine = startingChar;
 	    for (segPtr = linePtr->segPtr, leftToScan = startingChar;
 		    leftToScan > 0; segPtr = segPtr->nextPtr) {
 		if (segPtr->typePtr != &tkTextCharType) {
-		    indexInDString -= segPtr->size;
+		    indexInLine -= segPtr->size;
 		}
 		leftToScan -= segPtr->size;
 	    }
@@ -1250,8 +3424,8 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		 * Only use the last part of the line.
 		 */
 
-		firstChar = indexInDString;
-		if (firstChar >= Tcl_DStringLength(&line)) {
+		firstChar = indexInLine;
+		if (firstChar >= lineLength) {
 		    goto nextLine;
 		}
 	    } else {
@@ -1259,18 +3433,30 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		 * Use only the first part of the line.
 		 */
 
-		lastChar = indexInDString;
+		lastChar = indexInLine;
 	    }
 	}
-	do {
+
+	/*
+	 * Find the matches within the current line:  just the first one
+	 * if we're searching forwards, the last one if backwards, or all
+	 * of them (without overlaps) for -all.  An exact line still has
+	 * its newline, so an empty match can't start after that, but a
+	 * regular expression can match an empty string at the end of
+	 * its line.
+	 */
+
+	numMatches = 0;
+	while ((firstChar < lineLength)
+		|| (!exact && (firstChar == lineLength))) {
 	    int thisLength;
+
 	    if (exact) {
-		p = strstr(startOfLine + firstChar, pattern);
-		if (p == NULL) {
+		i = MatchExact(&exactPat, startOfLine, firstChar, lineLength);
+		if (i < 0) {
 		    break;
 		}
-		i = p - startOfLine;
-		thisLength = patLength;
+		thisLength = exactPat.length;
 	    } else {
 		char *start, *end;
 		int match;
@@ -1291,42 +3477,41 @@ TextSearchCmd(textPtr, interp, argc, argv)
 	    if (i >= lastChar) {
 		break;
 	    }
-	    matchChar = i;
-	    matchLength = thisLength;
-	    firstChar = matchChar+1;
-	} while (backwards);
+	    if (all || (numMatches == 0)) {
+		if (numMatches == maxMatches) {
+		    int *newMatches;
+
+		    newMatches = (int *) ckalloc((unsigned)
+			    (4 * maxMatches * sizeof(int)));
+		    memcpy((VOID *) newMatches, (VOID *) matches,
+			    2 * maxMatches * sizeof(int));
+		    if (matches != staticMatches) {
+			ckfree((char *) matches);
+		    }
+		    matches = newMatches;
+		    maxMatches *= 2;
+		}
+		numMatches++;
+	    }
+	    matches[2*numMatches - 2] = i;
+	    matches[2*numMatches - 1] = thisLength;
+	    if (!all && !backwards) {
+		break;
+	    }
+	    firstChar = i + ((all && (thisLength > 0)) ? thisLength : 1);
+	}
 
 	/*
-	 * If we found a match then we're done.  Make sure that
-	 * the match occurred before the stopping index, if one was
-	 * specified.
+	 * Turn the matches into indices, in the order of the search.
+	 * Make sure that each occurred before the stopping index, if one
+	 * was specified.
 	 */
 
-	if (matchChar >= 0) {
-	    /*
-	     * The index information returned by the regular expression
-	     * parser only considers textual information:  it doesn't
-	     * account for embedded windows or any other non-textual info.
-	     * Scan through the line's segments again to adjust both
-	     * matchChar and matchCount.
-	     */
-
-	    for (segPtr = linePtr->segPtr, leftToScan = matchChar;
-		    leftToScan >= 0; segPtr = segPtr->nextPtr) {
-		if (segPtr->typePtr != &tkTextCharType) {
-		    matchChar += segPtr->size;
-		    continue;
-		}
-		leftToScan -= segPtr->size;
-	    }
-	    for (leftToScan += matchLength; leftToScan > 0;
-		    segPtr = segPtr->nextPtr) {
-		if (segPtr->typePtr != &tkTextCharType) {
-		    matchLength += segPtr->size;
-		    continue;
-		}
-		leftToScan -= segPtr->size;
-	    }
+	for (m = 0; m < numMatches; m++) {
+	    i = backwards ? (numMatches - 1 - m) : m;
+	    matchChar = matches[2*i];
+	    matchLength = matches[2*i + 1];
+	    AdjustForSegments(linePtr, &matchChar, &matchLength);
 	    TkTextMakeIndex(textPtr->tree, lineNum, matchChar, &index);
 	    if (!searchWholeText) {
 		if (!backwards && (TkTextIndexCmp(&index, &stopIndex) >= 0)) {
@@ -1336,16 +3521,22 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		    goto done;
 		}
 	    }
-	    if (varName != NULL) {
-		sprintf(buffer, "%d", matchLength);
-		if (Tcl_SetVar(interp, varName, buffer, TCL_LEAVE_ERR_MSG)
-			== NULL) {
+	    sprintf(buffer, "%d", matchLength);
+	    if (!all) {
+		if ((varName != NULL) && (Tcl_SetVar(interp, varName, buffer,
+			TCL_LEAVE_ERR_MSG) == NULL)) {
 		    code = TCL_ERROR;
 		    goto done;
 		}
+		TkTextPrintIndex(&index, Tcl_GetStringResult(interp));
+		goto done;
 	    }
-	    TkTextPrintIndex(&index, Tcl_GetStringResult(interp));
-	    goto done;
+	    Tcl_DStringAppendElement(&countString, buffer);
+	    TkTextPrintIndex(&index, buffer);
+	    Tcl_DStringAppendElement(&resultString, buffer);
+	    TkTextIndexForwChars(&index, matchLength, &endIndex);
+	    TkTextPrintIndex(&endIndex, buffer);
+	    Tcl_DStringAppendElement(&resultString, buffer);
 	}
 
 	/*
@@ -1372,15 +3563,223 @@ TextSearchCmd(textPtr, interp, argc, argv)
 		lineNum = 0;
 	    }
 	}
-	Tcl_DStringSetLength(&line, 0);
     }
     done:
+
+    /*
+     * For -all, the result is the start and end of every match, and
+     * the -count variable gets a list of their lengths.
+     */
+
+    if (all && (code == TCL_OK)) {
+	if ((varName != NULL) && (Tcl_SetVar(interp, varName,
+		Tcl_DStringValue(&countString), TCL_LEAVE_ERR_MSG) == NULL)) {
+	    code = TCL_ERROR;
+	} else {
+	    Tcl_DStringResult(interp, &resultString);
+	}
+    }
     Tcl_DStringFree(&line);
-    if (noCase) {
-	Tcl_DStringFree(&patDString);
+    Tcl_DStringFree(&resultString);
+    Tcl_DStringFree(&countString);
+    if (matches != staticMatches) {
+	ckfree((char *) matches);
+    }
+    if (exact) {
+	FreeExact(&exactPat);
     }
     return code;
 }
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AdjustForSegments --
+ *
+ *	The positions found by TextSearchCmd only count the characters
+ *	of a line:  they don't account for embedded windows or any other
+ *	non-textual segments.  This procedure converts the position and
+ *	length of a match into ones that do.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	*charPtr and *lengthPtr are increased by the sizes of the
+ *	non-textual segments before and within the match.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+AdjustForSegments(linePtr, charPtr, lengthPtr)
+    TkTextLine *linePtr;	/* Line containing the match. */
+    int *charPtr;		/* Index of match among the characters
+				 * of the line;  updated to an index. */
+    int *lengthPtr;		/* Number of characters in match;  updated
+				 * to a count of index positions. */
+{
+    TkTextSegment *segPtr;
+    int leftToScan;
+
+    for (segPtr = linePtr->segPtr, leftToScan = *charPtr;
+	    (leftToScan >= 0) && (segPtr != NULL); segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr != &tkTextCharType) {
+	    *charPtr += segPtr->size;
+	    continue;
+	}
+	leftToScan -= segPtr->size;
+    }
+    for (leftToScan += *lengthPtr; (leftToScan > 0) && (segPtr != NULL);
+	    segPtr = segPtr->nextPtr) {
+	if (segPtr->typePtr != &tkTextCharType) {
+	    *lengthPtr += segPtr->size;
+	    continue;
+	}
+	leftToScan -= segPtr->size;
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CompileExact --
+ *
+ *	Prepare a pattern for exact matching with MatchExact, using
+ *	the Boyer-Moore-Horspool method.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	*patPtr is filled in;  FreeExact must be called to free the
+ *	storage it refers to.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CompileExact(patPtr, pattern, noCase)
+    register ExactPattern *patPtr;	/* Compiled pattern to fill in. */
+    char *pattern;			/* Pattern to compile. */
+    int noCase;				/* Non-zero means that case is to be
+					 * ignored. */
+{
+    register int i;
+
+    patPtr->length = strlen(pattern);
+    if (patPtr->length < sizeof(patPtr->staticString)) {
+	patPtr->string = patPtr->staticString;
+    } else {
+	patPtr->string = (unsigned char *) ckalloc((unsigned)
+		(patPtr->length + 1));
+    }
+    for (i = 0; i < 256; i++) {
+	patPtr->fold[i] = (noCase && isupper(i)) ? tolower(i) : i;
+    }
+    for (i = 0; i <= patPtr->length; i++) {
+	patPtr->string[i] = patPtr->fold[UCHAR(pattern[i])];
+    }
+
+    /*
+     * Each entry of the shift table tells how far the pattern can be
+     * moved along when the text character under its last character
+     * is the one for the entry.
+     */
+
+    for (i = 0; i < 256; i++) {
+	patPtr->shift[i] = patPtr->length;
+    }
+    for (i = 0; i < patPtr->length - 1; i++) {
+	patPtr->shift[patPtr->string[i]] = patPtr->length - 1 - i;
+    }
+    if (noCase) {
+	for (i = 0; i < 256; i++) {
+	    patPtr->shift[i] = patPtr->shift[patPtr->fold[i]];
+	}
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * MatchExact --
+ *
+ *	Find the first occurrence of a pattern compiled by CompileExact
+ *	in a range of characters.
+ *
+ * Results:
+ *	The return value is the index in string at which the first
+ *	match at or after first begins, or -1 if there is none.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+MatchExact(patPtr, string, first, length)
+    register ExactPattern *patPtr;	/* Pattern to look for. */
+    char *string;			/* Characters to search (need not be
+					 * null-terminated). */
+    int first;				/* Index in string at which to start
+					 * looking. */
+    int length;				/* Number of characters in string. */
+{
+    register unsigned char *s = (unsigned char *) string;
+    register unsigned char *pat = patPtr->string;
+    register int i, j;
+    int last = patPtr->length - 1;
+    unsigned char lastChar;
+
+    if (last < 0) {
+	return (first <= length) ? first : -1;
+    }
+    lastChar = pat[last];
+    for (i = first; i + last < length; i += patPtr->shift[s[i + last]]) {
+	if (patPtr->fold[s[i + last]] != lastChar) {
+	    continue;
+	}
+	for (j = last - 1; (j >= 0) && (patPtr->fold[s[i + j]] == pat[j]);
+		j--) {
+	    /* Empty loop body. */
+	}
+	if (j < 0) {
+	    return i;
+	}
+    }
+    return -1;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeExact --
+ *
+ *	Free the storage used by a pattern compiled by CompileExact.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory is freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeExact(patPtr)
+    ExactPattern *patPtr;		/* Pattern to free. */
+{
+    if (patPtr->string != patPtr->staticString) {
+	ckfree((char *) patPtr->string);
+    }
+}
 
 /*
  *----------------------------------------------------------------------
@@ -41,6 +41,13 @@ typedef struct TkTextLine {
 					 * means end of list. */
     struct TkTextSegment *segPtr;	/* First in ordered list of segments
 					 * that make up the line. */
+    int numDLines;			/* Number of display lines the line
+					 * takes up, as last counted by the
+					 * display code (see TkBTreeSetDLines),
+					 * or 0 if it hasn't been counted. */
+    unsigned int dLinesEpoch;		/* Used by the display code to tell
+					 * whether numDLines is up to date;
+					 * 0 for a new line. */
 } TkTextLine;
 
 /*
@@ -122,6 +129,11 @@ typedef struct TkTextSegment {
 					 * line, or NULL for end of list. */
     int size;				/* Size of this segment (# of bytes
 					 * of index space it occupies). */
+    int capacity;			/* For character segments, the number
+					 * of characters (not counting the
+					 * terminating null) there is room
+					 * for in body.chars.  Not used by
+					 * other segment types. */
     union {
 	char chars[4];			/* Characters that make up character
 					 * info.  Actual length varies to
@@ -309,6 +321,10 @@ typedef struct TkTextTag {
     int affectsDisplay;		/* Non-zero means that this tag affects the
 				 * way information is displayed on the screen
 				 * (so need to redisplay if tag changes). */
+    int tagInfoIndex;		/* Used by TkBTreeGetTags:  where this tag's
+				 * entry is in the arrays it's building, if
+				 * it has one yet.  Only meaningful while
+				 * TkBTreeGetTags is running. */
 } TkTextTag;
 
 #define TK_TAG_AFFECTS_DISPLAY	0x1
@@ -400,6 +416,24 @@ typedef struct TkText {
 				 * it here. */
     Tk_Uid state;		/* Normal or disabled.  Text is read-only
 				 * when disabled. */
+    int readOnly;		/* Non-zero means the text can't be changed
+				 * by the widget command, as when disabled,
+				 * and so a -file can stay mapped. */
+    char *fileName;		/* Value of -file option:  name of file
+				 * last loaded into the text (malloc'ed),
+				 * or NULL. */
+    char *mapChars;		/* Contents of file being used as the
+				 * text's mapped characters (see
+				 * TkBTreeMapChars), or NULL. */
+    size_t mapSize;		/* Number of bytes at mapChars. */
+    int mapped;			/* Non-zero means mapChars came from mmap,
+				 * zero means from ckalloc. */
+    int mapFd;			/* File mapChars is mapped from, kept open
+				 * so that the B-tree can tell if it has
+				 * shrunk, or -1. */
+    struct TkTextLoad *loadPtr;	/* Information about a load from a channel
+				 * by the "load" widget command that's still
+				 * going on, or NULL (see tkText.c). */
 
     /*
      * Default information for displaying (may be overridden by tags
@@ -453,10 +487,39 @@ typedef struct TkText {
     TkTextSegment *insertMarkPtr;
 				/* Points to segment for "insert" mark. */
 
+    /*
+     * Information used to undo and redo changes (see tkText.c):
+     */
+
+    int undo;			/* Value of -undo option:  non-zero means
+				 * insertions and deletions are recorded
+				 * so that they can be undone. */
+    int autoSeparators;		/* Value of -autoseparators option:  non-zero
+				 * means that each change that can't be
+				 * merged with the one before it is undone
+				 * on its own. */
+    int maxUndoBytes;		/* Value of -maxundobytes option:  most
+				 * memory to use for recorded changes, or 0
+				 * for no limit. */
+    struct TkTextUndo *undoFirstPtr;
+				/* Oldest change that can be undone, or
+				 * NULL if there's nothing to undo. */
+    struct TkTextUndo *undoLastPtr;
+				/* Newest change that can be undone (the
+				 * next to be undone), or NULL. */
+    struct TkTextUndo *redoPtr;	/* Next change to be redone, or NULL if
+				 * there's nothing to redo. */
+    int undoBytes;		/* Memory used by the changes that can be
+				 * undone or redone. */
+
     /*
      * Miscellaneous additional information:
      */
 
+    char *syncCmd;		/* Prefix of command to issue when the
+				 * display lines start or finish being
+				 * counted in the background, or NULL.
+				 * Malloc'ed. */
     char *takeFocus;		/* Value of -takeFocus option;  not used in
 				 * the C code, but used by keyboard traversal
 				 * scripts.  Malloc'ed, but may be NULL. */
@@ -475,11 +538,18 @@ typedef struct TkText {
  *				focus.
  * UPDATE_SCROLLBARS:		Non-zero means scrollbar(s) should be updated
  *				during next redisplay operation.
+ * UNDO_SEPARATOR:		Non-zero means the next change to be recorded
+ *				for undo mustn't be merged with the one
+ *				before it, and starts a new group of changes.
+ * UNDO_IN_PROGRESS:		Non-zero means a change is being undone or
+ *				redone, so it mustn't be recorded.
  */
 
 #define GOT_FOCUS		4
 #define UPDATE_SCROLLBARS	0x10
 #define NEED_REPICK		0x20
+#define UNDO_SEPARATOR		0x40
+#define UNDO_IN_PROGRESS	0x80
 
 /*
  * Records of the following type define segment types in terms of
@@ -488,7 +558,8 @@ typedef struct TkText {
  */
 
 typedef TkTextSegment *	Tk_SegSplitProc _ANSI_ARGS_((
-			    struct TkTextSegment *segPtr, int index));
+			    struct TkTextSegment *segPtr,
+			    TkTextLine *linePtr, int index));
 typedef int		Tk_SegDeleteProc _ANSI_ARGS_((
 			    struct TkTextSegment *segPtr,
 			    TkTextLine *linePtr, int treeGone));
@@ -556,6 +627,9 @@ typedef struct Tk_SegType {
  */
 
 extern int		tkBTreeDebug;
+extern int		tkBTreeCharAllocs;
+extern int		tkBTreeCharFrees;
+extern int		tkBTreeCharsCopied;
 extern int		tkTextDebug;
 extern Tk_SegType	tkTextCharType;
 extern Tk_Uid		tkTextCharUid;
@@ -573,6 +647,8 @@ extern Tk_Uid		tkTextWordUid;
  * but shouldn't be used anywhere else in Tk (or by Tk clients):
  */
 
+extern void		TkBTreeAppendChars _ANSI_ARGS_((TkTextIndex *indexPtr,
+			    char *string));
 extern int		TkBTreeCharTagged _ANSI_ARGS_((TkTextIndex *indexPtr,
 			    TkTextTag *tagPtr));
 extern void		TkBTreeCheck _ANSI_ARGS_((TkTextBTree tree));
@@ -581,6 +657,9 @@ extern TkTextBTree	TkBTreeCreate _ANSI_ARGS_((void));
 extern void		TkBTreeDestroy _ANSI_ARGS_((TkTextBTree tree));
 extern void		TkBTreeDeleteChars _ANSI_ARGS_((TkTextIndex *index1Ptr,
 			    TkTextIndex *index2Ptr));
+extern int		TkBTreeDLineIndex _ANSI_ARGS_((TkTextLine *linePtr));
+extern TkTextLine *	TkBTreeFindDLine _ANSI_ARGS_((TkTextBTree tree,
+			    int dLine, int *offsetPtr));
 extern TkTextLine *	TkBTreeFindLine _ANSI_ARGS_((TkTextBTree tree,
 			    int line));
 extern TkTextTag **	TkBTreeGetTags _ANSI_ARGS_((TkTextIndex *indexPtr,
@@ -590,17 +669,28 @@ extern void		TkBTreeInsertChars _ANSI_ARGS_((TkTextIndex *indexPtr,
 extern int		TkBTreeLineIndex _ANSI_ARGS_((TkTextLine *linePtr));
 extern void		TkBTreeLinkSegment _ANSI_ARGS_((TkTextSegment *segPtr,
 			    TkTextIndex *indexPtr));
+extern void		TkBTreeMapChars _ANSI_ARGS_((TkTextBTree tree,
+			    char *chars, size_t numChars, int fd));
+extern void		TkBTreeMemory _ANSI_ARGS_((TkTextBTree tree,
+			    Tcl_Interp *interp));
 extern TkTextLine *	TkBTreeNextLine _ANSI_ARGS_((TkTextLine *linePtr));
 extern int		TkBTreeNextTag _ANSI_ARGS_((TkTextSearch *searchPtr));
+extern int		TkBTreeNumDLines _ANSI_ARGS_((TkTextBTree tree));
 extern int		TkBTreeNumLines _ANSI_ARGS_((TkTextBTree tree));
+extern void		TkBTreeSetDLines _ANSI_ARGS_((TkTextLine *linePtr,
+			    int numDLines));
 extern void		TkBTreeStartSearch _ANSI_ARGS_((TkTextIndex *index1Ptr,
 			    TkTextIndex *index2Ptr, TkTextTag *tagPtr,
 			    TkTextSearch *searchPtr));
 extern void		TkBTreeTag _ANSI_ARGS_((TkTextIndex *index1Ptr,
 			    TkTextIndex *index2Ptr, TkTextTag *tagPtr,
 			    int add));
+extern void		TkBTreeTagRanges _ANSI_ARGS_((int numRanges,
+			    TkTextIndex *indexArray, TkTextTag *tagPtr,
+			    int add));
 extern void		TkBTreeUnlinkSegment _ANSI_ARGS_((TkTextBTree tree,
 			    TkTextSegment *segPtr, TkTextLine *linePtr));
+extern void		TkBTreeUnmapChars _ANSI_ARGS_((TkTextBTree tree));
 extern void		TkTextChanged _ANSI_ARGS_((TkText *textPtr,
 			    TkTextIndex *index1Ptr, TkTextIndex *index2Ptr));
 extern int		TkTextCharBbox _ANSI_ARGS_((TkText *textPtr,
@@ -616,6 +706,7 @@ extern int		TkTextDLineInfo _ANSI_ARGS_((TkText *textPtr,
 			    int *widthPtr, int *heightPtr, int *basePtr));
 extern TkTextTag *	TkTextCreateTag _ANSI_ARGS_((TkText *textPtr,
 			    char *tagName));
+extern int		TkTextEndVisible _ANSI_ARGS_((TkText *textPtr));
 extern void		TkTextFreeDInfo _ANSI_ARGS_((TkText *textPtr));
 extern void		TkTextFreeTag _ANSI_ARGS_((TkText *textPtr,
 			    TkTextTag *tagPtr));
@@ -660,12 +751,15 @@ extern int		TkTextScanCmd _ANSI_ARGS_((TkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
 extern int		TkTextSeeCmd _ANSI_ARGS_((TkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
+extern void		TkTextSeeEnd _ANSI_ARGS_((TkText *textPtr));
+extern int		TkTextPendingSync _ANSI_ARGS_((TkText *textPtr));
 extern int		TkTextSegToOffset _ANSI_ARGS_((TkTextSegment *segPtr,
 			    TkTextLine *linePtr));
 extern TkTextSegment *	TkTextSetMark _ANSI_ARGS_((TkText *textPtr, char *name,
 			    TkTextIndex *indexPtr));
 extern void		TkTextSetYView _ANSI_ARGS_((TkText *textPtr,
 			    TkTextIndex *indexPtr, int pickPlace));
+extern void		TkTextSync _ANSI_ARGS_((TkText *textPtr));
 extern int		TkTextTagCmd _ANSI_ARGS_((TkText *textPtr,
 			    Tcl_Interp *interp, int argc, char **argv));
 extern int		TkTextWindowCmd _ANSI_ARGS_((TkText *textPtr,
@@ -21,7 +21,11 @@
 
 /*
  * The data structure below keeps summary information about one tag as part
- * of the tag information in a node.
+ * of the tag information in a node.  Besides being in its node's list,
+ * each summary is in a hash table belonging to the tree, keyed by node
+ * and tag (see FindSummary), so that the summary for a particular tag
+ * can be found without going through the list:  with thousands of tags,
+ * the lists near the root of the tree get very long.
  */
 
 typedef struct Summary {
@@ -31,6 +35,11 @@ typedef struct Summary {
 					 * the subtree rooted at this node. */
     struct Summary *nextPtr;		/* Next in list of all tags for same
 					 * node, or NULL if at end of list. */
+    struct Summary *prevPtr;		/* Previous in list of all tags for
+					 * same node, or NULL if first. */
+    struct Node *nodePtr;		/* Node whose list this is in. */
+    struct Summary *hashNextPtr;	/* Next summary in same bucket of the
+					 * tree's summary table. */
 } Summary;
 
 /*
@@ -43,21 +52,49 @@ typedef struct Node {
     struct Node *nextPtr;		/* Next in list of siblings with the
 					 * same parent node, or NULL for end
 					 * of list. */
+    struct BTree *treePtr;		/* Tree containing the node, whose
+					 * arena holds the storage for the
+					 * node and everything in it. */
     Summary *summaryPtr;		/* First in malloc-ed list of info
 					 * about tags in this subtree (NULL if
 					 * no tag info in the subtree). */
+    TkTextTag **startTags;		/* Tags toggled on by the lines before
+					 * this subtree (see FindStartTags), or
+					 * NULL if there are none. */
+    int numStartTags;			/* Number of entries in startTags. */
+    unsigned int startEpoch;		/* Tree's tagEpoch when startTags was
+					 * found;  0 means never. */
     int level;				/* Level of this node in the B-tree.
 					 * 0 refers to the bottom of the tree
 					 * (children are lines, not nodes). */
     union {				/* First in linked list of children. */
 	struct Node *nodePtr;		/* Used if level > 0. */
 	TkTextLine *linePtr;		/* Used if level == 0. */
+	int firstLine;			/* Used if the node hasn't been loaded
+					 * (see below):  index of its first
+					 * line in the tree. */
     } children;
-    int numChildren;			/* Number of children of this node. */
+    int numChildren;			/* Number of children of this node, or
+					 * 0 if it hasn't been loaded. */
     int numLines;			/* Total number of lines (leaves) in
 					 * the subtree rooted here. */
+    int extraDLines;			/* Total number of display lines in
+					 * the subtree's lines beyond the
+					 * first one of each (see
+					 * TkBTreeSetDLines).  The subtree
+					 * takes up numLines + extraDLines
+					 * display lines. */
 } Node;
 
+/*
+ * EXTRA_DLINES gives the number of display lines beyond the first
+ * that a line adds to its nodes' extraDLines.  A line that hasn't been
+ * counted yet (numDLines is 0) is taken to be one display line.
+ */
+
+#define EXTRA_DLINES(linePtr) \
+	(((linePtr)->numDLines > 1) ? ((linePtr)->numDLines - 1) : 0)
+
 /*
  * Upper and lower bounds on how many children a node may have:
  * rebalance when either of these limits is exceeded.  MAX_CHILDREN
@@ -67,14 +104,161 @@ typedef struct Node {
 #define MAX_CHILDREN 12
 #define MIN_CHILDREN 6
 
+/*
+ * The nodes, lines, tag summaries and character and toggle segments of
+ * a tree aren't allocated one at a time:  they are carved out of big
+ * chunks of memory that belong to the tree, so that they are packed
+ * together and the whole tree can be freed by freeing its chunks.
+ * Blocks are rounded up to a multiple of ARENA_ALIGN bytes, and freed
+ * blocks are kept on a free list for their size until they are used
+ * again.  Blocks bigger than ARENA_MAX_BLOCK (segments for long lines)
+ * are allocated from the heap instead, but they are kept on a list so
+ * that they are freed with the tree too.
+ */
+
+#define ARENA_ALIGN 8
+#define ARENA_MAX_BLOCK 1024
+#define ARENA_MIN_CHUNK 4096
+#define ARENA_MAX_CHUNK 65536
+#define ARENA_ROUND(size) \
+	(((size) + ARENA_ALIGN - 1) & ~((unsigned) ARENA_ALIGN - 1))
+
+typedef struct FreeBlock {
+    struct FreeBlock *nextPtr;		/* Next free block of the same
+					 * size, or NULL for end of list. */
+} FreeBlock;
+
+typedef union ArenaChunk {
+    union ArenaChunk *nextPtr;		/* Next older chunk of the arena,
+					 * or NULL for end of list.  The
+					 * blocks follow this header. */
+    double align;			/* Aligns the blocks. */
+} ArenaChunk;
+
+typedef struct BigBlock {
+    struct BigBlock *prevPtr;		/* Neighbours in the arena's list of */
+    struct BigBlock *nextPtr;		/* big blocks, or NULL at the ends.
+					 * The block follows this header. */
+} BigBlock;
+
+typedef struct Arena {
+    ArenaChunk *chunkPtr;		/* Most recently allocated chunk, or
+					 * NULL if none yet. */
+    char *nextPtr;			/* First unused byte in chunkPtr. */
+    char *endPtr;			/* Byte just after the end of
+					 * chunkPtr. */
+    FreeBlock *freeLists[ARENA_MAX_BLOCK/ARENA_ALIGN];
+					/* Free blocks of each size, indexed
+					 * by size/ARENA_ALIGN - 1. */
+    BigBlock *bigPtr;			/* First in list of blocks allocated
+					 * from the heap, or NULL. */
+    int numChunks;			/* Number of chunks allocated.  Each
+					 * one is twice the size of the one
+					 * before, up to ARENA_MAX_CHUNK. */
+    long chunkBytes;			/* Total bytes in chunks. */
+    long bigBytes;			/* Total bytes in big blocks, including
+					 * their headers. */
+    long usedBytes;			/* Total bytes in blocks currently
+					 * handed out, big ones included. */
+} Arena;
+
+/*
+ * A tree can be given its whole text at once by TkBTreeMapChars, as a
+ * block of memory (normally a file mapped into memory) that stays
+ * around until TkBTreeUnmapChars is called.  The lines of such a text
+ * are only created when they are needed.  Until then, the nodes that
+ * would hold them aren't loaded:  such a node has no children yet, and
+ * just records the range of lines it covers.  It is loaded (see
+ * LoadNode) when something needs to go down into it, which creates
+ * its children, spreading its lines evenly among them so that they
+ * make a proper B-tree.  Every MAP_SAMPLE'th line of the text is
+ * indexed, so that creating lines for a leaf only needs to look
+ * through a few lines before them.  No changes may be made to the
+ * text while it is mapped, other than to tags and marks.  If the text
+ * is a mapped file, the file is checked before lines are copied out of
+ * it, in case it has been cut short since:  touching a page of the
+ * mapping past the new end of the file would raise SIGBUS.  Lines that
+ * are no longer in the file come out empty.
+ */
+
+#define MAP_SAMPLE 64
+
+typedef struct MappedText {
+    char *chars;			/* First character of the text.  Not
+					 * null-terminated;  belongs to the
+					 * caller of TkBTreeMapChars. */
+    char *end;				/* Character just after the text (or
+					 * the part of it still in the file). */
+    int fd;				/* File the text is mapped from, or
+					 * -1. */
+    int numNewlines;			/* Number of newlines in the text. */
+    char **lineStarts;			/* Malloc-ed array giving the first
+					 * character of every MAP_SAMPLE'th
+					 * line of the text (line 0 first). */
+    int linesLeft;			/* Number of lines of the tree not yet
+					 * created. */
+} MappedText;
+
+/*
+ * Each tree remembers the indices of the last few lines that were
+ * looked up by TkBTreeFindLine or TkBTreeLineIndex, so that scripts
+ * that go through the text a line at a time don't have to search the
+ * tree for every line.  A lookup of a line a little after a cached
+ * one (at most LINE_CACHE_REACH lines) just steps forward from it.
+ * The tree's epoch is incremented whenever lines are added or removed,
+ * which makes every entry stamped with an earlier epoch invalid.
+ */
+
+#define LINE_CACHE_SIZE 8
+#define LINE_CACHE_REACH 8
+
+typedef struct LineCacheEntry {
+    TkTextLine *linePtr;		/* A line of the tree. */
+    int lineIndex;			/* Index of linePtr in the tree. */
+    unsigned int epoch;			/* Tree's epoch when entry was made. */
+} LineCacheEntry;
+
 /*
  * The data structure below defines an entire B-tree.
  */
 
 typedef struct BTree {
     Node *rootPtr;			/* Pointer to root of B-tree. */
+    Arena arena;			/* Storage for the tree's nodes, lines,
+					 * summaries and segments. */
+    MappedText *mapPtr;			/* Text that lines are still being
+					 * created from, or NULL. */
+    unsigned int epoch;			/* Incremented each time lines are
+					 * added to or removed from the tree. */
+    LineCacheEntry lineCache[LINE_CACHE_SIZE];
+					/* Recently looked-up lines. */
+    int nextCacheEntry;			/* Entry of lineCache to replace
+					 * next. */
+    Summary **summaryBuckets;		/* Hash table of all the tree's
+					 * summaries (malloc-ed), or NULL if
+					 * there aren't any yet. */
+    int numSummaryBuckets;		/* Number of entries in summaryBuckets
+					 * (a power of 2). */
+    int numSummaries;			/* Number of summaries in the table. */
+    unsigned int tagEpoch;		/* Incremented whenever toggle counts
+					 * change or lines move between nodes,
+					 * which makes the startTags of every
+					 * node stamped earlier out of date. */
 } BTree;
 
+/*
+ * The table of summaries starts with MIN_SUMMARY_BUCKETS buckets and
+ * doubles in size whenever it holds more than two summaries per bucket.
+ * SUMMARY_BUCKET gives the bucket for a node and tag.
+ */
+
+#define MIN_SUMMARY_BUCKETS 64
+
+#define SUMMARY_BUCKET(treePtr, nodePtr, tagPtr) \
+	((int) (((((unsigned int) ((unsigned long) (nodePtr) >> 3)) \
+	* 2654435761U) ^ ((unsigned int) ((unsigned long) (tagPtr) >> 3))) \
+	* 2654435761U >> 8) & ((treePtr)->numSummaryBuckets - 1))
+
 /*
  * The structure below is used to pass information between
  * TkBTreeGetTags and IncCount:
@@ -99,6 +283,17 @@ typedef struct TagInfo {
 
 int tkBTreeDebug = 0;
 
+/*
+ * Counters of storage activity for character segments:  the number of
+ * segments allocated and freed, and the number of characters copied
+ * into segments.  They are reported (and reset) by the "debug stats"
+ * widget command.
+ */
+
+int tkBTreeCharAllocs = 0;
+int tkBTreeCharFrees = 0;
+int tkBTreeCharsCopied = 0;
+
 /*
  * Macros that determine how much space to allocate for new segments:
  */
@@ -108,10 +303,29 @@ int tkBTreeDebug = 0;
 #define TSEG_SIZE ((unsigned) (Tk_Offset(TkTextSegment, body) \
 	+ sizeof(TkTextToggle)))
 
+/*
+ * Character segments are given room for more characters than they are
+ * created with (see CharSegAlloc), so that typing and the merging of
+ * adjacent segments can usually be done in place.  Their storage is
+ * rounded up to a multiple of CSEG_GRAIN bytes, or of an eighth of
+ * their size for big segments.
+ */
+
+#define CSEG_GRAIN 16
+
 /*
  * Forward declarations for procedures defined in this file:
  */
 
+static Summary *	AddSummary _ANSI_ARGS_((Node *nodePtr,
+			    TkTextTag *tagPtr, int toggleCount));
+static VOID *		ArenaAlloc _ANSI_ARGS_((BTree *treePtr,
+			    unsigned int size));
+static void		ArenaFree _ANSI_ARGS_((BTree *treePtr, VOID *ptr,
+			    unsigned int size));
+static void		ArenaRelease _ANSI_ARGS_((BTree *treePtr));
+static void		CacheLine _ANSI_ARGS_((BTree *treePtr,
+			    TkTextLine *linePtr, int index));
 static void		ChangeNodeToggleCount _ANSI_ARGS_((Node *nodePtr,
 			    TkTextTag *tagPtr, int delta));
 static void		CharCheckProc _ANSI_ARGS_((TkTextSegment *segPtr,
@@ -120,17 +334,33 @@ static int		CharDeleteProc _ANSI_ARGS_((TkTextSegment *segPtr,
 			    TkTextLine *linePtr, int treeGone));
 static TkTextSegment *	CharCleanupProc _ANSI_ARGS_((TkTextSegment *segPtr,
 			    TkTextLine *linePtr));
+static TkTextSegment *	CharSegAlloc _ANSI_ARGS_((BTree *treePtr,
+			    int numChars));
 static TkTextSegment *	CharSplitProc _ANSI_ARGS_((TkTextSegment *segPtr,
-			    int index));
+			    TkTextLine *linePtr, int index));
 static void		CheckNodeConsistency _ANSI_ARGS_((Node *nodePtr));
 static void		CleanupLine _ANSI_ARGS_((TkTextLine *linePtr));
-static void		DeleteSummaries _ANSI_ARGS_((Summary *tagPtr));
-static void		DestroyNode _ANSI_ARGS_((Node *nodePtr));
+static int		DeleteInSegment _ANSI_ARGS_((TkTextIndex *index1Ptr,
+			    TkTextIndex *index2Ptr));
+static void		DeleteSummaries _ANSI_ARGS_((Node *nodePtr));
+static void		FindStartTags _ANSI_ARGS_((Node *nodePtr));
+static Summary *	FindSummary _ANSI_ARGS_((Node *nodePtr,
+			    TkTextTag *tagPtr));
 static void		IncCount _ANSI_ARGS_((TkTextTag *tagPtr, int inc,
 			    TagInfo *tagInfoPtr));
+static int		InsertInSegment _ANSI_ARGS_((TkTextIndex *indexPtr,
+			    char *string, int numChars));
+static void		LoadAll _ANSI_ARGS_((Node *nodePtr));
+static void		LoadNode _ANSI_ARGS_((Node *nodePtr));
 static void		Rebalance _ANSI_ARGS_((BTree *treePtr, Node *nodePtr));
 static void		RecomputeNodeCounts _ANSI_ARGS_((Node *nodePtr));
+static void		RemoveSummary _ANSI_ARGS_((Summary *summaryPtr));
+static void		SetStartTags _ANSI_ARGS_((Node *nodePtr,
+			    TkTextTag **tagPtrs, int numTags));
 static TkTextSegment *	SplitSeg _ANSI_ARGS_((TkTextIndex *indexPtr));
+static int		TagRange _ANSI_ARGS_((TkTextIndex *index1Ptr,
+			    TkTextIndex *index2Ptr, TkTextTag *tagPtr, int add,
+			    int oldState));
 static void		ToggleCheckProc _ANSI_ARGS_((TkTextSegment *segPtr,
 			    TkTextLine *linePtr));
 static TkTextSegment *	ToggleCleanupProc _ANSI_ARGS_((TkTextSegment *segPtr,
@@ -219,12 +449,27 @@ TkBTreeCreate()
      * which is also the root of the tree.
      */
 
-    rootPtr = (Node *) ckalloc(sizeof(Node));
-    linePtr = (TkTextLine *) ckalloc(sizeof(TkTextLine));
-    linePtr2 = (TkTextLine *) ckalloc(sizeof(TkTextLine));
+    treePtr = (BTree *) ckalloc(sizeof(BTree));
+    memset((VOID *) &treePtr->arena, 0, sizeof(Arena));
+    treePtr->mapPtr = NULL;
+    memset((VOID *) treePtr->lineCache, 0, sizeof(treePtr->lineCache));
+    treePtr->epoch = 1;
+    treePtr->nextCacheEntry = 0;
+    treePtr->summaryBuckets = NULL;
+    treePtr->numSummaryBuckets = 0;
+    treePtr->numSummaries = 0;
+    treePtr->tagEpoch = 1;
+    rootPtr = (Node *) ArenaAlloc(treePtr, sizeof(Node));
+    linePtr = (TkTextLine *) ArenaAlloc(treePtr, sizeof(TkTextLine));
+    linePtr2 = (TkTextLine *) ArenaAlloc(treePtr, sizeof(TkTextLine));
     rootPtr->parentPtr = NULL;
     rootPtr->nextPtr = NULL;
+    rootPtr->treePtr = treePtr;
     rootPtr->summaryPtr = NULL;
+    rootPtr->startTags = NULL;
+    rootPtr->numStartTags = 0;
+    rootPtr->startEpoch = 0;
+    rootPtr->extraDLines = 0;
     rootPtr->level = 0;
     rootPtr->children.linePtr = linePtr;
     rootPtr->numChildren = 2;
@@ -232,9 +477,10 @@ TkBTreeCreate()
 
     linePtr->parentPtr = rootPtr;
     linePtr->nextPtr = linePtr2;
-    segPtr = (TkTextSegment *) ckalloc(CSEG_SIZE(1));
+    linePtr->numDLines = 0;
+    linePtr->dLinesEpoch = 0;
+    segPtr = CharSegAlloc(treePtr, 1);
     linePtr->segPtr = segPtr;
-    segPtr->typePtr = &tkTextCharType;
     segPtr->nextPtr = NULL;
     segPtr->size = 1;
     segPtr->body.chars[0] = '\n';
@@ -242,15 +488,15 @@ TkBTreeCreate()
 
     linePtr2->parentPtr = rootPtr;
     linePtr2->nextPtr = NULL;
-    segPtr = (TkTextSegment *) ckalloc(CSEG_SIZE(1));
+    linePtr2->numDLines = 0;
+    linePtr2->dLinesEpoch = 0;
+    segPtr = CharSegAlloc(treePtr, 1);
     linePtr2->segPtr = segPtr;
-    segPtr->typePtr = &tkTextCharType;
     segPtr->nextPtr = NULL;
     segPtr->size = 1;
     segPtr->body.chars[0] = '\n';
     segPtr->body.chars[1] = 0;
 
-    treePtr = (BTree *) ckalloc(sizeof(BTree));
     treePtr->rootPtr = rootPtr;
 
     return (TkTextBTree) treePtr;
@@ -268,7 +514,10 @@ TkBTreeCreate()
  *	again be used.
  *
  * Side effects:
- *	Memory is freed.
+ *	Memory is freed.  Everything in the tree lives in its arena,
+ *	except for marks, which belong to the text widget and are
+ *	freed by it, so there is no need to visit the lines:  freeing
+ *	the arena's chunks frees the lot.
  *
  *----------------------------------------------------------------------
  */
@@ -279,56 +528,222 @@ TkBTreeDestroy(tree)
 {
     BTree *treePtr = (BTree *) tree;
 
-    DestroyNode(treePtr->rootPtr);
+    ArenaRelease(treePtr);
+    if (treePtr->mapPtr != NULL) {
+	ckfree((char *) treePtr->mapPtr->lineStarts);
+	ckfree((char *) treePtr->mapPtr);
+    }
+    if (treePtr->summaryBuckets != NULL) {
+	ckfree((char *) treePtr->summaryBuckets);
+    }
     ckfree((char *) treePtr);
 }
 
 /*
  *----------------------------------------------------------------------
  *
- * DestroyNode --
+ * ArenaAlloc --
  *
- *	This is a recursive utility procedure used during the deletion
- *	of a B-tree.
+ *	Allocate a block of storage from the arena of a B-tree.
+ *
+ * Results:
+ *	The return value is a pointer to a block of at least size
+ *	bytes, aligned for any kind of data.
+ *
+ * Side effects:
+ *	A new chunk is added to the arena if the block can't be found
+ *	a place in the ones it already has.  Big blocks are allocated
+ *	from the heap.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static VOID *
+ArenaAlloc(treePtr, size)
+    BTree *treePtr;			/* Tree that the block is for. */
+    unsigned int size;			/* Number of bytes needed. */
+{
+    register Arena *arenaPtr = &treePtr->arena;
+    register FreeBlock *blockPtr;
+    ArenaChunk *chunkPtr;
+    BigBlock *bigPtr;
+    unsigned int left, chunkSize;
+
+    size = ARENA_ROUND(size);
+    arenaPtr->usedBytes += size;
+    if (size > ARENA_MAX_BLOCK) {
+	bigPtr = (BigBlock *) ckalloc((unsigned) (sizeof(BigBlock) + size));
+	bigPtr->prevPtr = NULL;
+	bigPtr->nextPtr = arenaPtr->bigPtr;
+	if (arenaPtr->bigPtr != NULL) {
+	    arenaPtr->bigPtr->prevPtr = bigPtr;
+	}
+	arenaPtr->bigPtr = bigPtr;
+	arenaPtr->bigBytes += sizeof(BigBlock) + size;
+	return (VOID *) (bigPtr + 1);
+    }
+
+    blockPtr = arenaPtr->freeLists[size/ARENA_ALIGN - 1];
+    if (blockPtr != NULL) {
+	arenaPtr->freeLists[size/ARENA_ALIGN - 1] = blockPtr->nextPtr;
+	return (VOID *) blockPtr;
+    }
+    left = arenaPtr->endPtr - arenaPtr->nextPtr;
+    if (left < size) {
+	/*
+	 * Start a new chunk, and put what's left of the current one
+	 * on the free list for its size.
+	 */
+
+	if (left > 0) {
+	    blockPtr = (FreeBlock *) arenaPtr->nextPtr;
+	    blockPtr->nextPtr = arenaPtr->freeLists[left/ARENA_ALIGN - 1];
+	    arenaPtr->freeLists[left/ARENA_ALIGN - 1] = blockPtr;
+	}
+	chunkSize = ARENA_MAX_CHUNK;
+	if (arenaPtr->numChunks < 4) {
+	    chunkSize = ARENA_MIN_CHUNK << arenaPtr->numChunks;
+	}
+	chunkPtr = (ArenaChunk *) ckalloc(chunkSize);
+	chunkPtr->nextPtr = arenaPtr->chunkPtr;
+	arenaPtr->chunkPtr = chunkPtr;
+	arenaPtr->nextPtr = (char *) (chunkPtr + 1);
+	arenaPtr->endPtr = ((char *) chunkPtr) + chunkSize;
+	arenaPtr->numChunks++;
+	arenaPtr->chunkBytes += chunkSize;
+    }
+    blockPtr = (FreeBlock *) arenaPtr->nextPtr;
+    arenaPtr->nextPtr += size;
+    return (VOID *) blockPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ArenaFree --
+ *
+ *	Give a block allocated by ArenaAlloc back to the arena.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	All the storage for nodePtr and its descendants is freed.
+ *	The block goes on the free list for its size, or back to the
+ *	heap if it's a big one.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-DestroyNode(nodePtr)
-    register Node *nodePtr;
+ArenaFree(treePtr, ptr, size)
+    BTree *treePtr;			/* Tree that the block is from. */
+    VOID *ptr;				/* Block to free. */
+    unsigned int size;			/* Size passed to ArenaAlloc when
+					 * the block was allocated. */
 {
-    if (nodePtr->level == 0) {
-	TkTextLine *linePtr;
-	TkTextSegment *segPtr;
-
-	while (nodePtr->children.linePtr != NULL) {
-	    linePtr = nodePtr->children.linePtr;
-	    nodePtr->children.linePtr = linePtr->nextPtr;
-	    while (linePtr->segPtr != NULL) {
-		segPtr = linePtr->segPtr;
-		linePtr->segPtr = segPtr->nextPtr;
-		(*segPtr->typePtr->deleteProc)(segPtr, linePtr, 1);
-	    }
-	    ckfree((char *) linePtr);
+    register Arena *arenaPtr = &treePtr->arena;
+    register FreeBlock *blockPtr;
+    BigBlock *bigPtr;
+
+    size = ARENA_ROUND(size);
+    arenaPtr->usedBytes -= size;
+    if (size > ARENA_MAX_BLOCK) {
+	bigPtr = ((BigBlock *) ptr) - 1;
+	if (bigPtr->prevPtr == NULL) {
+	    arenaPtr->bigPtr = bigPtr->nextPtr;
+	} else {
+	    bigPtr->prevPtr->nextPtr = bigPtr->nextPtr;
 	}
-    } else {
-	register Node *childPtr;
-
-	while (nodePtr->children.nodePtr != NULL) {
-	    childPtr = nodePtr->children.nodePtr;
-	    nodePtr->children.nodePtr = childPtr->nextPtr;
-	    DestroyNode(childPtr);
+	if (bigPtr->nextPtr != NULL) {
+	    bigPtr->nextPtr->prevPtr = bigPtr->prevPtr;
 	}
+	arenaPtr->bigBytes -= sizeof(BigBlock) + size;
+	ckfree((char *) bigPtr);
+	return;
     }
-    DeleteSummaries(nodePtr->summaryPtr);
-    ckfree((char *) nodePtr);
+    blockPtr = (FreeBlock *) ptr;
+    blockPtr->nextPtr = arenaPtr->freeLists[size/ARENA_ALIGN - 1];
+    arenaPtr->freeLists[size/ARENA_ALIGN - 1] = blockPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ArenaRelease --
+ *
+ *	Free all of the storage in the arena of a B-tree at once.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Every block allocated from the arena is freed, and the arena
+ *	is left empty.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ArenaRelease(treePtr)
+    BTree *treePtr;			/* Tree whose storage is to be
+					 * freed. */
+{
+    Arena *arenaPtr = &treePtr->arena;
+    ArenaChunk *chunkPtr;
+    BigBlock *bigPtr;
+
+    while (arenaPtr->chunkPtr != NULL) {
+	chunkPtr = arenaPtr->chunkPtr;
+	arenaPtr->chunkPtr = chunkPtr->nextPtr;
+	ckfree((char *) chunkPtr);
+    }
+    while (arenaPtr->bigPtr != NULL) {
+	bigPtr = arenaPtr->bigPtr;
+	arenaPtr->bigPtr = bigPtr->nextPtr;
+	ckfree((char *) bigPtr);
+    }
+    memset((VOID *) arenaPtr, 0, sizeof(Arena));
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeMemory --
+ *
+ *	This procedure implements the "debug memory" widget command:
+ *	it reports how much storage a B-tree is using.
+ *
+ * Results:
+ *	The interpreter's result is set to a list giving the number of
+ *	lines in the tree and how many of them haven't been created yet
+ *	(see TkBTreeMapChars), the number of chunks in its arena, the
+ *	bytes obtained from the heap (chunks plus big blocks), the bytes
+ *	in blocks in use, and the heap bytes per line.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeMemory(tree, interp)
+    TkTextBTree tree;			/* Tree to report on. */
+    Tcl_Interp *interp;			/* Interpreter for result. */
+{
+    BTree *treePtr = (BTree *) tree;
+    Arena *arenaPtr = &treePtr->arena;
+    char buffer[200];
+    long heapBytes;
+
+    heapBytes = arenaPtr->chunkBytes + arenaPtr->bigBytes;
+    sprintf(buffer,
+	    "-lines %d -unloaded %d -chunks %d -heap %ld -used %ld -perline %.1f",
+	    treePtr->rootPtr->numLines,
+	    (treePtr->mapPtr != NULL) ? treePtr->mapPtr->linesLeft : 0,
+	    arenaPtr->numChunks, heapBytes, arenaPtr->usedBytes,
+	    ((double) heapBytes) / treePtr->rootPtr->numLines);
+    Tcl_SetResult(interp, buffer, TCL_VOLATILE);
 }
 
 /*
@@ -336,29 +751,191 @@ DestroyNode(nodePtr)
  *
  * DeleteSummaries --
  *
- *	Free up all of the memory in a list of tag summaries associated
- *	with a node.
+ *	Free up all of the memory in the tag information associated
+ *	with a node:  its list of tag summaries and its startTags.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Storage is released, and the summaries are removed from the
+ *	tree's summary table.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+DeleteSummaries(nodePtr)
+    Node *nodePtr;			/* Node whose summaries are to be
+					 * deleted. */
+{
+    while (nodePtr->summaryPtr != NULL) {
+	RemoveSummary(nodePtr->summaryPtr);
+    }
+    if (nodePtr->startTags != NULL) {
+	ArenaFree(nodePtr->treePtr, (VOID *) nodePtr->startTags,
+		nodePtr->numStartTags * sizeof(TkTextTag *));
+	nodePtr->startTags = NULL;
+	nodePtr->numStartTags = 0;
+    }
+    nodePtr->treePtr->tagEpoch++;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindSummary --
+ *
+ *	Look up a node's summary information for a tag.
  *
  * Results:
+ *	The return value is the Summary for tagPtr in nodePtr, or NULL
+ *	if no toggles for the tag occur in the subtree rooted at nodePtr.
+ *
+ * Side effects:
  *	None.
  *
+ *----------------------------------------------------------------------
+ */
+
+static Summary *
+FindSummary(nodePtr, tagPtr)
+    Node *nodePtr;			/* Node to look in. */
+    TkTextTag *tagPtr;			/* Tag to look for. */
+{
+    BTree *treePtr = nodePtr->treePtr;
+    register Summary *summaryPtr;
+
+    if (treePtr->summaryBuckets == NULL) {
+	return NULL;
+    }
+    for (summaryPtr = treePtr->summaryBuckets[SUMMARY_BUCKET(treePtr,
+	    nodePtr, tagPtr)]; summaryPtr != NULL;
+	    summaryPtr = summaryPtr->hashNextPtr) {
+	if ((summaryPtr->tagPtr == tagPtr)
+		&& (summaryPtr->nodePtr == nodePtr)) {
+	    return summaryPtr;
+	}
+    }
+    return NULL;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * AddSummary --
+ *
+ *	Create summary information for a tag in a node.  There mustn't
+ *	already be any.
+ *
+ * Results:
+ *	The return value is the new Summary.
+ *
  * Side effects:
- *	Storage is released.
+ *	The summary is added to the front of the node's list and to
+ *	the tree's summary table, which is enlarged if it's getting
+ *	full.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static Summary *
+AddSummary(nodePtr, tagPtr, toggleCount)
+    Node *nodePtr;			/* Node to add summary to. */
+    TkTextTag *tagPtr;			/* Tag it summarizes. */
+    int toggleCount;			/* Initial count of toggles. */
+{
+    BTree *treePtr = nodePtr->treePtr;
+    Summary *summaryPtr, *nextPtr, **oldBuckets;
+    int i, numOldBuckets, bucket;
+
+    if (treePtr->numSummaries >= 2*treePtr->numSummaryBuckets) {
+	/*
+	 * Double the size of the table (or create it) and move all of
+	 * the summaries over to the new buckets.
+	 */
+
+	oldBuckets = treePtr->summaryBuckets;
+	numOldBuckets = treePtr->numSummaryBuckets;
+	treePtr->numSummaryBuckets = (numOldBuckets == 0)
+		? MIN_SUMMARY_BUCKETS : 2*numOldBuckets;
+	treePtr->summaryBuckets = (Summary **) ckalloc((unsigned)
+		(treePtr->numSummaryBuckets * sizeof(Summary *)));
+	memset((VOID *) treePtr->summaryBuckets, 0,
+		treePtr->numSummaryBuckets * sizeof(Summary *));
+	for (i = 0; i < numOldBuckets; i++) {
+	    for (summaryPtr = oldBuckets[i]; summaryPtr != NULL;
+		    summaryPtr = nextPtr) {
+		nextPtr = summaryPtr->hashNextPtr;
+		bucket = SUMMARY_BUCKET(treePtr, summaryPtr->nodePtr,
+			summaryPtr->tagPtr);
+		summaryPtr->hashNextPtr = treePtr->summaryBuckets[bucket];
+		treePtr->summaryBuckets[bucket] = summaryPtr;
+	    }
+	}
+	if (oldBuckets != NULL) {
+	    ckfree((char *) oldBuckets);
+	}
+    }
+
+    summaryPtr = (Summary *) ArenaAlloc(treePtr, sizeof(Summary));
+    summaryPtr->tagPtr = tagPtr;
+    summaryPtr->toggleCount = toggleCount;
+    summaryPtr->nodePtr = nodePtr;
+    summaryPtr->prevPtr = NULL;
+    summaryPtr->nextPtr = nodePtr->summaryPtr;
+    if (nodePtr->summaryPtr != NULL) {
+	nodePtr->summaryPtr->prevPtr = summaryPtr;
+    }
+    nodePtr->summaryPtr = summaryPtr;
+    bucket = SUMMARY_BUCKET(treePtr, nodePtr, tagPtr);
+    summaryPtr->hashNextPtr = treePtr->summaryBuckets[bucket];
+    treePtr->summaryBuckets[bucket] = summaryPtr;
+    treePtr->numSummaries++;
+    return summaryPtr;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * RemoveSummary --
+ *
+ *	Delete the summary information for a tag in a node.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The summary is removed from its node's list and from the tree's
+ *	summary table, and its storage is released.
  *
  *----------------------------------------------------------------------
  */
 
 static void
-DeleteSummaries(summaryPtr)
-    register Summary *summaryPtr;	/* First in list of node's tag
-					 * summaries. */
+RemoveSummary(summaryPtr)
+    Summary *summaryPtr;		/* Summary to delete. */
 {
-    register Summary *nextPtr;
-    while (summaryPtr != NULL) {
-	nextPtr = summaryPtr->nextPtr;
-	ckfree((char *) summaryPtr);
-	summaryPtr = nextPtr;
+    Node *nodePtr = summaryPtr->nodePtr;
+    BTree *treePtr = nodePtr->treePtr;
+    register Summary **linkPtr;
+
+    if (summaryPtr->prevPtr == NULL) {
+	nodePtr->summaryPtr = summaryPtr->nextPtr;
+    } else {
+	summaryPtr->prevPtr->nextPtr = summaryPtr->nextPtr;
+    }
+    if (summaryPtr->nextPtr != NULL) {
+	summaryPtr->nextPtr->prevPtr = summaryPtr->prevPtr;
+    }
+    for (linkPtr = &treePtr->summaryBuckets[SUMMARY_BUCKET(treePtr,
+	    nodePtr, summaryPtr->tagPtr)]; *linkPtr != summaryPtr;
+	    linkPtr = &(*linkPtr)->hashNextPtr) {
+	/* Empty loop body. */
     }
+    *linkPtr = summaryPtr->hashNextPtr;
+    treePtr->numSummaries--;
+    ArenaFree(treePtr, (VOID *) summaryPtr, sizeof(Summary));
 }
 
 /*
@@ -407,6 +984,21 @@ TkBTreeInsertChars(indexPtr, string)
 					 * one in current chunk. */
     int changeToLineCount;		/* Counts change to total number of
 					 * lines in file. */
+    BTree *treePtr = (BTree *) indexPtr->tree;
+
+    /*
+     * Most insertions (typing, for example) add a few characters
+     * within one line:  try to put them into an existing character
+     * segment in place.
+     */
+
+    if ((strchr(string, '\n') == NULL)
+	    && InsertInSegment(indexPtr, string, (int) strlen(string))) {
+	if (tkBTreeDebug) {
+	    TkBTreeCheck(indexPtr->tree);
+	}
+	return;
+    }
 
     prevPtr = SplitSeg(indexPtr);
     linePtr = indexPtr->linePtr;
@@ -427,8 +1019,7 @@ TkBTreeInsertChars(indexPtr, string)
 	    }
 	}
 	chunkSize = eol-string;
-	segPtr = (TkTextSegment *) ckalloc(CSEG_SIZE(chunkSize));
-	segPtr->typePtr = &tkTextCharType;
+	segPtr = CharSegAlloc(treePtr, chunkSize);
 	if (curPtr == NULL) {
 	    segPtr->nextPtr = linePtr->segPtr;
 	    linePtr->segPtr = segPtr;
@@ -439,6 +1030,7 @@ TkBTreeInsertChars(indexPtr, string)
 	segPtr->size = chunkSize;
 	strncpy(segPtr->body.chars, string, (size_t) chunkSize);
 	segPtr->body.chars[chunkSize] = 0;
+	tkBTreeCharsCopied += chunkSize;
 	curPtr = segPtr;
 
 	if (eol[-1] != '\n') {
@@ -450,9 +1042,11 @@ TkBTreeInsertChars(indexPtr, string)
 	 * and move the remainder of the old line to it.
 	 */
 
-	newLinePtr = (TkTextLine *) ckalloc(sizeof(TkTextLine));
+	newLinePtr = (TkTextLine *) ArenaAlloc(treePtr, sizeof(TkTextLine));
 	newLinePtr->parentPtr = linePtr->parentPtr;
 	newLinePtr->nextPtr = linePtr->nextPtr;
+	newLinePtr->numDLines = 0;
+	newLinePtr->dLinesEpoch = 0;
 	linePtr->nextPtr = newLinePtr;
 	newLinePtr->segPtr = segPtr->nextPtr;
 	segPtr->nextPtr = NULL;
@@ -460,38 +1054,598 @@ TkBTreeInsertChars(indexPtr, string)
 	curPtr = NULL;
 	changeToLineCount++;
 
-	string = eol;
+	string = eol;
+    }
+
+    /*
+     * Cleanup the starting line for the insertion, plus the ending
+     * line if it's different.
+     */
+
+    CleanupLine(indexPtr->linePtr);
+    if (linePtr != indexPtr->linePtr) {
+	CleanupLine(linePtr);
+    }
+
+    /*
+     * Increment the line counts in all the parent nodes of the insertion
+     * point, then rebalance the tree if necessary.
+     */
+
+    if (changeToLineCount != 0) {
+	treePtr->epoch++;
+    }
+    for (nodePtr = linePtr->parentPtr ; nodePtr != NULL;
+	    nodePtr = nodePtr->parentPtr) {
+	nodePtr->numLines += changeToLineCount;
+    }
+    nodePtr = linePtr->parentPtr;
+    nodePtr->numChildren += changeToLineCount;
+    if (nodePtr->numChildren > MAX_CHILDREN) {
+	Rebalance((BTree *) indexPtr->tree, nodePtr);
+    }
+
+    if (tkBTreeDebug) {
+	TkBTreeCheck(indexPtr->tree);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeAppendChars --
+ *
+ *	Insert characters at a given position in a B-tree, normally the
+ *	newline that ends the last line of the text.  This does the
+ *	same thing as TkBTreeInsertChars, but is meant for strings
+ *	holding many lines:  instead of linking every new line into
+ *	the leaf node of the insertion point and leaving Rebalance to
+ *	split that node up again, the new lines are packed straight
+ *	into full leaf nodes as they are created.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Characters are added to the B-tree at the given position.
+ *	If the string contains newlines, new lines and leaf nodes
+ *	will be added, which could cause the structure of the B-tree
+ *	to change.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeAppendChars(indexPtr, string)
+    TkTextIndex *indexPtr;		/* Indicates where to insert text.
+					 * When the procedure returns, this
+					 * index is no longer valid because
+					 * of changes to the segment
+					 * structure. */
+    char *string;			/* Pointer to bytes to insert (may
+					 * contain newlines, must be null-
+					 * terminated). */
+{
+    BTree *treePtr = (BTree *) indexPtr->tree;
+    register Node *nodePtr;
+    Node *leafPtr;			/* Leaf node that new lines are
+					 * currently being added to. */
+    register TkTextSegment *segPtr;
+    TkTextSegment *curPtr;		/* New characters are inserted just
+					 * after this segment;  NULL means
+					 * at the beginning of the line. */
+    TkTextLine *linePtr;		/* Current line (new segments are
+					 * added to this line). */
+    TkTextLine *restPtr;		/* Lines that followed the insertion
+					 * line in its leaf;  they go after
+					 * the last new line. */
+    TkTextLine *newLinePtr;
+    int chunkSize;			/* # characters in current chunk. */
+    register char *eol;			/* Pointer to character just after last
+					 * one in current chunk. */
+    int numChildren;			/* # lines in leafPtr. */
+    int changeToLineCount;		/* Counts change to total number of
+					 * lines in file. */
+    int newLeaves;			/* # leaf nodes created. */
+
+    curPtr = SplitSeg(indexPtr);
+    linePtr = indexPtr->linePtr;
+    leafPtr = linePtr->parentPtr;
+
+    /*
+     * Take the lines after the insertion line out of its leaf for now,
+     * so that new lines can simply be added to the end of the leaf.
+     */
+
+    restPtr = linePtr->nextPtr;
+    linePtr->nextPtr = NULL;
+    numChildren = leafPtr->numChildren;
+    for (newLinePtr = restPtr; newLinePtr != NULL;
+	    newLinePtr = newLinePtr->nextPtr) {
+	numChildren--;
+    }
+
+    changeToLineCount = 0;
+    newLeaves = 0;
+    while (*string != 0) {
+	for (eol = string; *eol != 0; eol++) {
+	    if (*eol == '\n') {
+		eol++;
+		break;
+	    }
+	}
+	chunkSize = eol-string;
+	segPtr = CharSegAlloc(treePtr, chunkSize);
+	if (curPtr == NULL) {
+	    segPtr->nextPtr = linePtr->segPtr;
+	    linePtr->segPtr = segPtr;
+	} else {
+	    segPtr->nextPtr = curPtr->nextPtr;
+	    curPtr->nextPtr = segPtr;
+	}
+	segPtr->size = chunkSize;
+	memcpy((VOID *) segPtr->body.chars, (VOID *) string,
+		(size_t) chunkSize);
+	segPtr->body.chars[chunkSize] = 0;
+	tkBTreeCharsCopied += chunkSize;
+	curPtr = segPtr;
+
+	if (eol[-1] != '\n') {
+	    break;
+	}
+
+	/*
+	 * The chunk ended with a newline, so create a new TkTextLine
+	 * and move the remainder of the old line to it.  If the leaf
+	 * is full, finish it off and start a new one just after it
+	 * (making a new root first if the leaf is the root).
+	 */
+
+	newLinePtr = (TkTextLine *) ArenaAlloc(treePtr, sizeof(TkTextLine));
+	newLinePtr->nextPtr = NULL;
+	newLinePtr->numDLines = 0;
+	newLinePtr->dLinesEpoch = 0;
+	newLinePtr->segPtr = segPtr->nextPtr;
+	segPtr->nextPtr = NULL;
+	if (numChildren >= MAX_CHILDREN) {
+	    if (leafPtr->parentPtr == NULL) {
+		nodePtr = (Node *) ArenaAlloc(treePtr, sizeof(Node));
+		nodePtr->parentPtr = NULL;
+		nodePtr->nextPtr = NULL;
+		nodePtr->treePtr = treePtr;
+		nodePtr->summaryPtr = NULL;
+		nodePtr->startTags = NULL;
+		nodePtr->numStartTags = 0;
+		nodePtr->startEpoch = 0;
+		nodePtr->extraDLines = 0;
+		nodePtr->level = 1;
+		nodePtr->children.nodePtr = leafPtr;
+		nodePtr->numChildren = 1;
+		nodePtr->numLines = leafPtr->numLines;
+		RecomputeNodeCounts(nodePtr);
+		treePtr->rootPtr = nodePtr;
+	    }
+	    RecomputeNodeCounts(leafPtr);
+	    nodePtr = (Node *) ArenaAlloc(treePtr, sizeof(Node));
+	    nodePtr->parentPtr = leafPtr->parentPtr;
+	    nodePtr->nextPtr = leafPtr->nextPtr;
+	    nodePtr->treePtr = treePtr;
+	    leafPtr->nextPtr = nodePtr;
+	    nodePtr->summaryPtr = NULL;
+	    nodePtr->startTags = NULL;
+	    nodePtr->numStartTags = 0;
+	    nodePtr->startEpoch = 0;
+	    nodePtr->extraDLines = 0;
+	    nodePtr->level = 0;
+	    nodePtr->children.linePtr = newLinePtr;
+	    nodePtr->numChildren = 0;
+	    nodePtr->numLines = 0;
+	    leafPtr = nodePtr;
+	    numChildren = 0;
+	    newLeaves++;
+	} else {
+	    linePtr->nextPtr = newLinePtr;
+	}
+	newLinePtr->parentPtr = leafPtr;
+	linePtr = newLinePtr;
+	curPtr = NULL;
+	numChildren++;
+	changeToLineCount++;
+
+	string = eol;
+    }
+
+    /*
+     * Put back the lines that followed the insertion line and finish
+     * off the last leaf.  The other leaves between the first one and
+     * it hold nothing but character segments.
+     */
+
+    linePtr->nextPtr = restPtr;
+    if (changeToLineCount != 0) {
+	treePtr->epoch++;
+    }
+    if (newLeaves > 0) {
+	RecomputeNodeCounts(leafPtr);
+	for (nodePtr = leafPtr->parentPtr; nodePtr != NULL;
+		nodePtr = nodePtr->parentPtr) {
+	    nodePtr->numLines += changeToLineCount;
+	}
+	leafPtr->parentPtr->numChildren += newLeaves;
+    } else {
+	for (nodePtr = leafPtr; nodePtr != NULL;
+		nodePtr = nodePtr->parentPtr) {
+	    nodePtr->numLines += changeToLineCount;
+	}
+	leafPtr->numChildren += changeToLineCount;
+    }
+
+    /*
+     * Cleanup the starting line for the insertion, plus the ending
+     * line if it's different, then rebalance the tree upwards from
+     * the last leaf (which may be short, and whose ancestors may now
+     * have too many children).
+     */
+
+    CleanupLine(indexPtr->linePtr);
+    if (linePtr != indexPtr->linePtr) {
+	CleanupLine(linePtr);
+    }
+    Rebalance(treePtr, leafPtr);
+
+    if (tkBTreeDebug) {
+	TkBTreeCheck(indexPtr->tree);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeMapChars --
+ *
+ *	Replace the entire text of a B-tree with a block of characters,
+ *	such as a file mapped into memory.  The lines of the new text
+ *	are only created when they are needed, by copying them out of
+ *	the block, so the block must stay around until the tree is
+ *	destroyed, or TkBTreeUnmapChars or this procedure is called
+ *	again.  The text can't be changed until then, except by adding
+ *	and removing tags and marks.  If the block is a file mapped
+ *	into memory, fd is the open file, which is checked for having
+ *	shrunk before lines are copied out of the block.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	All of the old text and its tags are discarded;  the caller
+ *	must first unlink any marks from the tree.  The new text looks
+ *	just like it would if it were inserted into an empty tree
+ *	(every newline in it starts a new line), but little more than
+ *	the root of the tree is set up.  The block is scanned once, to
+ *	count its lines and index every MAP_SAMPLE'th one.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeMapChars(tree, chars, numChars, fd)
+    TkTextBTree tree;			/* Tree whose text is to be
+					 * replaced. */
+    char *chars;			/* First character of new text (need
+					 * not be null-terminated). */
+    size_t numChars;			/* Number of characters in new text. */
+    int fd;				/* File that chars is mapped from, or
+					 * -1.  The caller keeps it open. */
+{
+    BTree *treePtr = (BTree *) tree;
+    MappedText *mapPtr;
+    Node *rootPtr;
+    register char *p, *eol;
+    int numSamples, level;
+    long maxLines;
+
+    ArenaRelease(treePtr);
+    treePtr->epoch++;
+    if (treePtr->summaryBuckets != NULL) {
+	ckfree((char *) treePtr->summaryBuckets);
+	treePtr->summaryBuckets = NULL;
+	treePtr->numSummaryBuckets = 0;
+	treePtr->numSummaries = 0;
+    }
+    treePtr->tagEpoch++;
+    mapPtr = treePtr->mapPtr;
+    if (mapPtr == NULL) {
+	mapPtr = (MappedText *) ckalloc(sizeof(MappedText));
+	numSamples = 64;
+	mapPtr->lineStarts = (char **) ckalloc((unsigned)
+		(numSamples * sizeof(char *)));
+	treePtr->mapPtr = mapPtr;
+    } else {
+	numSamples = 0;
+    }
+    mapPtr->chars = chars;
+    mapPtr->end = chars + numChars;
+    mapPtr->fd = fd;
+
+    /*
+     * Count the newlines, remembering where every MAP_SAMPLE'th line
+     * starts.
+     */
+
+    mapPtr->numNewlines = 0;
+    mapPtr->lineStarts[0] = chars;
+    for (p = chars; (eol = memchr((VOID *) p, '\n',
+	    (size_t) (mapPtr->end - p))) != NULL; p = eol + 1) {
+	mapPtr->numNewlines++;
+	if ((mapPtr->numNewlines % MAP_SAMPLE) == 0) {
+	    if ((numSamples == 0) || (mapPtr->numNewlines/MAP_SAMPLE
+		    >= numSamples)) {
+		/*
+		 * The array is full (or is left over from an earlier text,
+		 * so its size isn't known):  make it bigger.
+		 */
+
+		numSamples = 2*(mapPtr->numNewlines/MAP_SAMPLE + 1);
+		mapPtr->lineStarts = (char **) ckrealloc((char *)
+			mapPtr->lineStarts,
+			(unsigned) (numSamples * sizeof(char *)));
+	    }
+	    mapPtr->lineStarts[mapPtr->numNewlines/MAP_SAMPLE] = eol + 1;
+	}
+    }
+
+    /*
+     * Make an unloaded root node for all the lines:  one for each
+     * newline, the one after the last newline, and the dummy last line
+     * of the tree.  It gets to a level at which it will have at least
+     * two children.
+     */
+
+    mapPtr->linesLeft = mapPtr->numNewlines + 2;
+    for (level = 0, maxLines = MAX_CHILDREN; maxLines < mapPtr->linesLeft;
+	    level++, maxLines *= MAX_CHILDREN) {
+	/* Empty loop body. */
+    }
+    rootPtr = (Node *) ArenaAlloc(treePtr, sizeof(Node));
+    rootPtr->parentPtr = NULL;
+    rootPtr->nextPtr = NULL;
+    rootPtr->treePtr = treePtr;
+    rootPtr->summaryPtr = NULL;
+    rootPtr->startTags = NULL;
+    rootPtr->numStartTags = 0;
+    rootPtr->startEpoch = 0;
+    rootPtr->extraDLines = 0;
+    rootPtr->level = level;
+    rootPtr->children.firstLine = 0;
+    rootPtr->numChildren = 0;
+    rootPtr->numLines = mapPtr->linesLeft;
+    treePtr->rootPtr = rootPtr;
+
+    if (tkBTreeDebug) {
+	TkBTreeCheck(tree);
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeUnmapChars --
+ *
+ *	Create all of the lines of a text given to TkBTreeMapChars that
+ *	haven't been created yet, after which the tree no longer needs
+ *	the block of characters, and its text can be changed again.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The whole tree is loaded.  Nothing happens if the tree's text
+ *	isn't mapped.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeUnmapChars(tree)
+    TkTextBTree tree;			/* Tree whose text is mapped. */
+{
+    BTree *treePtr = (BTree *) tree;
+
+    if (treePtr->mapPtr == NULL) {
+	return;
+    }
+    LoadAll(treePtr->rootPtr);
+    ckfree((char *) treePtr->mapPtr->lineStarts);
+    ckfree((char *) treePtr->mapPtr);
+    treePtr->mapPtr = NULL;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadAll --
+ *
+ *	This is a recursive utility procedure used by TkBTreeUnmapChars
+ *	to load a node and all of its descendants.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The lines of nodePtr's subtree are created, if they haven't
+ *	been already.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LoadAll(nodePtr)
+    Node *nodePtr;			/* Node to load. */
+{
+    Node *childPtr;
+
+    if (nodePtr->numChildren == 0) {
+	LoadNode(nodePtr);
+    }
+    if (nodePtr->level > 0) {
+	for (childPtr = nodePtr->children.nodePtr; childPtr != NULL;
+		childPtr = childPtr->nextPtr) {
+	    LoadAll(childPtr);
+	}
+    }
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * LoadNode --
+ *
+ *	This procedure creates the children of a node that hasn't been
+ *	loaded, in a tree whose text is mapped (see TkBTreeMapChars).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If nodePtr is a leaf, its lines are created by copying them
+ *	out of the mapped text (as much of it as is still in its file).
+ *	Otherwise its lines are shared out
+ *	as evenly as possible among just enough unloaded children
+ *	that none of them has more than it can hold.  Because a node
+ *	at level n can hold MAX_CHILDREN^(n+1) lines, and TkBTreeMapChars
+ *	gives the root at least two children, every child ends up with
+ *	at least half of what it can hold, and so a proper number of
+ *	children of its own.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+LoadNode(nodePtr)
+    Node *nodePtr;			/* Node to load. */
+{
+    BTree *treePtr = nodePtr->treePtr;
+    MappedText *mapPtr = treePtr->mapPtr;
+    int firstLine = nodePtr->children.firstLine;
+    int numChildren, share, extra, i, length;
+    long maxLines;
+    Node *childPtr, *prevPtr;
+    TkTextLine *linePtr, *prevLinePtr;
+    TkTextSegment *segPtr;
+    struct stat statBuf;
+    register char *p, *eol, *q;
+
+    if (nodePtr->level > 0) {
+	for (i = nodePtr->level, maxLines = 1; i > 0; i--) {
+	    maxLines *= MAX_CHILDREN;
+	}
+	numChildren = (nodePtr->numLines + maxLines - 1)/maxLines;
+	share = nodePtr->numLines/numChildren;
+	extra = nodePtr->numLines % numChildren;
+	prevPtr = NULL;
+	for (i = 0; i < numChildren; i++) {
+	    childPtr = (Node *) ArenaAlloc(treePtr, sizeof(Node));
+	    childPtr->parentPtr = nodePtr;
+	    childPtr->nextPtr = NULL;
+	    childPtr->treePtr = treePtr;
+	    childPtr->summaryPtr = NULL;
+	    childPtr->startTags = NULL;
+	    childPtr->numStartTags = 0;
+	    childPtr->startEpoch = 0;
+	    childPtr->extraDLines = 0;
+	    childPtr->level = nodePtr->level - 1;
+	    childPtr->children.firstLine = firstLine;
+	    childPtr->numChildren = 0;
+	    childPtr->numLines = share + ((i < extra) ? 1 : 0);
+	    firstLine += childPtr->numLines;
+	    if (prevPtr == NULL) {
+		nodePtr->children.nodePtr = childPtr;
+	    } else {
+		prevPtr->nextPtr = childPtr;
+	    }
+	    prevPtr = childPtr;
+	}
+	nodePtr->numChildren = numChildren;
+	return;
     }
 
     /*
-     * Cleanup the starting line for the insertion, plus the ending
-     * line if it's different.
+     * Stop short of any part of a mapped file that has been cut off.
      */
 
-    CleanupLine(indexPtr->linePtr);
-    if (linePtr != indexPtr->linePtr) {
-	CleanupLine(linePtr);
+    if ((mapPtr->fd >= 0) && (fstat(mapPtr->fd, &statBuf) == 0)
+	    && (statBuf.st_size < mapPtr->end - mapPtr->chars)) {
+	mapPtr->end = mapPtr->chars + statBuf.st_size;
     }
 
     /*
-     * Increment the line counts in all the parent nodes of the insertion
-     * point, then rebalance the tree if necessary.
+     * Find the first line of the leaf, starting from the last indexed
+     * line before it.  The line after the last newline, and the dummy
+     * line after that, get a newline added, as do the lines that are
+     * no longer there.
      */
 
-    for (nodePtr = linePtr->parentPtr ; nodePtr != NULL;
-	    nodePtr = nodePtr->parentPtr) {
-	nodePtr->numLines += changeToLineCount;
-    }
-    nodePtr = linePtr->parentPtr;
-    nodePtr->numChildren += changeToLineCount;
-    if (nodePtr->numChildren > MAX_CHILDREN) {
-	Rebalance((BTree *) indexPtr->tree, nodePtr);
+    if (firstLine > mapPtr->numNewlines) {
+	p = mapPtr->end;
+    } else {
+	p = mapPtr->lineStarts[firstLine/MAP_SAMPLE];
+	for (i = firstLine % MAP_SAMPLE; (i > 0) && (p < mapPtr->end); i--) {
+	    eol = (char *) memchr((VOID *) p, '\n',
+		    (size_t) (mapPtr->end - p));
+	    p = (eol == NULL) ? mapPtr->end : eol + 1;
+	}
+	if (p > mapPtr->end) {
+	    p = mapPtr->end;
+	}
     }
+    prevLinePtr = NULL;
+    for (i = 0; i < nodePtr->numLines; i++) {
+	eol = (char *) memchr((VOID *) p, '\n', (size_t) (mapPtr->end - p));
+	if (eol != NULL) {
+	    length = eol + 1 - p;
+	} else {
+	    length = mapPtr->end - p;
+	}
+	segPtr = CharSegAlloc(treePtr, length + 1);
+	segPtr->nextPtr = NULL;
+	memcpy((VOID *) segPtr->body.chars, (VOID *) p, (size_t) length);
+	p += length;
+	if (eol == NULL) {
+	    segPtr->body.chars[length++] = '\n';
+	}
+	segPtr->body.chars[length] = 0;
+	segPtr->size = length;
+	tkBTreeCharsCopied += length;
 
-    if (tkBTreeDebug) {
-	TkBTreeCheck(indexPtr->tree);
+	/*
+	 * Segments can't hold null characters:  turn any into spaces.
+	 */
+
+	for (q = segPtr->body.chars; (q = (char *) memchr((VOID *) q, 0,
+		(size_t) (segPtr->body.chars + length - q))) != NULL; q++) {
+	    *q = ' ';
+	}
+
+	linePtr = (TkTextLine *) ArenaAlloc(treePtr, sizeof(TkTextLine));
+	linePtr->parentPtr = nodePtr;
+	linePtr->nextPtr = NULL;
+	linePtr->numDLines = 0;
+	linePtr->dLinesEpoch = 0;
+	linePtr->segPtr = segPtr;
+	if (prevLinePtr == NULL) {
+	    nodePtr->children.linePtr = linePtr;
+	} else {
+	    prevLinePtr->nextPtr = linePtr;
+	}
+	prevLinePtr = linePtr;
     }
+    nodePtr->numChildren = nodePtr->numLines;
+    mapPtr->linesLeft -= nodePtr->numLines;
 }
+
 
 /*
  *--------------------------------------------------------------
@@ -536,7 +1690,8 @@ SplitSeg(indexPtr)
 	    if (count == 0) {
 		return prevPtr;
 	    }
-	    segPtr = (*segPtr->typePtr->splitProc)(segPtr, count);
+	    segPtr = (*segPtr->typePtr->splitProc)(segPtr,
+		    indexPtr->linePtr, count);
 	    if (prevPtr == NULL) {
 		indexPtr->linePtr->segPtr = segPtr;
 	    } else {
@@ -607,6 +1762,160 @@ CleanupLine(linePtr)
     }
 }
 
+/*
+ *--------------------------------------------------------------
+ *
+ * InsertInSegment --
+ *
+ *	This procedure is called by TkBTreeInsertChars to add
+ *	characters that contain no newline to the character segment
+ *	at the insertion point, without splitting any segments.
+ *	The characters go where SplitSeg would put them, so marks
+ *	and tag toggles at the insertion point end up on the same
+ *	sides of them as they would otherwise.
+ *
+ * Results:
+ *	The return value is 1 if the characters were inserted, or 0
+ *	if there is no character segment at the insertion point (in
+ *	which case nothing has been changed).
+ *
+ * Side effects:
+ *	The characters are added to a character segment, which is
+ *	reallocated if it doesn't have room for them.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+InsertInSegment(indexPtr, string, numChars)
+    TkTextIndex *indexPtr;		/* Indicates where to insert text. */
+    char *string;			/* Characters to insert (no
+					 * newlines). */
+    int numChars;			/* Number of characters in string. */
+{
+    TkTextSegment *prevPtr, *segPtr, *newPtr, **linkPtr;
+    BTree *treePtr;
+    int count;
+
+    /*
+     * Find the segments on either side of the insertion point, the
+     * same way as SplitSeg, then pick the character segment to add
+     * the characters to:  the end of the one before, the beginning
+     * of the one after, or the middle of one that SplitSeg would
+     * have to split.
+     */
+
+    for (count = indexPtr->charIndex, prevPtr = NULL,
+	    segPtr = indexPtr->linePtr->segPtr; segPtr != NULL;
+	    count -= segPtr->size, prevPtr = segPtr, segPtr = segPtr->nextPtr) {
+	if ((segPtr->size > count) || ((segPtr->size == 0) && (count == 0)
+		&& !segPtr->typePtr->leftGravity)) {
+	    break;
+	}
+    }
+    if (segPtr == NULL) {
+	return 0;
+    }
+    if ((count == 0) && (prevPtr != NULL)
+	    && (prevPtr->typePtr == &tkTextCharType)) {
+	segPtr = prevPtr;
+	count = segPtr->size;
+    }
+    if (segPtr->typePtr != &tkTextCharType) {
+	return 0;
+    }
+
+    if ((segPtr->size + numChars) <= segPtr->capacity) {
+	memmove((VOID *) (segPtr->body.chars + count + numChars),
+		(VOID *) (segPtr->body.chars + count),
+		(size_t) (segPtr->size - count + 1));
+	memcpy((VOID *) (segPtr->body.chars + count), (VOID *) string,
+		(size_t) numChars);
+	segPtr->size += numChars;
+	tkBTreeCharsCopied += segPtr->size - count;
+	return 1;
+    }
+
+    /*
+     * No room:  move the characters to a bigger segment.
+     */
+
+    treePtr = (BTree *) indexPtr->tree;
+    newPtr = CharSegAlloc(treePtr, segPtr->size + numChars);
+    newPtr->nextPtr = segPtr->nextPtr;
+    newPtr->size = segPtr->size + numChars;
+    memcpy((VOID *) newPtr->body.chars, (VOID *) segPtr->body.chars,
+	    (size_t) count);
+    memcpy((VOID *) (newPtr->body.chars + count), (VOID *) string,
+	    (size_t) numChars);
+    memcpy((VOID *) (newPtr->body.chars + count + numChars),
+	    (VOID *) (segPtr->body.chars + count),
+	    (size_t) (segPtr->size - count + 1));
+    tkBTreeCharsCopied += newPtr->size;
+    for (linkPtr = &indexPtr->linePtr->segPtr; *linkPtr != segPtr;
+	    linkPtr = &(*linkPtr)->nextPtr) {
+	/* Empty loop body. */
+    }
+    *linkPtr = newPtr;
+    ArenaFree(treePtr, (VOID *) segPtr, CSEG_SIZE(segPtr->capacity));
+    tkBTreeCharFrees++;
+    return 1;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * DeleteInSegment --
+ *
+ *	This procedure is called by TkBTreeDeleteChars to delete a
+ *	range of characters that lies within a single character
+ *	segment, without splitting any segments.
+ *
+ * Results:
+ *	The return value is 1 if the characters were deleted, or 0
+ *	if the range isn't inside one character segment (or is the
+ *	whole of one) in which case nothing has been changed.
+ *
+ * Side effects:
+ *	Characters are removed from a character segment.
+ *
+ *--------------------------------------------------------------
+ */
+
+static int
+DeleteInSegment(index1Ptr, index2Ptr)
+    TkTextIndex *index1Ptr;		/* Indicates first character that is
+					 * to be deleted. */
+    TkTextIndex *index2Ptr;		/* Indicates character just after the
+					 * last one that is to be deleted. */
+{
+    TkTextSegment *segPtr;
+    int first, last;
+
+    if (index1Ptr->linePtr != index2Ptr->linePtr) {
+	return 0;
+    }
+    for (first = index1Ptr->charIndex, segPtr = index1Ptr->linePtr->segPtr;
+	    segPtr != NULL; first -= segPtr->size, segPtr = segPtr->nextPtr) {
+	if (segPtr->size > first) {
+	    break;
+	}
+    }
+    if ((segPtr == NULL) || (segPtr->typePtr != &tkTextCharType)) {
+	return 0;
+    }
+    last = first + (index2Ptr->charIndex - index1Ptr->charIndex);
+    if ((last > segPtr->size) || ((last - first) >= segPtr->size)) {
+	return 0;
+    }
+    memmove((VOID *) (segPtr->body.chars + first),
+	    (VOID *) (segPtr->body.chars + last),
+	    (size_t) (segPtr->size - last + 1));
+    segPtr->size -= last - first;
+    tkBTreeCharsCopied += segPtr->size - first;
+    return 1;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -643,6 +1952,24 @@ TkBTreeDeleteChars(index1Ptr, index2Ptr)
     TkTextSegment *segPtr, *nextPtr;
     TkTextLine *curLinePtr;
     Node *curNodePtr, *nodePtr;
+    BTree *treePtr = (BTree *) index1Ptr->tree;
+
+    /*
+     * Deleting a few characters from within one character segment
+     * (backspacing, for example) doesn't need any segments split,
+     * merged or freed.
+     */
+
+    if (DeleteInSegment(index1Ptr, index2Ptr)) {
+	if (tkBTreeDebug) {
+	    TkBTreeCheck(index1Ptr->tree);
+	}
+	return;
+    }
+
+    if (index1Ptr->linePtr != index2Ptr->linePtr) {
+	treePtr->epoch++;
+    }
 
     /*
      * Tricky point:  split at index2Ptr first;  otherwise the split
@@ -690,9 +2017,10 @@ TkBTreeDeleteChars(index1Ptr, index2Ptr)
 		for (nodePtr = curNodePtr; nodePtr != NULL;
 			nodePtr = nodePtr->parentPtr) {
 		    nodePtr->numLines--;
+		    nodePtr->extraDLines -= EXTRA_DLINES(curLinePtr);
 		}
 		curNodePtr->numChildren--;
-		ckfree((char *) curLinePtr);
+		ArenaFree(treePtr, (VOID *) curLinePtr, sizeof(TkTextLine));
 	    }
 	    curLinePtr = nextLinePtr;
 	    segPtr = curLinePtr->segPtr;
@@ -716,7 +2044,8 @@ TkBTreeDeleteChars(index1Ptr, index2Ptr)
 		    prevNodePtr->nextPtr = curNodePtr->nextPtr;
 		}
 		parentPtr->numChildren--;
-		ckfree((char *) curNodePtr);
+		DeleteSummaries(curNodePtr);
+		ArenaFree(treePtr, (VOID *) curNodePtr, sizeof(Node));
 		curNodePtr = parentPtr;
 	    }
 	    curNodePtr = curLinePtr->parentPtr;
@@ -762,6 +2091,7 @@ TkBTreeDeleteChars(index1Ptr, index2Ptr)
 	for (nodePtr = curNodePtr; nodePtr != NULL;
 		nodePtr = nodePtr->parentPtr) {
 	    nodePtr->numLines--;
+	    nodePtr->extraDLines -= EXTRA_DLINES(index2Ptr->linePtr);
 	}
 	curNodePtr->numChildren--;
 	prevLinePtr = curNodePtr->children.linePtr;
@@ -773,8 +2103,8 @@ TkBTreeDeleteChars(index1Ptr, index2Ptr)
 	    }
 	    prevLinePtr->nextPtr = index2Ptr->linePtr->nextPtr;
 	}
-	ckfree((char *) index2Ptr->linePtr);
-	Rebalance((BTree *) index2Ptr->tree, curNodePtr);
+	ArenaFree(treePtr, (VOID *) index2Ptr->linePtr, sizeof(TkTextLine));
+	Rebalance(treePtr, curNodePtr);
     }
 
     /*
@@ -787,7 +2117,7 @@ TkBTreeDeleteChars(index1Ptr, index2Ptr)
      * Lastly, rebalance the first node of the range.
      */
 
-    Rebalance((BTree *) index1Ptr->tree, index1Ptr->linePtr->parentPtr);
+    Rebalance(treePtr, index1Ptr->linePtr->parentPtr);
     if (tkBTreeDebug) {
 	TkBTreeCheck(index1Ptr->tree);
     }
@@ -818,6 +2148,8 @@ TkBTreeFindLine(tree, line)
     BTree *treePtr = (BTree *) tree;
     register Node *nodePtr;
     register TkTextLine *linePtr;
+    register LineCacheEntry *entryPtr;
+    LineCacheEntry *bestPtr;
     int linesLeft;
 
     nodePtr = treePtr->rootPtr;
@@ -826,12 +2158,43 @@ TkBTreeFindLine(tree, line)
 	return NULL;
     }
 
+    /*
+     * If the line, or one shortly before it, was looked up recently,
+     * step forward from there and update the entry to refer to the
+     * new line, so that a scan through the lines keeps going in the
+     * same entry.
+     */
+
+    bestPtr = NULL;
+    for (entryPtr = treePtr->lineCache;
+	    entryPtr < treePtr->lineCache + LINE_CACHE_SIZE; entryPtr++) {
+	if ((entryPtr->epoch == treePtr->epoch)
+		&& (entryPtr->lineIndex <= line)
+		&& (entryPtr->lineIndex + LINE_CACHE_REACH >= line)
+		&& ((bestPtr == NULL)
+		|| (entryPtr->lineIndex > bestPtr->lineIndex))) {
+	    bestPtr = entryPtr;
+	}
+    }
+    if (bestPtr != NULL) {
+	for (linePtr = bestPtr->linePtr, linesLeft = line - bestPtr->lineIndex;
+		linesLeft > 0; linesLeft--) {
+	    linePtr = TkBTreeNextLine(linePtr);
+	}
+	bestPtr->linePtr = linePtr;
+	bestPtr->lineIndex = line;
+	return linePtr;
+    }
+
     /*
      * Work down through levels of the tree until a node is found at
-     * level 0.
+     * level 0, loading nodes of a mapped text as they're reached.
      */
 
     while (nodePtr->level != 0) {
+	if (nodePtr->numChildren == 0) {
+	    LoadNode(nodePtr);
+	}
 	for (nodePtr = nodePtr->children.nodePtr;
 		nodePtr->numLines <= linesLeft;
 		nodePtr = nodePtr->nextPtr) {
@@ -846,6 +2209,9 @@ TkBTreeFindLine(tree, line)
      * Work through the lines attached to the level-0 node.
      */
 
+    if (nodePtr->numChildren == 0) {
+	LoadNode(nodePtr);
+    }
     for (linePtr = nodePtr->children.linePtr; linesLeft > 0;
 	    linePtr = linePtr->nextPtr) {
 	if (linePtr == NULL) {
@@ -853,6 +2219,7 @@ TkBTreeFindLine(tree, line)
 	}
 	linesLeft -= 1;
     }
+    CacheLine(treePtr, linePtr, line);
     return linePtr;
 }
 
@@ -901,7 +2268,13 @@ TkBTreeNextLine(linePtr)
 	    return (TkTextLine *) NULL;
 	}
     }
-    while (nodePtr->level > 0) {
+    while (1) {
+	if (nodePtr->numChildren == 0) {
+	    LoadNode(nodePtr);
+	}
+	if (nodePtr->level == 0) {
+	    break;
+	}
 	nodePtr = nodePtr->children.nodePtr;
     }
     return nodePtr->children.linePtr;
@@ -932,8 +2305,18 @@ TkBTreeLineIndex(linePtr)
 {
     register TkTextLine *linePtr2;
     register Node *nodePtr, *parentPtr, *nodePtr2;
+    BTree *treePtr = linePtr->parentPtr->treePtr;
+    register LineCacheEntry *entryPtr;
     int index;
 
+    for (entryPtr = treePtr->lineCache;
+	    entryPtr < treePtr->lineCache + LINE_CACHE_SIZE; entryPtr++) {
+	if ((entryPtr->linePtr == linePtr)
+		&& (entryPtr->epoch == treePtr->epoch)) {
+	    return entryPtr->lineIndex;
+	}
+    }
+
     /*
      * First count how many lines precede this one in its level-0
      * node.
@@ -965,9 +2348,212 @@ TkBTreeLineIndex(linePtr)
 	    index += nodePtr2->numLines;
 	}
     }
+    CacheLine(treePtr, linePtr, index);
+    return index;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeSetDLines --
+ *
+ *	This procedure is called by the display code to record how many
+ *	display lines a line of text takes up, so that the B-tree can
+ *	add up display lines the way it adds up lines (see
+ *	TkBTreeDLineIndex and TkBTreeFindDLine).
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The line's numDLines is set, and the extraDLines counts of the
+ *	nodes above it are adjusted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeSetDLines(linePtr, numDLines)
+    TkTextLine *linePtr;		/* Line whose display lines have been
+					 * counted. */
+    int numDLines;			/* Number of display lines it takes
+					 * up (at least 1). */
+{
+    register Node *nodePtr;
+    int change;
+
+    change = EXTRA_DLINES(linePtr);
+    linePtr->numDLines = numDLines;
+    change = EXTRA_DLINES(linePtr) - change;
+    if (change != 0) {
+	for (nodePtr = linePtr->parentPtr; nodePtr != NULL;
+		nodePtr = nodePtr->parentPtr) {
+	    nodePtr->extraDLines += change;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeDLineIndex --
+ *
+ *	Given a pointer to a line in a B-tree, return the number of
+ *	display lines taken up by the lines before it, as recorded by
+ *	TkBTreeSetDLines.
+ *
+ * Results:
+ *	The result is the index of linePtr's first display line among
+ *	all the display lines of the text (0 for the first line).
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkBTreeDLineIndex(linePtr)
+    TkTextLine *linePtr;		/* Pointer to existing line in
+					 * B-tree. */
+{
+    register TkTextLine *linePtr2;
+    register Node *nodePtr, *parentPtr, *nodePtr2;
+    int index;
+
+    /*
+     * This works like TkBTreeLineIndex, except that each line counts
+     * for its display lines and each node for its lines' display
+     * lines.
+     */
+
+    nodePtr = linePtr->parentPtr;
+    index = 0;
+    for (linePtr2 = nodePtr->children.linePtr; linePtr2 != linePtr;
+	    linePtr2 = linePtr2->nextPtr) {
+	if (linePtr2 == NULL) {
+	    panic("TkBTreeDLineIndex couldn't find line");
+	}
+	index += 1 + EXTRA_DLINES(linePtr2);
+    }
+    for (parentPtr = nodePtr->parentPtr ; parentPtr != NULL;
+	    nodePtr = parentPtr, parentPtr = parentPtr->parentPtr) {
+	for (nodePtr2 = parentPtr->children.nodePtr; nodePtr2 != nodePtr;
+		nodePtr2 = nodePtr2->nextPtr) {
+	    if (nodePtr2 == NULL) {
+		panic("TkBTreeDLineIndex couldn't find node");
+	    }
+	    index += nodePtr2->numLines + nodePtr2->extraDLines;
+	}
+    }
     return index;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeFindDLine --
+ *
+ *	Find the line of a B-tree that contains a particular display
+ *	line, going by the counts recorded with TkBTreeSetDLines.
+ *
+ * Results:
+ *	The return value is a pointer to the line structure for the
+ *	line that takes up display line "dLine" (counting from 0 for
+ *	the first display line of the text), or NULL if there is no such
+ *	display line.  *offsetPtr is set to the number of the display
+ *	line within the line (0 for its first display line).
+ *
+ * Side effects:
+ *	Nodes of a mapped text may be loaded.
+ *
+ *----------------------------------------------------------------------
+ */
+
+TkTextLine *
+TkBTreeFindDLine(tree, dLine, offsetPtr)
+    TkTextBTree tree;			/* B-tree in which to find line. */
+    int dLine;				/* Index of desired display line. */
+    int *offsetPtr;			/* Where to store the display line's
+					 * index within its line. */
+{
+    BTree *treePtr = (BTree *) tree;
+    register Node *nodePtr;
+    register TkTextLine *linePtr;
+    int dLinesLeft;
+
+    nodePtr = treePtr->rootPtr;
+    dLinesLeft = dLine;
+    if ((dLine < 0) || (dLine >= nodePtr->numLines + nodePtr->extraDLines)) {
+	return NULL;
+    }
+
+    /*
+     * Work down through levels of the tree until a node is found at
+     * level 0, then through the lines attached to it.
+     */
+
+    while (nodePtr->level != 0) {
+	if (nodePtr->numChildren == 0) {
+	    LoadNode(nodePtr);
+	}
+	for (nodePtr = nodePtr->children.nodePtr;
+		nodePtr->numLines + nodePtr->extraDLines <= dLinesLeft;
+		nodePtr = nodePtr->nextPtr) {
+	    if (nodePtr == NULL) {
+		panic("TkBTreeFindDLine ran out of nodes");
+	    }
+	    dLinesLeft -= nodePtr->numLines + nodePtr->extraDLines;
+	}
+    }
+    if (nodePtr->numChildren == 0) {
+	LoadNode(nodePtr);
+    }
+    for (linePtr = nodePtr->children.linePtr;
+	    1 + EXTRA_DLINES(linePtr) <= dLinesLeft;
+	    linePtr = linePtr->nextPtr) {
+	if (linePtr == NULL) {
+	    panic("TkBTreeFindDLine ran out of lines");
+	}
+	dLinesLeft -= 1 + EXTRA_DLINES(linePtr);
+    }
+    *offsetPtr = dLinesLeft;
+    return linePtr;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheLine --
+ *
+ *	Remember the index of a line in a tree's cache of recently
+ *	looked-up lines, replacing the oldest entry.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	An entry of the cache is overwritten.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CacheLine(treePtr, linePtr, index)
+    BTree *treePtr;			/* Tree containing line. */
+    TkTextLine *linePtr;		/* Line to remember. */
+    int index;				/* Index of linePtr in the tree. */
+{
+    LineCacheEntry *entryPtr;
+
+    entryPtr = &treePtr->lineCache[treePtr->nextCacheEntry];
+    entryPtr->linePtr = linePtr;
+    entryPtr->lineIndex = index;
+    entryPtr->epoch = treePtr->epoch;
+    treePtr->nextCacheEntry = (treePtr->nextCacheEntry + 1) % LINE_CACHE_SIZE;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1082,21 +2668,126 @@ TkBTreeTag(index1Ptr, index2Ptr, tagPtr, add)
     int add;				/* One means add tag to the given
 					 * range of characters;  zero means
 					 * remove the tag from the range. */
+{
+    TagRange(index1Ptr, index2Ptr, tagPtr, add,
+	    TkBTreeCharTagged(index1Ptr, tagPtr));
+
+    if (tkBTreeDebug) {
+	TkBTreeCheck(index1Ptr->tree);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeTagRanges --
+ *
+ *	Turn a given tag on or off for many ranges of characters at
+ *	once.  This does the same as calling TkBTreeTag for each range,
+ *	but the state of the tag at the start of each range is worked
+ *	out from the toggles between it and the end of the range before,
+ *	rather than from the top of the tree each time.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The given tag is added to or removed from the characters in
+ *	each range.  The ranges must be sorted, and each must start
+ *	after the end of the one before it.  The indexes are no longer
+ *	valid when this procedure returns.
+ *
+ *----------------------------------------------------------------------
+ */
+
+void
+TkBTreeTagRanges(numRanges, indexArray, tagPtr, add)
+    int numRanges;			/* Number of ranges. */
+    TkTextIndex *indexArray;		/* Start and end of each range, in
+					 * order;  2*numRanges entries. */
+    TkTextTag *tagPtr;			/* Tag to add or remove. */
+    int add;				/* One means add tag to the ranges;
+					 * zero means remove it. */
+{
+    TkTextSearch search;
+    int i, state;
+
+    if (numRanges <= 0) {
+	return;
+    }
+    state = TkBTreeCharTagged(&indexArray[0], tagPtr);
+    for (i = 0; i < numRanges; i++) {
+	if (i > 0) {
+	    /*
+	     * The characters between the end of the last range and the
+	     * start of this one haven't changed, so the tag's state at
+	     * the start of this range is its state at the end of the
+	     * last, flipped once for each toggle in between.
+	     */
+
+	    TkBTreeStartSearch(&indexArray[2*i - 1], &indexArray[2*i],
+		    tagPtr, &search);
+	    while (TkBTreeNextTag(&search)) {
+		state ^= 1;
+	    }
+	}
+	state = TagRange(&indexArray[2*i], &indexArray[2*i + 1], tagPtr,
+		add, state);
+    }
+
+    if (tkBTreeDebug) {
+	TkBTreeCheck(indexArray[0].tree);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TagRange --
+ *
+ *	Does the work of TkBTreeTag and TkBTreeTagRanges for a single
+ *	range of characters, given whether the first character in the
+ *	range currently has the tag.
+ *
+ * Results:
+ *	Returns 1 if the character just after the range had the tag
+ *	before this procedure was called (and so still has it), 0
+ *	otherwise.
+ *
+ * Side effects:
+ *	Same as TkBTreeTag.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+TagRange(index1Ptr, index2Ptr, tagPtr, add, oldState)
+    register TkTextIndex *index1Ptr;	/* Indicates first character in
+					 * range. */
+    register TkTextIndex *index2Ptr;	/* Indicates character just after the
+					 * last one in range. */
+    TkTextTag *tagPtr;			/* Tag to add or remove. */
+    int add;				/* One means add tag to the given
+					 * range of characters;  zero means
+					 * remove the tag from the range. */
+    int oldState;			/* 1 means the character at index1Ptr
+					 * has the tag now, 0 means it
+					 * doesn't. */
 {
     TkTextSegment *segPtr, *prevPtr;
     TkTextSearch search;
     TkTextLine *cleanupLinePtr;
-    int oldState;
+    Node *countNodePtr;
+    int countDelta;
+    BTree *treePtr = (BTree *) index1Ptr->tree;
 
     /*
-     * See whether the tag is present at the start of the range.  If
-     * the state doesn't already match what we want then add a toggle
-     * there.
+     * If the tag's state at the start of the range doesn't already
+     * match what we want then add a toggle there.
      */
 
-    oldState = TkBTreeCharTagged(index1Ptr, tagPtr);
     if ((add != 0) ^ oldState) {
-	segPtr = (TkTextSegment *) ckalloc(TSEG_SIZE);
+	segPtr = (TkTextSegment *) ArenaAlloc(treePtr, TSEG_SIZE);
 	segPtr->typePtr = (add) ? &tkTextToggleOnType : &tkTextToggleOffType;
 	prevPtr = SplitSeg(index1Ptr);
 	if (prevPtr == NULL) {
@@ -1114,11 +2805,17 @@ TkBTreeTag(index1Ptr, index2Ptr, tagPtr, add)
     /*
      * Scan the range of characters and delete any internal tag
      * transitions.  Keep track of what the old state was at the end
-     * of the range, and add a toggle there if it's needed.
+     * of the range, and add a toggle there if it's needed.  The
+     * toggle counts for the deleted transitions are gathered up in
+     * countDelta and applied once for each leaf node, rather than
+     * once per toggle:  removing a tag from a large range can delete
+     * thousands of toggles.
      */
 
     TkBTreeStartSearch(index1Ptr, index2Ptr, tagPtr, &search);
     cleanupLinePtr = index1Ptr->linePtr;
+    countNodePtr = NULL;
+    countDelta = 0;
     while (TkBTreeNextTag(&search)) {
 	oldState ^= 1;
 	segPtr = search.segPtr;
@@ -1132,11 +2829,17 @@ TkBTreeTag(index1Ptr, index2Ptr, tagPtr, add)
 	    prevPtr->nextPtr = segPtr->nextPtr;
 	}
 	if (segPtr->body.toggle.inNodeCounts) {
-	    ChangeNodeToggleCount(search.curIndex.linePtr->parentPtr,
-		    segPtr->body.toggle.tagPtr, -1);
+	    if (search.curIndex.linePtr->parentPtr != countNodePtr) {
+		if (countDelta != 0) {
+		    ChangeNodeToggleCount(countNodePtr, tagPtr, countDelta);
+		}
+		countNodePtr = search.curIndex.linePtr->parentPtr;
+		countDelta = 0;
+	    }
+	    countDelta--;
 	    segPtr->body.toggle.inNodeCounts = 0;
 	}
-	ckfree((char *) segPtr);
+	ArenaFree(treePtr, (VOID *) segPtr, TSEG_SIZE);
 
 	/*
 	 * The code below is a bit tricky.  After deleting a toggle
@@ -1153,8 +2856,11 @@ TkBTreeTag(index1Ptr, index2Ptr, tagPtr, add)
 	    cleanupLinePtr = search.curIndex.linePtr;
 	}
     }
+    if (countDelta != 0) {
+	ChangeNodeToggleCount(countNodePtr, tagPtr, countDelta);
+    }
     if ((add != 0) ^ oldState) {
-	segPtr = (TkTextSegment *) ckalloc(TSEG_SIZE);
+	segPtr = (TkTextSegment *) ArenaAlloc(treePtr, TSEG_SIZE);
 	segPtr->typePtr = (add) ? &tkTextToggleOffType : &tkTextToggleOnType;
 	prevPtr = SplitSeg(index2Ptr);
 	if (prevPtr == NULL) {
@@ -1178,10 +2884,7 @@ TkBTreeTag(index1Ptr, index2Ptr, tagPtr, add)
     if (cleanupLinePtr != index2Ptr->linePtr) {
 	CleanupLine(index2Ptr->linePtr);
     }
-
-    if (tkBTreeDebug) {
-	TkBTreeCheck(index1Ptr->tree);
-    }
+    return oldState;
 }
 
 /*
@@ -1210,7 +2913,9 @@ ChangeNodeToggleCount(nodePtr, tagPtr, delta)
     int delta;				/* Amount to add to current toggle
 					 * count for tag (may be negative). */
 {
-    register Summary *summaryPtr, *prevPtr;
+    register Summary *summaryPtr;
+
+    nodePtr->treePtr->tagEpoch++;
 
     /*
      * Iterate over the node and all of its ancestors.
@@ -1222,15 +2927,11 @@ ChangeNodeToggleCount(nodePtr, tagPtr, delta)
 	 * perhaps all we have to do is adjust its count.
 	 */
     
-	for (prevPtr = NULL, summaryPtr = nodePtr->summaryPtr;
-		summaryPtr != NULL;
-		prevPtr = summaryPtr, summaryPtr = summaryPtr->nextPtr) {
-	    if (summaryPtr->tagPtr != tagPtr) {
-		continue;
-	    }
+	summaryPtr = FindSummary(nodePtr, tagPtr);
+	if (summaryPtr != NULL) {
 	    summaryPtr->toggleCount += delta;
 	    if (summaryPtr->toggleCount > 0) {
-		goto nextAncestor;
+		continue;
 	    }
 	    if (summaryPtr->toggleCount < 0) {
 		panic("ChangeNodeToggleCount: negative toggle count");
@@ -1240,13 +2941,8 @@ ChangeNodeToggleCount(nodePtr, tagPtr, delta)
 	     * Zero count;  must remove this tag from the list.
 	     */
     
-	    if (prevPtr == NULL) {
-		nodePtr->summaryPtr = summaryPtr->nextPtr;
-	    } else {
-		prevPtr->nextPtr = summaryPtr->nextPtr;
-	    }
-	    ckfree((char *) summaryPtr);
-	    goto nextAncestor;
+	    RemoveSummary(summaryPtr);
+	    continue;
 	}
     
 	/*
@@ -1256,14 +2952,7 @@ ChangeNodeToggleCount(nodePtr, tagPtr, delta)
 	if (delta < 0) {
 	    panic("ChangeNodeToggleCount: negative delta, no tag entry");
 	}
-	summaryPtr = (Summary *) ckalloc(sizeof(Summary));
-	summaryPtr->tagPtr = tagPtr;
-	summaryPtr->toggleCount = delta;
-	summaryPtr->nextPtr = nodePtr->summaryPtr;
-	nodePtr->summaryPtr = summaryPtr;
-
-	nextAncestor:
-	continue;
+	AddSummary(nodePtr, tagPtr, delta);
     }
 }
 
@@ -1357,7 +3046,6 @@ TkBTreeNextTag(searchPtr)
 {
     register TkTextSegment *segPtr;
     register Node *nodePtr;
-    register Summary *summaryPtr;
 
     if (searchPtr->linesLeft <= 0) {
 	goto searchOver;
@@ -1424,12 +3112,9 @@ TkBTreeNextTag(searchPtr)
 		nodePtr = nodePtr->parentPtr;
 	    }
 	    nodePtr = nodePtr->nextPtr;
-	    for (summaryPtr = nodePtr->summaryPtr; summaryPtr != NULL;
-		    summaryPtr = summaryPtr->nextPtr) {
-		if ((searchPtr->allTags) ||
-			(summaryPtr->tagPtr == searchPtr->tagPtr)) {
-		    goto gotNodeWithTag;
-		}
+	    if ((searchPtr->allTags) ? (nodePtr->summaryPtr != NULL)
+		    : (FindSummary(nodePtr, searchPtr->tagPtr) != NULL)) {
+		goto gotNodeWithTag;
 	    }
 	    searchPtr->linesLeft -= nodePtr->numLines;
 	}
@@ -1444,12 +3129,9 @@ TkBTreeNextTag(searchPtr)
 	while (nodePtr->level > 0) {
 	    for (nodePtr = nodePtr->children.nodePtr; ;
 		    nodePtr = nodePtr->nextPtr) {
-		for (summaryPtr = nodePtr->summaryPtr; summaryPtr != NULL;
-			summaryPtr = summaryPtr->nextPtr) {
-		    if ((searchPtr->allTags)
-			    || (summaryPtr->tagPtr == searchPtr->tagPtr)) {
-			goto nextChild;
-		    }
+		if ((searchPtr->allTags) ? (nodePtr->summaryPtr != NULL)
+			: (FindSummary(nodePtr, searchPtr->tagPtr) != NULL)) {
+		    goto nextChild;
 		}
 		searchPtr->linesLeft -= nodePtr->numLines;
 		if (nodePtr->nextPtr == NULL) {
@@ -1567,11 +3249,9 @@ TkBTreeCharTagged(indexPtr, tagPtr)
 
 	for (siblingPtr = nodePtr->parentPtr->children.nodePtr; 
 		siblingPtr != nodePtr; siblingPtr = siblingPtr->nextPtr) {
-	    for (summaryPtr = siblingPtr->summaryPtr; summaryPtr != NULL;
-		    summaryPtr = summaryPtr->nextPtr) {
-		if (summaryPtr->tagPtr == tagPtr) {
-		    toggles += summaryPtr->toggleCount;
-		}
+	    summaryPtr = FindSummary(siblingPtr, tagPtr);
+	    if (summaryPtr != NULL) {
+		toggles += summaryPtr->toggleCount;
 	    }
 	}
     }
@@ -1618,7 +3298,7 @@ TkBTreeGetTags(indexPtr, numTagsPtr)
     register Node *nodePtr;
     register TkTextLine *siblingLinePtr;
     register TkTextSegment *segPtr;
-    int src, dst, index;
+    int src, dst, index, i;
     TagInfo tagInfo;
 #define NUM_TAG_INFOS 10
 
@@ -1629,6 +3309,17 @@ TkBTreeGetTags(indexPtr, numTagsPtr)
     tagInfo.counts = (int *) ckalloc((unsigned)
 	    NUM_TAG_INFOS*sizeof(int));
 
+    /*
+     * Start with the tags that are toggled on by the lines before
+     * indexPtr's level-0 node.
+     */
+
+    nodePtr = indexPtr->linePtr->parentPtr;
+    FindStartTags(nodePtr);
+    for (i = 0; i < nodePtr->numStartTags; i++) {
+	IncCount(nodePtr->startTags[i], 1, &tagInfo);
+    }
+
     /*
      * Record tag toggles within the line of indexPtr but preceding
      * indexPtr.
@@ -1660,28 +3351,6 @@ TkBTreeGetTags(indexPtr, numTagsPtr)
 	}
     }
 
-    /*
-     * For each node in the ancestry of this line, record tag toggles
-     * for all siblings that precede that node.
-     */
-
-    for (nodePtr = indexPtr->linePtr->parentPtr; nodePtr->parentPtr != NULL;
-	    nodePtr = nodePtr->parentPtr) {
-	register Node *siblingPtr;
-	register Summary *summaryPtr;
-
-	for (siblingPtr = nodePtr->parentPtr->children.nodePtr; 
-		siblingPtr != nodePtr; siblingPtr = siblingPtr->nextPtr) {
-	    for (summaryPtr = siblingPtr->summaryPtr; summaryPtr != NULL;
-		    summaryPtr = summaryPtr->nextPtr) {
-		if (summaryPtr->toggleCount & 1) {
-		    IncCount(summaryPtr->tagPtr, summaryPtr->toggleCount,
-			    &tagInfo);
-		}
-	    }
-	}
-    }
-
     /*
      * Go through the tag information and squash out all of the tags
      * that have even toggle counts (these tags exist before the point
@@ -1729,15 +3398,18 @@ IncCount(tagPtr, inc, tagInfoPtr)
     TagInfo *tagInfoPtr;	/* Holds cumulative information about tags;
 				 * increment count here. */
 {
-    register TkTextTag **tagPtrPtr;
-    int count;
+    int i;
 
-    for (tagPtrPtr = tagInfoPtr->tagPtrs, count = tagInfoPtr->numTags;
-	    count > 0; tagPtrPtr++, count--) {
-	if (*tagPtrPtr == tagPtr) {
-	    tagInfoPtr->counts[tagInfoPtr->numTags-count] += inc;
-	    return;
-	}
+    /*
+     * The tag remembers where its entry is, but the number may be left
+     * over from an earlier call, so make sure the entry is really the
+     * tag's.
+     */
+
+    i = tagPtr->tagInfoIndex;
+    if ((i < tagInfoPtr->numTags) && (tagInfoPtr->tagPtrs[i] == tagPtr)) {
+	tagInfoPtr->counts[i] += inc;
+	return;
     }
 
     /*
@@ -1765,11 +3437,142 @@ IncCount(tagPtr, inc, tagInfoPtr)
 	tagInfoPtr->arraySize = newSize;
     }
 
+    tagPtr->tagInfoIndex = tagInfoPtr->numTags;
     tagInfoPtr->tagPtrs[tagInfoPtr->numTags] = tagPtr;
     tagInfoPtr->counts[tagInfoPtr->numTags] = inc;
     tagInfoPtr->numTags++;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * FindStartTags --
+ *
+ *	Make sure that a node's startTags are up to date:  they hold the
+ *	tags with an odd number of toggles in the lines before the node.
+ *	TkBTreeGetTags starts from these, rather than adding up the
+ *	summaries of all the nodes before the character it's asked
+ *	about, which is slow when there are thousands of tags.  Each
+ *	node's startTags are its parent's, plus the toggles in the
+ *	siblings before it;  they're kept until the tree's tagEpoch
+ *	changes, so consecutive calls for nearby characters only have
+ *	to look at a few nodes.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The startTags of nodePtr, of its ancestors, and of siblings of
+ *	theirs that come before them may be recomputed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FindStartTags(nodePtr)
+    Node *nodePtr;			/* Node whose startTags are needed. */
+{
+    BTree *treePtr = nodePtr->treePtr;
+    Node *parentPtr, *childPtr;
+    register Summary *summaryPtr;
+    TagInfo tagInfo;
+    int i, src, dst;
+
+    if (nodePtr->startEpoch == treePtr->tagEpoch) {
+	return;
+    }
+    parentPtr = nodePtr->parentPtr;
+    if (parentPtr == NULL) {
+	SetStartTags(nodePtr, (TkTextTag **) NULL, 0);
+	return;
+    }
+
+    /*
+     * Work forward from the parent's first child, which starts with
+     * the same tags as the parent, to nodePtr, adding each child's
+     * toggles to get the tags for the next one.
+     */
+
+    FindStartTags(parentPtr);
+    childPtr = parentPtr->children.nodePtr;
+    if (childPtr->startEpoch != treePtr->tagEpoch) {
+	SetStartTags(childPtr, parentPtr->startTags,
+		parentPtr->numStartTags);
+    }
+    for ( ; childPtr != nodePtr; childPtr = childPtr->nextPtr) {
+	if (childPtr->nextPtr->startEpoch == treePtr->tagEpoch) {
+	    continue;
+	}
+	tagInfo.numTags = 0;
+	tagInfo.arraySize = NUM_TAG_INFOS;
+	tagInfo.tagPtrs = (TkTextTag **) ckalloc((unsigned)
+		NUM_TAG_INFOS*sizeof(TkTextTag *));
+	tagInfo.counts = (int *) ckalloc((unsigned)
+		NUM_TAG_INFOS*sizeof(int));
+	for (i = 0; i < childPtr->numStartTags; i++) {
+	    IncCount(childPtr->startTags[i], 1, &tagInfo);
+	}
+	for (summaryPtr = childPtr->summaryPtr; summaryPtr != NULL;
+		summaryPtr = summaryPtr->nextPtr) {
+	    if (summaryPtr->toggleCount & 1) {
+		IncCount(summaryPtr->tagPtr, summaryPtr->toggleCount,
+			&tagInfo);
+	    }
+	}
+	for (src = 0, dst = 0; src < tagInfo.numTags; src++) {
+	    if (tagInfo.counts[src] & 1) {
+		tagInfo.tagPtrs[dst] = tagInfo.tagPtrs[src];
+		dst++;
+	    }
+	}
+	SetStartTags(childPtr->nextPtr, tagInfo.tagPtrs, dst);
+	ckfree((char *) tagInfo.tagPtrs);
+	ckfree((char *) tagInfo.counts);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * SetStartTags --
+ *
+ *	Store a new set of startTags for a node.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The node's old startTags are freed, the new ones are copied into
+ *	storage from the tree's arena, and the node is stamped with the
+ *	tree's current tagEpoch.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+SetStartTags(nodePtr, tagPtrs, numTags)
+    Node *nodePtr;			/* Node whose startTags are to be
+					 * set. */
+    TkTextTag **tagPtrs;		/* Tags on at the start of the node. */
+    int numTags;			/* Number of entries in tagPtrs. */
+{
+    BTree *treePtr = nodePtr->treePtr;
+
+    if (nodePtr->startTags != NULL) {
+	ArenaFree(treePtr, (VOID *) nodePtr->startTags,
+		nodePtr->numStartTags * sizeof(TkTextTag *));
+	nodePtr->startTags = NULL;
+    }
+    nodePtr->numStartTags = numTags;
+    if (numTags > 0) {
+	nodePtr->startTags = (TkTextTag **) ArenaAlloc(treePtr,
+		numTags * sizeof(TkTextTag *));
+	memcpy((VOID *) nodePtr->startTags, (VOID *) tagPtrs,
+		numTags * sizeof(TkTextTag *));
+    }
+    nodePtr->startEpoch = treePtr->tagEpoch;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1826,16 +3629,7 @@ TkBTreeCheck(tree)
     if (nodePtr->numLines < 2) {
 	panic("TkBTreeCheck: less than 2 lines in tree");
     }
-    while (nodePtr->level > 0) {
-	nodePtr = nodePtr->children.nodePtr;
-	while (nodePtr->nextPtr != NULL) {
-	    nodePtr = nodePtr->nextPtr;
-	}
-    }
-    linePtr = nodePtr->children.linePtr;
-    while (linePtr->nextPtr != NULL) {
-	linePtr = linePtr->nextPtr;
-    }
+    linePtr = TkBTreeFindLine(tree, nodePtr->numLines - 1);
     segPtr = linePtr->segPtr;
     while ((segPtr->typePtr == &tkTextToggleOffType)
 	    || (segPtr->typePtr == &tkTextRightMarkType)
@@ -1892,8 +3686,15 @@ CheckNodeConsistency(nodePtr)
     register Summary *summaryPtr, *summaryPtr2;
     register TkTextLine *linePtr;
     register TkTextSegment *segPtr;
-    int numChildren, numLines, toggleCount, minChildren;
+    int numChildren, numLines, extraDLines, toggleCount, minChildren;
+
+    if ((nodePtr->numChildren == 0) && (nodePtr->treePtr->mapPtr != NULL)) {
+	/*
+	 * The node hasn't been loaded from a mapped text yet.
+	 */
 
+	return;
+    }
     if (nodePtr->parentPtr != NULL) {
 	minChildren = MIN_CHILDREN;
     } else if (nodePtr->level > 0) {
@@ -1909,6 +3710,7 @@ CheckNodeConsistency(nodePtr)
 
     numChildren = 0;
     numLines = 0;
+    extraDLines = 0;
     if (nodePtr->level == 0) {
 	for (linePtr = nodePtr->children.linePtr; linePtr != NULL;
 		linePtr = linePtr->nextPtr) {
@@ -1936,6 +3738,7 @@ CheckNodeConsistency(nodePtr)
 	    }
 	    numChildren++;
 	    numLines++;
+	    extraDLines += EXTRA_DLINES(linePtr);
 	}
     } else {
 	for (childNodePtr = nodePtr->children.nodePtr; childNodePtr != NULL;
@@ -1943,6 +3746,9 @@ CheckNodeConsistency(nodePtr)
 	    if (childNodePtr->parentPtr != nodePtr) {
 		panic("CheckNodeConsistency: node doesn't point to parent");
 	    }
+	    if (childNodePtr->treePtr != nodePtr->treePtr) {
+		panic("CheckNodeConsistency: node doesn't point to tree");
+	    }
 	    if (childNodePtr->level != (nodePtr->level-1)) {
 		panic("CheckNodeConsistency: level mismatch (%d %d)",
 			nodePtr->level, childNodePtr->level);
@@ -1964,6 +3770,7 @@ CheckNodeConsistency(nodePtr)
 	    }
 	    numChildren++;
 	    numLines += childNodePtr->numLines;
+	    extraDLines += childNodePtr->extraDLines;
 	}
     }
     if (numChildren != nodePtr->numChildren) {
@@ -1974,6 +3781,10 @@ CheckNodeConsistency(nodePtr)
 	panic("CheckNodeConsistency: mismatch in numLines (%d %d)",
 		numLines, nodePtr->numLines);
     }
+    if (extraDLines != nodePtr->extraDLines) {
+	panic("CheckNodeConsistency: mismatch in extraDLines (%d %d)",
+		extraDLines, nodePtr->extraDLines);
+    }
 
     for (summaryPtr = nodePtr->summaryPtr; summaryPtr != NULL;
 	    summaryPtr = summaryPtr->nextPtr) {
@@ -2009,6 +3820,13 @@ CheckNodeConsistency(nodePtr)
 	    panic("CheckNodeConsistency: mismatch in toggleCount (%d %d)",
 		    toggleCount, summaryPtr->toggleCount);
 	}
+	if ((summaryPtr->nodePtr != nodePtr)
+		|| ((summaryPtr->nextPtr != NULL)
+		&& (summaryPtr->nextPtr->prevPtr != summaryPtr))
+		|| (FindSummary(nodePtr, summaryPtr->tagPtr) != summaryPtr)) {
+	    panic("CheckNodeConsistency: node tag \"%s\" not %s",
+		    summaryPtr->tagPtr->name, "properly linked");
+	}
 	for (summaryPtr2 = summaryPtr->nextPtr; summaryPtr2 != NULL;
 		summaryPtr2 = summaryPtr2->nextPtr) {
 	    if (summaryPtr2->tagPtr == summaryPtr->tagPtr) {
@@ -2068,10 +3886,15 @@ Rebalance(treePtr, nodePtr)
 		 */
     
 		if (nodePtr->parentPtr == NULL) {
-		    newPtr = (Node *) ckalloc(sizeof(Node));
+		    newPtr = (Node *) ArenaAlloc(treePtr, sizeof(Node));
 		    newPtr->parentPtr = NULL;
 		    newPtr->nextPtr = NULL;
+		    newPtr->treePtr = treePtr;
 		    newPtr->summaryPtr = NULL;
+		    newPtr->startTags = NULL;
+		    newPtr->numStartTags = 0;
+		    newPtr->startEpoch = 0;
+		    newPtr->extraDLines = 0;
 		    newPtr->level = nodePtr->level + 1;
 		    newPtr->children.nodePtr = nodePtr;
 		    newPtr->numChildren = 1;
@@ -2079,11 +3902,16 @@ Rebalance(treePtr, nodePtr)
 		    RecomputeNodeCounts(newPtr);
 		    treePtr->rootPtr = newPtr;
 		}
-		newPtr = (Node *) ckalloc(sizeof(Node));
+		newPtr = (Node *) ArenaAlloc(treePtr, sizeof(Node));
 		newPtr->parentPtr = nodePtr->parentPtr;
 		newPtr->nextPtr = nodePtr->nextPtr;
+		newPtr->treePtr = treePtr;
 		nodePtr->nextPtr = newPtr;
 		newPtr->summaryPtr = NULL;
+		newPtr->startTags = NULL;
+		newPtr->numStartTags = 0;
+		newPtr->startEpoch = 0;
+		newPtr->extraDLines = 0;
 		newPtr->level = nodePtr->level;
 		newPtr->numChildren = nodePtr->numChildren - MIN_CHILDREN;
 		if (nodePtr->level == 0) {
@@ -2131,8 +3959,8 @@ Rebalance(treePtr, nodePtr)
 		if ((nodePtr->numChildren == 1) && (nodePtr->level > 0)) {
 		    treePtr->rootPtr = nodePtr->children.nodePtr;
 		    treePtr->rootPtr->parentPtr = NULL;
-		    DeleteSummaries(nodePtr->summaryPtr);
-		    ckfree((char *) nodePtr);
+		    DeleteSummaries(nodePtr);
+		    ArenaFree(treePtr, (VOID *) nodePtr, sizeof(Node));
 		}
 		return;
 	    }
@@ -2221,8 +4049,8 @@ Rebalance(treePtr, nodePtr)
 		RecomputeNodeCounts(nodePtr);
 		nodePtr->nextPtr = otherPtr->nextPtr;
 		nodePtr->parentPtr->numChildren--;
-		DeleteSummaries(otherPtr->summaryPtr);
-		ckfree((char *) otherPtr);
+		DeleteSummaries(otherPtr);
+		ArenaFree(treePtr, (VOID *) otherPtr, sizeof(Node));
 		continue;
 	    }
 
@@ -2288,6 +4116,8 @@ RecomputeNodeCounts(nodePtr)
     }
     nodePtr->numChildren = 0;
     nodePtr->numLines = 0;
+    nodePtr->extraDLines = 0;
+    nodePtr->treePtr->tagEpoch++;
 
     /*
      * Scan through the children, adding the childrens' tag counts into
@@ -2300,6 +4130,7 @@ RecomputeNodeCounts(nodePtr)
 		linePtr = linePtr->nextPtr) {
 	    nodePtr->numChildren++;
 	    nodePtr->numLines++;
+	    nodePtr->extraDLines += EXTRA_DLINES(linePtr);
 	    linePtr->parentPtr = nodePtr;
 	    for (segPtr = linePtr->segPtr; segPtr != NULL;
 		    segPtr = segPtr->nextPtr) {
@@ -2309,20 +4140,11 @@ RecomputeNodeCounts(nodePtr)
 		    continue;
 		}
 		tagPtr = segPtr->body.toggle.tagPtr;
-		for (summaryPtr = nodePtr->summaryPtr; ;
-			summaryPtr = summaryPtr->nextPtr) {
-		    if (summaryPtr == NULL) {
-			summaryPtr = (Summary *) ckalloc(sizeof(Summary));
-			summaryPtr->tagPtr = tagPtr;
-			summaryPtr->toggleCount = 1;
-			summaryPtr->nextPtr = nodePtr->summaryPtr;
-			nodePtr->summaryPtr = summaryPtr;
-			break;
-		    }
-		    if (summaryPtr->tagPtr == tagPtr) {
-			summaryPtr->toggleCount++;
-			break;
-		    }
+		summaryPtr = FindSummary(nodePtr, tagPtr);
+		if (summaryPtr == NULL) {
+		    AddSummary(nodePtr, tagPtr, 1);
+		} else {
+		    summaryPtr->toggleCount++;
 		}
 	    }
 	}
@@ -2331,23 +4153,16 @@ RecomputeNodeCounts(nodePtr)
 		childPtr = childPtr->nextPtr) {
 	    nodePtr->numChildren++;
 	    nodePtr->numLines += childPtr->numLines;
+	    nodePtr->extraDLines += childPtr->extraDLines;
 	    childPtr->parentPtr = nodePtr;
 	    for (summaryPtr2 = childPtr->summaryPtr; summaryPtr2 != NULL;
 		    summaryPtr2 = summaryPtr2->nextPtr) {
-		for (summaryPtr = nodePtr->summaryPtr; ;
-			summaryPtr = summaryPtr->nextPtr) {
-		    if (summaryPtr == NULL) {
-			summaryPtr = (Summary *) ckalloc(sizeof(Summary));
-			summaryPtr->tagPtr = summaryPtr2->tagPtr;
-			summaryPtr->toggleCount = summaryPtr2->toggleCount;
-			summaryPtr->nextPtr = nodePtr->summaryPtr;
-			nodePtr->summaryPtr = summaryPtr;
-			break;
-		    }
-		    if (summaryPtr->tagPtr == summaryPtr2->tagPtr) {
-			summaryPtr->toggleCount += summaryPtr2->toggleCount;
-			break;
-		    }
+		summaryPtr = FindSummary(nodePtr, summaryPtr2->tagPtr);
+		if (summaryPtr == NULL) {
+		    AddSummary(nodePtr, summaryPtr2->tagPtr,
+			    summaryPtr2->toggleCount);
+		} else {
+		    summaryPtr->toggleCount += summaryPtr2->toggleCount;
 		}
 	    }
 	}
@@ -2358,21 +4173,11 @@ RecomputeNodeCounts(nodePtr)
      * records that still have a zero count.
      */
 
-    summaryPtr2 = NULL;
-    for (summaryPtr = nodePtr->summaryPtr; summaryPtr != NULL; ) {
-	if (summaryPtr->toggleCount > 0) {
-	    summaryPtr2 = summaryPtr;
-	    summaryPtr = summaryPtr->nextPtr;
-	    continue;
-	}
-	if (summaryPtr2 != NULL) {
-	    summaryPtr2->nextPtr = summaryPtr->nextPtr;
-	    ckfree((char *) summaryPtr);
-	    summaryPtr = summaryPtr2->nextPtr;
-	} else {
-	    nodePtr->summaryPtr = summaryPtr->nextPtr;
-	    ckfree((char *) summaryPtr);
-	    summaryPtr = nodePtr->summaryPtr;
+    for (summaryPtr = nodePtr->summaryPtr; summaryPtr != NULL;
+	    summaryPtr = summaryPtr2) {
+	summaryPtr2 = summaryPtr->nextPtr;
+	if (summaryPtr->toggleCount == 0) {
+	    RemoveSummary(summaryPtr);
 	}
     }
 }
@@ -2404,6 +4209,73 @@ TkBTreeNumLines(tree)
     return treePtr->rootPtr->numLines - 1;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkBTreeNumDLines --
+ *
+ *	This procedure returns a count of the number of display lines
+ *	taken up by the text in a given B-tree, as recorded by
+ *	TkBTreeSetDLines.
+ *
+ * Results:
+ *	The return value is the number of display lines taken up by the
+ *	usable lines in tree (i.e. not counting the dummy last line).
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkBTreeNumDLines(tree)
+    TkTextBTree tree;			/* Information about tree. */
+{
+    BTree *treePtr = (BTree *) tree;
+    return treePtr->rootPtr->numLines - 1 + treePtr->rootPtr->extraDLines;
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * CharSegAlloc --
+ *
+ *	This procedure allocates a character segment, with some room
+ *	to spare.
+ *
+ * Results:
+ *	The return value is a pointer to a new character segment
+ *	with room for at least numChars characters (plus a null).
+ *	The caller must fill in its nextPtr, size and characters.
+ *
+ * Side effects:
+ *	Storage is allocated.
+ *
+ *--------------------------------------------------------------
+ */
+
+static TkTextSegment *
+CharSegAlloc(treePtr, numChars)
+    BTree *treePtr;			/* Tree that the segment is for. */
+    int numChars;			/* Number of characters the segment
+					 * must have room for. */
+{
+    TkTextSegment *segPtr;
+    int grain, capacity;
+
+    for (grain = CSEG_GRAIN; (grain*8) < numChars; grain *= 2) {
+	/* Empty loop body. */
+    }
+    capacity = ((numChars + grain)/grain)*grain - 1;
+    capacity = ARENA_ROUND(CSEG_SIZE(capacity)) - CSEG_SIZE(0);
+    segPtr = (TkTextSegment *) ArenaAlloc(treePtr, CSEG_SIZE(capacity));
+    segPtr->typePtr = &tkTextCharType;
+    segPtr->capacity = capacity;
+    tkBTreeCharAllocs++;
+    return segPtr;
+}
+
 /*
  *--------------------------------------------------------------
  *
@@ -2414,36 +4286,33 @@ TkBTreeNumLines(tree)
  * Results:
  *	The return value is a pointer to a chain of two segments
  *	that have the same characters as segPtr except split
- *	among the two segments.
+ *	among the two segments.  The first of them is segPtr.
  *
  * Side effects:
- *	Storage for segPtr is freed.
+ *	SegPtr is truncated (keeping its storage) and a new segment
+ *	is allocated for the rest of its characters.
  *
  *--------------------------------------------------------------
  */
 
 static TkTextSegment *
-CharSplitProc(segPtr, index)
+CharSplitProc(segPtr, linePtr, index)
     TkTextSegment *segPtr;		/* Pointer to segment to split. */
+    TkTextLine *linePtr;		/* Line containing segment. */
     int index;				/* Position within segment at which
 					 * to split. */
 {
-    TkTextSegment *newPtr1, *newPtr2;
-
-    newPtr1 = (TkTextSegment *) ckalloc(CSEG_SIZE(index));
-    newPtr2 = (TkTextSegment *) ckalloc(
-	    CSEG_SIZE(segPtr->size - index));
-    newPtr1->typePtr = &tkTextCharType;
-    newPtr1->nextPtr = newPtr2;
-    newPtr1->size = index;
-    strncpy(newPtr1->body.chars, segPtr->body.chars, (size_t) index);
-    newPtr1->body.chars[index] = 0;
-    newPtr2->typePtr = &tkTextCharType;
-    newPtr2->nextPtr = segPtr->nextPtr;
-    newPtr2->size = segPtr->size - index;
-    strcpy(newPtr2->body.chars, segPtr->body.chars + index);
-    ckfree((char*) segPtr);
-    return newPtr1;
+    TkTextSegment *newPtr;
+
+    newPtr = CharSegAlloc(linePtr->parentPtr->treePtr, segPtr->size - index);
+    newPtr->nextPtr = segPtr->nextPtr;
+    newPtr->size = segPtr->size - index;
+    strcpy(newPtr->body.chars, segPtr->body.chars + index);
+    tkBTreeCharsCopied += newPtr->size;
+    segPtr->nextPtr = newPtr;
+    segPtr->size = index;
+    segPtr->body.chars[index] = 0;
+    return segPtr;
 }
 
 /*
@@ -2459,35 +4328,65 @@ CharSplitProc(segPtr, index)
  *	the (new) list of segments that used to start with segPtr.
  *
  * Side effects:
- *	Storage for the segments may be allocated and freed.
+ *	Storage for the segments may be allocated and freed.  When
+ *	one of the segments has room for the characters of both,
+ *	they are merged into it.
  *
  *--------------------------------------------------------------
  */
 
-	/* ARGSUSED */
 static TkTextSegment *
 CharCleanupProc(segPtr, linePtr)
     TkTextSegment *segPtr;		/* Pointer to first of two adjacent
 					 * segments to join. */
-    TkTextLine *linePtr;		/* Line containing segments (not
-					 * used). */
+    TkTextLine *linePtr;		/* Line containing segments. */
 {
     TkTextSegment *segPtr2, *newPtr;
+    BTree *treePtr = linePtr->parentPtr->treePtr;
+    int size;
 
-    segPtr2 = segPtr->nextPtr;
-    if ((segPtr2 == NULL) || (segPtr2->typePtr != &tkTextCharType)) {
-	return segPtr;
-    }
-    newPtr = (TkTextSegment *) ckalloc(CSEG_SIZE(
-	    segPtr->size + segPtr2->size));
-    newPtr->typePtr = &tkTextCharType;
-    newPtr->nextPtr = segPtr2->nextPtr;
-    newPtr->size = segPtr->size + segPtr2->size;
-    strcpy(newPtr->body.chars, segPtr->body.chars);
-    strcpy(newPtr->body.chars + segPtr->size, segPtr2->body.chars);
-    ckfree((char*) segPtr);
-    ckfree((char*) segPtr2);
-    return newPtr;
+    /*
+     * Keep merging until the next segment isn't a character segment:
+     * if segPtr gets merged in place, CleanupLine won't see a change
+     * and come back to it.
+     */
+
+    while (1) {
+	segPtr2 = segPtr->nextPtr;
+	if ((segPtr2 == NULL) || (segPtr2->typePtr != &tkTextCharType)) {
+	    return segPtr;
+	}
+	size = segPtr->size + segPtr2->size;
+	if (size <= segPtr->capacity) {
+	    strcpy(segPtr->body.chars + segPtr->size, segPtr2->body.chars);
+	    tkBTreeCharsCopied += segPtr2->size;
+	    segPtr->nextPtr = segPtr2->nextPtr;
+	    segPtr->size = size;
+	    ArenaFree(treePtr, (VOID *) segPtr2, CSEG_SIZE(segPtr2->capacity));
+	} else if (size <= segPtr2->capacity) {
+	    memmove((VOID *) (segPtr2->body.chars + segPtr->size),
+		    (VOID *) segPtr2->body.chars,
+		    (size_t) (segPtr2->size + 1));
+	    memcpy((VOID *) segPtr2->body.chars, (VOID *) segPtr->body.chars,
+		    (size_t) segPtr->size);
+	    tkBTreeCharsCopied += size;
+	    segPtr2->size = size;
+	    ArenaFree(treePtr, (VOID *) segPtr, CSEG_SIZE(segPtr->capacity));
+	    segPtr = segPtr2;
+	} else {
+	    newPtr = CharSegAlloc(treePtr, size);
+	    newPtr->nextPtr = segPtr2->nextPtr;
+	    newPtr->size = size;
+	    strcpy(newPtr->body.chars, segPtr->body.chars);
+	    strcpy(newPtr->body.chars + segPtr->size, segPtr2->body.chars);
+	    tkBTreeCharsCopied += size;
+	    ArenaFree(treePtr, (VOID *) segPtr, CSEG_SIZE(segPtr->capacity));
+	    ArenaFree(treePtr, (VOID *) segPtr2, CSEG_SIZE(segPtr2->capacity));
+	    tkBTreeCharFrees++;
+	    segPtr = newPtr;
+	}
+	tkBTreeCharFrees++;
+    }
 }
 
 /*
@@ -2501,12 +4400,12 @@ CharCleanupProc(segPtr, linePtr)
  *	Always returns 0 to indicate that the segment was deleted.
  *
  * Side effects:
- *	Storage for the segment is freed.
+ *	Storage for the segment is freed, unless the entire B-tree
+ *	is going away (its arena is freed all at once).
  *
  *--------------------------------------------------------------
  */
 
-	/* ARGSUSED */
 static int
 CharDeleteProc(segPtr, linePtr, treeGone)
     TkTextSegment *segPtr;		/* Segment to delete. */
@@ -2515,7 +4414,11 @@ CharDeleteProc(segPtr, linePtr, treeGone)
 					 * being deleted, so everything must
 					 * get cleaned up. */
 {
-    ckfree((char*) segPtr);
+    if (!treeGone) {
+	ArenaFree(linePtr->parentPtr->treePtr, (VOID *) segPtr,
+		CSEG_SIZE(segPtr->capacity));
+    }
+    tkBTreeCharFrees++;
     return 0;
 }
 
@@ -2557,6 +4460,9 @@ CharCheckProc(segPtr, linePtr)
     if (strlen(segPtr->body.chars) != segPtr->size) {
 	panic("CharCheckProc: segment has wrong size");
     }
+    if (segPtr->capacity < segPtr->size) {
+	panic("CharCheckProc: segment has more characters than room");
+    }
     if (segPtr->nextPtr == NULL) {
 	if (segPtr->body.chars[segPtr->size-1] != '\n') {
 	    panic("CharCheckProc: line doesn't end with newline");
@@ -2580,9 +4486,9 @@ CharCheckProc(segPtr, linePtr)
  *	unless the entire B-tree is going away.
  *
  * Side effects:
- *	If the tree is going away then the toggle's memory is
- *	freed;  otherwise the toggle counts in nodes above the
- *	segment get updated.
+ *	Unless the tree is going away (in which case its arena,
+ *	toggles and all, is freed all at once), the toggle counts
+ *	in nodes above the segment get updated.
  *
  *--------------------------------------------------------------
  */
@@ -2596,7 +4502,6 @@ ToggleDeleteProc(segPtr, linePtr, treeGone)
 					 * get cleaned up. */
 {
     if (treeGone) {
-	ckfree((char *) segPtr);
 	return 0;
     }
 
@@ -2671,9 +4576,11 @@ ToggleCleanupProc(segPtr, linePtr)
 			segPtr->body.toggle.tagPtr, -counts);
 	    }
 	    prevPtr->nextPtr = segPtr2->nextPtr;
-	    ckfree((char *) segPtr2);
+	    ArenaFree(linePtr->parentPtr->treePtr, (VOID *) segPtr2,
+		    TSEG_SIZE);
 	    segPtr2 = segPtr->nextPtr;
-	    ckfree((char *) segPtr);
+	    ArenaFree(linePtr->parentPtr->treePtr, (VOID *) segPtr,
+		    TSEG_SIZE);
 	    return segPtr2;
 	}
     }
@@ -65,6 +65,56 @@ typedef struct Style {
 				 * to delete entry. */
 } Style;
 
+/*
+ * While LayoutDLine walks through the segments of a text line, it keeps
+ * track of the tags on the current character in a structure of the
+ * following type, updating it at each tag toggle rather than asking
+ * the B-tree for the tags of every chunk.  Only the tags that affect
+ * the display are kept, so toggles of other tags cost nothing.
+ */
+
+#define NUM_STATIC_TAGS	10
+
+typedef struct TagSet {
+    int numTags;		/* Number of tags in tagPtrs. */
+    int arraySize;		/* Number of slots in tagPtrs. */
+    TkTextTag **tagPtrs;	/* Tags that affect the display and are on
+				 * at the current character, in order of
+				 * increasing priority.  Points either to
+				 * staticTags or to malloc'ed space. */
+    TkTextSegment *segPtr;	/* First segment whose toggles haven't been
+				 * accounted for yet, or NULL. */
+    int charIndex;		/* Index within its line of the first
+				 * character of segPtr. */
+    TkTextTag *staticTags[NUM_STATIC_TAGS];
+				/* Space for tagPtrs when it's small. */
+} TagSet;
+
+/*
+ * Styles are looked up by the exact set of tags that are on, in
+ * dInfoPtr->tagSetTable, so that the options of the tags don't have to
+ * be merged again for a combination that has been seen before.  The
+ * table is keyed by a hash of the tags, and the entries with the same
+ * hash are chained together.  Each entry holds a reference to its
+ * style.  The table is emptied whenever tag options or priorities, or
+ * the widget's own options, change (see FreeTagSetStyles), and once it
+ * holds more than MAX_TAG_SETS entries.
+ */
+
+#define MAX_TAG_SETS	1000
+
+typedef struct TagSetStyle {
+    Style *stylePtr;		/* Style for the characters that have
+				 * exactly these tags. */
+    struct TagSetStyle *nextPtr;/* Next entry with the same hash, or
+				 * NULL. */
+    int numTags;		/* Number of tags in tagPtrs. */
+    TkTextTag *tagPtrs[1];	/* The tags, in order of increasing
+				 * priority.  Actual size will be numTags,
+				 * not 1.  THIS MUST BE THE LAST FIELD IN
+				 * THE STRUCTURE. */
+} TagSetStyle;
+
 /*
  * The following structure describes one line of the display, which may
  * be either part or all of one line of the text.
@@ -130,6 +180,75 @@ typedef struct DLine {
 #define TOP_LINE	4
 #define BOTTOM_LINE	8
 
+/*
+ * DLines that scroll out of the window, or that were only layed out to
+ * measure the text (as in MeasureUp), are kept for reuse by GetDLine
+ * rather than freed, so that scrolling back and forth doesn't have to
+ * lay the same lines out again and again.  They're grouped by text
+ * line in the following structures, which are kept in
+ * dInfoPtr->layoutTable and in a list in order of last use.  A
+ * DLine's layout depends only on the characters and tags of its text
+ * line from its first character on, and on the window's size and
+ * options, so the entries for a text line are thrown away whenever
+ * anything in that line changes (see InvalidateLayouts) and all the
+ * entries are thrown away whenever the whole window is re-layed out.
+ */
+
+typedef struct LayoutEntry {
+    TkTextLine *linePtr;	/* Text line whose DLines are kept here. */
+    DLine *dLinePtr;		/* First in list of kept DLines for the
+				 * line, linked by their nextPtr fields,
+				 * in no particular order. */
+    int numDLines;		/* Number of DLines in the list. */
+    Tcl_HashEntry *hPtr;	/* Entry in layoutTable.  Used to delete
+				 * entry. */
+    struct LayoutEntry *prevPtr;
+				/* Entry used more recently than this one,
+				 * or NULL if this is the most recent. */
+    struct LayoutEntry *nextPtr;
+				/* Entry used less recently than this one,
+				 * or NULL if this is the least recent. */
+} LayoutEntry;
+
+/*
+ * Once more than MAX_KEPT_DLINES DLines are kept, the entries that were
+ * used least recently are freed.
+ */
+
+#define MAX_KEPT_DLINES	500
+
+/*
+ * When display lines are counted in the background for the vertical
+ * scrollbar or the -synccommand, CountDLinesProc starts COUNT_DELAY_MS
+ * milliseconds after the first change that needs it (so that a burst
+ * of changes, such as typing into a long line, is counted once rather
+ * than after every change) and then counts for at most
+ * COUNT_BATCH_USECS microseconds at a time before letting other events
+ * in.  The lines in the window are always laid out first, by the
+ * redisplay, so only the rest of the text is left to the background.
+ */
+
+#define COUNT_DELAY_MS		20
+#define COUNT_BATCH_USECS	5000
+
+/*
+ * The following macro is true if textPtr's display lines are to be
+ * counted in the background.  Mapped texts aren't counted, since that
+ * would build every line of the file.
+ */
+
+#define COUNT_IN_BACKGROUND(textPtr) \
+	((((textPtr)->yScrollCmd != NULL) || ((textPtr)->syncCmd != NULL)) \
+	&& ((textPtr)->mapChars == NULL))
+
+/*
+ * When more than MAX_DLINE_MARKS text lines have their display line
+ * counts go out of date at once, InvalidateDLineCounts moves to a new
+ * epoch rather than marking the lines one at a time.
+ */
+
+#define MAX_DLINE_MARKS		1000
+
 /*
  * Overall display information for a text widget:
  */
@@ -137,6 +256,9 @@ typedef struct DLine {
 typedef struct DInfo {
     Tcl_HashTable styleTable;	/* Hash table that maps from StyleValues
 				 * to Styles for this widget. */
+    Tcl_HashTable tagSetTable;	/* Maps from hashes of sets of tags to
+				 * TagSetStyles (see GetStyle). */
+    int numTagSets;		/* Number of TagSetStyles in tagSetTable. */
     DLine *dLinePtr;		/* First in list of all display lines for
 				 * this widget, in order from top to bottom. */
     int x;			/* First x-coordinate that may be used for
@@ -156,6 +278,36 @@ typedef struct DInfo {
 				 * figure out when to redraw part or all of
 				 * the eof field. */
 
+    /*
+     * Information about DLines kept for reuse (see LayoutEntry):
+     */
+
+    Tcl_HashTable layoutTable;	/* Maps from TkTextLine pointers to the
+				 * LayoutEntry for the line. */
+    LayoutEntry *firstEntryPtr;	/* Most recently used entry, or NULL if
+				 * no DLines are kept. */
+    LayoutEntry *lastEntryPtr;	/* Least recently used entry, or NULL. */
+    int numKeptDLines;		/* Total number of DLines in entries. */
+
+    /*
+     * Information used to keep the display line counts in the B-tree
+     * up to date for the vertical scrollbar (see CountDLinesProc):
+     */
+
+    unsigned int dLinesEpoch;	/* A text line's display line count is
+				 * current only if the line's dLinesEpoch
+				 * field holds this value.  Incremented
+				 * when all the counts go out of date. */
+    int countLine;		/* Index of the first text line that may
+				 * still need counting, or -1 if all the
+				 * lines are counted. */
+    int countTail;		/* Number of lines at the end of the text
+				 * after the last one that may need
+				 * counting.  Only valid if countLine
+				 * isn't -1. */
+    Tcl_TimerToken countTimer;	/* Token for the timer handler that counts
+				 * the next batch of lines, or NULL. */
+
     /*
      * Information used for scrolling:
      */
@@ -220,11 +372,19 @@ typedef struct CharInfo {
  *				scheduled to update the display.
  * REDRAW_BORDERS:		Means window border or pad area has
  *				potentially been damaged and must be redrawn.
+ * DINFO_SEE_END:		Means text has been appended while the end
+ *				of the text was visible:  the next update of
+ *				the DLines must scroll the view so that the
+ *				end is at the bottom of the window again.
+ * DINFO_OUT_OF_SYNC:		Means the -synccommand was last told that
+ *				display lines are still being counted.
  */
 
 #define DINFO_OUT_OF_DATE	1
 #define REDRAW_PENDING		2
 #define REDRAW_BORDERS		4
+#define DINFO_SEE_END		8
+#define DINFO_OUT_OF_SYNC	16
 
 /*
  * The following counters keep statistics about redisplay that can be
@@ -233,6 +393,8 @@ typedef struct CharInfo {
 
 static int numRedisplays;	/* Number of calls to DisplayText. */
 static int linesRedrawn;	/* Number of calls to DisplayDLine. */
+static int numCopies;		/* Number of calls to Ctk_ScrollRect to
+				 * shift part of the screen. */
 
 /*
  * Forward declarations for procedures defined later in this file:
@@ -241,6 +403,8 @@ static int linesRedrawn;	/* Number of calls to DisplayDLine. */
 static void		AdjustForTab _ANSI_ARGS_((TkText *textPtr,
 			    TkTextTabArray *tabArrayPtr, int index,
 			    TkTextDispChunk *chunkPtr));
+static void		CacheDLines _ANSI_ARGS_((TkText *textPtr,
+			    DLine *firstPtr, DLine *lastPtr, int unlink));
 static void		CharBboxProc _ANSI_ARGS_((TkTextDispChunk *chunkPtr,
 			    int index, int y,
 			    int *xPtr, int *yPtr, int *widthPtr,
@@ -251,6 +415,11 @@ static int		CharMeasureProc _ANSI_ARGS_((TkTextDispChunk *chunkPtr,
 			    int x));
 static void		CharUndisplayProc _ANSI_ARGS_((TkText *textPtr,
 			    TkTextDispChunk *chunkPtr));
+static void		CountDLines _ANSI_ARGS_((TkText *textPtr,
+			    TkTextLine *linePtr));
+static void		CountDLinesProc _ANSI_ARGS_((ClientData clientData));
+static int		CountPendingDLines _ANSI_ARGS_((TkText *textPtr,
+			    int maxUsecs));
 static void		DisplayDLine _ANSI_ARGS_((TkText *textPtr,
 			    DLine *dlPtr, DLine *prevPtr));
 static void		DisplayText _ANSI_ARGS_((ClientData clientData));
@@ -258,25 +427,41 @@ static DLine *		FindDLine _ANSI_ARGS_((DLine *dlPtr,
 			    TkTextIndex *indexPtr));
 static void		FreeDLines _ANSI_ARGS_((TkText *textPtr,
 			    DLine *firstPtr, DLine *lastPtr, int unlink));
+static void		FreeLayoutEntry _ANSI_ARGS_((TkText *textPtr,
+			    LayoutEntry *entryPtr));
 static void		FreeStyle _ANSI_ARGS_((TkText *textPtr,
 			    Style *stylePtr));
-static Style *		GetStyle _ANSI_ARGS_((TkText *textPtr,
+static void		FreeTagSet _ANSI_ARGS_((TagSet *setPtr));
+static void		FreeTagSetStyles _ANSI_ARGS_((TkText *textPtr));
+static DLine *		GetDLine _ANSI_ARGS_((TkText *textPtr,
 			    TkTextIndex *indexPtr));
+static Style *		GetStyle _ANSI_ARGS_((TkText *textPtr,
+			    TagSet *setPtr));
 static void		GetXView _ANSI_ARGS_((Tcl_Interp *interp,
 			    TkText *textPtr, int report));
 static void		GetYView _ANSI_ARGS_((Tcl_Interp *interp,
 			    TkText *textPtr, int report));
+static void		InitTagSet _ANSI_ARGS_((TkTextIndex *indexPtr,
+			    TagSet *setPtr));
+static void		InvalidateDLineCounts _ANSI_ARGS_((TkText *textPtr,
+			    TkTextIndex *index1Ptr, TkTextIndex *index2Ptr));
+static void		InvalidateLayouts _ANSI_ARGS_((TkText *textPtr,
+			    TkTextIndex *index1Ptr, TkTextIndex *index2Ptr));
 static DLine *		LayoutDLine _ANSI_ARGS_((TkText *textPtr,
 			    TkTextIndex *indexPtr));
 static void		MeasureUp _ANSI_ARGS_((TkText *textPtr,
 			    TkTextIndex *srcPtr, int distance,
 			    TkTextIndex *dstPtr));
 static void		UpdateDisplayInfo _ANSI_ARGS_((TkText *textPtr));
+static void		ReportSync _ANSI_ARGS_((TkText *textPtr,
+			    int inSync));
 static void		ScrollByLines _ANSI_ARGS_((TkText *textPtr,
 			    int offset));
 static int		SizeOfTab _ANSI_ARGS_((TkText *textPtr,
 			    TkTextTabArray *tabArrayPtr, int index, int x,
 			    int maxX));
+static int		UpdateTagSet _ANSI_ARGS_((TagSet *setPtr,
+			    int charIndex));
 
 /*
  *----------------------------------------------------------------------
@@ -304,8 +489,18 @@ TkTextCreateDInfo(textPtr)
 
     dInfoPtr = (DInfo *) ckalloc(sizeof(DInfo));
     Tcl_InitHashTable(&dInfoPtr->styleTable, sizeof(StyleValues)/sizeof(int));
+    Tcl_InitHashTable(&dInfoPtr->tagSetTable, TCL_ONE_WORD_KEYS);
+    dInfoPtr->numTagSets = 0;
     dInfoPtr->dLinePtr = NULL;
     dInfoPtr->topOfEof = 0;
+    Tcl_InitHashTable(&dInfoPtr->layoutTable, TCL_ONE_WORD_KEYS);
+    dInfoPtr->firstEntryPtr = NULL;
+    dInfoPtr->lastEntryPtr = NULL;
+    dInfoPtr->numKeptDLines = 0;
+    dInfoPtr->dLinesEpoch = 1;
+    dInfoPtr->countLine = -1;
+    dInfoPtr->countTail = 0;
+    dInfoPtr->countTimer = NULL;
     dInfoPtr->newCharOffset = 0;
     dInfoPtr->curPixelOffset = 0;
     dInfoPtr->maxLength = 0;
@@ -343,16 +538,24 @@ TkTextFreeDInfo(textPtr)
 
     /*
      * Be careful to free up styleTable *after* freeing up all the
-     * DLines, so that the hash table is still intact to free up the
-     * style-related information from the lines.  Once the lines are
+     * DLines, including the ones kept for reuse, and the styles kept
+     * for sets of tags, so that the hash table is still intact to free
+     * up the style-related information from them.  Once they are
      * all free then styleTable will be empty.
      */
 
     FreeDLines(textPtr, dInfoPtr->dLinePtr, (DLine *) NULL, 1);
+    InvalidateLayouts(textPtr, (TkTextIndex *) NULL, (TkTextIndex *) NULL);
+    Tcl_DeleteHashTable(&dInfoPtr->layoutTable);
+    FreeTagSetStyles(textPtr);
+    Tcl_DeleteHashTable(&dInfoPtr->tagSetTable);
     Tcl_DeleteHashTable(&dInfoPtr->styleTable);
     if (dInfoPtr->flags & REDRAW_PENDING) {
 	Tcl_CancelIdleCall(DisplayText, (ClientData) textPtr);
     }
+    if (dInfoPtr->countTimer != NULL) {
+	Tcl_DeleteTimerHandler(dInfoPtr->countTimer);
+    }
     ckfree((char *) dInfoPtr);
 }
 
@@ -362,31 +565,60 @@ TkTextFreeDInfo(textPtr)
  * GetStyle --
  *
  *	This procedure creates all the information needed to display
- *	text at a particular location.
+ *	text with a particular set of tags.
  *
  * Results:
  *	The return value is a pointer to a Style structure that
- *	corresponds to *sValuePtr.
+ *	corresponds to the tags in *setPtr.  The caller owns a
+ *	reference to it and must eventually call FreeStyle.
  *
  * Side effects:
- *	A new entry may be created in the style table for the widget.
+ *	New entries may be created in the style table and the table
+ *	of tag sets for the widget.
  *
  *----------------------------------------------------------------------
  */
 
 static Style *
-GetStyle(textPtr, indexPtr)
+GetStyle(textPtr, setPtr)
     TkText *textPtr;		/* Overall information about text widget. */
-    TkTextIndex *indexPtr;	/* The character in the text for which
+    TagSet *setPtr;		/* The tags on the characters for which
 				 * display information is wanted. */
 {
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
     TkTextTag **tagPtrs;
     register TkTextTag *tagPtr;
     StyleValues styleValues;
     Style *stylePtr;
+    TagSetStyle *setStylePtr;
     Tcl_HashEntry *hPtr;
+    unsigned long hash;
     int numTags, new, i;
 
+    /*
+     * See if this set of tags has been seen before.
+     */
+
+    tagPtrs = setPtr->tagPtrs;
+    numTags = setPtr->numTags;
+    hash = numTags;
+    for (i = 0; i < numTags; i++) {
+	hash = hash * 31 + (((unsigned long) tagPtrs[i]) >> 3);
+    }
+    hPtr = Tcl_CreateHashEntry(&dInfoPtr->tagSetTable, (char *) hash, &new);
+    if (!new) {
+	for (setStylePtr = (TagSetStyle *) Tcl_GetHashValue(hPtr);
+		setStylePtr != NULL; setStylePtr = setStylePtr->nextPtr) {
+	    if ((setStylePtr->numTags == numTags)
+		    && (memcmp((VOID *) setStylePtr->tagPtrs,
+			    (VOID *) tagPtrs,
+			    numTags * sizeof(TkTextTag *)) == 0)) {
+		setStylePtr->stylePtr->refCount++;
+		return setStylePtr->stylePtr;
+	    }
+	}
+    }
+
     /*
      * The variables below keep track of the highest-priority specification
      * that has occurred for each of the various fields of the StyleValues.
@@ -398,13 +630,11 @@ GetStyle(textPtr, indexPtr)
     int tabPrio, wrapPrio;
 
     /*
-     * Find out what tags are present for the character, then compute
-     * a StyleValues structure corresponding to those tags (scan
+     * Compute a StyleValues structure corresponding to the tags (scan
      * through all of the tags, saving information for the highest-
      * priority tag).
      */
 
-    tagPtrs = TkBTreeGetTags(indexPtr, &numTags);
     underlinePrio = justifyPrio = offsetPrio = -1;
     lMargin1Prio = lMargin2Prio = rMarginPrio = -1;
     spacing1Prio = spacing2Prio = spacing3Prio = -1;
@@ -474,34 +704,49 @@ GetStyle(textPtr, indexPtr)
 	    wrapPrio = tagPtr->priority;
 	}
     }
-    if (tagPtrs != NULL) {
-	ckfree((char *) tagPtrs);
-    }
 
     /*
      * Use an existing style if there's one around that matches.
+     * Otherwise make a new one.
      */
 
-    hPtr = Tcl_CreateHashEntry(&textPtr->dInfoPtr->styleTable,
+    hPtr = Tcl_CreateHashEntry(&dInfoPtr->styleTable,
 	    (char *) &styleValues, &new);
     if (!new) {
 	stylePtr = (Style *) Tcl_GetHashValue(hPtr);
 	stylePtr->refCount++;
-	return stylePtr;
+    } else {
+	stylePtr = (Style *) ckalloc(sizeof(Style));
+	stylePtr->refCount = 1;
+	stylePtr->ctkStyle = styleValues.underline ?
+		CTK_UNDERLINE_STYLE : CTK_PLAIN_STYLE;
+	stylePtr->sValuePtr = (StyleValues *)
+		Tcl_GetHashKey(&dInfoPtr->styleTable, hPtr);
+	stylePtr->hPtr = hPtr;
+	Tcl_SetHashValue(hPtr, stylePtr);
     }
 
     /*
-     * No existing style matched.  Make a new one.
+     * Remember the style for this set of tags.  If too many sets have
+     * been remembered, start again.
      */
 
-    stylePtr = (Style *) ckalloc(sizeof(Style));
-    stylePtr->refCount = 1;
-    stylePtr->ctkStyle = styleValues.underline ?
-    	    CTK_UNDERLINE_STYLE : CTK_PLAIN_STYLE;
-    stylePtr->sValuePtr = (StyleValues *)
-	    Tcl_GetHashKey(&textPtr->dInfoPtr->styleTable, hPtr);
-    stylePtr->hPtr = hPtr;
-    Tcl_SetHashValue(hPtr, stylePtr);
+    if (dInfoPtr->numTagSets >= MAX_TAG_SETS) {
+	FreeTagSetStyles(textPtr);
+    }
+    hPtr = Tcl_CreateHashEntry(&dInfoPtr->tagSetTable, (char *) hash, &new);
+    setStylePtr = (TagSetStyle *) ckalloc((unsigned) (sizeof(TagSetStyle)
+	    + (numTags - 1) * sizeof(TkTextTag *)));
+    setStylePtr->stylePtr = stylePtr;
+    stylePtr->refCount++;
+    setStylePtr->nextPtr = new ? NULL
+	    : (TagSetStyle *) Tcl_GetHashValue(hPtr);
+    setStylePtr->numTags = numTags;
+    for (i = 0; i < numTags; i++) {
+	setStylePtr->tagPtrs[i] = tagPtrs[i];
+    }
+    Tcl_SetHashValue(hPtr, setStylePtr);
+    dInfoPtr->numTagSets++;
     return stylePtr;
 }
 
@@ -536,6 +781,235 @@ FreeStyle(textPtr, stylePtr)
 	ckfree((char *) stylePtr);
     }
 }
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeTagSetStyles --
+ *
+ *	This procedure forgets the styles remembered for sets of tags
+ *	by GetStyle.  It's called when something changes that could
+ *	give a set of tags a different style, and when the table gets
+ *	too big.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The entries in dInfoPtr->tagSetTable are freed, along with
+ *	their references to styles.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeTagSetStyles(textPtr)
+    TkText *textPtr;		/* Information about overall widget. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    Tcl_HashEntry *hPtr;
+    Tcl_HashSearch search;
+    TagSetStyle *setStylePtr, *nextPtr;
+
+    if (dInfoPtr->numTagSets == 0) {
+	return;
+    }
+    for (hPtr = Tcl_FirstHashEntry(&dInfoPtr->tagSetTable, &search);
+	    hPtr != NULL; hPtr = Tcl_NextHashEntry(&search)) {
+	for (setStylePtr = (TagSetStyle *) Tcl_GetHashValue(hPtr);
+		setStylePtr != NULL; setStylePtr = nextPtr) {
+	    nextPtr = setStylePtr->nextPtr;
+	    FreeStyle(textPtr, setStylePtr->stylePtr);
+	    ckfree((char *) setStylePtr);
+	}
+	Tcl_DeleteHashEntry(hPtr);
+    }
+    dInfoPtr->numTagSets = 0;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InitTagSet --
+ *
+ *	This procedure fills in a TagSet with the tags that affect the
+ *	display of a given character, ready for UpdateTagSet to follow
+ *	the toggles after it in the same line.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	*setPtr is initialized.  FreeTagSet must be called to release
+ *	it.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InitTagSet(indexPtr, setPtr)
+    TkTextIndex *indexPtr;	/* The character whose tags are wanted. */
+    TagSet *setPtr;		/* Structure to fill in. */
+{
+    TkTextTag **tagPtrs, *tagPtr;
+    TkTextSegment *segPtr;
+    int numTags, charIndex, i, j;
+
+    setPtr->numTags = 0;
+    setPtr->arraySize = NUM_STATIC_TAGS;
+    setPtr->tagPtrs = setPtr->staticTags;
+    tagPtrs = TkBTreeGetTags(indexPtr, &numTags);
+    for (i = 0; i < numTags; i++) {
+	tagPtr = tagPtrs[i];
+	if (!tagPtr->affectsDisplay) {
+	    continue;
+	}
+	if (setPtr->numTags == setPtr->arraySize) {
+	    setPtr->arraySize = numTags;
+	    setPtr->tagPtrs = (TkTextTag **) ckalloc((unsigned)
+		    (numTags * sizeof(TkTextTag *)));
+	    memcpy((VOID *) setPtr->tagPtrs, (VOID *) setPtr->staticTags,
+		    NUM_STATIC_TAGS * sizeof(TkTextTag *));
+	}
+
+	/*
+	 * Insert the tag in order of priority.
+	 */
+
+	for (j = setPtr->numTags; (j > 0)
+		&& (setPtr->tagPtrs[j-1]->priority > tagPtr->priority); j--) {
+	    setPtr->tagPtrs[j] = setPtr->tagPtrs[j-1];
+	}
+	setPtr->tagPtrs[j] = tagPtr;
+	setPtr->numTags++;
+    }
+    if (tagPtrs != NULL) {
+	ckfree((char *) tagPtrs);
+    }
+
+    /*
+     * Skip the segments whose toggles TkBTreeGetTags counted:  all of
+     * those that end at or before the character.
+     */
+
+    for (charIndex = 0, segPtr = indexPtr->linePtr->segPtr;
+	    (segPtr != NULL)
+	    && (charIndex + segPtr->size <= indexPtr->charIndex);
+	    charIndex += segPtr->size, segPtr = segPtr->nextPtr) {
+	/* Empty loop body. */
+    }
+    setPtr->segPtr = segPtr;
+    setPtr->charIndex = charIndex;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * UpdateTagSet --
+ *
+ *	This procedure brings a TagSet up to date for a character
+ *	further along the same line, by applying the tag toggles
+ *	between them.
+ *
+ * Results:
+ *	The return value is 1 if the set of tags changed, 0 otherwise.
+ *
+ * Side effects:
+ *	*setPtr is modified to hold the tags that affect the display of
+ *	the character at charIndex, as TkBTreeGetTags would give them.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+UpdateTagSet(setPtr, charIndex)
+    TagSet *setPtr;		/* Tags at an earlier character in the
+				 * line. */
+    int charIndex;		/* Index within the line of the character
+				 * whose tags are wanted. */
+{
+    TkTextSegment *segPtr;
+    TkTextTag *tagPtr, **newPtrs;
+    int changed, i, j;
+
+    changed = 0;
+    for (segPtr = setPtr->segPtr; (segPtr != NULL)
+	    && (setPtr->charIndex + segPtr->size <= charIndex);
+	    segPtr = segPtr->nextPtr) {
+	setPtr->charIndex += segPtr->size;
+	if ((segPtr->typePtr != &tkTextToggleOnType)
+		&& (segPtr->typePtr != &tkTextToggleOffType)) {
+	    continue;
+	}
+	tagPtr = segPtr->body.toggle.tagPtr;
+	if (!tagPtr->affectsDisplay) {
+	    continue;
+	}
+	changed = 1;
+
+	/*
+	 * Each toggle flips its tag:  remove the tag if it's in the set,
+	 * otherwise insert it in order of priority.
+	 */
+
+	for (i = 0; i < setPtr->numTags; i++) {
+	    if (setPtr->tagPtrs[i] == tagPtr) {
+		break;
+	    }
+	}
+	if (i < setPtr->numTags) {
+	    setPtr->numTags--;
+	    for ( ; i < setPtr->numTags; i++) {
+		setPtr->tagPtrs[i] = setPtr->tagPtrs[i+1];
+	    }
+	    continue;
+	}
+	if (setPtr->numTags == setPtr->arraySize) {
+	    newPtrs = (TkTextTag **) ckalloc((unsigned)
+		    (2 * setPtr->arraySize * sizeof(TkTextTag *)));
+	    memcpy((VOID *) newPtrs, (VOID *) setPtr->tagPtrs,
+		    setPtr->numTags * sizeof(TkTextTag *));
+	    if (setPtr->tagPtrs != setPtr->staticTags) {
+		ckfree((char *) setPtr->tagPtrs);
+	    }
+	    setPtr->tagPtrs = newPtrs;
+	    setPtr->arraySize *= 2;
+	}
+	for (j = setPtr->numTags; (j > 0)
+		&& (setPtr->tagPtrs[j-1]->priority > tagPtr->priority); j--) {
+	    setPtr->tagPtrs[j] = setPtr->tagPtrs[j-1];
+	}
+	setPtr->tagPtrs[j] = tagPtr;
+	setPtr->numTags++;
+    }
+    setPtr->segPtr = segPtr;
+    return changed;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeTagSet --
+ *
+ *	This procedure releases the storage used by a TagSet.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory may be freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeTagSet(setPtr)
+    TagSet *setPtr;		/* Structure to release. */
+{
+    if (setPtr->tagPtrs != setPtr->staticTags) {
+	ckfree((char *) setPtr->tagPtrs);
+    }
+}
 
 /*
  *----------------------------------------------------------------------
@@ -601,6 +1075,9 @@ LayoutDLine(textPtr, indexPtr)
 					 * lines with numChars > 0.  Used to
 					 * drop 0-sized chunks from the end
 					 * of the line. */
+    TagSet tagSet;			/* Tags on the current character. */
+    Style *stylePtr;			/* Style for tagSet, or NULL if it
+					 * has to be looked up. */
     int offset, code;
     StyleValues *sValuePtr;
 
@@ -651,6 +1128,8 @@ LayoutDLine(textPtr, indexPtr)
 	    offset -= segPtr->size, segPtr = segPtr->nextPtr) {
 	/* Empty loop body. */
     }
+    InitTagSet(&curIndex, &tagSet);
+    stylePtr = NULL;
 
     while (segPtr != NULL) {
 	if (segPtr->typePtr->layoutProc == NULL) {
@@ -662,7 +1141,18 @@ LayoutDLine(textPtr, indexPtr)
 	    chunkPtr = (TkTextDispChunk *) ckalloc(sizeof(TkTextDispChunk));
 	    chunkPtr->nextPtr = NULL;
 	}
-	chunkPtr->stylePtr = GetStyle(textPtr, &curIndex);
+
+	/*
+	 * Chunks get the same style as the one before them unless a tag
+	 * that affects the display has been toggled in between.
+	 */
+
+	if (UpdateTagSet(&tagSet, curIndex.charIndex) || (stylePtr == NULL)) {
+	    stylePtr = GetStyle(textPtr, &tagSet);
+	} else {
+	    stylePtr->refCount++;
+	}
+	chunkPtr->stylePtr = stylePtr;
 
 	/*
 	 * Save style information such as justification and indentation,
@@ -716,6 +1206,7 @@ LayoutDLine(textPtr, indexPtr)
 		chunkPtr);
 	if (code <= 0) {
 	    FreeStyle(textPtr, chunkPtr->stylePtr);
+	    stylePtr = NULL;
 	    if (code < 0) {
 		/*
 		 * This segment doesn't wish to display itself (e.g. most
@@ -787,6 +1278,7 @@ LayoutDLine(textPtr, indexPtr)
     if (noCharsYet) {
 	panic("LayoutDLine couldn't place any characters on a line");
     }
+    FreeTagSet(&tagSet);
     wholeLine = (segPtr == NULL);
 
     /*
@@ -890,6 +1382,74 @@ LayoutDLine(textPtr, indexPtr)
     return dlPtr;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetDLine --
+ *
+ *	This procedure returns a display line starting at a given index,
+ *	like LayoutDLine, but it uses a DLine kept by CacheDLines if
+ *	there is one rather than laying the line out again.
+ *
+ * Results:
+ *	The return value is a pointer to a DLine structure, as for
+ *	LayoutDLine.  The caller owns the DLine and eventually passes
+ *	it to FreeDLines or CacheDLines.
+ *
+ * Side effects:
+ *	Storage may be allocated for a new DLine, or a kept one is
+ *	taken out of the widget's layoutTable.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static DLine *
+GetDLine(textPtr, indexPtr)
+    TkText *textPtr;		/* Overall information about text widget. */
+    TkTextIndex *indexPtr;	/* Beginning of display line. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    Tcl_HashEntry *hPtr;
+    LayoutEntry *entryPtr;
+    register DLine *dlPtr, *prevPtr;
+
+    hPtr = Tcl_FindHashEntry(&dInfoPtr->layoutTable,
+	    (char *) indexPtr->linePtr);
+    if (hPtr == NULL) {
+	return LayoutDLine(textPtr, indexPtr);
+    }
+    entryPtr = (LayoutEntry *) Tcl_GetHashValue(hPtr);
+    for (prevPtr = NULL, dlPtr = entryPtr->dLinePtr; dlPtr != NULL;
+	    prevPtr = dlPtr, dlPtr = dlPtr->nextPtr) {
+	if (dlPtr->index.charIndex == indexPtr->charIndex) {
+	    break;
+	}
+    }
+    if (dlPtr == NULL) {
+	return LayoutDLine(textPtr, indexPtr);
+    }
+    if (prevPtr == NULL) {
+	entryPtr->dLinePtr = dlPtr->nextPtr;
+    } else {
+	prevPtr->nextPtr = dlPtr->nextPtr;
+    }
+    entryPtr->numDLines--;
+    dInfoPtr->numKeptDLines--;
+    if (entryPtr->dLinePtr == NULL) {
+	FreeLayoutEntry(textPtr, entryPtr);
+    }
+
+    /*
+     * Make the line look as if it had just been layed out.
+     */
+
+    dlPtr->y = 0;
+    dlPtr->oldY = -1;
+    dlPtr->nextPtr = NULL;
+    dlPtr->flags = NEW_LAYOUT;
+    return dlPtr;
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -934,13 +1494,28 @@ UpdateDisplayInfo(textPtr)
     dInfoPtr->flags &= ~DINFO_OUT_OF_DATE;
 
     /*
-     * Delete any DLines that are now above the top of the window.
+     * If the view is following the end of the text, pick the top line
+     * that puts the last line at the bottom of the window.  This is
+     * done here, rather than each time text is appended, so that a
+     * burst of appends costs one layout.
+     */
+
+    if (dInfoPtr->flags & DINFO_SEE_END) {
+	dInfoPtr->flags &= ~DINFO_SEE_END;
+	TkTextMakeIndex(textPtr->tree, TkBTreeNumLines(textPtr->tree) - 1,
+		1000000, &index);
+	MeasureUp(textPtr, &index, dInfoPtr->maxY - dInfoPtr->y,
+		&textPtr->topIndex);
+    }
+
+    /*
+     * Set aside any DLines that are now above the top of the window.
      */
 
     index = textPtr->topIndex;
     dlPtr = FindDLine(dInfoPtr->dLinePtr, &index);
     if ((dlPtr != NULL) && (dlPtr != dInfoPtr->dLinePtr)) {
-	FreeDLines(textPtr, dInfoPtr->dLinePtr, dlPtr, 1);
+	CacheDLines(textPtr, dInfoPtr->dLinePtr, dlPtr, 1);
     }
 
     /*
@@ -1005,7 +1580,7 @@ UpdateDisplayInfo(textPtr)
 			string,
 			TCL_GLOBAL_ONLY|TCL_APPEND_VALUE|TCL_LIST_ELEMENT);
 	    }
-	    newPtr = LayoutDLine(textPtr, &index);
+	    newPtr = GetDLine(textPtr, &index);
 	    if (prevPtr == NULL) {
 		dInfoPtr->dLinePtr = newPtr;
 	    } else {
@@ -1090,10 +1665,10 @@ UpdateDisplayInfo(textPtr)
     }
 
     /*
-     * Delete any DLine structures that don't fit on the screen.
+     * Set aside any DLine structures that don't fit on the screen.
      */
 
-    FreeDLines(textPtr, dlPtr, (DLine *) NULL, 1);
+    CacheDLines(textPtr, dlPtr, (DLine *) NULL, 1);
 
     /*
      *--------------------------------------------------------------
@@ -1127,7 +1702,7 @@ UpdateDisplayInfo(textPtr)
 	    index.charIndex = 0;
 	    lowestPtr = NULL;
 	    do {
-		dlPtr = LayoutDLine(textPtr, &index);
+		dlPtr = GetDLine(textPtr, &index);
 		dlPtr->nextPtr = lowestPtr;
 		lowestPtr = dlPtr;
 		TkTextIndexForwChars(&index, dlPtr->count, &index);
@@ -1158,7 +1733,7 @@ UpdateDisplayInfo(textPtr)
 			    TCL_GLOBAL_ONLY|TCL_APPEND_VALUE|TCL_LIST_ELEMENT);
 		}
 	    }
-	    FreeDLines(textPtr, lowestPtr, (DLine *) NULL, 0);
+	    CacheDLines(textPtr, lowestPtr, (DLine *) NULL, 0);
 	    charsToCount = INT_MAX;
 	}
 
@@ -1229,86 +1804,722 @@ UpdateDisplayInfo(textPtr)
 	    dInfoPtr->maxLength = dlPtr->length;
 	}
     }
-    maxOffset = dInfoPtr->maxLength - (dInfoPtr->maxX - dInfoPtr->x);
-    if (dInfoPtr->newCharOffset > maxOffset) {
-	dInfoPtr->newCharOffset = maxOffset;
+    maxOffset = dInfoPtr->maxLength - (dInfoPtr->maxX - dInfoPtr->x);
+    if (dInfoPtr->newCharOffset > maxOffset) {
+	dInfoPtr->newCharOffset = maxOffset;
+    }
+    if (dInfoPtr->newCharOffset < 0) {
+	dInfoPtr->newCharOffset = 0;
+    }
+    pixelOffset = dInfoPtr->newCharOffset;
+    if (pixelOffset != dInfoPtr->curPixelOffset) {
+	dInfoPtr->curPixelOffset = pixelOffset;
+	for (dlPtr = dInfoPtr->dLinePtr; dlPtr != NULL;
+		dlPtr = dlPtr->nextPtr) {
+	    dlPtr->oldY = -1;
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeDLines --
+ *
+ *	This procedure is called to free up all of the resources
+ *	associated with one or more DLine structures.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory gets freed and various other resources are released.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeDLines(textPtr, firstPtr, lastPtr, unlink)
+    TkText *textPtr;			/* Information about overall text
+					 * widget. */
+    register DLine *firstPtr;		/* Pointer to first DLine to free up. */
+    DLine *lastPtr;			/* Pointer to DLine just after last
+					 * one to free (NULL means everything
+					 * starting with firstPtr). */
+    int unlink;				/* 1 means DLines are currently linked
+					 * into the list rooted at
+					 * textPtr->dInfoPtr->dLinePtr and
+					 * they have to be unlinked.  0 means
+					 * just free without unlinking. */
+{
+    register TkTextDispChunk *chunkPtr, *nextChunkPtr;
+    register DLine *nextDLinePtr;
+
+    if (unlink) {
+	if (textPtr->dInfoPtr->dLinePtr == firstPtr) {
+	    textPtr->dInfoPtr->dLinePtr = lastPtr;
+	} else {
+	    register DLine *prevPtr;
+	    for (prevPtr = textPtr->dInfoPtr->dLinePtr;
+		    prevPtr->nextPtr != firstPtr; prevPtr = prevPtr->nextPtr) {
+		/* Empty loop body. */
+	    }
+	    prevPtr->nextPtr = lastPtr;
+	}
+    }
+    while (firstPtr != lastPtr) {
+	nextDLinePtr = firstPtr->nextPtr;
+	for (chunkPtr = firstPtr->chunkPtr; chunkPtr != NULL;
+		chunkPtr = nextChunkPtr) {
+	    if (chunkPtr->undisplayProc != NULL) {
+		(*chunkPtr->undisplayProc)(textPtr, chunkPtr);
+	    }
+	    FreeStyle(textPtr, chunkPtr->stylePtr);
+	    nextChunkPtr = chunkPtr->nextPtr;
+	    ckfree((char *) chunkPtr);
+	}
+	ckfree((char *) firstPtr);
+	firstPtr = nextDLinePtr;
+    }
+    textPtr->dInfoPtr->dLinesInvalidated = 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CacheDLines --
+ *
+ *	This procedure is called instead of FreeDLines for DLines that
+ *	are still correct but aren't needed right now, such as lines
+ *	that have scrolled out of the window, so that GetDLine can use
+ *	them again.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The DLines are added to the widget's layoutTable.  If that makes
+ *	too many, the least recently used ones are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CacheDLines(textPtr, firstPtr, lastPtr, unlink)
+    TkText *textPtr;			/* Information about overall text
+					 * widget. */
+    register DLine *firstPtr;		/* Pointer to first DLine to keep. */
+    DLine *lastPtr;			/* Pointer to DLine just after last
+					 * one to keep (NULL means everything
+					 * starting with firstPtr). */
+    int unlink;				/* 1 means DLines are currently linked
+					 * into the list rooted at
+					 * textPtr->dInfoPtr->dLinePtr and
+					 * they have to be unlinked.  0 means
+					 * just keep without unlinking. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    register DLine *dlPtr;
+    DLine *nextDLinePtr;
+    LayoutEntry *entryPtr;
+    Tcl_HashEntry *hPtr;
+    int new;
+
+    if (unlink) {
+	if (dInfoPtr->dLinePtr == firstPtr) {
+	    dInfoPtr->dLinePtr = lastPtr;
+	} else {
+	    register DLine *prevPtr;
+	    for (prevPtr = dInfoPtr->dLinePtr;
+		    prevPtr->nextPtr != firstPtr; prevPtr = prevPtr->nextPtr) {
+		/* Empty loop body. */
+	    }
+	    prevPtr->nextPtr = lastPtr;
+	}
+    }
+    while (firstPtr != lastPtr) {
+	nextDLinePtr = firstPtr->nextPtr;
+	hPtr = Tcl_CreateHashEntry(&dInfoPtr->layoutTable,
+		(char *) firstPtr->index.linePtr, &new);
+	if (new) {
+	    entryPtr = (LayoutEntry *) ckalloc(sizeof(LayoutEntry));
+	    entryPtr->linePtr = firstPtr->index.linePtr;
+	    entryPtr->dLinePtr = NULL;
+	    entryPtr->numDLines = 0;
+	    entryPtr->hPtr = hPtr;
+	    Tcl_SetHashValue(hPtr, entryPtr);
+	} else {
+	    entryPtr = (LayoutEntry *) Tcl_GetHashValue(hPtr);
+	    for (dlPtr = entryPtr->dLinePtr; dlPtr != NULL;
+		    dlPtr = dlPtr->nextPtr) {
+		if (dlPtr->index.charIndex == firstPtr->index.charIndex) {
+		    break;
+		}
+	    }
+	    if (dlPtr != NULL) {
+		/*
+		 * There's already a DLine kept for this position (the
+		 * line was layed out again while the old one was on
+		 * the screen);  one is enough.
+		 */
+
+		FreeDLines(textPtr, firstPtr, nextDLinePtr, 0);
+		firstPtr = nextDLinePtr;
+		continue;
+	    }
+
+	    /*
+	     * Take the entry out of the list of entries, so it can be
+	     * put back at the front.
+	     */
+
+	    if (entryPtr->prevPtr == NULL) {
+		dInfoPtr->firstEntryPtr = entryPtr->nextPtr;
+	    } else {
+		entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+	    }
+	    if (entryPtr->nextPtr == NULL) {
+		dInfoPtr->lastEntryPtr = entryPtr->prevPtr;
+	    } else {
+		entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+	    }
+	}
+	entryPtr->prevPtr = NULL;
+	entryPtr->nextPtr = dInfoPtr->firstEntryPtr;
+	if (entryPtr->nextPtr == NULL) {
+	    dInfoPtr->lastEntryPtr = entryPtr;
+	} else {
+	    entryPtr->nextPtr->prevPtr = entryPtr;
+	}
+	dInfoPtr->firstEntryPtr = entryPtr;
+	firstPtr->nextPtr = entryPtr->dLinePtr;
+	entryPtr->dLinePtr = firstPtr;
+	entryPtr->numDLines++;
+	dInfoPtr->numKeptDLines++;
+	firstPtr = nextDLinePtr;
+    }
+    while (dInfoPtr->numKeptDLines > MAX_KEPT_DLINES) {
+	FreeLayoutEntry(textPtr, dInfoPtr->lastEntryPtr);
+    }
+    dInfoPtr->dLinesInvalidated = 1;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * FreeLayoutEntry --
+ *
+ *	This procedure frees an entry in a widget's layoutTable, along
+ *	with all the DLines kept in it.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Memory gets freed and the entry is removed from layoutTable.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+FreeLayoutEntry(textPtr, entryPtr)
+    TkText *textPtr;			/* Information about overall text
+					 * widget. */
+    LayoutEntry *entryPtr;		/* Entry to free. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+
+    if (entryPtr->prevPtr == NULL) {
+	dInfoPtr->firstEntryPtr = entryPtr->nextPtr;
+    } else {
+	entryPtr->prevPtr->nextPtr = entryPtr->nextPtr;
+    }
+    if (entryPtr->nextPtr == NULL) {
+	dInfoPtr->lastEntryPtr = entryPtr->prevPtr;
+    } else {
+	entryPtr->nextPtr->prevPtr = entryPtr->prevPtr;
+    }
+    Tcl_DeleteHashEntry(entryPtr->hPtr);
+    dInfoPtr->numKeptDLines -= entryPtr->numDLines;
+    FreeDLines(textPtr, entryPtr->dLinePtr, (DLine *) NULL, 0);
+    ckfree((char *) entryPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InvalidateLayouts --
+ *
+ *	This procedure is called when something changes that may affect
+ *	the layout of a range of text lines, to throw away any DLines
+ *	kept for those lines.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Entries in the widget's layoutTable for text lines from the line
+ *	of index1Ptr through the line of index2Ptr are freed.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InvalidateLayouts(textPtr, index1Ptr, index2Ptr)
+    TkText *textPtr;		/* Widget record for text widget. */
+    TkTextIndex *index1Ptr;	/* Index in first line whose DLines are
+				 * to be thrown away.  NULL means start at
+				 * beginning of text. */
+    TkTextIndex *index2Ptr;	/* Index in last line whose DLines are
+				 * to be thrown away.  NULL means go to the
+				 * end of the text. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    LayoutEntry *entryPtr, *nextPtr;
+    Tcl_HashEntry *hPtr;
+    TkTextLine *linePtr;
+    int line1, line2, lineIndex;
+
+    if (dInfoPtr->firstEntryPtr == NULL) {
+	return;
+    }
+    if ((index1Ptr == NULL) && (index2Ptr == NULL)) {
+	while (dInfoPtr->firstEntryPtr != NULL) {
+	    FreeLayoutEntry(textPtr, dInfoPtr->firstEntryPtr);
+	}
+	return;
+    }
+    line1 = (index1Ptr == NULL) ? 0 : TkBTreeLineIndex(index1Ptr->linePtr);
+    line2 = (index2Ptr == NULL) ? TkBTreeNumLines(textPtr->tree)
+	    : TkBTreeLineIndex(index2Ptr->linePtr);
+
+    /*
+     * If the range is short, look up each of its lines;  otherwise
+     * check where the line of each entry is.
+     */
+
+    if ((line2 - line1) < dInfoPtr->layoutTable.numEntries) {
+	linePtr = (index1Ptr == NULL) ? TkBTreeFindLine(textPtr->tree, 0)
+		: index1Ptr->linePtr;
+	for (lineIndex = line1; (lineIndex <= line2) && (linePtr != NULL);
+		lineIndex++, linePtr = TkBTreeNextLine(linePtr)) {
+	    hPtr = Tcl_FindHashEntry(&dInfoPtr->layoutTable, (char *) linePtr);
+	    if (hPtr != NULL) {
+		FreeLayoutEntry(textPtr,
+			(LayoutEntry *) Tcl_GetHashValue(hPtr));
+	    }
+	}
+	return;
+    }
+    for (entryPtr = dInfoPtr->firstEntryPtr; entryPtr != NULL;
+	    entryPtr = nextPtr) {
+	nextPtr = entryPtr->nextPtr;
+	lineIndex = TkBTreeLineIndex(entryPtr->linePtr);
+	if ((lineIndex >= line1) && (lineIndex <= line2)) {
+	    FreeLayoutEntry(textPtr, entryPtr);
+	}
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * InvalidateDLineCounts --
+ *
+ *	This procedure is called when something changes that may affect
+ *	the number of display lines taken up by a range of text lines,
+ *	to mark their counts out of date.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The lines from the line of index1Ptr through the line of
+ *	index2Ptr will be counted again:  by GetYView if they're in the
+ *	window, and by CountDLinesProc in the background if the text has
+ *	a -yscrollcommand or a -synccommand.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+InvalidateDLineCounts(textPtr, index1Ptr, index2Ptr)
+    TkText *textPtr;		/* Widget record for text widget. */
+    TkTextIndex *index1Ptr;	/* Index in first line whose count is out
+				 * of date.  NULL means start at beginning
+				 * of text. */
+    TkTextIndex *index2Ptr;	/* Index in last line whose count is out
+				 * of date.  NULL means go to the end of
+				 * the text. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    TkTextLine *linePtr;
+    int line1, line2, numLines, i;
+
+    numLines = TkBTreeNumLines(textPtr->tree);
+    line1 = (index1Ptr == NULL) ? 0 : TkBTreeLineIndex(index1Ptr->linePtr);
+    line2 = (index2Ptr == NULL) ? numLines
+	    : TkBTreeLineIndex(index2Ptr->linePtr);
+    if (((line1 == 0) && (line2 >= numLines - 1))
+	    || (line2 - line1 > MAX_DLINE_MARKS)
+	    || !COUNT_IN_BACKGROUND(textPtr)) {
+	/*
+	 * Every line is affected, or a lot of them, or the counts aren't
+	 * being kept up to date anyway (this includes a mapped text,
+	 * whose lines are only built as needed, so it's best not to walk
+	 * through them):  it's cheaper to move to a new epoch than to
+	 * mark the lines one at a time.
+	 */
+
+	dInfoPtr->dLinesEpoch++;
+	if (dInfoPtr->dLinesEpoch == 0) {
+	    dInfoPtr->dLinesEpoch = 1;
+	}
+	line1 = 0;
+	line2 = numLines;
+    } else {
+	linePtr = index1Ptr->linePtr;
+	for (i = line1; (i <= line2) && (linePtr != NULL); i++) {
+	    linePtr->dLinesEpoch = 0;
+	    linePtr = TkBTreeNextLine(linePtr);
+	}
+    }
+
+    /*
+     * The lines still to be counted run from countLine to countTail
+     * lines before the end of the text.  The tail is measured from the
+     * end so that it stays right when lines are added or deleted
+     * before it.
+     */
+
+    if (line2 > numLines - 1) {
+	line2 = numLines - 1;
+    }
+    if (dInfoPtr->countLine < 0) {
+	dInfoPtr->countLine = line1;
+	dInfoPtr->countTail = numLines - 1 - line2;
+    } else {
+	if (line1 < dInfoPtr->countLine) {
+	    dInfoPtr->countLine = line1;
+	}
+	if (numLines - 1 - line2 < dInfoPtr->countTail) {
+	    dInfoPtr->countTail = numLines - 1 - line2;
+	}
+    }
+    if ((dInfoPtr->countTimer == NULL) && COUNT_IN_BACKGROUND(textPtr)) {
+	dInfoPtr->countTimer = Tcl_CreateTimerHandler(COUNT_DELAY_MS,
+		CountDLinesProc, (ClientData) textPtr);
+    }
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountDLines --
+ *
+ *	This procedure lays out a text line to count the display lines
+ *	it takes up.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The count is recorded in the B-tree (see TkBTreeSetDLines) and
+ *	the line is marked as counted.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CountDLines(textPtr, linePtr)
+    TkText *textPtr;		/* Widget record for text widget. */
+    TkTextLine *linePtr;	/* Line to count. */
+{
+    TkTextIndex index;
+    DLine *dlPtr;
+    int count;
+
+    index.tree = textPtr->tree;
+    index.linePtr = linePtr;
+    index.charIndex = 0;
+    count = 0;
+    do {
+	dlPtr = LayoutDLine(textPtr, &index);
+	dlPtr->nextPtr = NULL;
+	count++;
+	TkTextIndexForwChars(&index, dlPtr->count, &index);
+	FreeDLines(textPtr, dlPtr, (DLine *) NULL, 0);
+    } while (index.linePtr == linePtr);
+    TkBTreeSetDLines(linePtr, count);
+    linePtr->dLinesEpoch = textPtr->dInfoPtr->dLinesEpoch;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountDLinesProc --
+ *
+ *	This procedure is invoked as a timer handler to count the
+ *	display lines of text lines whose counts are out of date, a
+ *	batch at a time, so that the vertical scrollbar can be given
+ *	fractions in display lines without holding up the application.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Counts are recorded in the B-tree.  If lines are left when the
+ *	time for a batch runs out, the procedure reschedules itself.
+ *	If any counts changed, the scrollbar is updated.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+CountDLinesProc(clientData)
+    ClientData clientData;	/* Information about text widget. */
+{
+    TkText *textPtr = (TkText *) clientData;
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    int changed;
+
+    dInfoPtr->countTimer = NULL;
+    if ((textPtr->tkwin == NULL) || (dInfoPtr->countLine < 0)
+	    || !COUNT_IN_BACKGROUND(textPtr)) {
+	return;
+    }
+
+    /*
+     * If the window is about to be redisplayed, wait:  the redisplay
+     * counts the lines in the window (see GetYView) without having to
+     * lay them out again.
+     */
+
+    if (dInfoPtr->flags & REDRAW_PENDING) {
+	dInfoPtr->countTimer = Tcl_CreateTimerHandler(1, CountDLinesProc,
+		(ClientData) textPtr);
+	return;
+    }
+
+    /*
+     * The -synccommand may change or destroy the widget, so check
+     * again after it.
+     */
+
+    Tk_Preserve((ClientData) textPtr);
+    ReportSync(textPtr, 0);
+    if ((textPtr->tkwin == NULL) || (dInfoPtr->countLine < 0)
+	    || !COUNT_IN_BACKGROUND(textPtr)) {
+	goto done;
+    }
+    changed = CountPendingDLines(textPtr, COUNT_BATCH_USECS);
+    if ((dInfoPtr->countLine >= 0) && (dInfoPtr->countTimer == NULL)) {
+	dInfoPtr->countTimer = Tcl_CreateTimerHandler(1, CountDLinesProc,
+		(ClientData) textPtr);
+    }
+
+    /*
+     * If the display is up to date, it won't be updating the scrollbar
+     * by itself, so do it here.
+     */
+
+    if (changed && (textPtr->yScrollCmd != NULL)
+	    && (dInfoPtr->dLinePtr != NULL)
+	    && !(dInfoPtr->flags & DINFO_OUT_OF_DATE)) {
+	GetYView(textPtr->interp, textPtr, 1);
+    }
+    if ((textPtr->tkwin != NULL) && (dInfoPtr->countLine < 0)) {
+	ReportSync(textPtr, 1);
+    }
+
+    done:
+    Tk_Release((ClientData) textPtr);
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * CountPendingDLines --
+ *
+ *	This procedure counts the display lines of the text lines whose
+ *	counts are out of date, starting from dInfoPtr->countLine, until
+ *	they're all counted or maxUsecs microseconds have gone by.
+ *
+ * Results:
+ *	The return value is 1 if any line's count changed, 0 otherwise.
+ *
+ * Side effects:
+ *	Counts are recorded in the B-tree and dInfoPtr->countLine moves
+ *	past the lines counted;  it's set to -1 if none are left.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+CountPendingDLines(textPtr, maxUsecs)
+    TkText *textPtr;		/* Widget record for text widget. */
+    int maxUsecs;		/* Time to stop after, in microseconds, or
+				 * 0 to count all the lines. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    TkTextLine *linePtr;
+    Tcl_Time start, now;
+    int numLines, lastLine, oldCount, counted, changed;
+
+    numLines = TkBTreeNumLines(textPtr->tree);
+    lastLine = numLines - 1 - dInfoPtr->countTail;
+    if (lastLine > numLines - 2) {
+	lastLine = numLines - 2;
+    }
+    Tcl_GetTime(&start);
+    linePtr = TkBTreeFindLine(textPtr->tree, dInfoPtr->countLine);
+    changed = 0;
+    while (dInfoPtr->countLine <= lastLine) {
+	counted = (linePtr->dLinesEpoch != dInfoPtr->dLinesEpoch);
+	if (counted) {
+	    oldCount = linePtr->numDLines;
+	    CountDLines(textPtr, linePtr);
+	    if (linePtr->numDLines != oldCount) {
+		changed = 1;
+	    }
+	}
+	dInfoPtr->countLine++;
+	linePtr = TkBTreeNextLine(linePtr);
+	if (counted && (maxUsecs > 0)) {
+	    Tcl_GetTime(&now);
+	    if (((now.sec - start.sec) * 1000000 + (now.usec - start.usec))
+		    >= maxUsecs) {
+		break;
+	    }
+	}
+    }
+    if (dInfoPtr->countLine > lastLine) {
+	dInfoPtr->countLine = -1;
+    }
+    return changed;
+}
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ReportSync --
+ *
+ *	This procedure tells the text's -synccommand, if it has one,
+ *	whether its display lines are all counted.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	If inSync differs from what was last reported, the -synccommand
+ *	is evaluated at global level with inSync appended.  Errors are
+ *	reported with Tcl_BackgroundError.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ReportSync(textPtr, inSync)
+    TkText *textPtr;		/* Widget record for text widget. */
+    int inSync;			/* 1 means all the display lines are
+				 * counted, 0 means some are still to be
+				 * counted. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    Tcl_DString command;
+    int code;
+
+    if (((dInfoPtr->flags & DINFO_OUT_OF_SYNC) == 0) == (inSync != 0)) {
+	return;
+    }
+    if (inSync) {
+	dInfoPtr->flags &= ~DINFO_OUT_OF_SYNC;
+    } else {
+	dInfoPtr->flags |= DINFO_OUT_OF_SYNC;
     }
-    if (dInfoPtr->newCharOffset < 0) {
-	dInfoPtr->newCharOffset = 0;
+    if (textPtr->syncCmd == NULL) {
+	return;
     }
-    pixelOffset = dInfoPtr->newCharOffset;
-    if (pixelOffset != dInfoPtr->curPixelOffset) {
-	dInfoPtr->curPixelOffset = pixelOffset;
-	for (dlPtr = dInfoPtr->dLinePtr; dlPtr != NULL;
-		dlPtr = dlPtr->nextPtr) {
-	    dlPtr->oldY = -1;
-	}
+    Tcl_DStringInit(&command);
+    Tcl_DStringAppend(&command, textPtr->syncCmd, -1);
+    Tcl_DStringAppend(&command, inSync ? " 1" : " 0", -1);
+    code = Tcl_GlobalEval(textPtr->interp, Tcl_DStringValue(&command));
+    Tcl_DStringFree(&command);
+    if (code != TCL_OK) {
+	Tcl_AddErrorInfo(textPtr->interp,
+		"\n    (sync command executed by text)");
+	Tcl_BackgroundError(textPtr->interp);
     }
 }
-
+
 /*
  *----------------------------------------------------------------------
  *
- * FreeDLines --
+ * TkTextSync --
  *
- *	This procedure is called to free up all of the resources
- *	associated with one or more DLine structures.
+ *	This procedure implements the "sync" widget command:  it counts
+ *	all the display lines whose counts are out of date at once,
+ *	rather than waiting for them to be counted in the background.
  *
  * Results:
  *	None.
  *
  * Side effects:
- *	Memory gets freed and various other resources are released.
+ *	Counts are recorded in the B-tree, the scrollbar is updated if
+ *	they changed, and the -synccommand is told that the display
+ *	lines are counted.
  *
  *----------------------------------------------------------------------
  */
 
-static void
-FreeDLines(textPtr, firstPtr, lastPtr, unlink)
-    TkText *textPtr;			/* Information about overall text
-					 * widget. */
-    register DLine *firstPtr;		/* Pointer to first DLine to free up. */
-    DLine *lastPtr;			/* Pointer to DLine just after last
-					 * one to free (NULL means everything
-					 * starting with firstPtr). */
-    int unlink;				/* 1 means DLines are currently linked
-					 * into the list rooted at
-					 * textPtr->dInfoPtr->dLinePtr and
-					 * they have to be unlinked.  0 means
-					 * just free without unlinking. */
+void
+TkTextSync(textPtr)
+    TkText *textPtr;		/* Widget record for text widget. */
 {
-    register TkTextDispChunk *chunkPtr, *nextChunkPtr;
-    register DLine *nextDLinePtr;
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
 
-    if (unlink) {
-	if (textPtr->dInfoPtr->dLinePtr == firstPtr) {
-	    textPtr->dInfoPtr->dLinePtr = lastPtr;
-	} else {
-	    register DLine *prevPtr;
-	    for (prevPtr = textPtr->dInfoPtr->dLinePtr;
-		    prevPtr->nextPtr != firstPtr; prevPtr = prevPtr->nextPtr) {
-		/* Empty loop body. */
-	    }
-	    prevPtr->nextPtr = lastPtr;
+    if ((dInfoPtr->countLine >= 0) && COUNT_IN_BACKGROUND(textPtr)) {
+	if (dInfoPtr->countTimer != NULL) {
+	    Tcl_DeleteTimerHandler(dInfoPtr->countTimer);
+	    dInfoPtr->countTimer = NULL;
 	}
-    }
-    while (firstPtr != lastPtr) {
-	nextDLinePtr = firstPtr->nextPtr;
-	for (chunkPtr = firstPtr->chunkPtr; chunkPtr != NULL;
-		chunkPtr = nextChunkPtr) {
-	    if (chunkPtr->undisplayProc != NULL) {
-		(*chunkPtr->undisplayProc)(textPtr, chunkPtr);
+	if (CountPendingDLines(textPtr, 0) && (textPtr->yScrollCmd != NULL)
+		&& (dInfoPtr->dLinePtr != NULL)
+		&& !(dInfoPtr->flags & DINFO_OUT_OF_DATE)) {
+	    GetYView(textPtr->interp, textPtr, 1);
+	    if (textPtr->tkwin == NULL) {
+		return;
 	    }
-	    FreeStyle(textPtr, chunkPtr->stylePtr);
-	    nextChunkPtr = chunkPtr->nextPtr;
-	    ckfree((char *) chunkPtr);
 	}
-	ckfree((char *) firstPtr);
-	firstPtr = nextDLinePtr;
     }
-    textPtr->dInfoPtr->dLinesInvalidated = 1;
+    ReportSync(textPtr, 1);
 }
-
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * TkTextPendingSync --
+ *
+ *	This procedure implements the "pendingsync" widget command.
+ *
+ * Results:
+ *	The return value is 1 if some display lines are still to be
+ *	counted in the background, 0 otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+int
+TkTextPendingSync(textPtr)
+    TkText *textPtr;		/* Widget record for text widget. */
+{
+    return (textPtr->dInfoPtr->countLine >= 0)
+	    && COUNT_IN_BACKGROUND(textPtr);
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -1462,6 +2673,86 @@ DisplayText(clientData)
 
     dInfoPtr->flags &= ~REDRAW_PENDING;
 
+    /*
+     * See if it's possible to bring some parts of the screen up-to-date
+     * by scrolling (shifting lines that are already displayed).
+     */
+
+    for (dlPtr = dInfoPtr->dLinePtr; dlPtr != NULL; dlPtr = dlPtr->nextPtr) {
+	register DLine *dlPtr2;
+	int offset, height, y, oldY;
+
+	if ((dlPtr->oldY == -1) || (dlPtr->y == dlPtr->oldY)
+		|| ((dlPtr->oldY + dlPtr->height) > dInfoPtr->maxY)) {
+	    continue;
+	}
+
+	/*
+	 * This line is already drawn somewhere in the window so it only
+	 * needs to be shifted to its new location.  See if there's a group
+	 * of lines that can all be shifted together.
+	 */
+
+	offset = dlPtr->y - dlPtr->oldY;
+	height = dlPtr->height;
+	y = dlPtr->y;
+	for (dlPtr2 = dlPtr->nextPtr; dlPtr2 != NULL;
+		dlPtr2 = dlPtr2->nextPtr) {
+	    if ((dlPtr2->oldY == -1)
+		    || ((dlPtr2->oldY + offset) != dlPtr2->y)
+		    || ((dlPtr2->oldY + dlPtr2->height) > dInfoPtr->maxY)) {
+		break;
+	    }
+	    height += dlPtr2->height;
+	}
+
+	/*
+	 * Reduce the height of the area being shifted if necessary to
+	 * avoid overwriting the border area.
+	 */
+
+	if ((y + height) > dInfoPtr->maxY) {
+	    height = dInfoPtr->maxY - y;
+	}
+	oldY = dlPtr->oldY;
+	if (!Ctk_ScrollRect(textPtr->tkwin, dInfoPtr->x,
+		(offset > 0) ? oldY : y, dInfoPtr->maxX,
+		((offset > 0) ? y : oldY) + height, offset)) {
+	    /*
+	     * The window is partly obscured:  just redraw the lines.
+	     */
+
+	    continue;
+	}
+	numCopies++;
+
+	/*
+	 * Update the lines we shifted to show that they are in place.
+	 */
+
+	while (1) {
+	    dlPtr->oldY = dlPtr->y;
+	    if (dlPtr->nextPtr == dlPtr2) {
+		break;
+	    }
+	    dlPtr = dlPtr->nextPtr;
+	}
+
+	/*
+	 * Scan through the lines following the shifted ones to see if
+	 * they were overwritten by the shift.  If so, mark them for
+	 * redisplay.
+	 */
+
+	for ( ; dlPtr2 != NULL; dlPtr2 = dlPtr2->nextPtr) {
+	    if ((dlPtr2->oldY != -1)
+		    && ((dlPtr2->oldY + dlPtr2->height) > y)
+		    && (dlPtr2->oldY < (y + height))) {
+		dlPtr2->oldY = -1;
+	    }
+	}
+    }
+
     /*
      * Redraw the borders if that's needed.
      */
@@ -1646,6 +2937,9 @@ TkTextChanged(textPtr, index1Ptr, index2Ptr)
     DLine *firstPtr, *lastPtr;
     TkTextIndex rounded;
 
+    InvalidateLayouts(textPtr, index1Ptr, index2Ptr);
+    InvalidateDLineCounts(textPtr, index1Ptr, index2Ptr);
+
     /*
      * Schedule both a redisplay and a recomputation of display information.
      * It's done here rather than the end of the procedure for two reasons:
@@ -1735,6 +3029,31 @@ TkTextRedrawTag(textPtr, index1Ptr, index2Ptr, tagPtr, withTag)
     DInfo *dInfoPtr = textPtr->dInfoPtr;
     TkTextIndex endOfText, *endIndexPtr;
 
+    /*
+     * A redraw of the whole text means the tag's options or priority
+     * changed, so any style remembered for a set of tags may be wrong.
+     */
+
+    if ((index1Ptr == NULL) && (index2Ptr == NULL)) {
+	FreeTagSetStyles(textPtr);
+    }
+    InvalidateLayouts(textPtr, index1Ptr, index2Ptr);
+
+    /*
+     * Adding or removing a tag can only change how the lines wrap if
+     * the tag has options that move characters along the line.
+     */
+
+    if (((index1Ptr == NULL) && (index2Ptr == NULL))
+	    || (tagPtr->justifyString != NULL)
+	    || (tagPtr->lMargin1String != NULL)
+	    || (tagPtr->lMargin2String != NULL)
+	    || (tagPtr->rMarginString != NULL)
+	    || (tagPtr->tabString != NULL)
+	    || (tagPtr->wrapMode != NULL)) {
+	InvalidateDLineCounts(textPtr, index1Ptr, index2Ptr);
+    }
+
     /*
      * Round up the starting position if it's before the first line
      * visible on the screen (we only care about what's on the screen).
@@ -1884,11 +3203,17 @@ TkTextRelayoutWindow(textPtr)
     dInfoPtr->flags |= REDRAW_PENDING|REDRAW_BORDERS|DINFO_OUT_OF_DATE;
 
     /*
-     * Throw away all the current layout information.
+     * Throw away all the current layout information, including the
+     * DLines kept for reuse, the styles remembered for sets of tags,
+     * and the counts of display lines.
      */
 
     FreeDLines(textPtr, dInfoPtr->dLinePtr, (DLine *) NULL, 1);
     dInfoPtr->dLinePtr = NULL;
+    FreeTagSetStyles(textPtr);
+    InvalidateLayouts(textPtr, (TkTextIndex *) NULL, (TkTextIndex *) NULL);
+    InvalidateDLineCounts(textPtr, (TkTextIndex *) NULL,
+	    (TkTextIndex *) NULL);
 
     /*
      * Recompute some overall things for the layout.  Even if the
@@ -2125,7 +3450,7 @@ MeasureUp(textPtr, srcPtr, distance, dstPtr)
 	index.charIndex = 0;
 	lowestPtr = NULL;
 	do {
-	    dlPtr = LayoutDLine(textPtr, &index);
+	    dlPtr = GetDLine(textPtr, &index);
 	    dlPtr->nextPtr = lowestPtr;
 	    lowestPtr = dlPtr;
 	    TkTextIndexForwChars(&index, dlPtr->count, &index);
@@ -2149,11 +3474,11 @@ MeasureUp(textPtr, srcPtr, distance, dstPtr)
 	}
 
 	/*
-	 * Discard the display lines, then either return or prepare
+	 * Set aside the display lines, then either return or prepare
 	 * for the next display line to lay out.
 	 */
 
-	FreeDLines(textPtr, lowestPtr, (DLine *) NULL, 0);
+	CacheDLines(textPtr, lowestPtr, (DLine *) NULL, 0);
 	if (distance < 0) {
 	    return;
 	}
@@ -2284,6 +3609,88 @@ TkTextSeeCmd(textPtr, interp, argc, argv)
     }
     return TCL_OK;
 }
+
+/*
+ *--------------------------------------------------------------
+ *
+ * TkTextEndVisible --
+ *
+ *	This procedure is called before text is appended to a text
+ *	widget, to find out whether the view should follow the end of
+ *	the text.
+ *
+ * Results:
+ *	The return value is 1 if the last line of the text is entirely
+ *	visible in the window (or will be once a pending TkTextSeeEnd
+ *	takes effect), 0 otherwise.
+ *
+ * Side effects:
+ *	The display information may be brought up to date.
+ *
+ *--------------------------------------------------------------
+ */
+
+int
+TkTextEndVisible(textPtr)
+    TkText *textPtr;		/* Information about text widget. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+    DLine *dlPtr;
+    TkTextIndex index;
+
+    if (dInfoPtr->flags & DINFO_SEE_END) {
+	return 1;
+    }
+    if (dInfoPtr->flags & DINFO_OUT_OF_DATE) {
+	UpdateDisplayInfo(textPtr);
+    }
+    dlPtr = dInfoPtr->dLinePtr;
+    if (dlPtr == NULL) {
+	return 1;
+    }
+    while (dlPtr->nextPtr != NULL) {
+	dlPtr = dlPtr->nextPtr;
+    }
+    if ((dlPtr->y + dlPtr->height) > dInfoPtr->maxY) {
+	return 0;
+    }
+    TkTextIndexForwChars(&dlPtr->index, dlPtr->count, &index);
+    return (TkBTreeLineIndex(index.linePtr)
+	    == TkBTreeNumLines(textPtr->tree));
+}
+
+
+/*
+ *--------------------------------------------------------------
+ *
+ * TkTextSeeEnd --
+ *
+ *	Arrange for the end of the text to be scrolled into view at
+ *	the bottom of the window, the next time the display information
+ *	is brought up to date.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The view will change when the widget is next redisplayed (or
+ *	sooner, if a widget command needs the display information).
+ *
+ *--------------------------------------------------------------
+ */
+
+void
+TkTextSeeEnd(textPtr)
+    TkText *textPtr;		/* Information about text widget. */
+{
+    DInfo *dInfoPtr = textPtr->dInfoPtr;
+
+    if (!(dInfoPtr->flags & REDRAW_PENDING)) {
+	Tcl_DoWhenIdle(DisplayText, (ClientData) textPtr);
+    }
+    dInfoPtr->flags |= REDRAW_PENDING|DINFO_OUT_OF_DATE|DINFO_SEE_END;
+}
+
 
 /*
  *--------------------------------------------------------------
@@ -2410,7 +3817,7 @@ ScrollByLines(textPtr, offset)
 	    index.charIndex = 0;
 	    lowestPtr = NULL;
 	    do {
-		dlPtr = LayoutDLine(textPtr, &index);
+		dlPtr = GetDLine(textPtr, &index);
 		dlPtr->nextPtr = lowestPtr;
 		lowestPtr = dlPtr;
 		TkTextIndexForwChars(&index, dlPtr->count, &index);
@@ -2427,11 +3834,11 @@ ScrollByLines(textPtr, offset)
 	    }
     
 	    /*
-	     * Discard the display lines, then either return or prepare
+	     * Set aside the display lines, then either return or prepare
 	     * for the next display line to lay out.
 	     */
     
-	    FreeDLines(textPtr, lowestPtr, (DLine *) NULL, 0);
+	    CacheDLines(textPtr, lowestPtr, (DLine *) NULL, 0);
 	    if (offset >= 0) {
 		goto scheduleUpdate;
 	    }
@@ -2453,10 +3860,10 @@ ScrollByLines(textPtr, offset)
 	lastLinePtr = TkBTreeFindLine(textPtr->tree,
 		TkBTreeNumLines(textPtr->tree));
 	for (i = 0; i < offset; i++) {
-	    dlPtr = LayoutDLine(textPtr, &textPtr->topIndex);
+	    dlPtr = GetDLine(textPtr, &textPtr->topIndex);
 	    dlPtr->nextPtr = NULL;
 	    TkTextIndexForwChars(&textPtr->topIndex, dlPtr->count, &new);
-	    FreeDLines(textPtr, dlPtr, (DLine *) NULL, 0);
+	    CacheDLines(textPtr, dlPtr, (DLine *) NULL, 0);
 	    if (new.linePtr == lastLinePtr) {
 		break;
 	    }
@@ -2569,11 +3976,38 @@ TkTextYviewCmd(textPtr, interp, argc, argv)
 	    if (fraction < 0) {
 		fraction = 0;
 	    }
-	    fraction *= TkBTreeNumLines(textPtr->tree);
-	    lineNum = fraction;
-	    TkTextMakeIndex(textPtr->tree, lineNum, 0, &index);
-	    index.charIndex = TkBTreeCharsInLine(index.linePtr)
-		    * (fraction-lineNum) + 0.5;
+	    if (textPtr->yScrollCmd == NULL) {
+		fraction *= TkBTreeNumLines(textPtr->tree);
+		lineNum = fraction;
+		TkTextMakeIndex(textPtr->tree, lineNum, 0, &index);
+		index.charIndex = TkBTreeCharsInLine(index.linePtr)
+			* (fraction-lineNum) + 0.5;
+		TkTextSetYView(textPtr, &index, 0);
+		break;
+	    }
+
+	    /*
+	     * Fractions are in display lines when there's a scrollbar (see
+	     * GetYView).  Find the text line with the display line at the
+	     * fraction, then lay the line out to find where that display
+	     * line starts.
+	     */
+
+	    fraction *= TkBTreeNumDLines(textPtr->tree);
+	    index.tree = textPtr->tree;
+	    index.linePtr = TkBTreeFindDLine(textPtr->tree, (int) fraction,
+		    &count);
+	    index.charIndex = 0;
+	    for ( ; count > 0; count--) {
+		dlPtr = GetDLine(textPtr, &index);
+		dlPtr->nextPtr = NULL;
+		TkTextIndexForwChars(&index, dlPtr->count, &new);
+		CacheDLines(textPtr, dlPtr, (DLine *) NULL, 0);
+		if (new.linePtr != index.linePtr) {
+		    break;
+		}
+		index = new;
+	    }
 	    TkTextSetYView(textPtr, &index, 0);
 	    break;
 	case TK_SCROLL_PAGES:
@@ -2608,12 +4042,12 @@ TkTextYviewCmd(textPtr, interp, argc, argv)
 		lastLinePtr = TkBTreeFindLine(textPtr->tree,
 			TkBTreeNumLines(textPtr->tree));
 		do {
-		    dlPtr = LayoutDLine(textPtr, &textPtr->topIndex);
+		    dlPtr = GetDLine(textPtr, &textPtr->topIndex);
 		    dlPtr->nextPtr = NULL;
 		    TkTextIndexForwChars(&textPtr->topIndex, dlPtr->count,
 			    &new);
 		    pixels -= dlPtr->height;
-		    FreeDLines(textPtr, dlPtr, (DLine *) NULL, 0);
+		    CacheDLines(textPtr, dlPtr, (DLine *) NULL, 0);
 		    if (new.linePtr == lastLinePtr) {
 			break;
 		    }
@@ -2722,10 +4156,13 @@ GetXView(interp, textPtr, report)
  *	report is non-zero, then interp->result isn't modified directly,
  *	but a script is evaluated in interp to report the new scroll
  *	position to the scrollbar (if the scroll position hasn't changed
- *	then no script is invoked).
+ *	then no script is invoked).  If the text has a -yscrollcommand,
+ *	the fractions are in display lines;  otherwise they're in text
+ *	lines.
  *
  * Side effects:
- *	None.
+ *	If the text has a -yscrollcommand, the display lines of text
+ *	lines in the window are counted, if they're out of date.
  *
  *----------------------------------------------------------------------
  */
@@ -2742,34 +4179,112 @@ GetYView(interp, textPtr, report)
     DInfo *dInfoPtr = textPtr->dInfoPtr;
     char buffer[200];
     double first, last;
-    DLine *dlPtr;
-    int totalLines, code, count;
+    DLine *dlPtr, *nextPtr, *otherPtr;
+    TkTextLine *linePtr;
+    TkTextIndex index;
+    int totalLines, code, count, lineNum, before;
 
     dlPtr = dInfoPtr->dLinePtr;
-    totalLines = TkBTreeNumLines(textPtr->tree);
-    first = ((double) TkBTreeLineIndex(dlPtr->index.linePtr))
-	    + ((double) dlPtr->index.charIndex)
-	    / (TkBTreeCharsInLine(dlPtr->index.linePtr));
-    first /= totalLines;
-    while (1) {
-	if ((dlPtr->y + dlPtr->height) > dInfoPtr->maxY) {
-	    /*
-	     * The last line is only partially visible, so don't
-	     * count its characters in what's visible.
-	     */
-	    count = 0;
-	    break;
+    if (textPtr->yScrollCmd != NULL) {
+	/*
+	 * There's a scrollbar, so measure in display lines, using the
+	 * counts kept in the B-tree.  If the top line of the window isn't
+	 * the first display line of its text line, lay out the ones above
+	 * it to see how many there are.
+	 */
+
+	before = 0;
+	if (dlPtr->index.charIndex > 0) {
+	    index = dlPtr->index;
+	    index.charIndex = 0;
+	    while (index.charIndex < dlPtr->index.charIndex) {
+		otherPtr = GetDLine(textPtr, &index);
+		otherPtr->nextPtr = NULL;
+		index.charIndex += otherPtr->count;
+		CacheDLines(textPtr, otherPtr, (DLine *) NULL, 0);
+		before++;
+	    }
 	}
-	if (dlPtr->nextPtr == NULL) {
-	    count = dlPtr->count;
-	    break;
+
+	/*
+	 * Count the lines in the window, so that the fractions agree
+	 * with what's on the screen even if the rest of the text hasn't
+	 * been counted yet.  A text line that's entirely in the window
+	 * can be counted from its DLines.  For one that's cut off at the
+	 * top or bottom, just make sure the count is at least what's
+	 * known to be there, and leave the rest to CountDLinesProc:
+	 * laying out the whole of a very long line every time the
+	 * window is redisplayed would be too slow.
+	 */
+
+	for ( ; dlPtr != NULL; dlPtr = nextPtr) {
+	    count = 1;
+	    for (nextPtr = dlPtr->nextPtr; (nextPtr != NULL)
+		    && (nextPtr->index.linePtr == dlPtr->index.linePtr);
+		    nextPtr = nextPtr->nextPtr) {
+		count++;
+	    }
+	    linePtr = dlPtr->index.linePtr;
+	    if (linePtr->dLinesEpoch == dInfoPtr->dLinesEpoch) {
+		continue;
+	    }
+	    if ((dlPtr->index.charIndex == 0) && (nextPtr != NULL)) {
+		TkBTreeSetDLines(linePtr, count);
+		linePtr->dLinesEpoch = dInfoPtr->dLinesEpoch;
+	    } else {
+		if (dlPtr == dInfoPtr->dLinePtr) {
+		    count += before;
+		}
+		if (count > linePtr->numDLines) {
+		    TkBTreeSetDLines(linePtr, count);
+		}
+	    }
 	}
-	dlPtr = dlPtr->nextPtr;
+	dlPtr = dInfoPtr->dLinePtr;
+	totalLines = TkBTreeNumDLines(textPtr->tree);
+	lineNum = TkBTreeDLineIndex(dlPtr->index.linePtr) + before;
+	first = ((double) lineNum) / totalLines;
+
+	/*
+	 * If the last line is only partially visible, don't count it
+	 * in what's visible.
+	 */
+
+	for ( ; (dlPtr != NULL)
+		&& ((dlPtr->y + dlPtr->height) <= dInfoPtr->maxY);
+		dlPtr = dlPtr->nextPtr) {
+	    lineNum++;
+	}
+	last = ((double) lineNum) / totalLines;
+	if (last > 1.0) {
+	    last = 1.0;
+	}
+    } else {
+	totalLines = TkBTreeNumLines(textPtr->tree);
+	first = ((double) TkBTreeLineIndex(dlPtr->index.linePtr))
+		+ ((double) dlPtr->index.charIndex)
+		/ (TkBTreeCharsInLine(dlPtr->index.linePtr));
+	first /= totalLines;
+	while (1) {
+	    if ((dlPtr->y + dlPtr->height) > dInfoPtr->maxY) {
+		/*
+		 * The last line is only partially visible, so don't
+		 * count its characters in what's visible.
+		 */
+		count = 0;
+		break;
+	    }
+	    if (dlPtr->nextPtr == NULL) {
+		count = dlPtr->count;
+		break;
+	    }
+	    dlPtr = dlPtr->nextPtr;
+	}
+	last = ((double) TkBTreeLineIndex(dlPtr->index.linePtr))
+		+ ((double) (dlPtr->index.charIndex + count))
+		/ (TkBTreeCharsInLine(dlPtr->index.linePtr));
+	last /= totalLines;
     }
-    last = ((double) TkBTreeLineIndex(dlPtr->index.linePtr))
-	    + ((double) (dlPtr->index.charIndex + count))
-	    / (TkBTreeCharsInLine(dlPtr->index.linePtr));
-    last /= totalLines;
     if (!report) {
 	char buffer[60];
 	sprintf(buffer, "%g %g", first, last);
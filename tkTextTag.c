@@ -53,14 +53,39 @@ static Tk_ConfigSpec tagConfigSpecs[] = {
 	(char *) NULL, 0, 0}
 };
 
+/*
+ * The structure below holds one range of characters for "tag add",
+ * "tag remove", and "tag apply".  All of a command's ranges are
+ * parsed before any of them is applied, then sorted by tag and
+ * position so that each tag's ranges can be merged and handed to
+ * the B-tree in one call.  Up to STATIC_RANGES ranges are held
+ * without allocating.
+ */
+
+typedef struct RangeInfo {
+    TkTextTag *tagPtr;		/* Tag to add to or remove from range. */
+    int line1, line2;		/* Line numbers of index1 and index2. */
+    TkTextIndex index1;		/* First character in range. */
+    TkTextIndex index2;		/* Character just after range. */
+} RangeInfo;
+
+#define STATIC_RANGES 16
+
 /*
  * Forward declarations for procedures defined later in this file:
  */
 
+static void		ApplyRanges _ANSI_ARGS_((TkText *textPtr,
+			    int numRanges, RangeInfo *rangeArray, int add));
 static void		ChangeTagPriority _ANSI_ARGS_((TkText *textPtr,
 			    TkTextTag *tagPtr, int prio));
 static TkTextTag *	FindTag _ANSI_ARGS_((Tcl_Interp *interp,
 			    TkText *textPtr, char *tagName));
+static int		GetRange _ANSI_ARGS_((Tcl_Interp *interp,
+			    TkText *textPtr, char *string1, char *string2,
+			    RangeInfo *rangePtr));
+static int		RangeSortProc _ANSI_ARGS_((CONST VOID *first,
+			    CONST VOID *second));
 static void		SortTags _ANSI_ARGS_((int numTags,
 			    TkTextTag **tagArrayPtr));
 static int		TagSortProc _ANSI_ARGS_((CONST VOID *first,
@@ -93,11 +118,13 @@ TkTextTagCmd(textPtr, interp, argc, argv)
 				 * parsed this command enough to know that
 				 * argv[1] is "tag". */
 {
-    int c, i, addTag;
+    int c, i, addTag, numRanges;
     size_t length;
     char *fullOption;
     register TkTextTag *tagPtr;
     TkTextIndex first, last, index1, index2;
+    RangeInfo staticRanges[STATIC_RANGES];
+    RangeInfo *rangeArray;
 
     if (argc < 3) {
 	Tcl_AppendResult(interp, "wrong # args: should be \"",
@@ -119,28 +146,109 @@ TkTextTagCmd(textPtr, interp, argc, argv)
 	    return TCL_ERROR;
 	}
 	tagPtr = TkTextCreateTag(textPtr, argv[3]);
+
+	/*
+	 * Parse all of the ranges before changing anything, stopping
+	 * at the first one that's empty (as "tag add" always has).
+	 */
+
+	rangeArray = staticRanges;
+	if ((argc - 3)/2 > STATIC_RANGES) {
+	    rangeArray = (RangeInfo *) ckalloc((unsigned)
+		    (((argc - 3)/2) * sizeof(RangeInfo)));
+	}
+	numRanges = 0;
 	for (i = 4; i < argc; i += 2) {
-	    if (TkTextGetIndex(interp, textPtr, argv[i], &index1) != TCL_OK) {
+	    if (GetRange(interp, textPtr, argv[i],
+		    (argc > (i+1)) ? argv[i+1] : (char *) NULL,
+		    &rangeArray[numRanges]) != TCL_OK) {
+		if (rangeArray != staticRanges) {
+		    ckfree((char *) rangeArray);
+		}
 		return TCL_ERROR;
 	    }
-	    if (argc > (i+1)) {
-		if (TkTextGetIndex(interp, textPtr, argv[i+1], &index2)
-			!= TCL_OK) {
-		    return TCL_ERROR;
-		}
-		if (TkTextIndexCmp(&index1, &index2) >= 0) {
-		    return TCL_OK;
-		}
-	    } else {
-		index2 = index1;
-		TkTextIndexForwChars(&index2, 1, &index2);
+	    if (TkTextIndexCmp(&rangeArray[numRanges].index1,
+		    &rangeArray[numRanges].index2) >= 0) {
+		break;
 	    }
-    
-	    if (tagPtr->affectsDisplay) {
-		TkTextRedrawTag(textPtr, &index1, &index2, tagPtr, !addTag);
+	    rangeArray[numRanges].tagPtr = tagPtr;
+	    numRanges++;
+	}
+	ApplyRanges(textPtr, numRanges, rangeArray, addTag);
+	if (rangeArray != staticRanges) {
+	    ckfree((char *) rangeArray);
+	}
+    } else if ((c == 'a') && (strncmp(argv[2], "apply", length) == 0)
+	    && (length >= 2)) {
+	int numElems, numFields;
+	char **elemArgv, **fieldArgv;
+
+	addTag = 1;
+	if ((argc == 5) && (strcmp(argv[3], "-remove") == 0)) {
+	    addTag = 0;
+	} else if (argc != 4) {
+	    Tcl_AppendResult(interp, "wrong # args: should be \"",
+		    argv[0], " tag apply ?-remove? rangeList\"",
+		    (char *) NULL);
+	    return TCL_ERROR;
+	}
+	if (Tcl_SplitList(interp, argv[argc-1], &numElems, &elemArgv)
+		!= TCL_OK) {
+	    return TCL_ERROR;
+	}
+	rangeArray = staticRanges;
+	if (numElems > STATIC_RANGES) {
+	    rangeArray = (RangeInfo *) ckalloc((unsigned)
+		    (numElems * sizeof(RangeInfo)));
+	}
+
+	/*
+	 * Each element of the list is "start end tagName".  Empty
+	 * ranges are skipped.
+	 */
+
+	numRanges = 0;
+	for (i = 0; i < numElems; i++) {
+	    if (Tcl_SplitList(interp, elemArgv[i], &numFields, &fieldArgv)
+		    != TCL_OK) {
+		goto applyError;
+	    }
+	    if (numFields != 3) {
+		ckfree((char *) fieldArgv);
+		Tcl_AppendResult(interp, "bad range \"", elemArgv[i],
+			"\":  must be \"index1 index2 tagName\"",
+			(char *) NULL);
+		goto applyError;
+	    }
+	    if (GetRange(interp, textPtr, fieldArgv[0], fieldArgv[1],
+		    &rangeArray[numRanges]) != TCL_OK) {
+		ckfree((char *) fieldArgv);
+		goto applyError;
 	    }
-	    TkBTreeTag(&index1, &index2, tagPtr, addTag);
+	    if (TkTextIndexCmp(&rangeArray[numRanges].index1,
+		    &rangeArray[numRanges].index2) < 0) {
+		rangeArray[numRanges].tagPtr = (addTag)
+			? TkTextCreateTag(textPtr, fieldArgv[2])
+			: FindTag((Tcl_Interp *) NULL, textPtr, fieldArgv[2]);
+		if (rangeArray[numRanges].tagPtr != NULL) {
+		    numRanges++;
+		}
+	    }
+	    ckfree((char *) fieldArgv);
+	}
+	ApplyRanges(textPtr, numRanges, rangeArray, addTag);
+	ckfree((char *) elemArgv);
+	if (rangeArray != staticRanges) {
+	    ckfree((char *) rangeArray);
+	}
+	return TCL_OK;
+
+	applyError:
+	ckfree((char *) elemArgv);
+	if (rangeArray != staticRanges) {
+	    ckfree((char *) rangeArray);
 	}
+	return TCL_ERROR;
     } else if ((c == 'b') && (strncmp(argv[2], "bind", length) == 0)) {
         return Ctk_Unsupported(interp, "textWidget bind");
     } else if ((c == 'c') && (strncmp(argv[2], "cget", length) == 0)
@@ -531,14 +639,167 @@ TkTextTagCmd(textPtr, interp, argc, argv)
 	goto addAndRemove;
     } else {
 	Tcl_AppendResult(interp, "bad tag option \"", argv[2],
-		"\":  must be add, bind, cget, configure, delete, lower, ",
-		"names, nextrange, raise, ranges, or remove",
+		"\":  must be add, apply, bind, cget, configure, delete, ",
+		"lower, names, nextrange, raise, ranges, or remove",
 		(char *) NULL);
 	return TCL_ERROR;
     }
     return TCL_OK;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * GetRange --
+ *
+ *	Parse the two indexes of a range of characters for "tag add",
+ *	"tag remove", or "tag apply".
+ *
+ * Results:
+ *	A standard Tcl result.  If TCL_OK is returned, the indexes of
+ *	the range and their line numbers are stored at *rangePtr;  the
+ *	range may be empty.  Otherwise an error message is left in
+ *	interp->result.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+GetRange(interp, textPtr, string1, string2, rangePtr)
+    Tcl_Interp *interp;		/* Interpreter to use for error reporting. */
+    TkText *textPtr;		/* Information about text widget. */
+    char *string1;		/* Index of first character in range. */
+    char *string2;		/* Index of character just after range, or
+				 * NULL to mean the range is just the
+				 * character at string1. */
+    RangeInfo *rangePtr;	/* Where to store the range. */
+{
+    if (TkTextGetIndex(interp, textPtr, string1, &rangePtr->index1)
+	    != TCL_OK) {
+	return TCL_ERROR;
+    }
+    if (string2 != NULL) {
+	if (TkTextGetIndex(interp, textPtr, string2, &rangePtr->index2)
+		!= TCL_OK) {
+	    return TCL_ERROR;
+	}
+    } else {
+	TkTextIndexForwChars(&rangePtr->index1, 1, &rangePtr->index2);
+    }
+    rangePtr->line1 = TkBTreeLineIndex(rangePtr->index1.linePtr);
+    rangePtr->line2 = TkBTreeLineIndex(rangePtr->index2.linePtr);
+    return TCL_OK;
+}
+
+
+/*
+ *----------------------------------------------------------------------
+ *
+ * ApplyRanges --
+ *
+ *	Add tags to, or remove them from, a number of ranges of
+ *	characters at once.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	The ranges are sorted by tag and position, and the ranges for
+ *	each tag that overlap or touch are merged.  Then each tag's
+ *	ranges are redrawn and passed to TkBTreeTagRanges, which works
+ *	through them in a single pass.  The indexes at *rangeArray are
+ *	no longer valid when this procedure returns.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static void
+ApplyRanges(textPtr, numRanges, rangeArray, add)
+    TkText *textPtr;		/* Information about text widget. */
+    int numRanges;		/* Number of ranges at *rangeArray;  none
+				 * of them is empty. */
+    RangeInfo *rangeArray;	/* Ranges to change;  they're rearranged
+				 * by this procedure. */
+    int add;			/* 1 means add each range's tag, 0 means
+				 * remove it. */
+{
+    TkTextIndex staticIndexes[2*STATIC_RANGES];
+    TkTextIndex *indexArray;
+    TkTextTag *tagPtr;
+    RangeInfo *rangePtr, *lastPtr;
+    int i, j, k, count;
+
+    if (numRanges == 0) {
+	return;
+    }
+    /*
+     * Ranges usually come in order already;  only sort if they don't.
+     */
+
+    for (i = 1; i < numRanges; i++) {
+	if (RangeSortProc((VOID *) &rangeArray[i-1],
+		(VOID *) &rangeArray[i]) > 0) {
+	    qsort((VOID *) rangeArray, (unsigned) numRanges,
+		    sizeof(RangeInfo), RangeSortProc);
+	    break;
+	}
+    }
+    indexArray = staticIndexes;
+    if (numRanges > STATIC_RANGES) {
+	indexArray = (TkTextIndex *) ckalloc((unsigned)
+		(2 * numRanges * sizeof(TkTextIndex)));
+    }
+    for (i = 0; i < numRanges; i = j) {
+	/*
+	 * Merge this tag's ranges into lastPtr as long as they overlap
+	 * or touch, copying the indexes of each merged range into
+	 * indexArray.
+	 */
+
+	tagPtr = rangeArray[i].tagPtr;
+	lastPtr = &rangeArray[i];
+	count = 0;
+	for (j = i+1; ; j++) {
+	    rangePtr = &rangeArray[j];
+	    if ((j < numRanges) && (rangePtr->tagPtr == tagPtr)
+		    && ((rangePtr->line1 < lastPtr->line2)
+		    || ((rangePtr->line1 == lastPtr->line2)
+		    && (rangePtr->index1.charIndex
+			    <= lastPtr->index2.charIndex)))) {
+		if ((rangePtr->line2 > lastPtr->line2)
+			|| ((rangePtr->line2 == lastPtr->line2)
+			&& (rangePtr->index2.charIndex
+				> lastPtr->index2.charIndex))) {
+		    lastPtr->line2 = rangePtr->line2;
+		    lastPtr->index2 = rangePtr->index2;
+		}
+		continue;
+	    }
+	    indexArray[2*count] = lastPtr->index1;
+	    indexArray[2*count + 1] = lastPtr->index2;
+	    count++;
+	    if ((j >= numRanges) || (rangePtr->tagPtr != tagPtr)) {
+		break;
+	    }
+	    lastPtr = rangePtr;
+	}
+
+	if (tagPtr->affectsDisplay) {
+	    for (k = 0; k < count; k++) {
+		TkTextRedrawTag(textPtr, &indexArray[2*k], &indexArray[2*k + 1],
+			tagPtr, !add);
+	    }
+	}
+	TkBTreeTagRanges(count, indexArray, tagPtr, add);
+    }
+    if (indexArray != staticIndexes) {
+	ckfree((char *) indexArray);
+    }
+}
+
 /*
  *----------------------------------------------------------------------
  *
@@ -601,6 +862,7 @@ TkTextCreateTag(textPtr, tagName)
     tagPtr->underline = 0;
     tagPtr->wrapMode = NULL;
     tagPtr->affectsDisplay = 0;
+    tagPtr->tagInfoIndex = 0;
     textPtr->numTags++;
     Tcl_SetHashValue(hPtr, tagPtr);
     return tagPtr;
@@ -785,6 +1047,42 @@ TagSortProc(first, second)
     return tagPtr1->priority - tagPtr2->priority;
 }
 
+/*
+ *----------------------------------------------------------------------
+ *
+ * RangeSortProc --
+ *
+ *	This procedure is called by qsort when sorting the ranges for
+ *	ApplyRanges:  by tag priority, then by starting position.
+ *
+ * Results:
+ *	The return value is negative if the first range should be
+ *	before the second, 0 if they start at the same place with the
+ *	same tag, and positive otherwise.
+ *
+ * Side effects:
+ *	None.
+ *
+ *----------------------------------------------------------------------
+ */
+
+static int
+RangeSortProc(first, second)
+    CONST VOID *first, *second;		/* Elements to be compared. */
+{
+    RangeInfo *rangePtr1, *rangePtr2;
+
+    rangePtr1 = (RangeInfo *) first;
+    rangePtr2 = (RangeInfo *) second;
+    if (rangePtr1->tagPtr != rangePtr2->tagPtr) {
+	return rangePtr1->tagPtr->priority - rangePtr2->tagPtr->priority;
+    }
+    if (rangePtr1->line1 != rangePtr2->line1) {
+	return rangePtr1->line1 - rangePtr2->line1;
+    }
+    return rangePtr1->index1.charIndex - rangePtr2->index1.charIndex;
+}
+
 /*
  *----------------------------------------------------------------------
  *
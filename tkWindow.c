@@ -168,9 +168,7 @@ int
 Tk_Init(interp)
     Tcl_Interp *interp;		/* Interpreter to initialize. */
 {
-#ifdef USE_TCL_STUBS
     Tk_Window winPtr;
-#endif
     static char initCmd[] =
 	"if [file exists $tk_library/ctk.tcl] {\n\
 	    source $tk_library/ctk.tcl\n\
@@ -186,12 +184,19 @@ Tk_Init(interp)
     Tcl_InitStubs(interp, "8", 0);
 #endif
 
-#ifdef USE_TCL_STUBS
-    winPtr = Tk_CreateMainWindow(interp, NULL, "ctk", "ctk");
-    if (winPtr == NULL) {
-        return(TCL_ERROR);
+    /*
+     * Cwish creates its main window before calling Tk_Init, but an
+     * interpreter that loads Tk as a package (such as one created
+     * for each terminal by ctk_serve) needs one made here.
+     */
+
+    if (Tk_MainWindow(interp) == NULL) {
+	Tcl_ResetResult(interp);
+	winPtr = Tk_CreateMainWindow(interp, NULL, "ctk", "ctk");
+	if (winPtr == NULL) {
+	    return(TCL_ERROR);
+	}
     }
-#endif
 
     retval = Tcl_Eval(interp, initCmd);
     if (retval != TCL_OK) {
@@ -233,14 +238,14 @@ GetScreen(interp, screenName)
 				 * use CTK_DISPLAY environment variable. */
 {
     register TkDisplay *dispPtr;
-    char *p;
+    char *device, *p;
     size_t length;
 
     /*
-     * Separate the terminal type from the rest of the display
-     * name.  ScreenName is assumed to have the syntax
-     * <device>:<type> with the colon and the type being
-     * optional.
+     * Separate the driver and the terminal type from the rest of
+     * the display name.  ScreenName is assumed to have the syntax
+     * <driver>@<device>:<type> with the driver and the type (and
+     * their separators) being optional.
      */
 
     if (screenName == NULL || screenName[0] == '\0') {
@@ -257,11 +262,13 @@ GetScreen(interp, screenName)
 	    screenName = "tty";
 	}
     }
-    p = strchr(screenName, ':');
+    device = strchr(screenName, '@');
+    device = (device == NULL) ? screenName : device + 1;
+    p = strchr(device, ':');
     if (p == NULL) {
-	length = strlen(screenName);
+	length = strlen(device);
     } else {
-	length = p - screenName;
+	length = p - device;
     }
 
     /*
@@ -269,7 +276,7 @@ GetScreen(interp, screenName)
      */
 
     for (dispPtr = tkDisplayList; dispPtr != NULL; dispPtr = dispPtr->nextPtr) {
-	if ((strncmp(dispPtr->name, screenName, length) == 0)
+	if ((strncmp(dispPtr->name, device, length) == 0)
 		&& (dispPtr->name[length] == '\0')) {
 	    return dispPtr;
 	}
@@ -281,6 +288,7 @@ GetScreen(interp, screenName)
 
     dispPtr = (TkDisplay *) ckalloc(sizeof(TkDisplay));
     if (CtkDisplayInit(interp, dispPtr, screenName) != TCL_OK) {
+	ckfree((char *) dispPtr);
 	return (TkDisplay *) NULL;
     }
     dispPtr->numWindows = 0;
@@ -535,6 +543,9 @@ Tk_CreateWindowFromPath(interp, winPtr, pathName, screenName)
     	dispPtr = parentPtr->dispPtr;
     } else {
 	dispPtr = GetScreen(interp, screenName);
+	if (dispPtr == NULL) {
+	    return (TkWindow *) NULL;
+	}
     }
 
     /*
@@ -75,6 +75,30 @@ static GenericHandler *lastGenericPtr = NULL;
 
 static int genericHandlersActive = 0;
 
+/*
+ * Forward declarations for procedures defined later in this file:
+ */
+
+static void		RefreshDisplays _ANSI_ARGS_((int busy));
+static void		RefreshTimerProc _ANSI_ARGS_((ClientData clientData));
+
+/*
+ * Refresh scheduling.  The displays are brought up to date when the
+ * event queue has been drained (or, with the CTK_REFRESH_EVENT policy,
+ * around every event).  If ctkRefreshInterval is non-zero, refreshes
+ * are at least that many milliseconds apart;  a refresh that comes too
+ * soon is deferred to a timer handler, and the timer also keeps the
+ * displays refreshed while a burst of events keeps the queue busy.
+ * These are set by the "ctk refresh" command.
+ */
+
+int ctkRefreshPolicy = CTK_REFRESH_DRAINED;
+int ctkRefreshInterval = 0;
+static Tcl_Time lastRefresh = {0, 0};
+				/* When displays were last refreshed. */
+static Tcl_TimerToken refreshTimer = NULL;
+				/* Token for deferred refresh, or NULL. */
+
 /*
  * Array of event masks corresponding to each X event:
  */
@@ -87,6 +111,7 @@ static unsigned long eventMasks[] = {
     CTK_FOCUS_EVENT_MASK,		/* CTK_UNFOCUS_EVENT */
     CTK_KEY_EVENT_MASK,			/* CTK_KEY_EVENT */
     CTK_DESTROY_EVENT_MASK,		/* CTK_DESTROY_EVENT */
+    CTK_PASTE_EVENT_MASK,		/* CTK_PASTE_EVENT */
     0					/* CTK_UNSUPPORTED_EVENT */
 };
 
@@ -437,7 +462,9 @@ Tk_HandleEvent(eventPtr)
   *
   * Tk_DoOneEvent --
   *
-  *     Flushes displays and the calls Tcl_DoOneEvent.
+  *     Calls Tcl_DoOneEvent, flushing the displays whenever
+  *     there are no more events ready to be handled (so a burst
+  *     of events results in a single terminal update).
   *
   * Results:
   *     See Tcl_DoOneEvent().
@@ -451,11 +478,135 @@ Tk_HandleEvent(eventPtr)
 int Tk_DoOneEvent(int flags)
 {
        int retval;
-       Ctk_DisplayFlush(NULL);
-       retval = Tcl_DoOneEvent(flags);
-       Ctk_DisplayFlush(NULL);
 
-       return(retval);
+       if (ctkRefreshPolicy == CTK_REFRESH_EVENT) {
+	   Ctk_DisplayFlush(NULL);
+	   retval = Tcl_DoOneEvent(flags);
+	   Ctk_DisplayFlush(NULL);
+	   return(retval);
+       }
+
+       if (Tcl_DoOneEvent(flags | TCL_DONT_WAIT)) {
+	   RefreshDisplays(1);
+	   return(1);
+       }
+
+       /*
+	* Nothing is ready:  bring the displays up to date before
+	* waiting for something to happen.
+	*/
+
+       RefreshDisplays(0);
+       if (flags & TCL_DONT_WAIT) {
+	   return(0);
+       }
+       return(Tcl_DoOneEvent(flags));
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * RefreshDisplays --
+ *
+ *	Flushes all displays, unless the last refresh was less
+ *	than ctkRefreshInterval ago, in which case the refresh is
+ *	deferred to a timer handler.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Displays get flushed, or a timer handler is created.
+ *
+ *--------------------------------------------------------------
+ */
+
+static void
+RefreshDisplays(busy)
+    int busy;			/* Non-zero means more events may be
+				 * ready:  only make sure that a refresh
+				 * will happen within ctkRefreshInterval. */
+{
+    TkDisplay *dispPtr;
+    Tcl_Time now;
+    long elapsed;
+
+    if (ctkRefreshInterval <= 0) {
+	if (!busy) {
+	    Ctk_DisplayFlush(NULL);
+	}
+	return;
+    }
+    for (dispPtr = tkDisplayList; dispPtr != NULL;
+	    dispPtr = dispPtr->nextPtr) {
+	if (CtkDisplayIsDamaged(dispPtr)) {
+	    break;
+	}
+    }
+    if (dispPtr == NULL) {
+	/*
+	 * Nothing has been drawn;  at most the cursor has moved,
+	 * which is cheap enough to do right away.
+	 */
+
+	if (!busy) {
+	    Ctk_DisplayFlush(NULL);
+	}
+	return;
+    }
+    Tcl_GetTime(&now);
+    elapsed = (now.sec - lastRefresh.sec) * 1000
+	    + (now.usec - lastRefresh.usec) / 1000;
+    if (elapsed >= 0 && elapsed < ctkRefreshInterval) {
+	if (refreshTimer == NULL) {
+	    refreshTimer = Tcl_CreateTimerHandler(
+		    (int) (ctkRefreshInterval - elapsed),
+		    RefreshTimerProc, (ClientData) NULL);
+	}
+    } else if (busy) {
+	/*
+	 * The interval is already up:  refresh as soon as the events
+	 * that are ready have been handled.
+	 */
+
+	if (refreshTimer == NULL) {
+	    refreshTimer = Tcl_CreateTimerHandler(0, RefreshTimerProc,
+		    (ClientData) NULL);
+	}
+    } else {
+	if (refreshTimer != NULL) {
+	    Tcl_DeleteTimerHandler(refreshTimer);
+	    refreshTimer = NULL;
+	}
+	lastRefresh = now;
+	Ctk_DisplayFlush(NULL);
+    }
+}
+
+/*
+ *--------------------------------------------------------------
+ *
+ * RefreshTimerProc --
+ *
+ *	Timer handler for a deferred refresh.
+ *
+ * Results:
+ *	None.
+ *
+ * Side effects:
+ *	Displays get flushed.
+ *
+ *--------------------------------------------------------------
+ */
+
+	/* ARGSUSED */
+static void
+RefreshTimerProc(clientData)
+    ClientData clientData;	/* Not used. */
+{
+    refreshTimer = NULL;
+    Tcl_GetTime(&lastRefresh);
+    Ctk_DisplayFlush(NULL);
 }
 
 